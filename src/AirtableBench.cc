@@ -0,0 +1,1963 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <format>
+#include <functional>
+#include <future>
+#include <new>
+#include <phosg/JSON.hh>
+#include <phosg/Strings.hh>
+#include <ranges>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AirtableClient.hh"
+#include "AirtableTime.hh"
+#include "AsyncHTTPClient.hh"
+#include "AsyncUtils.hh"
+#include "CPUThreadPool.hh"
+#include "CompactRecord.hh"
+#include "FieldTypes.hh"
+#include "IOThreadPool.hh"
+#include "JSONScan.hh"
+#include "JSONWriter.hh"
+#include "LazyRecord.hh"
+#include "Metrics.hh"
+#include "MockAirtableServer.hh"
+#include "PageArena.hh"
+#include "RecordBatch.hh"
+#include "RecordStreamParser.hh"
+#include "StringInterner.hh"
+#include "TableDecoder.hh"
+#include "Tracing.hh"
+#include "TypedRecords.hh"
+
+using namespace std;
+
+// airtable-bench runs offline benchmarks against synthetic data that resembles
+// real API responses, and prints a JSON object mapping each benchmark's name
+// to its results, so results can be tracked across changes.
+
+// Global operator new and delete are replaced so benchmarks can measure how
+// much memory their workloads use. Each allocation is prefixed with a header
+// that records its size. Some benchmarks allocate on thread pool threads, so
+// the counters are atomic; relaxed ordering is enough because they're only
+// read after the measured work has been joined.
+struct AllocationStats {
+  atomic<size_t> current_bytes = 0;
+  atomic<size_t> peak_bytes = 0;
+  atomic<size_t> num_allocations = 0;
+};
+static AllocationStats allocation_stats;
+static constexpr size_t ALLOCATION_HEADER_SIZE = alignof(max_align_t);
+
+void* operator new(size_t size) {
+  void* block = malloc(size + ALLOCATION_HEADER_SIZE);
+  if (!block) {
+    throw bad_alloc();
+  }
+  *reinterpret_cast<size_t*>(block) = size;
+  size_t current_bytes = allocation_stats.current_bytes.fetch_add(size, memory_order_relaxed) + size;
+  size_t peak_bytes = allocation_stats.peak_bytes.load(memory_order_relaxed);
+  while ((peak_bytes < current_bytes) &&
+      !allocation_stats.peak_bytes.compare_exchange_weak(peak_bytes, current_bytes, memory_order_relaxed)) {
+  }
+  allocation_stats.num_allocations.fetch_add(1, memory_order_relaxed);
+  return reinterpret_cast<uint8_t*>(block) + ALLOCATION_HEADER_SIZE;
+}
+
+void operator delete(void* ptr) noexcept {
+  if (ptr) {
+    void* block = reinterpret_cast<uint8_t*>(ptr) - ALLOCATION_HEADER_SIZE;
+    allocation_stats.current_bytes.fetch_sub(*reinterpret_cast<size_t*>(block), memory_order_relaxed);
+    free(block);
+  }
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+  operator delete(ptr);
+}
+
+// Runs fn once and returns the peak number of bytes allocated (above what was
+// already allocated when fn was called) and the number of allocations made.
+template <typename FnT>
+static pair<size_t, size_t> measure_allocations(FnT&& fn) {
+  size_t start_bytes = allocation_stats.current_bytes.load(memory_order_relaxed);
+  size_t start_allocations = allocation_stats.num_allocations.load(memory_order_relaxed);
+  allocation_stats.peak_bytes.store(start_bytes, memory_order_relaxed);
+  fn();
+  return make_pair(
+      allocation_stats.peak_bytes.load(memory_order_relaxed) - start_bytes,
+      allocation_stats.num_allocations.load(memory_order_relaxed) - start_allocations);
+}
+
+struct SyntheticTableSpec {
+  size_t num_fields = 30;
+  size_t long_text_length = 200;
+  bool key_by_field_id = false;
+};
+
+static const char* const BASE_FIELD_NAMES[] = {
+    "Customer Shipping Address",
+    "Order Fulfillment Status",
+    "Quantity Ordered",
+    "Unit Price (USD, before discounts)",
+    "Requires Manual Review",
+    "Product Categories",
+    "Account Manager",
+    "Product Photos and Documents",
+};
+static constexpr size_t NUM_BASE_FIELD_NAMES = sizeof(BASE_FIELD_NAMES) / sizeof(BASE_FIELD_NAMES[0]);
+
+static string make_airtable_id(const char* prefix, uint64_t n) {
+  static const char* alphabet = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+  string ret = prefix;
+  n = n * 0x9E3779B97F4A7C15ULL + 0x1234567;
+  while (ret.size() < 17) {
+    ret.push_back(alphabet[n % 62]);
+    n = (n / 62) ^ (n * 31);
+  }
+  return ret;
+}
+
+static string synthetic_field_key(size_t field_index, const SyntheticTableSpec& spec) {
+  if (spec.key_by_field_id) {
+    return make_airtable_id("fld", field_index);
+  }
+  return std::format("{} {}", BASE_FIELD_NAMES[field_index % NUM_BASE_FIELD_NAMES], field_index);
+}
+
+static phosg::JSON make_synthetic_cell(size_t field_index, size_t record_index, const SyntheticTableSpec& spec) {
+  uint64_t seed = field_index * 1000003 + record_index;
+  switch (field_index % NUM_BASE_FIELD_NAMES) {
+    case 0:
+      return std::format("{} Example Street, Apt {}", seed % 10000, seed % 100);
+    case 1: {
+      string text;
+      while (text.size() < spec.long_text_length) {
+        text += std::format("Status note {} for \"order\" {}.\n", seed % 97, record_index);
+      }
+      text.resize(spec.long_text_length);
+      return text;
+    }
+    case 2:
+      return static_cast<int64_t>(seed % 1000);
+    case 3:
+      return static_cast<double>(seed % 100000) / 100.0;
+    case 4:
+      return (seed & 1) ? true : false;
+    case 5:
+      return phosg::JSON::list({"Hardware", std::format("Category {}", seed % 7), "Clearance"});
+    case 6:
+      return phosg::JSON::dict({
+          {"id", make_airtable_id("usr", seed % 20)},
+          {"email", std::format("manager{}@example.com", seed % 20)},
+          {"name", std::format("Account Manager {}", seed % 20)},
+      });
+    case 7: {
+      auto make_thumbnail = [&](size_t width, size_t height) -> phosg::JSON {
+        return phosg::JSON::dict({
+            {"url", std::format("https://v5.airtableusercontent.com/v3/u/{}/{}x{}", seed, width, height)},
+            {"width", width},
+            {"height", height},
+        });
+      };
+      return phosg::JSON::list({phosg::JSON::dict({
+          {"id", make_airtable_id("att", seed)},
+          {"width", 1024},
+          {"height", 768},
+          {"url", std::format("https://v5.airtableusercontent.com/v3/u/{}/photo.jpg", seed)},
+          {"filename", std::format("photo-{}.jpg", seed)},
+          {"size", 123456 + seed % 1000},
+          {"type", "image/jpeg"},
+          {"thumbnails", phosg::JSON::dict({
+                             {"small", make_thumbnail(48, 36)},
+                             {"large", make_thumbnail(512, 384)},
+                             {"full", make_thumbnail(3000, 2250)},
+                         })},
+      })});
+    }
+    default:
+      throw logic_error("unhandled synthetic field type");
+  }
+}
+
+// Returns the schema of the table that make_synthetic_page's records come from
+static TableSchema make_synthetic_schema(const SyntheticTableSpec& spec) {
+  static const char* const FIELD_TYPES[NUM_BASE_FIELD_NAMES] = {
+      "singleLineText",
+      "multilineText",
+      "number",
+      "currency",
+      "checkbox",
+      "multipleSelects",
+      "singleCollaborator",
+      "multipleAttachments",
+  };
+  TableSchema schema;
+  schema.name = "Synthetic Table";
+  schema.primary_field_id = make_airtable_id("fld", 0);
+  for (size_t field_index = 0; field_index < spec.num_fields; field_index++) {
+    auto& field = schema.fields[make_airtable_id("fld", field_index)];
+    field.name = std::format("{} {}", BASE_FIELD_NAMES[field_index % NUM_BASE_FIELD_NAMES], field_index);
+    field.type = FIELD_TYPES[field_index % NUM_BASE_FIELD_NAMES];
+  }
+  return schema;
+}
+
+// Returns a response body in the same format as the list records API
+static string make_synthetic_page(size_t num_records, size_t page_index, const SyntheticTableSpec& spec) {
+  auto records_json = phosg::JSON::list();
+  for (size_t z = 0; z < num_records; z++) {
+    size_t record_index = page_index * num_records + z;
+    auto fields_json = phosg::JSON::dict();
+    for (size_t field_index = 0; field_index < spec.num_fields; field_index++) {
+      fields_json.emplace(synthetic_field_key(field_index, spec), make_synthetic_cell(field_index, record_index, spec));
+    }
+    records_json.emplace_back(phosg::JSON::dict({
+        {"id", make_airtable_id("rec", record_index)},
+        {"createdTime", "2024-03-15T12:34:56.000Z"},
+        {"fields", std::move(fields_json)},
+    }));
+  }
+  return phosg::JSON::dict({
+                               {"records", std::move(records_json)},
+                               {"offset", make_airtable_id("itr", page_index) + "/" + make_airtable_id("rec", page_index)},
+                           })
+      .serialize();
+}
+
+// Parses a page the same way AirtableClient::list_records_page does
+static vector<Record> parse_page_dom(const string& data) {
+  auto response_json = phosg::JSON::parse(data);
+  vector<Record> ret;
+  for (const auto& record_json : response_json.at("records").as_list()) {
+    ret.emplace_back(*record_json);
+  }
+  return ret;
+}
+
+// Parses a page the same way AirtableClient::list_records_page does, feeding
+// the data to the parser in pieces of the given size as if it were arriving
+// from the network
+static vector<Record> parse_page_streaming(const string& data, size_t piece_size) {
+  RecordStreamParser parser;
+  for (size_t offset = 0; offset < data.size(); offset += piece_size) {
+    parser.feed(data.data() + offset, min<size_t>(piece_size, data.size() - offset));
+  }
+  parser.finish();
+  return parser.take_records();
+}
+
+// Calls fn repeatedly for at least min_iterations iterations and at least
+// min_seconds, and returns the average time per call in microseconds.
+template <typename FnT>
+static double measure_usecs_per_call(FnT&& fn, size_t min_iterations = 10, double min_seconds = 0.5) {
+  auto start = chrono::steady_clock::now();
+  size_t iterations = 0;
+  chrono::duration<double> elapsed;
+  do {
+    fn();
+    iterations++;
+    elapsed = chrono::steady_clock::now() - start;
+  } while (iterations < min_iterations || elapsed.count() < min_seconds);
+  return (elapsed.count() * 1000000.0) / iterations;
+}
+
+static phosg::JSON bench_field_key_modes() {
+  auto ret = phosg::JSON::dict();
+  for (bool key_by_field_id : {false, true}) {
+    SyntheticTableSpec spec;
+    spec.key_by_field_id = key_by_field_id;
+    string page = make_synthetic_page(100, 0, spec);
+    double parse_usecs = measure_usecs_per_call([&]() -> void {
+      auto records = parse_page_dom(page);
+      if (records.size() != 100) {
+        throw logic_error("incorrect record count");
+      }
+    });
+    ret.emplace(key_by_field_id ? "field_ids" : "field_names", phosg::JSON::dict({
+                                                                   {"bytes_per_page", page.size()},
+                                                                   {"parse_usecs_per_page", parse_usecs},
+                                                               }));
+  }
+  return ret;
+}
+
+static phosg::JSON bench_record_parsing() {
+  static constexpr size_t RECORDS_PER_PAGE = 100;
+  static constexpr size_t STREAM_PIECE_SIZE = 0x4000;
+
+  SyntheticTableSpec spec;
+  string page = make_synthetic_page(RECORDS_PER_PAGE, 0, spec);
+
+  // Make sure both parsers produce the same records before timing them
+  auto dom_records = parse_page_dom(page);
+  auto stream_records = parse_page_streaming(page, STREAM_PIECE_SIZE);
+  if (dom_records.size() != RECORDS_PER_PAGE || stream_records.size() != RECORDS_PER_PAGE) {
+    throw logic_error("incorrect record count");
+  }
+  for (size_t z = 0; z < RECORDS_PER_PAGE; z++) {
+    if (dom_records[z].json_for_update() != stream_records[z].json_for_update()) {
+      throw logic_error(std::format("streaming parser result differs from DOM parser result for record {}", dom_records[z].id));
+    }
+  }
+
+  auto run_parser = [&](function<vector<Record>()> parse_fn) -> phosg::JSON {
+    double usecs = measure_usecs_per_call([&]() -> void {
+      if (parse_fn().size() != RECORDS_PER_PAGE) {
+        throw logic_error("incorrect record count");
+      }
+    });
+    auto [peak_bytes, num_allocations] = measure_allocations([&]() -> void {
+      parse_fn();
+    });
+    return phosg::JSON::dict({
+        {"usecs_per_page", usecs},
+        {"records_per_second", (RECORDS_PER_PAGE * 1000000.0) / usecs},
+        {"peak_bytes_per_page", peak_bytes},
+        {"allocations_per_page", num_allocations},
+    });
+  };
+
+  return phosg::JSON::dict({
+      {"bytes_per_page", page.size()},
+      {"dom", run_parser([&]() -> vector<Record> { return parse_page_dom(page); })},
+      {"streaming", run_parser([&]() -> vector<Record> { return parse_page_streaming(page, STREAM_PIECE_SIZE); })},
+  });
+}
+
+static phosg::JSON bench_record_writing() {
+  // The API accepts at most 10 records per create or update request
+  static constexpr size_t RECORDS_PER_REQUEST = 10;
+
+  SyntheticTableSpec spec;
+  auto records = parse_page_dom(make_synthetic_page(RECORDS_PER_REQUEST, 0, spec));
+
+  // Builds the request body the way create_records did before JSONWriter
+  auto write_dom = [&]() -> string {
+    auto record_jsons = phosg::JSON::list();
+    for (const auto& record : records) {
+      record_jsons.emplace_back(record.json_for_create());
+    }
+    return phosg::JSON::dict({{"records", std::move(record_jsons)}}).serialize();
+  };
+  // The writer's buffer is reused across requests, as it would be by a caller
+  // writing many batches
+  JSONWriter w;
+  auto write_direct = [&]() -> const string& {
+    w.clear();
+    w.begin_object();
+    w.write_key("records");
+    w.begin_array();
+    for (const auto& record : records) {
+      record.write_json_for_create(w);
+    }
+    w.end_array();
+    w.end_object();
+    return w.str();
+  };
+
+  if (phosg::JSON::parse(write_dom()) != phosg::JSON::parse(write_direct())) {
+    throw logic_error("JSONWriter output differs from DOM output");
+  }
+
+  double dom_usecs = measure_usecs_per_call([&]() -> void { write_dom(); });
+  auto [dom_peak_bytes, dom_allocations] = measure_allocations([&]() -> void { write_dom(); });
+  double direct_usecs = measure_usecs_per_call([&]() -> void { write_direct(); });
+  auto [direct_peak_bytes, direct_allocations] = measure_allocations([&]() -> void { write_direct(); });
+
+  return phosg::JSON::dict({
+      {"bytes_per_request", w.str().size()},
+      {"dom", phosg::JSON::dict({
+                  {"usecs_per_request", dom_usecs},
+                  {"peak_bytes_per_request", dom_peak_bytes},
+                  {"allocations_per_request", dom_allocations},
+              })},
+      {"direct", phosg::JSON::dict({
+                     {"usecs_per_request", direct_usecs},
+                     {"peak_bytes_per_request", direct_peak_bytes},
+                     {"allocations_per_request", direct_allocations},
+                 })},
+  });
+}
+
+static phosg::JSON bench_json_scan() {
+  static constexpr size_t RECORDS_PER_PAGE = 100;
+  static constexpr size_t STREAM_PIECE_SIZE = 0x4000;
+
+  // Page shapes resembling our tables: a typical narrow table, a wide table,
+  // and a wide table with long text cells (notes, descriptions, etc.)
+  struct Corpus {
+    const char* name;
+    SyntheticTableSpec spec;
+  };
+  vector<Corpus> corpora = {
+      {"narrow", SyntheticTableSpec{.num_fields = 30, .long_text_length = 200, .key_by_field_id = false}},
+      {"wide", SyntheticTableSpec{.num_fields = 200, .long_text_length = 200, .key_by_field_id = false}},
+      {"wide_long_text", SyntheticTableSpec{.num_fields = 200, .long_text_length = 4000, .key_by_field_id = false}},
+  };
+
+  JSONScanLevel orig_level = get_json_scan_level();
+  JSONScanLevel max_level = max_supported_json_scan_level();
+
+  auto ret = phosg::JSON::dict({{"max_supported_level", name_for_json_scan_level(max_level)}});
+  for (const auto& corpus : corpora) {
+    string page = make_synthetic_page(RECORDS_PER_PAGE, 0, corpus.spec);
+    auto corpus_ret = phosg::JSON::dict({{"bytes_per_page", page.size()}});
+    for (JSONScanLevel level : {JSONScanLevel::SCALAR, JSONScanLevel::SSE42, JSONScanLevel::AVX2}) {
+      if (static_cast<int>(level) > static_cast<int>(max_level)) {
+        continue;
+      }
+      set_json_scan_level(level);
+      double usecs = measure_usecs_per_call([&]() -> void {
+        if (parse_page_streaming(page, STREAM_PIECE_SIZE).size() != RECORDS_PER_PAGE) {
+          throw logic_error("incorrect record count");
+        }
+      });
+      corpus_ret.emplace(name_for_json_scan_level(level), phosg::JSON::dict({
+                                                              {"usecs_per_page", usecs},
+                                                              {"records_per_second", (RECORDS_PER_PAGE * 1000000.0) / usecs},
+                                                              {"megabytes_per_second", page.size() / usecs},
+                                                          }));
+    }
+    ret.emplace(corpus.name, std::move(corpus_ret));
+  }
+  set_json_scan_level(orig_level);
+  return ret;
+}
+
+static phosg::JSON bench_schema_decoding() {
+  static constexpr size_t RECORDS_PER_PAGE = 100;
+
+  SyntheticTableSpec spec;
+  string page = make_synthetic_page(RECORDS_PER_PAGE, 0, spec);
+  TableDecoder decoder(make_synthetic_schema(spec), spec.key_by_field_id);
+
+  auto sniffed_records = RecordStreamParser::parse(page).first;
+  auto decoded_records = RecordStreamParser::parse(page, &decoder).first;
+  for (size_t z = 0; z < RECORDS_PER_PAGE; z++) {
+    if (sniffed_records[z].json_for_update() != decoded_records[z].json_for_update()) {
+      throw logic_error(std::format("schema-decoded result differs from sniffed result for record {}", sniffed_records[z].id));
+    }
+  }
+
+  auto run_parser = [&](const TableDecoder* decoder) -> phosg::JSON {
+    double usecs = measure_usecs_per_call([&]() -> void {
+      if (RecordStreamParser::parse(page, decoder).first.size() != RECORDS_PER_PAGE) {
+        throw logic_error("incorrect record count");
+      }
+    });
+    return phosg::JSON::dict({
+        {"usecs_per_page", usecs},
+        {"records_per_second", (RECORDS_PER_PAGE * 1000000.0) / usecs},
+    });
+  };
+
+  return phosg::JSON::dict({
+      {"sniffed", run_parser(nullptr)},
+      {"schema_decoded", run_parser(&decoder)},
+  });
+}
+
+// A row type for tables generated with the first NUM_BASE_FIELD_NAMES
+// synthetic fields, keyed by name
+struct SyntheticRow {
+  string id;
+  uint64_t creation_time = 0;
+  string shipping_address;
+  string fulfillment_status;
+  int64_t quantity = 0;
+  double unit_price = 0.0;
+  bool requires_manual_review = false;
+  vector<string> product_categories;
+  CollaboratorField account_manager;
+  vector<Attachment> photos;
+};
+
+template <>
+struct RecordMapping<SyntheticRow> {
+  static constexpr auto id = &SyntheticRow::id;
+  static constexpr auto creation_time = &SyntheticRow::creation_time;
+  static constexpr auto fields = make_tuple(
+      airtable_field("Customer Shipping Address 0", &SyntheticRow::shipping_address),
+      airtable_field("Order Fulfillment Status 1", &SyntheticRow::fulfillment_status),
+      airtable_field("Quantity Ordered 2", &SyntheticRow::quantity),
+      airtable_field("Unit Price (USD, before discounts) 3", &SyntheticRow::unit_price),
+      airtable_field("Requires Manual Review 4", &SyntheticRow::requires_manual_review),
+      airtable_field("Product Categories 5", &SyntheticRow::product_categories),
+      airtable_field("Account Manager 6", &SyntheticRow::account_manager),
+      airtable_field("Product Photos and Documents 7", &SyntheticRow::photos));
+};
+
+static vector<SyntheticRow> parse_page_typed(const string& data) {
+  vector<SyntheticRow> ret;
+  RecordStreamParser parser([&ret](JSONReader& r) -> void {
+    read_mapped_record(r, ret.emplace_back());
+  });
+  parser.feed(data);
+  parser.finish();
+  return ret;
+}
+
+static bool typed_row_matches_record(const SyntheticRow& row, const Record& record) {
+  auto names = mapped_field_names<SyntheticRow>();
+  auto cell_json = [&](size_t index) -> phosg::JSON {
+    return record.fields.at(names[index])->to_json();
+  };
+  auto cell_number = [&](size_t index) -> double {
+    const auto& field = *record.fields.at(names[index]);
+    return (field.type == Field::ValueType::Integer)
+        ? static_cast<const IntegerField&>(field).value
+        : static_cast<const FloatField&>(field).value;
+  };
+  return (row.id == record.id) &&
+      (row.creation_time == record.creation_time) &&
+      (cell_json(0) == phosg::JSON(row.shipping_address)) &&
+      (cell_json(1) == phosg::JSON(row.fulfillment_status)) &&
+      (cell_number(2) == row.quantity) &&
+      (cell_number(3) == row.unit_price) &&
+      (cell_json(4) == phosg::JSON(row.requires_manual_review)) &&
+      (cell_json(5) == StringArrayField(row.product_categories).to_json()) &&
+      (cell_json(6) == row.account_manager.to_json()) &&
+      (cell_json(7) == AttachmentField(row.photos).to_json());
+}
+
+static phosg::JSON bench_typed_records() {
+  static constexpr size_t RECORDS_PER_PAGE = 100;
+
+  SyntheticTableSpec spec{.num_fields = NUM_BASE_FIELD_NAMES, .long_text_length = 200, .key_by_field_id = false};
+  string page = make_synthetic_page(RECORDS_PER_PAGE, 0, spec);
+  TableDecoder decoder(make_synthetic_schema(spec), spec.key_by_field_id);
+
+  auto records = RecordStreamParser::parse(page).first;
+  auto rows = parse_page_typed(page);
+  for (size_t z = 0; z < RECORDS_PER_PAGE; z++) {
+    if (!typed_row_matches_record(rows[z], records[z])) {
+      throw logic_error(std::format("typed result differs from Record result for record {}", records[z].id));
+    }
+  }
+
+  auto run = [&](auto&& parse_page) -> phosg::JSON {
+    auto [peak_bytes, num_allocations] = measure_allocations([&]() -> void {
+      parse_page();
+    });
+    double usecs = measure_usecs_per_call([&]() -> void {
+      if (parse_page() != RECORDS_PER_PAGE) {
+        throw logic_error("incorrect record count");
+      }
+    });
+    return phosg::JSON::dict({
+        {"usecs_per_page", usecs},
+        {"records_per_second", (RECORDS_PER_PAGE * 1000000.0) / usecs},
+        {"peak_bytes", peak_bytes},
+        {"allocations", num_allocations},
+    });
+  };
+
+  return phosg::JSON::dict({
+      {"sniffed", run([&]() -> size_t { return RecordStreamParser::parse(page).first.size(); })},
+      {"schema_decoded", run([&]() -> size_t { return RecordStreamParser::parse(page, &decoder).first.size(); })},
+      {"typed", run([&]() -> size_t { return parse_page_typed(page).size(); })},
+  });
+}
+
+static vector<CompactRecord> parse_page_compact(const string& data, shared_ptr<FieldDictionary> dictionary) {
+  vector<CompactRecord> ret;
+  RecordStreamParser parser([&](JSONReader& r) -> void {
+    ret.emplace_back(r, dictionary);
+  });
+  parser.feed(data);
+  parser.finish();
+  return ret;
+}
+
+static phosg::JSON bench_compact_records() {
+  static constexpr size_t RECORDS_PER_PAGE = 100;
+  static constexpr size_t NUM_PAGES = 10;
+
+  SyntheticTableSpec spec;
+  vector<string> pages;
+  for (size_t page_index = 0; page_index < NUM_PAGES; page_index++) {
+    pages.emplace_back(make_synthetic_page(RECORDS_PER_PAGE, page_index, spec));
+  }
+
+  auto dictionary = make_shared<FieldDictionary>();
+  auto records = RecordStreamParser::parse(pages[0]).first;
+  auto compact_records = parse_page_compact(pages[0], dictionary);
+  for (size_t z = 0; z < RECORDS_PER_PAGE; z++) {
+    if (compact_records[z].to_record().json_for_update() != records[z].json_for_update()) {
+      throw logic_error(std::format("compact result differs from Record result for record {}", records[z].id));
+    }
+  }
+
+  // Memory is measured while holding all pages' records, as a client would
+  // when listing a whole table
+  auto run = [&](auto&& parse_page) -> phosg::JSON {
+    auto [peak_bytes, num_allocations] = measure_allocations([&]() -> void {
+      vector<decltype(parse_page(pages[0]))> all_pages;
+      for (const auto& page : pages) {
+        all_pages.emplace_back(parse_page(page));
+      }
+    });
+    double usecs = measure_usecs_per_call([&]() -> void {
+      if (parse_page(pages[0]).size() != RECORDS_PER_PAGE) {
+        throw logic_error("incorrect record count");
+      }
+    });
+    return phosg::JSON::dict({
+        {"usecs_per_page", usecs},
+        {"records_per_second", (RECORDS_PER_PAGE * 1000000.0) / usecs},
+        {"bytes_per_record", static_cast<double>(peak_bytes) / (RECORDS_PER_PAGE * NUM_PAGES)},
+        {"allocations_per_record", static_cast<double>(num_allocations) / (RECORDS_PER_PAGE * NUM_PAGES)},
+    });
+  };
+
+  return phosg::JSON::dict({
+      {"record", run([&](const string& page) -> vector<Record> { return RecordStreamParser::parse(page).first; })},
+      {"compact_record", run([&](const string& page) -> vector<CompactRecord> { return parse_page_compact(page, dictionary); })},
+  });
+}
+
+static RecordBatch parse_pages_batch(const vector<string>& pages) {
+  RecordBatch batch;
+  RecordStreamParser parser([&batch](JSONReader& r) -> void {
+    batch.append_record(r);
+  });
+  for (const auto& page : pages) {
+    parser.feed(page);
+    parser.finish();
+    parser.reset();
+  }
+  return batch;
+}
+
+static phosg::JSON bench_record_batch() {
+  static constexpr size_t RECORDS_PER_PAGE = 100;
+  static constexpr size_t NUM_PAGES = 20;
+  static constexpr size_t NUM_RECORDS = RECORDS_PER_PAGE * NUM_PAGES;
+
+  SyntheticTableSpec spec;
+  vector<string> pages;
+  for (size_t page_index = 0; page_index < NUM_PAGES; page_index++) {
+    pages.emplace_back(make_synthetic_page(RECORDS_PER_PAGE, page_index, spec));
+  }
+  auto parse_pages_records = [&]() -> vector<Record> {
+    vector<Record> ret;
+    for (const auto& page : pages) {
+      auto page_records = RecordStreamParser::parse(page).first;
+      ret.insert(ret.end(), make_move_iterator(page_records.begin()), make_move_iterator(page_records.end()));
+    }
+    return ret;
+  };
+
+  // The scan workload sums a number field and counts checked checkboxes, as
+  // an analytics job aggregating a table would
+  string price_field = synthetic_field_key(3, spec);
+  string review_field = synthetic_field_key(4, spec);
+  auto scan_records = [&](const vector<Record>& records) -> pair<double, size_t> {
+    double price_sum = 0.0;
+    size_t review_count = 0;
+    for (const auto& record : records) {
+      auto price_it = record.fields.find(price_field);
+      if (price_it != record.fields.end()) {
+        const auto& field = *price_it->second;
+        price_sum += (field.type == Field::ValueType::Integer)
+            ? static_cast<const IntegerField&>(field).value
+            : static_cast<const FloatField&>(field).value;
+      }
+      auto review_it = record.fields.find(review_field);
+      if (review_it != record.fields.end() && static_cast<const CheckboxField&>(*review_it->second).value) {
+        review_count++;
+      }
+    }
+    return make_pair(price_sum, review_count);
+  };
+  auto scan_batch = [&](const RecordBatch& batch) -> pair<double, size_t> {
+    double price_sum = 0.0;
+    for (double price : batch.find_column(price_field)->float64_values()) {
+      price_sum += price; // Null rows are zero, so they don't need to be skipped
+    }
+    size_t review_count = 0;
+    const auto* review_column = batch.find_column(review_field);
+    auto review_bitmap = review_column->bool_bitmap();
+    auto validity_bitmap = review_column->validity_bitmap();
+    for (size_t z = 0; z < review_bitmap.size(); z++) {
+      review_count += popcount(review_bitmap[z] & validity_bitmap[z]);
+    }
+    return make_pair(price_sum, review_count);
+  };
+
+  auto records = parse_pages_records();
+  auto batch = parse_pages_batch(pages);
+  if (batch.num_rows() != NUM_RECORDS) {
+    throw logic_error("incorrect batch row count");
+  }
+  for (size_t z = 0; z < NUM_RECORDS; z++) {
+    if (batch.record_id(z) != records[z].id) {
+      throw logic_error(std::format("batch has incorrect record ID at row {}", z));
+    }
+  }
+  if (scan_records(records) != scan_batch(batch)) {
+    throw logic_error("batch scan result differs from Record scan result");
+  }
+
+  auto column_types = phosg::JSON::dict();
+  for (const auto& column : batch.get_columns()) {
+    column_types.emplace(column.get_name(), name_for_column_type(column.get_type()));
+  }
+
+  auto [records_peak_bytes, records_allocations] = measure_allocations([&]() -> void {
+    parse_pages_records();
+  });
+  auto [batch_peak_bytes, batch_allocations] = measure_allocations([&]() -> void {
+    parse_pages_batch(pages);
+  });
+  double records_parse_usecs = measure_usecs_per_call([&]() -> void {
+    parse_pages_records();
+  });
+  double batch_parse_usecs = measure_usecs_per_call([&]() -> void {
+    parse_pages_batch(pages);
+  });
+  double records_scan_usecs = measure_usecs_per_call([&]() -> void {
+    scan_records(records);
+  });
+  double batch_scan_usecs = measure_usecs_per_call([&]() -> void {
+    scan_batch(batch);
+  });
+
+  return phosg::JSON::dict({
+      {"num_records", NUM_RECORDS},
+      {"column_types", std::move(column_types)},
+      {"records", phosg::JSON::dict({
+                      {"parse_usecs", records_parse_usecs},
+                      {"scan_usecs", records_scan_usecs},
+                      {"peak_bytes", records_peak_bytes},
+                      {"allocations", records_allocations},
+                  })},
+      {"batch", phosg::JSON::dict({
+                    {"parse_usecs", batch_parse_usecs},
+                    {"scan_usecs", batch_scan_usecs},
+                    {"peak_bytes", batch_peak_bytes},
+                    {"allocations", batch_allocations},
+                })},
+  });
+}
+
+static phosg::JSON bench_page_arena() {
+  static constexpr size_t RECORDS_PER_PAGE = 100;
+
+  SyntheticTableSpec spec;
+  string page = make_synthetic_page(RECORDS_PER_PAGE, 0, spec);
+  TableDecoder decoder(make_synthetic_schema(spec), spec.key_by_field_id);
+
+  // Each iteration parses a page and then drops all of its records, as a
+  // caller processing a table page by page would
+  auto run = [&](const TableDecoder* decoder, bool use_arena) -> phosg::JSON {
+    size_t arena_allocations = 0;
+    size_t arena_bytes = 0;
+    auto parse_and_drop = [&]() -> void {
+      auto arena = use_arena ? make_shared<PageArena>() : nullptr;
+      auto records = RecordStreamParser::parse(page, decoder, arena).first;
+      if (records.size() != RECORDS_PER_PAGE) {
+        throw logic_error("incorrect record count");
+      }
+      if (arena) {
+        arena_allocations = arena->get_num_allocations();
+        arena_bytes = arena->get_bytes_allocated();
+      }
+    };
+    auto [peak_bytes, num_allocations] = measure_allocations(parse_and_drop);
+    double usecs = measure_usecs_per_call(parse_and_drop);
+    auto ret = phosg::JSON::dict({
+        {"usecs_per_page", usecs},
+        {"records_per_second", (RECORDS_PER_PAGE * 1000000.0) / usecs},
+        {"peak_bytes", peak_bytes},
+        {"malloc_allocations", num_allocations},
+    });
+    if (use_arena) {
+      ret.emplace("arena_allocations", arena_allocations);
+      ret.emplace("arena_bytes", arena_bytes);
+    }
+    return ret;
+  };
+
+  return phosg::JSON::dict({
+      {"malloc", run(nullptr, false)},
+      {"arena", run(nullptr, true)},
+      {"schema_decoded_malloc", run(&decoder, false)},
+      {"schema_decoded_arena", run(&decoder, true)},
+  });
+}
+
+// Returns num_times pseudorandom timestamps between 1970 and 2100 with
+// microsecond precision
+static vector<uint64_t> make_synthetic_times(size_t num_times) {
+  static constexpr uint64_t MAX_SECS = 4102444800; // 2100-01-01T00:00:00Z
+  vector<uint64_t> ret;
+  ret.reserve(num_times);
+  uint64_t state = 0x9E3779B97F4A7C15;
+  for (size_t z = 0; z < num_times; z++) {
+    // xorshift64
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    ret.emplace_back((state % MAX_SECS) * 1000000 + (state >> 40) % 1000000);
+  }
+  return ret;
+}
+
+// Formats time via gmtime_r and strftime, with frac_digits fractional digits
+// (or no fraction at all if frac_digits is zero)
+static string format_time_libc(uint64_t time, size_t frac_digits) {
+  static constexpr uint64_t DIVISORS[7] = {1000000, 100000, 10000, 1000, 100, 10, 1};
+  time_t secs = time / 1000000;
+  struct tm t;
+  gmtime_r(&secs, &t);
+  char buf[0x40];
+  string ret(buf, strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S", &t));
+  if (frac_digits) {
+    ret += std::format(".{:0{}}", (time % 1000000) / DIVISORS[frac_digits], frac_digits);
+  }
+  ret += 'Z';
+  return ret;
+}
+
+// Parses time via strptime and timegm; this is what parse_airtable_time did
+// before, except that it used mktime, which applies the local timezone
+static uint64_t parse_time_libc(const string& time) {
+  struct tm t = {};
+  const char* frac_start = strptime(time.c_str(), "%Y-%m-%dT%H:%M:%S", &t);
+  if (frac_start == nullptr) {
+    throw runtime_error("invalid time format");
+  }
+  uint64_t frac = 0;
+  if (*frac_start == '.') {
+    size_t frac_length = strlen(frac_start + 1) - 1;
+    frac = strtoull(frac_start + 1, nullptr, 10);
+    for (size_t place = frac_length; place < 6; place++) {
+      frac *= 10;
+    }
+  }
+  return timegm(&t) * 1000000 + frac;
+}
+
+static phosg::JSON bench_airtable_time() {
+  static constexpr size_t NUM_TIMES = 10000;
+
+  // Check that parsing and formatting match libc at every supported precision,
+  // including at the boundaries of years, months, and leap days
+  auto times = make_synthetic_times(NUM_TIMES);
+  for (const char* s : {"1970-01-01T00:00:00.000Z", "1999-12-31T23:59:59.999Z", "2000-02-29T12:00:00.000Z",
+           "2024-02-29T23:59:59.999Z", "2024-03-01T00:00:00.000Z", "2038-01-19T03:14:08.000Z", "2099-12-31T23:59:59.999Z"}) {
+    times.emplace_back(parse_time_libc(s));
+  }
+  for (size_t frac_digits = 0; frac_digits <= 6; frac_digits++) {
+    for (uint64_t time : times) {
+      string libc_str = format_time_libc(time, frac_digits);
+      uint64_t parsed = parse_airtable_time(libc_str);
+      uint64_t libc_parsed = parse_time_libc(libc_str);
+      if (parsed != libc_parsed) {
+        throw logic_error(std::format("parse_airtable_time({}) returned {}; expected {}", libc_str, parsed, libc_parsed));
+      }
+    }
+  }
+  for (uint64_t time : times) {
+    string str = format_airtable_time(time);
+    string libc_str = format_time_libc(time, 3);
+    if (str != libc_str) {
+      throw logic_error(std::format("format_airtable_time({}) returned {}; expected {}", time, str, libc_str));
+    }
+  }
+  for (const char* s : {"2024-02-30T00:00:00.000Z", "2023-02-29T00:00:00.000Z", "2024-13-01T00:00:00.000Z",
+           "2024-01-01T24:00:00.000Z", "2024-01-01T00:60:00.000Z", "2024-01-01 00:00:00.000Z", "2024-01-01T00:00:00.Z",
+           "2024-01-01T00:00:00.0x0Z", "2024-01-01T00:00:00.000", "1969-12-31T23:59:59.999Z", "2024-01-01T00:00:00.0000000Z"}) {
+    bool threw = false;
+    try {
+      parse_airtable_time(s);
+    } catch (const runtime_error&) {
+      threw = true;
+    }
+    if (!threw) {
+      throw logic_error(std::format("parse_airtable_time({}) did not reject invalid time", s));
+    }
+  }
+
+  // Measure throughput on the millisecond-precision strings Airtable sends
+  string formatted = format_airtable_times(times);
+  vector<string> strs;
+  vector<string_view> str_views;
+  for (size_t z = 0; z < times.size(); z++) {
+    str_views.emplace_back(formatted.data() + z * AIRTABLE_TIME_LENGTH, AIRTABLE_TIME_LENGTH);
+    strs.emplace_back(str_views.back());
+  }
+  vector<uint64_t> parsed(times.size());
+  uint64_t checksum = 0;
+  auto run = [&](auto&& fn) -> phosg::JSON {
+    double usecs = measure_usecs_per_call(fn);
+    return phosg::JSON::dict({
+        {"usecs_per_batch", usecs},
+        {"timestamps_per_second", (times.size() * 1000000.0) / usecs},
+    });
+  };
+  auto ret = phosg::JSON::dict({
+      {"batch_size", times.size()},
+      {"parse_libc", run([&]() -> void {
+         for (const auto& s : strs) {
+           checksum += parse_time_libc(s);
+         }
+       })},
+      {"parse", run([&]() -> void {
+         for (const auto& s : str_views) {
+           checksum += parse_airtable_time(s);
+         }
+       })},
+      {"parse_batch", run([&]() -> void {
+         parse_airtable_times(str_views, parsed);
+         checksum += parsed[0];
+       })},
+      {"format_libc", run([&]() -> void {
+         for (uint64_t time : times) {
+           checksum += format_time_libc(time, 3).size();
+         }
+       })},
+      {"format", run([&]() -> void {
+         for (uint64_t time : times) {
+           checksum += format_airtable_time(time).size();
+         }
+       })},
+      {"format_batch", run([&]() -> void {
+         checksum += format_airtable_times(times).size();
+       })},
+  });
+  // Keep the compiler from discarding the results
+  if (checksum == 0) {
+    throw logic_error("checksum is zero");
+  }
+  return ret;
+}
+
+static phosg::JSON bench_field_interning() {
+  static constexpr size_t RECORDS_PER_PAGE = 100;
+  static constexpr size_t NUM_PAGES = 20;
+  static constexpr size_t NUM_RECORDS = RECORDS_PER_PAGE * NUM_PAGES;
+
+  SyntheticTableSpec spec;
+  vector<string> pages;
+  for (size_t page_index = 0; page_index < NUM_PAGES; page_index++) {
+    pages.emplace_back(make_synthetic_page(RECORDS_PER_PAGE, page_index, spec));
+  }
+  TableDecoder decoder(make_synthetic_schema(spec), spec.key_by_field_id);
+
+  // Each run keeps the whole table resident, as a cache of the table would
+  auto run = [&](auto&& parse_all) -> phosg::JSON {
+    size_t num_records = 0;
+    auto [peak_bytes, num_allocations] = measure_allocations([&]() -> void {
+      num_records = parse_all().size();
+    });
+    if (num_records != NUM_RECORDS) {
+      throw logic_error("incorrect record count");
+    }
+    return phosg::JSON::dict({
+        {"bytes_per_record", static_cast<double>(peak_bytes) / NUM_RECORDS},
+        {"allocations_per_record", static_cast<double>(num_allocations) / NUM_RECORDS},
+    });
+  };
+
+  auto parse_records = [&](const TableDecoder* decoder) -> vector<Record> {
+    auto interner = make_shared<StringInterner>();
+    vector<Record> ret;
+    for (const auto& page : pages) {
+      auto page_records = RecordStreamParser::parse(page, decoder, nullptr, interner).first;
+      ret.insert(ret.end(), make_move_iterator(page_records.begin()), make_move_iterator(page_records.end()));
+    }
+    return ret;
+  };
+  // For comparison, this stores each record's cells in its own map with its
+  // own copies of the field names, as Records did before RecordFields
+  auto parse_maps = [&]() -> vector<unordered_map<string, shared_ptr<Field>>> {
+    vector<unordered_map<string, shared_ptr<Field>>> ret;
+    for (const auto& page : pages) {
+      for (auto& record : RecordStreamParser::parse(page).first) {
+        ret.emplace_back(record.fields.to_map());
+      }
+    }
+    return ret;
+  };
+
+  return phosg::JSON::dict({
+      {"per_record_maps", run(parse_maps)},
+      {"interned_names", run([&]() { return parse_records(nullptr); })},
+      {"interned_names_with_decoder", run([&]() { return parse_records(&decoder); })},
+  });
+}
+
+static phosg::JSON bench_lazy_records() {
+  static constexpr size_t RECORDS_PER_PAGE = 100;
+
+  SyntheticTableSpec spec;
+  auto page = make_shared<const string>(make_synthetic_page(RECORDS_PER_PAGE, 0, spec));
+  string quantity_field = synthetic_field_key(2, spec);
+  string review_field = synthetic_field_key(4, spec);
+
+  // Each scan sums the quantities of the records that require review, which
+  // touches 2 of each record's 30 fields
+  auto scan_records = [&]() -> int64_t {
+    int64_t total = 0;
+    for (const auto& record : RecordStreamParser::parse(*page).first) {
+      if (static_cast<const CheckboxField&>(*record.fields.at(review_field)).value) {
+        total += static_cast<const IntegerField&>(*record.fields.at(quantity_field)).value;
+      }
+    }
+    return total;
+  };
+  auto scan_lazy_records = [&]() -> int64_t {
+    int64_t total = 0;
+    for (const auto& record : LazyRecord::parse_page(page).first) {
+      const auto& review = record.get(review_field);
+      if (review && static_cast<const CheckboxField&>(*review).value) {
+        total += static_cast<const IntegerField&>(*record.get(quantity_field)).value;
+      }
+    }
+    return total;
+  };
+  if (scan_records() != scan_lazy_records()) {
+    throw logic_error("lazy scan result differs from Record scan result");
+  }
+  auto lazy_records = LazyRecord::parse_page(page).first;
+  auto records = RecordStreamParser::parse(*page).first;
+  for (size_t z = 0; z < RECORDS_PER_PAGE; z++) {
+    auto full_record = lazy_records[z].to_record();
+    if (full_record.json_for_update() != records[z].json_for_update()) {
+      throw logic_error(std::format("lazy result differs from Record result for record {}", full_record.id));
+    }
+  }
+
+  auto run = [&](auto&& scan) -> phosg::JSON {
+    int64_t total = 0;
+    auto [peak_bytes, num_allocations] = measure_allocations([&]() -> void {
+      total += scan();
+    });
+    double usecs = measure_usecs_per_call([&]() -> void {
+      total += scan();
+    });
+    // Keep the compiler from discarding the results
+    if (total < 0) {
+      throw logic_error("negative total");
+    }
+    return phosg::JSON::dict({
+        {"usecs_per_page", usecs},
+        {"records_per_second", (RECORDS_PER_PAGE * 1000000.0) / usecs},
+        {"peak_bytes", peak_bytes},
+        {"allocations_per_record", static_cast<double>(num_allocations) / RECORDS_PER_PAGE},
+    });
+  };
+
+  return phosg::JSON::dict({
+      {"record", run(scan_records)},
+      {"lazy_record", run(scan_lazy_records)},
+  });
+}
+
+// This is a function rather than a lambda because the coroutine may outlive
+// the lambda object that created it
+static asio::awaitable<size_t> parse_page_async(
+    const string& page, const TableDecoder* decoder, shared_ptr<StringInterner> interner) {
+  co_return RecordStreamParser::parse(page, decoder, nullptr, interner).first.size();
+}
+
+static phosg::JSON bench_io_thread_pool() {
+  static constexpr size_t RECORDS_PER_PAGE = 100;
+  static constexpr size_t NUM_PAGES = 200;
+
+  SyntheticTableSpec spec;
+  string page = make_synthetic_page(RECORDS_PER_PAGE, 0, spec);
+  TableDecoder decoder(make_synthetic_schema(spec), spec.key_by_field_id);
+
+  // Each run parses NUM_PAGES pages as concurrent coroutines sharing one
+  // interner and decoder, as a client's list_records calls would
+  auto run = [&](size_t num_threads) -> phosg::JSON {
+    IOThreadPool pool(num_threads);
+    auto interner = make_shared<StringInterner>();
+    auto parse_all = [&]() -> void {
+      vector<future<size_t>> futures;
+      for (size_t z = 0; z < NUM_PAGES; z++) {
+        futures.emplace_back(asio::co_spawn(
+            pool.get_io_context(), parse_page_async(page, &decoder, interner), asio::use_future));
+      }
+      for (auto& f : futures) {
+        if (f.get() != RECORDS_PER_PAGE) {
+          throw logic_error("incorrect record count");
+        }
+      }
+    };
+    double usecs = measure_usecs_per_call(parse_all, 3);
+    return phosg::JSON::dict({
+        {"threads", pool.num_threads()},
+        {"usecs_per_run", usecs},
+        {"records_per_second", (NUM_PAGES * RECORDS_PER_PAGE * 1000000.0) / usecs},
+    });
+  };
+
+  auto ret = phosg::JSON::dict();
+  size_t max_threads = max<size_t>(thread::hardware_concurrency(), 1);
+  for (size_t num_threads = 1; num_threads < max_threads; num_threads *= 2) {
+    ret.emplace(std::format("threads_{}", num_threads), run(num_threads));
+  }
+  ret.emplace(std::format("threads_{}", max_threads), run(max_threads));
+  return ret;
+}
+
+// Parses a page on the calling coroutine's thread, or on cpu_pool if given
+static asio::awaitable<void> parse_page_on_pool(
+    const string& page, const TableDecoder* decoder, CPUThreadPool* cpu_pool, size_t& num_pages_done) {
+  auto parse = [&]() -> void {
+    if (RecordStreamParser::parse(page, decoder).first.size() != 100) {
+      throw logic_error("incorrect record count");
+    }
+  };
+  if (cpu_pool) {
+    co_await cpu_pool->async_run(parse);
+  } else {
+    parse();
+  }
+  num_pages_done++;
+}
+
+// Stands in for a connection's I/O: wakes up every millisecond until
+// num_pages_done reaches num_pages, and records how late each wakeup was
+static asio::awaitable<void> measure_tick_latency(
+    const size_t& num_pages_done, size_t num_pages, vector<double>& late_usecs) {
+  static constexpr auto TICK_INTERVAL = chrono::milliseconds(1);
+  auto executor = co_await asio::this_coro::executor;
+  asio::steady_timer timer(executor);
+  while (num_pages_done < num_pages) {
+    auto expected = chrono::steady_clock::now() + TICK_INTERVAL;
+    timer.expires_at(expected);
+    co_await timer.async_wait(asio::use_awaitable);
+    late_usecs.emplace_back(chrono::duration<double, micro>(chrono::steady_clock::now() - expected).count());
+  }
+}
+
+static phosg::JSON bench_cpu_offload() {
+  static constexpr size_t RECORDS_PER_PAGE = 100;
+  static constexpr size_t NUM_PAGES = 100;
+
+  SyntheticTableSpec spec;
+  string page = make_synthetic_page(RECORDS_PER_PAGE, 0, spec);
+  TableDecoder decoder(make_synthetic_schema(spec), spec.key_by_field_id);
+  CPUThreadPool cpu_pool;
+
+  // Each run parses NUM_PAGES pages as concurrent coroutines on one I/O
+  // thread, while another coroutine on the same thread measures how long it
+  // takes to be woken up, as a socket read would be
+  auto run = [&](CPUThreadPool* cpu_pool) -> phosg::JSON {
+    asio::io_context io_context;
+    size_t num_pages_done = 0;
+    vector<double> late_usecs;
+    asio::co_spawn(io_context, measure_tick_latency(num_pages_done, NUM_PAGES, late_usecs), asio::detached);
+    for (size_t z = 0; z < NUM_PAGES; z++) {
+      asio::co_spawn(io_context, parse_page_on_pool(page, &decoder, cpu_pool, num_pages_done), asio::detached);
+    }
+    auto start = chrono::steady_clock::now();
+    io_context.run();
+    double usecs = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+
+    if (late_usecs.empty()) {
+      throw logic_error("no ticks were measured");
+    }
+    sort(late_usecs.begin(), late_usecs.end());
+    return phosg::JSON::dict({
+        {"records_per_second", (NUM_PAGES * RECORDS_PER_PAGE * 1000000.0) / usecs},
+        {"tick_late_usecs_p50", late_usecs[late_usecs.size() / 2]},
+        {"tick_late_usecs_max", late_usecs.back()},
+    });
+  };
+
+  return phosg::JSON::dict({
+      {"cpu_threads", cpu_pool.num_threads()},
+      {"parse_on_io_thread", run(nullptr)},
+      {"parse_on_cpu_pool", run(&cpu_pool)},
+  });
+}
+
+// A read-only stream over an in-memory buffer, which returns at most
+// piece_size bytes per read, so the response-reading benchmark measures the
+// reader and not a socket. Reads complete via the handler's executor, as
+// socket reads do.
+class InMemoryReadStream {
+public:
+  using executor_type = asio::any_io_executor;
+
+  InMemoryReadStream(const executor_type& executor, const string& data, size_t piece_size)
+      : executor(executor), data(data), piece_size(piece_size) {}
+
+  executor_type get_executor() {
+    return this->executor;
+  }
+
+  template <typename MutableBufferSequenceT, typename TokenT>
+  auto async_read_some(const MutableBufferSequenceT& bufs, TokenT&& token) {
+    return asio::async_initiate<TokenT, void(asio::error_code, size_t)>(
+        [this, bufs](auto handler) -> void {
+          size_t bytes_available = min(this->piece_size, this->data.size() - this->offset);
+          size_t bytes_read = asio::buffer_copy(bufs, asio::buffer(this->data.data() + this->offset, bytes_available));
+          this->offset += bytes_read;
+          asio::error_code ec = ((bytes_read == 0) && (asio::buffer_size(bufs) > 0)) ? asio::error_code(asio::error::eof) : asio::error_code();
+          auto handler_executor = asio::get_associated_executor(handler, this->executor);
+          asio::post(handler_executor, [handler = std::move(handler), ec, bytes_read]() mutable -> void {
+            std::move(handler)(ec, bytes_read);
+          });
+        },
+        token);
+  }
+
+  void rewind() {
+    this->offset = 0;
+  }
+
+private:
+  executor_type executor;
+  const string& data;
+  size_t piece_size;
+  size_t offset = 0;
+};
+
+// Reads an HTTP response's status line, headers, and body the way
+// make_request_on_stream does, either always calling the reader's coroutines
+// or calling the non-suspending try_* functions first
+static asio::awaitable<size_t> read_response(InMemoryReadStream& stream, bool use_fast_paths) {
+  AsyncSocketReader r(stream);
+  string line;
+  size_t content_length = 0;
+  for (bool is_status_line = true;; is_status_line = false) {
+    if (!use_fast_paths || !r.try_read_line(line, "\r\n", 4096)) {
+      line = co_await r.read_line("\r\n", 4096);
+    }
+    if (line.empty()) {
+      break;
+    }
+    if (!is_status_line && line.starts_with("content-length:")) {
+      content_length = stoull(line.substr(15));
+    }
+  }
+  string data;
+  if (!use_fast_paths || !r.try_read_data(data, content_length)) {
+    data = co_await r.read_data(content_length);
+  }
+  co_return data.size();
+}
+
+// Stands in for the chain of coroutines live during an API call
+// (make_api_call, make_request, make_request_on_connection, ...), each with
+// a differently-sized frame
+template <size_t Depth>
+static asio::awaitable<size_t> nested_call(size_t value) {
+  array<uint8_t, Depth * 48> locals;
+  locals.fill(static_cast<uint8_t>(value));
+  if constexpr (Depth > 1) {
+    value = co_await nested_call<Depth - 1>(value);
+  }
+  co_return value + locals[Depth];
+}
+
+static phosg::JSON bench_coroutine_frames() {
+  static constexpr size_t NUM_HEADERS = 20;
+  static constexpr size_t BODY_SIZE = 0x800;
+  static constexpr size_t NUM_CALLS = 1000;
+
+  string response = "HTTP/1.1 200 OK\r\n";
+  for (size_t z = 0; z < NUM_HEADERS; z++) {
+    response += std::format("x-synthetic-header-{}: {}\r\n", z, make_airtable_id("req", z));
+  }
+  response += std::format("content-length: {}\r\n\r\n", BODY_SIZE);
+  response.append(BODY_SIZE, 'x');
+
+  // Runs fn NUM_CALLS times in one coroutine and returns the time and number
+  // of allocations per call. The first call isn't counted, so asio's
+  // per-thread caches are warm, as they would be in a long-running client.
+  auto run = [&](auto fn) -> phosg::JSON {
+    asio::io_context io_context;
+    double usecs = 0;
+    size_t num_allocations = 0;
+    auto run_calls = [&]() -> asio::awaitable<void> {
+      co_await fn();
+      size_t start_allocations = allocation_stats.num_allocations.load(memory_order_relaxed);
+      auto start = chrono::steady_clock::now();
+      for (size_t z = 0; z < NUM_CALLS; z++) {
+        co_await fn();
+      }
+      usecs = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+      num_allocations = allocation_stats.num_allocations.load(memory_order_relaxed) - start_allocations;
+    };
+    asio::co_spawn(io_context, run_calls(), asio::detached);
+    io_context.run();
+    return phosg::JSON::dict({
+        {"usecs_per_call", usecs / NUM_CALLS},
+        {"allocations_per_call", static_cast<double>(num_allocations) / NUM_CALLS},
+    });
+  };
+
+  // The lambdas passed to run() outlive the coroutines they create, since
+  // run() doesn't return until the io_context has no more work
+  auto read_with = [&](bool use_fast_paths, size_t piece_size) -> phosg::JSON {
+    // Reads complete on the reading coroutine's executor, so the stream's own
+    // executor is never run
+    asio::io_context stream_context;
+    InMemoryReadStream stream(stream_context.get_executor(), response, piece_size);
+    return run([&]() -> asio::awaitable<void> {
+      stream.rewind();
+      if (co_await read_response(stream, use_fast_paths) != BODY_SIZE) {
+        throw logic_error("incorrect body size");
+      }
+    });
+  };
+
+  return phosg::JSON::dict({
+      {"response_bytes", response.size()},
+      {"nested_calls_depth_6", run([]() -> asio::awaitable<void> {
+         co_await nested_call<6>(1);
+       })},
+      {"read_response_coroutine_per_read", read_with(false, 0x4000)},
+      {"read_response_fast_paths", read_with(true, 0x4000)},
+      {"read_response_fast_paths_256_byte_reads", read_with(true, 0x100)},
+  });
+}
+
+// Returns the name of the backend asio uses for socket I/O in this build
+static const char* asio_backend_name() {
+#if defined(ASIO_HAS_IO_URING_AS_DEFAULT)
+  return "io_uring";
+#elif defined(ASIO_HAS_EPOLL)
+  return "epoll";
+#elif defined(ASIO_HAS_KQUEUE)
+  return "kqueue";
+#else
+  return "select";
+#endif
+}
+
+// Counts the syscalls made by the thread that creates it and by threads that
+// thread creates afterward, via the raw_syscalls:sys_enter tracepoint.
+// Counts from other threads are only included after they exit. This requires
+// tracefs and permission to use perf events (e.g. root, or
+// kernel.perf_event_paranoid = -1); if either is unavailable, count() returns
+// -1.
+class SyscallCounter {
+public:
+  SyscallCounter() {
+#ifdef __linux__
+    for (const char* id_filename : {
+             "/sys/kernel/tracing/events/raw_syscalls/sys_enter/id",
+             "/sys/kernel/debug/tracing/events/raw_syscalls/sys_enter/id"}) {
+      FILE* f = fopen(id_filename, "r");
+      if (!f) {
+        continue;
+      }
+      unsigned long long event_id;
+      bool read_id = (fscanf(f, "%llu", &event_id) == 1);
+      fclose(f);
+      if (read_id) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_TRACEPOINT;
+        attr.size = sizeof(attr);
+        attr.config = event_id;
+        attr.inherit = 1;
+        this->fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+        break;
+      }
+    }
+#endif
+  }
+  SyscallCounter(const SyscallCounter&) = delete;
+  SyscallCounter(SyscallCounter&&) = delete;
+  SyscallCounter& operator=(const SyscallCounter&) = delete;
+  SyscallCounter& operator=(SyscallCounter&&) = delete;
+  ~SyscallCounter() {
+    if (this->fd >= 0) {
+      close(this->fd);
+    }
+  }
+
+  int64_t count() const {
+    uint64_t value;
+    if ((this->fd >= 0) && (read(this->fd, &value, sizeof(value)) == sizeof(value))) {
+      return value;
+    }
+    return -1;
+  }
+
+private:
+  int fd = -1;
+};
+
+// Reads one request from sock and responds with response, as the API would
+static asio::awaitable<void> serve_loopback_connection(asio::ip::tcp::socket sock, const string& response) {
+  AsyncSocketReader r(sock);
+  string line;
+  do {
+    if (!r.try_read_line(line, "\r\n", 4096)) {
+      line = co_await r.read_line("\r\n", 4096);
+    }
+  } while (!line.empty());
+  co_await asio::async_write(sock, asio::buffer(response), asio::use_awaitable);
+}
+
+// Serves each connection accepted on acceptor until it's closed
+static asio::awaitable<void> run_loopback_server(asio::ip::tcp::acceptor& acceptor, const string& response) {
+  for (;;) {
+    asio::error_code ec;
+    auto sock = co_await acceptor.async_accept(asio::redirect_error(asio::use_awaitable, ec));
+    if (ec) {
+      co_return;
+    }
+    asio::co_spawn(acceptor.get_executor(), serve_loopback_connection(std::move(sock), response), asio::detached);
+  }
+}
+
+static asio::awaitable<void> make_loopback_request(
+    AsyncHTTPClient& client, const HTTPRequest& req, size_t expected_size, vector<double>& latency_usecs) {
+  auto start = chrono::steady_clock::now();
+  auto resp = co_await client.make_request(req);
+  if ((resp.response_code != 200) || (resp.data.size() != expected_size)) {
+    throw logic_error("incorrect loopback response");
+  }
+  latency_usecs.emplace_back(chrono::duration<double, micro>(chrono::steady_clock::now() - start).count());
+}
+
+// Makes num_requests requests with at most concurrency running at once, then
+// closes acceptor so the server stops
+static asio::awaitable<void> run_loopback_client(
+    AsyncHTTPClient& client,
+    const HTTPRequest& req,
+    size_t expected_size,
+    size_t num_requests,
+    size_t concurrency,
+    vector<double>& latency_usecs,
+    asio::ip::tcp::acceptor& acceptor) {
+  co_await parallel_for_each(views::iota(static_cast<size_t>(0), num_requests), concurrency, [&](size_t) -> asio::awaitable<void> {
+    return make_loopback_request(client, req, expected_size, latency_usecs);
+  });
+  acceptor.close();
+}
+
+static phosg::JSON bench_loopback_http() {
+  static constexpr size_t NUM_REQUESTS = 5000;
+  static constexpr size_t CONCURRENCY = 256;
+
+  SyntheticTableSpec spec;
+  string body = make_synthetic_page(10, 0, spec);
+  string response = std::format(
+      "HTTP/1.1 200 OK\r\nContent-Type: application/json; charset=utf-8\r\nContent-Length: {}\r\n\r\n{}",
+      body.size(), body);
+
+  // The client and server share one thread, so both sides' syscalls are
+  // counted, and so the results don't depend on how threads are scheduled
+  vector<double> latency_usecs;
+  double usecs;
+  int64_t num_syscalls;
+  long num_context_switches;
+  {
+    SyscallCounter syscall_counter;
+    struct rusage start_usage;
+    getrusage(RUSAGE_SELF, &start_usage);
+    {
+      asio::io_context io_context(1);
+      asio::ip::tcp::acceptor acceptor(io_context, asio::ip::tcp::endpoint(asio::ip::address_v4::loopback(), 0));
+      acceptor.listen(asio::socket_base::max_listen_connections);
+
+      AsyncHTTPClient client(io_context);
+      HTTPRequest req;
+      req.method = HTTPRequest::Method::GET;
+      req.domain = "127.0.0.1";
+      req.port = acceptor.local_endpoint().port();
+      req.path = "/v0/appBenchmark/Table";
+      req.http_version = "HTTP/1.1";
+      req.headers.emplace("Host", "127.0.0.1");
+
+      exception_ptr client_exc;
+      asio::co_spawn(io_context, run_loopback_server(acceptor, response), asio::detached);
+      asio::co_spawn(
+          io_context,
+          run_loopback_client(client, req, body.size(), NUM_REQUESTS, CONCURRENCY, latency_usecs, acceptor),
+          [&](exception_ptr exc) -> void {
+            client_exc = exc;
+          });
+      auto start = chrono::steady_clock::now();
+      io_context.run();
+      usecs = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+      if (client_exc) {
+        rethrow_exception(client_exc);
+      }
+    }
+    // The io_context's resolver thread has exited by now, so its syscalls are
+    // included in the count
+    num_syscalls = syscall_counter.count();
+    struct rusage end_usage;
+    getrusage(RUSAGE_SELF, &end_usage);
+    num_context_switches = (end_usage.ru_nvcsw - start_usage.ru_nvcsw) + (end_usage.ru_nivcsw - start_usage.ru_nivcsw);
+  }
+
+  if (latency_usecs.size() != NUM_REQUESTS) {
+    throw logic_error("incorrect number of responses");
+  }
+  sort(latency_usecs.begin(), latency_usecs.end());
+  auto ret = phosg::JSON::dict({
+      {"backend", asio_backend_name()},
+      {"requests", NUM_REQUESTS},
+      {"concurrency", CONCURRENCY},
+      {"requests_per_second", (NUM_REQUESTS * 1000000.0) / usecs},
+      {"latency_usecs_p50", latency_usecs[latency_usecs.size() / 2]},
+      {"latency_usecs_p99", latency_usecs[(latency_usecs.size() * 99) / 100]},
+      {"latency_usecs_max", latency_usecs.back()},
+      {"context_switches_per_request", static_cast<double>(num_context_switches) / NUM_REQUESTS},
+  });
+  // The syscall count is null if perf events are unavailable
+  ret.emplace("syscalls_per_request", (num_syscalls < 0) ? phosg::JSON(nullptr) : phosg::JSON(static_cast<double>(num_syscalls) / NUM_REQUESTS));
+  return ret;
+}
+
+static phosg::JSON bench_metrics() {
+  static constexpr size_t RECORDS_PER_CALL = 10000;
+  static constexpr size_t NUM_BASES = 50;
+
+  // Records what a single API call would, on one thread or several at once
+  // (all recording into the same series, which is the worst case for
+  // contention)
+  ClientMetrics metrics;
+  auto record_calls = [&]() -> void {
+    for (size_t z = 0; z < RECORDS_PER_CALL; z++) {
+      ClientMetrics::GaugeIncrement in_flight(metrics.in_flight_requests);
+      auto& request_metrics = metrics.get_series("list_records", "appBenchmark");
+      request_metrics.requests.fetch_add(1, memory_order_relaxed);
+      for (size_t phase = 0; phase < static_cast<size_t>(RequestPhase::NUM_PHASES); phase++) {
+        request_metrics.record(static_cast<RequestPhase>(phase), (z * 7919) % 100000);
+      }
+      request_metrics.request_bytes.fetch_add(300, memory_order_relaxed);
+      request_metrics.response_body_bytes.fetch_add(50000, memory_order_relaxed);
+    }
+  };
+  auto run = [&](size_t num_threads) -> phosg::JSON {
+    double usecs = measure_usecs_per_call([&]() -> void {
+      vector<thread> threads;
+      for (size_t z = 1; z < num_threads; z++) {
+        threads.emplace_back(record_calls);
+      }
+      record_calls();
+      for (auto& t : threads) {
+        t.join();
+      }
+    });
+    return phosg::JSON::dict({
+        {"threads", num_threads},
+        {"nsecs_per_call", (usecs * 1000.0) / RECORDS_PER_CALL},
+    });
+  };
+
+  auto ret = phosg::JSON::dict({
+      {"record_call_1_thread", run(1)},
+      {"record_call_all_threads", run(max<size_t>(thread::hardware_concurrency(), 1))},
+  });
+
+  for (size_t z = 0; z < NUM_BASES; z++) {
+    for (const char* api_method : {"list_records", "get_record", "update_records"}) {
+      auto& request_metrics = metrics.get_series(api_method, make_airtable_id("app", z));
+      for (size_t phase = 0; phase < static_cast<size_t>(RequestPhase::NUM_PHASES); phase++) {
+        request_metrics.record(static_cast<RequestPhase>(phase), z * 100);
+      }
+    }
+  }
+  size_t prometheus_bytes = 0;
+  ret.emplace("snapshot_and_export_usecs", measure_usecs_per_call([&]() -> void {
+    prometheus_bytes = metrics.snapshot().to_prometheus().size();
+  }));
+  ret.emplace("export_series", NUM_BASES * 3 + 1);
+  ret.emplace("export_bytes", prometheus_bytes);
+  return ret;
+}
+
+// Records the spans that AirtableClient and AsyncHTTPClient record for one
+// API call that succeeds on the first try
+static void trace_api_call(Tracer* tracer) {
+  TraceSpan call_span(tracer, "list_records");
+  call_span.set_attribute("base_id", "appBenchmark");
+  call_span.set_attribute("table", "Table");
+  {
+    TraceSpan attempt_span(&call_span, "attempt");
+    attempt_span.set_attribute("try", static_cast<int64_t>(0));
+    attempt_span.set_attribute("http.method", "GET");
+    attempt_span.set_attribute("server.address", "api.airtable.com");
+    attempt_span.set_attribute("url.path", "/v0/appBenchmark/Table");
+    auto now = Tracer::clock::now();
+    attempt_span.add_child("resolve", now, now);
+    attempt_span.add_child("connect", now, now);
+    attempt_span.add_child("tls_handshake", now, now);
+    {
+      TraceSpan write_span(&attempt_span, "write");
+    }
+    {
+      TraceSpan read_headers_span(&attempt_span, "read_headers");
+    }
+    {
+      TraceSpan read_body_span(&attempt_span, "read_body");
+      read_body_span.set_attribute("bytes", static_cast<int64_t>(50000));
+    }
+    attempt_span.set_attribute("http.status_code", static_cast<int64_t>(200));
+  }
+  TraceSpan parse_span(&call_span, "parse");
+}
+
+static phosg::JSON bench_tracing() {
+  static constexpr size_t CALLS_PER_RUN = 10000;
+  static constexpr size_t SPANS_PER_CALL = 9;
+
+  auto run = [&](bool enabled, size_t num_threads) -> phosg::JSON {
+    // The tracer is cleared before each run and is large enough to hold all
+    // of the run's spans, so none are dropped. The time includes freeing the
+    // previous run's spans, which a real trace also pays when it's cleared.
+    Tracer tracer(CALLS_PER_RUN * SPANS_PER_CALL * num_threads);
+    Tracer* tracer_ptr = enabled ? &tracer : nullptr;
+    auto trace_calls = [&]() -> void {
+      for (size_t z = 0; z < CALLS_PER_RUN; z++) {
+        trace_api_call(tracer_ptr);
+      }
+    };
+    double usecs = measure_usecs_per_call([&]() -> void {
+      tracer.clear();
+      vector<thread> threads;
+      for (size_t z = 1; z < num_threads; z++) {
+        threads.emplace_back(trace_calls);
+      }
+      trace_calls();
+      for (auto& t : threads) {
+        t.join();
+      }
+    });
+    return phosg::JSON::dict({
+        {"threads", num_threads},
+        {"nsecs_per_call", (usecs * 1000.0) / CALLS_PER_RUN},
+    });
+  };
+
+  size_t num_threads = max<size_t>(thread::hardware_concurrency(), 1);
+  auto ret = phosg::JSON::dict({
+      {"spans_per_call", SPANS_PER_CALL},
+      {"disabled_1_thread", run(false, 1)},
+      {"enabled_1_thread", run(true, 1)},
+      {"enabled_all_threads", run(true, num_threads)},
+  });
+
+  Tracer tracer;
+  for (size_t z = 0; z < 1000; z++) {
+    trace_api_call(&tracer);
+  }
+  size_t chrome_bytes = 0;
+  size_t otlp_bytes = 0;
+  ret.emplace("export_spans", tracer.spans().size());
+  ret.emplace("chrome_export_usecs", measure_usecs_per_call([&]() -> void {
+    chrome_bytes = tracer.to_chrome_trace().size();
+  }));
+  ret.emplace("chrome_export_bytes", chrome_bytes);
+  ret.emplace("otlp_export_usecs", measure_usecs_per_call([&]() -> void {
+    otlp_bytes = tracer.to_otlp_json().size();
+  }));
+  ret.emplace("otlp_export_bytes", otlp_bytes);
+  return ret;
+}
+
+// End-to-end benchmarks: AirtableClient against a MockAirtableServer on the
+// loopback interface. These include everything a real API call does (TLS,
+// HTTP, and parsing on both ends), so they're the ones to check when a change
+// could affect more than one layer.
+
+// Adds a table with the synthetic schema to server, with num_records records
+// whose cells match make_synthetic_page's. Returns the records' IDs.
+static vector<string> add_synthetic_table(
+    MockAirtableServer& server,
+    const string& base_id,
+    const string& table_name,
+    size_t num_records,
+    const SyntheticTableSpec& spec) {
+  auto schema = make_synthetic_schema(spec);
+  vector<MockAirtableServer::FieldSpec> fields;
+  for (size_t field_index = 0; field_index < spec.num_fields; field_index++) {
+    const auto& field = schema.fields.at(make_airtable_id("fld", field_index));
+    fields.emplace_back(MockAirtableServer::FieldSpec{field.name, field.type});
+  }
+  server.add_table(base_id, table_name, fields);
+
+  vector<string> record_ids;
+  JSONWriter w;
+  for (size_t record_index = 0; record_index < num_records; record_index++) {
+    w.begin_object();
+    for (size_t field_index = 0; field_index < spec.num_fields; field_index++) {
+      w.write_key(synthetic_field_key(field_index, spec));
+      w.write_raw(make_synthetic_cell(field_index, record_index, spec).serialize());
+    }
+    w.end_object();
+    record_ids.emplace_back(server.add_record(base_id, table_name, w.take()));
+  }
+  return record_ids;
+}
+
+static asio::awaitable<size_t> scan_mock_table(
+    AirtableClient& client, const string& base_id, const string& table_name, const string& filter_formula, bool lazy) {
+  AirtableClient::ListRecordsOptions options;
+  options.filter_formula = filter_formula;
+  if (lazy) {
+    auto records = co_await client.list_lazy_records(base_id, table_name, &options);
+    co_return records.size();
+  }
+  auto records = co_await client.list_records(base_id, table_name, &options);
+  co_return records.size();
+}
+
+static asio::awaitable<void> create_mock_records(
+    AirtableClient& client,
+    const string& base_id,
+    const string& table_name,
+    const vector<unordered_map<string, shared_ptr<Field>>>& contents) {
+  auto record_ids = co_await client.create_records(base_id, table_name, contents);
+  if (record_ids.size() != contents.size()) {
+    throw logic_error("incorrect number of records created");
+  }
+}
+
+static asio::awaitable<void> create_all_mock_records(
+    AirtableClient& client,
+    const string& base_id,
+    const string& table_name,
+    const vector<vector<unordered_map<string, shared_ptr<Field>>>>& batches,
+    size_t concurrency) {
+  co_await parallel_for_each(batches, concurrency, [&](const auto& contents) -> asio::awaitable<void> {
+    return create_mock_records(client, base_id, table_name, contents);
+  });
+}
+
+static asio::awaitable<void> get_mock_record(
+    AirtableClient& client,
+    const string& base_id,
+    const string& table_name,
+    const string& record_id,
+    vector<double>& latency_usecs) {
+  auto start = chrono::steady_clock::now();
+  auto record = co_await client.get_record(base_id, table_name, record_id);
+  if (record_id != record.id) {
+    throw logic_error("incorrect record returned");
+  }
+  latency_usecs.emplace_back(chrono::duration<double, micro>(chrono::steady_clock::now() - start).count());
+}
+
+static asio::awaitable<void> get_all_mock_records(
+    AirtableClient& client,
+    const string& base_id,
+    const string& table_name,
+    const vector<string>& record_ids,
+    size_t concurrency,
+    vector<double>& latency_usecs) {
+  co_await parallel_for_each(record_ids, concurrency, [&](const string& record_id) -> asio::awaitable<void> {
+    return get_mock_record(client, base_id, table_name, record_id, latency_usecs);
+  });
+}
+
+static phosg::JSON run_end_to_end_workloads(const MockAirtableServer::Options& options) {
+  static constexpr size_t NUM_RECORDS = 2000;
+  static constexpr size_t NUM_CREATED_RECORDS = 1000;
+  static constexpr size_t RECORDS_PER_CREATE = 10;
+  static constexpr size_t CREATE_CONCURRENCY = 8;
+  static constexpr size_t NUM_LOOKUPS = 1000;
+  static constexpr size_t LOOKUP_CONCURRENCY = 16;
+
+  SyntheticTableSpec spec;
+  string base_id = make_airtable_id("app", 0);
+  string scanned_table_name = "Scanned";
+  string created_table_name = "Created";
+
+  // The server and client each get their own thread, so the server's work
+  // isn't counted against the client. The client has only one thread, so
+  // the lookups' latency vector doesn't need a lock.
+  IOThreadPool server_pool(1);
+  MockAirtableServer server(server_pool.get_io_context(), options);
+  server.add_base(base_id, "Benchmark");
+  auto record_ids = add_synthetic_table(server, base_id, scanned_table_name, NUM_RECORDS, spec);
+  add_synthetic_table(server, base_id, created_table_name, 0, spec);
+  server.start();
+
+  IOThreadPool client_pool(1);
+  AirtableClient client(client_pool.get_io_context(), "keyBenchmark", "127.0.0.1", server.port());
+  // The mock server's certificate is self-signed, so it can't be verified
+  client.get_ssl_context().set_verify_mode(asio::ssl::verify_none);
+
+  auto ret = phosg::JSON::dict({
+      {"latency_usecs", static_cast<int64_t>(chrono::duration_cast<chrono::microseconds>(options.latency).count())},
+      {"bytes_per_second", options.bytes_per_second},
+  });
+
+  auto bench_scan = [&](const string& filter_formula, bool lazy) -> phosg::JSON {
+    size_t num_returned = 0;
+    double usecs = measure_usecs_per_call([&]() -> void {
+      num_returned = client_pool.run_sync(scan_mock_table(client, base_id, scanned_table_name, filter_formula, lazy));
+    }, 3);
+    // The server reads every record to evaluate a filter, but the client
+    // only receives the matching ones, so records/s is for matching records
+    return phosg::JSON::dict({
+        {"records_returned", num_returned},
+        {"usecs_per_scan", usecs},
+        {"records_per_second", (num_returned * 1000000.0) / usecs},
+    });
+  };
+  ret.emplace("full_scan", bench_scan("", false));
+  ret.emplace("full_scan_lazy", bench_scan("", true));
+  ret.emplace("filtered_scan", bench_scan("AND({Quantity Ordered 2} >= 500, {Requires Manual Review 4})", false));
+
+  {
+    vector<vector<unordered_map<string, shared_ptr<Field>>>> batches;
+    for (size_t page_index = 0; page_index < NUM_CREATED_RECORDS / RECORDS_PER_CREATE; page_index++) {
+      string page = make_synthetic_page(RECORDS_PER_CREATE, page_index, spec);
+      auto& contents = batches.emplace_back();
+      for (const auto& record : parse_page_streaming(page, page.size())) {
+        contents.emplace_back(record.fields.to_map());
+      }
+    }
+    double usecs = measure_usecs_per_call([&]() -> void {
+      client_pool.run_sync(create_all_mock_records(client, base_id, created_table_name, batches, CREATE_CONCURRENCY));
+    }, 3);
+    ret.emplace("bulk_create", phosg::JSON::dict({
+        {"records", NUM_CREATED_RECORDS},
+        {"records_per_request", RECORDS_PER_CREATE},
+        {"concurrency", CREATE_CONCURRENCY},
+        {"records_per_second", (NUM_CREATED_RECORDS * 1000000.0) / usecs},
+    }));
+  }
+
+  {
+    vector<string> lookup_ids;
+    for (size_t z = 0; z < NUM_LOOKUPS; z++) {
+      lookup_ids.emplace_back(record_ids[(z * 7919) % record_ids.size()]);
+    }
+    vector<double> latency_usecs;
+    double usecs = measure_usecs_per_call([&]() -> void {
+      client_pool.run_sync(get_all_mock_records(client, base_id, scanned_table_name, lookup_ids, LOOKUP_CONCURRENCY, latency_usecs));
+    }, 3);
+    sort(latency_usecs.begin(), latency_usecs.end());
+    ret.emplace("point_lookups", phosg::JSON::dict({
+        {"records", NUM_LOOKUPS},
+        {"concurrency", LOOKUP_CONCURRENCY},
+        {"records_per_second", (NUM_LOOKUPS * 1000000.0) / usecs},
+        {"latency_usecs_p50", latency_usecs[latency_usecs.size() / 2]},
+        {"latency_usecs_p99", latency_usecs[(latency_usecs.size() * 99) / 100]},
+    }));
+  }
+
+  ret.emplace("server_requests", server.num_requests());
+  // The server's coroutines refer to it, so they must stop before it's
+  // destroyed
+  server_pool.stop();
+  server_pool.join();
+  return ret;
+}
+
+static phosg::JSON bench_end_to_end() {
+  // The WAN settings approximate a client in the same region as Airtable's
+  // servers: a 20ms round trip and 100Mbps of bandwidth
+  MockAirtableServer::Options wan_options;
+  wan_options.latency = chrono::milliseconds(20);
+  wan_options.bytes_per_second = 12500000;
+  return phosg::JSON::dict({
+      {"local", run_end_to_end_workloads(MockAirtableServer::Options())},
+      {"wan", run_end_to_end_workloads(wan_options)},
+  });
+}
+
+struct Benchmark {
+  const char* name;
+  const char* description;
+  function<phosg::JSON()> fn;
+};
+
+static const vector<Benchmark> BENCHMARKS = {
+    {"field-key-modes", "Response size and parse time per 100-record page, with fields keyed by name vs. by ID", bench_field_key_modes},
+    {"record-parsing", "Records/s and peak memory per 100-record page, parsing via a DOM vs. streaming directly into Records", bench_record_parsing},
+    {"record-writing", "Time and peak memory to build a 10-record create request body via a DOM vs. JSONWriter", bench_record_writing},
+    {"json-scan", "Streaming parse throughput on narrow and wide pages with each supported SIMD level", bench_json_scan},
+    {"schema-decoding", "Streaming parse throughput with cell types guessed from JSON shape vs. taken from the table schema", bench_schema_decoding},
+    {"typed-records", "Streaming parse throughput and memory decoding into Records vs. directly into a mapped struct", bench_typed_records},
+    {"compact-records", "Parse throughput, memory, and allocations per record for Records vs. CompactRecords", bench_compact_records},
+    {"record-batch", "Parse time, memory, and column scan time for a 2000-record table as Records vs. a columnar RecordBatch", bench_record_batch},
+    {"page-arena", "Parse-and-drop throughput and allocation counts per 100-record page with malloc vs. a page arena", bench_page_arena},
+    {"airtable-time", "Timestamps/s parsing and formatting Airtable times with libc (strptime/strftime) vs. the calendar-arithmetic codec", bench_airtable_time},
+    {"field-interning", "Resident memory and allocations per record for a 2000-record table with per-record field maps vs. interned field names, with and without a TableDecoder", bench_field_interning},
+    {"lazy-records", "Throughput and allocations per 100-record page for a scan that reads 2 of 30 fields, with Records vs. LazyRecords", bench_lazy_records},
+    {"io-thread-pool", "Records/s parsing 200 pages as concurrent coroutines on an IOThreadPool with 1 thread up to one per core", bench_io_thread_pool},
+    {"cpu-offload", "Records/s and timer wakeup latency on one I/O thread while parsing 100 pages on that thread vs. on a CPUThreadPool", bench_cpu_offload},
+    {"coroutine-frames", "Time and allocations per call for nested coroutines and for reading an HTTP response with a coroutine per line vs. buffered fast paths", bench_coroutine_frames},
+    {"loopback-http", "Requests/s, latency, and syscalls per request for 5000 HTTP requests (256 at once) to a server on the same io_context, with asio's configured backend (epoll or io_uring)", bench_loopback_http},
+    {"metrics", "Time to record one API call's metrics on one thread and on all threads at once, and to snapshot and export 151 series in Prometheus format", bench_metrics},
+    {"tracing", "Time to record one API call's 9 spans with tracing disabled and enabled, and to export 9000 spans as Chrome trace and OTLP JSON", bench_tracing},
+    {"end-to-end", "Records/s through AirtableClient against a local mock server, with no limits and with simulated WAN latency and bandwidth, for full scans, filtered scans, bulk creates, and point lookups", bench_end_to_end},
+};
+
+static void print_usage() {
+  fputs("\
+Usage: airtable-bench [BENCHMARK-NAME ...]\n\
+\n\
+Runs the given benchmarks (or all benchmarks, if none are given) and writes\n\
+the results to stdout as JSON. Available benchmarks:\n",
+      stderr);
+  for (const auto& bench : BENCHMARKS) {
+    fprintf(stderr, "  %s: %s\n", bench.name, bench.description);
+  }
+}
+
+int main(int argc, char** argv) {
+  vector<const Benchmark*> to_run;
+  for (int x = 1; x < argc; x++) {
+    if (!strcmp(argv[x], "--help")) {
+      print_usage();
+      return 0;
+    }
+    const Benchmark* found = nullptr;
+    for (const auto& bench : BENCHMARKS) {
+      if (!strcmp(bench.name, argv[x])) {
+        found = &bench;
+      }
+    }
+    if (!found) {
+      fprintf(stderr, "Unknown benchmark: %s\n", argv[x]);
+      print_usage();
+      return 1;
+    }
+    to_run.emplace_back(found);
+  }
+  if (to_run.empty()) {
+    for (const auto& bench : BENCHMARKS) {
+      to_run.emplace_back(&bench);
+    }
+  }
+
+  auto results = phosg::JSON::dict();
+  for (const auto* bench : to_run) {
+    fprintf(stderr, "Running %s...\n", bench->name);
+    results.emplace(bench->name, bench->fn());
+  }
+  phosg::fwritex(stdout, results.serialize(phosg::JSON::SerializeOption::FORMAT));
+  fputc('\n', stdout);
+  return 0;
+}
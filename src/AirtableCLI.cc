@@ -9,6 +9,7 @@
 #include <string>
 
 #include "AirtableClient.hh"
+#include "IOThreadPool.hh"
 
 using namespace std;
 
@@ -35,6 +36,13 @@ Commands:\n\
     --sort-field-desc=FIELD-NAME-OR-ID: Sort the returned records by this field\n\
         in descending order. May be given multiple times.\n\
     --view=NAME-OR-ID: Only return records that are visible in this view.\n\
+    --return-fields-by-id: Key each record's fields by field ID instead of by\n\
+        field name.\n\
+    --cell-format=string: Return all cell values as strings. Requires\n\
+        --time-zone and --user-locale.\n\
+    --time-zone=TZ: Time zone to use when formatting dates (e.g. UTC).\n\
+    --user-locale=LOCALE: Locale to use when formatting dates (e.g. en-us).\n\
+    --include-comment-count: Include each record's comment count.\n\
 \n\
   get-record BASE-ID TABLE-NAME-OR-ID RECORD-ID: Gets the contents of a\n\
     specific record.\n\
@@ -71,11 +79,14 @@ void write_json(const phosg::JSON& json) {
   fputc('\n', stdout);
 }
 
-void output_records_list(vector<Record> records) {
+void output_records_list(vector<Record> records, bool include_comment_count = false) {
   auto record_jsons = phosg::JSON::list();
   for (const auto& record : records) {
     auto record_json = record.json_for_update();
     record_json.emplace("creation_time", format_airtable_time(record.creation_time));
+    if (include_comment_count) {
+      record_json.emplace("comment_count", record.comment_count);
+    }
     record_jsons.emplace_back(std::move(record_json));
   }
   write_json(record_jsons);
@@ -129,6 +140,18 @@ asio::awaitable<void> run_command(asio::io_context& io_context, const string& ac
           list_records_options.sort_fields.emplace_back(make_pair(&argv[x][18], false));
         } else if (!strncmp(argv[x], "--view=", 7)) {
           list_records_options.view = &argv[x][7];
+        } else if (!strcmp(argv[x], "--return-fields-by-id")) {
+          list_records_options.return_fields_by_field_id = true;
+        } else if (!strcmp(argv[x], "--cell-format=string")) {
+          list_records_options.cell_format = AirtableClient::ListRecordsOptions::CellFormat::STRING;
+        } else if (!strcmp(argv[x], "--cell-format=json")) {
+          list_records_options.cell_format = AirtableClient::ListRecordsOptions::CellFormat::JSON;
+        } else if (!strncmp(argv[x], "--time-zone=", 12)) {
+          list_records_options.time_zone = &argv[x][12];
+        } else if (!strncmp(argv[x], "--user-locale=", 14)) {
+          list_records_options.user_locale = &argv[x][14];
+        } else if (!strcmp(argv[x], "--include-comment-count")) {
+          list_records_options.include_comment_count = true;
         } else {
           throw invalid_argument("unknown option");
         }
@@ -201,28 +224,7 @@ asio::awaitable<void> run_command(asio::io_context& io_context, const string& ac
 
         auto root_dict = phosg::JSON::dict();
         for (const auto& [table_name, table] : table_schemas) {
-
-          auto fields_dict = phosg::JSON::dict();
-          for (const auto& [field_name, field] : table.fields) {
-            auto field_dict = phosg::JSON::dict({{"name", field.name}, {"type", field.type}});
-            if (!field.options.is_null()) {
-              field_dict.insert("options", field.options);
-            }
-            fields_dict.emplace(field_name, std::move(field_dict));
-          }
-
-          auto views_dict = phosg::JSON::dict();
-          for (const auto& [view_name, view] : table.views) {
-            views_dict.emplace(view_name, phosg::JSON::dict({{"name", view.name}, {"type", view.type}}));
-          }
-
-          auto table_dict = phosg::JSON::dict({
-              {"name", table.name},
-              {"primary_field_id", table.primary_field_id},
-              {"fields", std::move(fields_dict)},
-              {"views", std::move(views_dict)},
-          });
-          root_dict.emplace(table_name, std::move(table_dict));
+          root_dict.emplace(table_name, table.to_json());
         }
         write_json(root_dict);
         break;
@@ -230,7 +232,7 @@ asio::awaitable<void> run_command(asio::io_context& io_context, const string& ac
 
       case Command::ListRecords: {
         auto records = co_await client.list_records(base_id, table_id, &list_records_options);
-        output_records_list(records);
+        output_records_list(records, list_records_options.include_comment_count);
         break;
       }
 
@@ -331,9 +333,8 @@ int main(int argc, char** argv) {
     return 1;
   }
 
-  asio::io_context io_context;
-  asio::co_spawn(io_context, run_command(io_context, access_token, argc, argv), asio::detached);
-  io_context.run();
+  IOThreadPool pool;
+  pool.run_sync(run_command(pool.get_io_context(), access_token, argc, argv));
 
   return 0;
 }
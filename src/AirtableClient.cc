@@ -3,18 +3,26 @@
 #include <inttypes.h>
 #include <stdio.h>
 
+#include <chrono>
 #include <format>
 #include <phosg/Network.hh>
 #include <phosg/Strings.hh>
 #include <stdexcept>
 
 #include "AsyncUtils.hh"
+#include "JSONReader.hh"
+#include "JSONWriter.hh"
+#include "RecordStreamParser.hh"
 
 using namespace std;
 
 AirtableClient::ListRecordsOptions::ListRecordsOptions()
     : max_records(0),
-      page_size(100) {}
+      page_size(100),
+      return_fields_by_field_id(false),
+      cell_format(CellFormat::JSON),
+      include_comment_count(false),
+      page_arena_size(0) {}
 
 AirtableClient::AirtableClient(
     asio::io_context& io_context,
@@ -24,34 +32,67 @@ AirtableClient::AirtableClient(
     : AsyncHTTPClient(io_context),
       access_token(access_token),
       hostname(api_domain),
-      port(api_port) {}
+      port(api_port),
+      field_name_interner(make_shared<StringInterner>()) {}
 
-asio::awaitable<phosg::JSON> AirtableClient::make_api_call(
+void AirtableClient::set_cpu_pool(shared_ptr<CPUThreadPool> pool) {
+  this->cpu_pool = std::move(pool);
+  if (this->metrics) {
+    this->metrics->cpu_pool_threads = this->cpu_pool ? this->cpu_pool->num_threads() : 0;
+  }
+}
+
+void AirtableClient::set_metrics(shared_ptr<ClientMetrics> metrics) {
+  this->AsyncHTTPClient::set_metrics(std::move(metrics));
+  if (this->metrics) {
+    this->metrics->cpu_pool_threads = this->cpu_pool ? this->cpu_pool->num_threads() : 0;
+  }
+}
+
+AirtableClient::ApiCallContext::ApiCallContext(
+    AirtableClient* client, const char* api_method, const string& base_id, const string& table_name)
+    : metrics(client->metrics ? &client->metrics->get_series(api_method, base_id) : nullptr),
+      span(client->tracer.get(), api_method) {
+  if (!base_id.empty()) {
+    this->span.set_attribute("base_id", base_id);
+  }
+  if (!table_name.empty()) {
+    this->span.set_attribute("table", table_name);
+  }
+}
+
+asio::awaitable<HTTPResponse> AirtableClient::make_raw_api_call(
+    ApiCallContext& call,
     HTTPRequest::Method method,
     string&& path,
     unordered_multimap<string, string>&& query_params,
-    const phosg::JSON* json,
-    bool parse_response) {
+    string&& json_data,
+    const BodyDataCallback* on_body_data) {
+  HTTPRequest req;
+  req.method = method;
+  req.https = true;
+  req.domain = this->hostname;
+  req.port = this->port;
+  req.path = std::move(path);
+  req.query_params = std::move(query_params);
+  req.http_version = "HTTP/1.1";
+  req.headers.emplace("Host", this->hostname);
+  req.headers.emplace("Authorization", "Bearer " + this->access_token);
+  req.headers.emplace("Connection", "close"); // TODO: Support keep-alive
+  if (!json_data.empty()) {
+    req.headers.emplace("Content-Type", "application/json");
+    req.data = std::move(json_data);
+  }
 
   // TODO: Make try count configurable
   for (size_t try_num = 0; try_num < 3; try_num++) {
-    HTTPRequest req;
-    req.method = method;
-    req.https = true;
-    req.domain = this->hostname;
-    req.port = this->port;
-    req.path = std::move(path);
-    req.query_params = std::move(query_params);
-    req.http_version = "HTTP/1.1";
-    req.headers.emplace("Host", this->hostname);
-    req.headers.emplace("Authorization", "Bearer " + this->access_token);
-    req.headers.emplace("Connection", "close"); // TODO: Support keep-alive
-    if (json) {
-      req.headers.emplace("Content-Type", "application/json");
-      req.data = json->serialize();
+    if ((try_num > 0) && call.metrics) {
+      call.metrics->retries.fetch_add(1, memory_order_relaxed);
     }
-
-    auto resp = co_await this->make_request(req);
+    TraceSpan attempt_span(&call.span, "attempt");
+    attempt_span.set_attribute("try", static_cast<int64_t>(try_num));
+    auto resp = co_await this->make_request(req, on_body_data, call.metrics, &attempt_span);
+    attempt_span.end();
 
     if ((resp.response_code >= 500) && (resp.response_code <= 599)) {
       // 0 means some non-HTTP error occurred, like connect() failed or SSL
@@ -65,6 +106,7 @@ asio::awaitable<phosg::JSON> AirtableClient::make_api_call(
       // caller like all other client (4xx) error codes.
       // TODO: We probably should make this configurable; callers may not want
       // to wait this long.
+      TraceSpan wait_span(&call.span, "retry_wait");
       co_await async_sleep(std::chrono::seconds(30));
       continue;
 
@@ -72,17 +114,32 @@ asio::awaitable<phosg::JSON> AirtableClient::make_api_call(
       throw runtime_error(std::format("API returned HTTP {}", resp.response_code));
     }
 
-    if (parse_response) {
-      co_return phosg::JSON::parse(resp.data);
-    } else {
-      co_return nullptr; // Becomes JSON null
-    }
+    co_return resp;
   }
   throw runtime_error("Failed to make API call after 3 tries");
 }
 
+asio::awaitable<phosg::JSON> AirtableClient::make_api_call(
+    ApiCallContext& call,
+    HTTPRequest::Method method,
+    string&& path,
+    unordered_multimap<string, string>&& query_params,
+    string&& json_data,
+    bool parse_response) {
+  auto resp = co_await this->make_raw_api_call(
+      call, method, std::move(path), std::move(query_params), std::move(json_data));
+  if (parse_response) {
+    co_return co_await this->run_cpu_work(call, [&]() -> phosg::JSON {
+      return phosg::JSON::parse(resp.data);
+    });
+  } else {
+    co_return nullptr; // Becomes JSON null
+  }
+}
+
 asio::awaitable<vector<BaseInfo>> AirtableClient::list_bases() {
-  auto response_json = co_await this->make_api_call(HTTPRequest::Method::GET, "/v0/meta/bases");
+  ApiCallContext call(this, "list_bases", "");
+  auto response_json = co_await this->make_api_call(call, HTTPRequest::Method::GET, "/v0/meta/bases");
 
   vector<BaseInfo> ret;
   for (const auto& base_json : response_json.at("bases").as_list()) {
@@ -96,7 +153,9 @@ asio::awaitable<vector<BaseInfo>> AirtableClient::list_bases() {
 }
 
 asio::awaitable<unordered_map<string, TableSchema>> AirtableClient::get_base_schema(const string& base_id) {
-  auto response_json = co_await this->make_api_call(HTTPRequest::Method::GET, "/v0/meta/bases/" + base_id + "/tables");
+  ApiCallContext call(this, "get_base_schema", base_id);
+  auto response_json = co_await this->make_api_call(
+      call, HTTPRequest::Method::GET, "/v0/meta/bases/" + base_id + "/tables");
 
   unordered_map<string, TableSchema> ret;
   for (const auto& table_json : response_json.at("tables").as_list()) {
@@ -122,11 +181,8 @@ asio::awaitable<unordered_map<string, TableSchema>> AirtableClient::get_base_sch
   co_return ret;
 }
 
-asio::awaitable<pair<vector<Record>, string>> AirtableClient::list_records_page(
-    const string& base_id,
-    const string& table_name,
-    const ListRecordsOptions* options,
-    const string& offset) {
+unordered_multimap<string, string> AirtableClient::list_records_query_params(
+    const ListRecordsOptions* options, const string& offset) {
   if (!options) {
     static const ListRecordsOptions default_options;
     options = &default_options;
@@ -153,25 +209,93 @@ asio::awaitable<pair<vector<Record>, string>> AirtableClient::list_records_page(
   if (!options->view.empty()) {
     query_params.emplace("view", options->view);
   }
+  if (options->return_fields_by_field_id) {
+    query_params.emplace("returnFieldsByFieldId", "true");
+  }
+  if (options->cell_format == ListRecordsOptions::CellFormat::STRING) {
+    if (options->time_zone.empty() || options->user_locale.empty()) {
+      throw invalid_argument("time_zone and user_locale are required when cell_format is STRING");
+    }
+    query_params.emplace("cellFormat", "string");
+  }
+  if (!options->time_zone.empty()) {
+    query_params.emplace("timeZone", options->time_zone);
+  }
+  if (!options->user_locale.empty()) {
+    query_params.emplace("userLocale", options->user_locale);
+  }
+  if (options->include_comment_count) {
+    query_params.emplace("recordMetadata[]", "commentCount");
+  }
   if (!offset.empty()) {
     query_params.emplace("offset", offset);
   }
+  return query_params;
+}
 
-  auto response_json = co_await this->make_api_call(HTTPRequest::Method::GET, "/v0/" + base_id + "/" + table_name, std::move(query_params));
-
-  const auto& record_jsons = response_json.at("records").as_list();
-  vector<Record> ret;
-  for (const auto& record_json : record_jsons) {
-    ret.emplace_back(*record_json);
+asio::awaitable<void> AirtableClient::stream_records_page(
+    const string& base_id,
+    const string& table_name,
+    const ListRecordsOptions* options,
+    const string& offset,
+    RecordStreamParser& parser) {
+  ApiCallContext call(this, "list_records", base_id, table_name);
+  if (this->cpu_pool) {
+    // The response is parsed on the CPU pool after it's received, so the
+    // io_context's thread only has to read it
+    auto resp = co_await this->make_raw_api_call(
+        call,
+        HTTPRequest::Method::GET,
+        "/v0/" + base_id + "/" + table_name,
+        this->list_records_query_params(options, offset));
+    co_await this->run_cpu_work(call, [&]() -> void {
+      parser.feed(resp.data);
+      parser.finish();
+    });
+
+  } else {
+    // The response is parsed as it arrives, so parsing overlaps with reading.
+    // The time spent in the parser is still measured, so it can be recorded
+    // separately from the transfer time.
+    chrono::steady_clock::duration parse_time{};
+    BodyDataCallback on_body_data = [&parser, &parse_time](const char* data, size_t size) -> void {
+      auto start = chrono::steady_clock::now();
+      parser.feed(data, size);
+      parse_time += chrono::steady_clock::now() - start;
+    };
+    co_await this->make_raw_api_call(
+        call,
+        HTTPRequest::Method::GET,
+        "/v0/" + base_id + "/" + table_name,
+        this->list_records_query_params(options, offset),
+        "",
+        &on_body_data);
+    auto start = chrono::steady_clock::now();
+    parser.finish();
+    if (call.metrics || call.span.active()) {
+      parse_time += chrono::steady_clock::now() - start;
+      uint64_t parse_usecs = chrono::duration_cast<chrono::microseconds>(parse_time).count();
+      if (call.metrics) {
+        call.metrics->record(RequestPhase::PARSE, parse_usecs);
+      }
+      call.span.set_attribute("parse_usecs", static_cast<int64_t>(parse_usecs));
+    }
   }
+}
 
-  string next_offset;
-  try {
-    next_offset = response_json.at("offset").as_string();
-  } catch (const out_of_range&) {
+asio::awaitable<pair<vector<Record>, string>> AirtableClient::list_records_page(
+    const string& base_id,
+    const string& table_name,
+    const ListRecordsOptions* options,
+    const string& offset) {
+  if (!options) {
+    static const ListRecordsOptions default_options;
+    options = &default_options;
   }
-
-  co_return make_pair(std::move(ret), std::move(next_offset));
+  auto arena = options->page_arena_size ? make_shared<PageArena>(options->page_arena_size) : nullptr;
+  RecordStreamParser parser(options->decoder.get(), std::move(arena), this->field_name_interner);
+  co_await this->stream_records_page(base_id, table_name, options, offset, parser);
+  co_return make_pair(parser.take_records(), parser.get_offset());
 }
 
 asio::awaitable<vector<Record>> AirtableClient::list_records(
@@ -187,9 +311,94 @@ asio::awaitable<vector<Record>> AirtableClient::list_records(
   co_return ret;
 };
 
+asio::awaitable<pair<vector<LazyRecord>, string>> AirtableClient::list_lazy_records_page(
+    const string& base_id,
+    const string& table_name,
+    const ListRecordsOptions* options,
+    const string& offset) {
+  // Unlike the other list functions, this doesn't parse the response as it
+  // arrives, since the records refer to the complete response buffer
+  ApiCallContext call(this, "list_records", base_id, table_name);
+  auto resp = co_await this->make_raw_api_call(
+      call,
+      HTTPRequest::Method::GET,
+      "/v0/" + base_id + "/" + table_name,
+      this->list_records_query_params(options, offset));
+  co_return co_await this->run_cpu_work(call, [&]() -> pair<vector<LazyRecord>, string> {
+    return LazyRecord::parse_page(
+        make_shared<const string>(std::move(resp.data)),
+        options ? options->decoder : nullptr,
+        this->field_name_interner);
+  });
+}
+
+asio::awaitable<vector<LazyRecord>> AirtableClient::list_lazy_records(
+    const string& base_id, const string& table_name, const ListRecordsOptions* options) {
+  vector<LazyRecord> ret;
+  string offset;
+  do {
+    auto page_ret = co_await this->list_lazy_records_page(base_id, table_name, options, offset);
+    ret.insert(ret.end(), make_move_iterator(page_ret.first.begin()), make_move_iterator(page_ret.first.end()));
+    offset = std::move(page_ret.second);
+  } while (!offset.empty());
+  co_return ret;
+}
+
+asio::awaitable<pair<vector<CompactRecord>, string>> AirtableClient::list_compact_records_page(
+    const string& base_id,
+    const string& table_name,
+    const ListRecordsOptions* options,
+    shared_ptr<FieldDictionary> dictionary,
+    const string& offset) {
+  vector<CompactRecord> records;
+  RecordStreamParser parser([&](JSONReader& r) -> void {
+    records.emplace_back(r, dictionary);
+  });
+  co_await this->stream_records_page(base_id, table_name, options, offset, parser);
+  co_return make_pair(std::move(records), parser.get_offset());
+}
+
+asio::awaitable<vector<CompactRecord>> AirtableClient::list_compact_records(
+    const string& base_id,
+    const string& table_name,
+    const ListRecordsOptions* options,
+    shared_ptr<FieldDictionary> dictionary) {
+  vector<CompactRecord> records;
+  RecordStreamParser parser([&](JSONReader& r) -> void {
+    records.emplace_back(r, dictionary);
+  });
+  string offset;
+  do {
+    co_await this->stream_records_page(base_id, table_name, options, offset, parser);
+    offset = parser.get_offset();
+    parser.reset();
+  } while (!offset.empty());
+  co_return records;
+}
+
+asio::awaitable<RecordBatch> AirtableClient::list_records_batch(
+    const string& base_id, const string& table_name, const ListRecordsOptions* options) {
+  RecordBatch batch;
+  RecordStreamParser parser([&batch](JSONReader& r) -> void {
+    batch.append_record(r);
+  });
+  string offset;
+  do {
+    co_await this->stream_records_page(base_id, table_name, options, offset, parser);
+    offset = parser.get_offset();
+    parser.reset();
+  } while (!offset.empty());
+  co_return batch;
+}
+
 asio::awaitable<Record> AirtableClient::get_record(const string& base_id, const string& table_name, const string& record_id) {
-  auto response_json = co_await this->make_api_call(HTTPRequest::Method::GET, "/v0/" + base_id + "/" + table_name + "/" + record_id);
-  co_return Record(response_json);
+  ApiCallContext call(this, "get_record", base_id, table_name);
+  auto resp = co_await this->make_raw_api_call(
+      call, HTTPRequest::Method::GET, "/v0/" + base_id + "/" + table_name + "/" + record_id);
+  ScopedPhaseTimer parse_timer(call.metrics, RequestPhase::PARSE);
+  TraceSpan parse_span(&call.span, "parse");
+  JSONReader r(resp.data);
+  co_return Record(r, nullptr, nullptr, this->field_name_interner);
 }
 
 asio::awaitable<vector<string>> AirtableClient::create_records(
@@ -197,13 +406,25 @@ asio::awaitable<vector<string>> AirtableClient::create_records(
     const string& table_name,
     const vector<unordered_map<string, shared_ptr<Field>>>& contents,
     bool parse_response) {
-  auto record_jsons = phosg::JSON::list();
+  JSONWriter w;
+  w.begin_object();
+  w.write_key("records");
+  w.begin_array();
   for (const auto& it : contents) {
-    record_jsons.emplace_back(Record::json_for_create(it));
+    Record::write_json_for_create(w, it);
   }
-  auto root_json = phosg::JSON::dict({{"records", std::move(record_jsons)}});
+  w.end_array();
+  w.end_object();
 
-  auto response_json = co_await this->make_api_call(HTTPRequest::Method::POST, "/v0/" + base_id + "/" + table_name, {}, &root_json, parse_response);
+  ApiCallContext call(this, "create_records", base_id, table_name);
+  call.span.set_attribute("records", static_cast<int64_t>(contents.size()));
+  auto response_json = co_await this->make_api_call(
+      call,
+      HTTPRequest::Method::POST,
+      "/v0/" + base_id + "/" + table_name,
+      {},
+      w.take(),
+      parse_response);
 
   vector<string> ret;
   if (parse_response) {
@@ -221,24 +442,27 @@ asio::awaitable<vector<Record>> AirtableClient::update_records(
     const unordered_map<string, unordered_map<string, shared_ptr<Field>>>& contents,
     bool parse_response) {
 
-  auto records = phosg::JSON::list();
+  JSONWriter w;
+  w.begin_object();
+  w.write_key("records");
+  w.begin_array();
   for (const auto& it : contents) {
-    auto json = Record::json_for_create(it.second);
-    json.emplace("id", it.first);
-    records.emplace_back(std::move(json));
+    Record::write_json_for_update(w, it.first, it.second);
   }
-  auto root_json = phosg::JSON::dict({{"records", std::move(records)}});
+  w.end_array();
+  w.end_object();
 
-  auto response_json = co_await this->make_api_call(HTTPRequest::Method::PATCH, "/v0/" + base_id + "/" + table_name, {}, &root_json, parse_response);
+  ApiCallContext call(this, "update_records", base_id, table_name);
+  call.span.set_attribute("records", static_cast<int64_t>(contents.size()));
+  auto resp = co_await this->make_raw_api_call(
+      call, HTTPRequest::Method::PATCH, "/v0/" + base_id + "/" + table_name, {}, w.take());
 
-  vector<Record> ret;
-  if (parse_response) {
-    const auto& records = response_json.at("records").as_list();
-    for (const auto& record_json : records) {
-      ret.emplace_back(*record_json);
-    }
+  if (!parse_response) {
+    co_return vector<Record>();
   }
-  co_return ret;
+  co_return co_await this->run_cpu_work(call, [&]() -> vector<Record> {
+    return RecordStreamParser::parse(resp.data, nullptr, nullptr, this->field_name_interner).first;
+  });
 }
 
 asio::awaitable<unordered_map<string, bool>> AirtableClient::delete_records(
@@ -249,8 +473,15 @@ asio::awaitable<unordered_map<string, bool>> AirtableClient::delete_records(
     query_params.emplace("records[]", record_id);
   }
 
+  ApiCallContext call(this, "delete_records", base_id, table_name);
+  call.span.set_attribute("records", static_cast<int64_t>(record_ids.size()));
   auto response_json = co_await this->make_api_call(
-      HTTPRequest::Method::DELETE, "/v0/" + base_id + "/" + table_name, std::move(query_params), nullptr, parse_response);
+      call,
+      HTTPRequest::Method::DELETE,
+      "/v0/" + base_id + "/" + table_name,
+      std::move(query_params),
+      "",
+      parse_response);
 
   unordered_map<string, bool> ret;
   if (parse_response) {
@@ -8,8 +8,23 @@
 #include <unordered_map>
 
 #include "AsyncHTTPClient.hh"
+#include "CPUThreadPool.hh"
+#include "CompactRecord.hh"
 #include "FieldTypes.hh"
+#include "JSONReader.hh"
+#include "JSONWriter.hh"
+#include "LazyRecord.hh"
+#include "Metrics.hh"
+#include "RecordBatch.hh"
+#include "RecordStreamParser.hh"
+#include "StringInterner.hh"
+#include "TableDecoder.hh"
+#include "Tracing.hh"
+#include "TypedRecords.hh"
 
+// Like AsyncHTTPClient, an AirtableClient may be shared by coroutines running
+// on multiple threads (see IOThreadPool); its only shared mutable state is the
+// field name interner, which is thread-safe.
 class AirtableClient : public AsyncHTTPClient {
 public:
   AirtableClient() = delete;
@@ -36,12 +51,34 @@ public:
   asio::awaitable<std::unordered_map<std::string, TableSchema>> get_base_schema(const std::string& base_id);
 
   struct ListRecordsOptions {
+    enum class CellFormat {
+      JSON = 0,
+      STRING, // Requires time_zone and user_locale to be set
+    };
+
     std::vector<std::string> fields; // if empty, get all fields
     std::string filter_formula; // if empty, omit from request
     size_t max_records; // if zero, no limit
     size_t page_size; // cannot be zero; default is 100
     std::vector<std::pair<std::string, bool>> sort_fields; // (field_name, ascending) pairs
     std::string view; // name or id
+    // If true, the returned records' fields maps are keyed by field ID instead
+    // of field name. IDs are much shorter than most names, so this reduces the
+    // response size for tables with many fields.
+    bool return_fields_by_field_id;
+    CellFormat cell_format;
+    std::string time_zone; // if empty, omit from request
+    std::string user_locale; // if empty, omit from request
+    // If true, Record::comment_count is populated
+    bool include_comment_count;
+    // If not null, cells are decoded according to the table's schema instead
+    // of by guessing their types (see TableDecoder). The decoder must have
+    // been created with key_by_field_id matching return_fields_by_field_id.
+    std::shared_ptr<const TableDecoder> decoder;
+    // If not zero, each page's Fields are allocated from a PageArena with
+    // this initial size, so they're freed all at once when the last record
+    // (or Field) from the page is destroyed
+    size_t page_arena_size;
 
     ListRecordsOptions();
   };
@@ -58,6 +95,39 @@ public:
   // Like list_records_page, but automatically reads all pages.
   asio::awaitable<std::vector<Record>> list_records(const std::string& base_id, const std::string& table_name, const ListRecordsOptions* options);
 
+  // Like list_records_page and list_records, but return LazyRecords, which
+  // decode each cell only when it's first accessed. Each page's response body
+  // is kept in memory until all of its records are destroyed.
+  // ListRecordsOptions::page_arena_size is ignored.
+  asio::awaitable<std::pair<std::vector<LazyRecord>, std::string>> list_lazy_records_page(
+      const std::string& base_id,
+      const std::string& table_name,
+      const ListRecordsOptions* options,
+      const std::string& offset = "");
+  asio::awaitable<std::vector<LazyRecord>> list_lazy_records(
+      const std::string& base_id, const std::string& table_name, const ListRecordsOptions* options);
+
+  // Like list_records_page and list_records, but return CompactRecords, which
+  // use much less memory for large tables. New field names are added to the
+  // given dictionary, which should be shared by all records from the table.
+  // ListRecordsOptions::decoder is ignored.
+  asio::awaitable<std::pair<std::vector<CompactRecord>, std::string>> list_compact_records_page(
+      const std::string& base_id,
+      const std::string& table_name,
+      const ListRecordsOptions* options,
+      std::shared_ptr<FieldDictionary> dictionary,
+      const std::string& offset = "");
+  asio::awaitable<std::vector<CompactRecord>> list_compact_records(
+      const std::string& base_id,
+      const std::string& table_name,
+      const ListRecordsOptions* options,
+      std::shared_ptr<FieldDictionary> dictionary);
+
+  // Like list_records, but returns all records in a single column-oriented
+  // batch (see RecordBatch). ListRecordsOptions::decoder is ignored.
+  asio::awaitable<RecordBatch> list_records_batch(
+      const std::string& base_id, const std::string& table_name, const ListRecordsOptions* options);
+
   // Gets the contents of a single record.
   asio::awaitable<Record> get_record(const std::string& base_id, const std::string& table_name, const std::string& record_id);
 
@@ -85,15 +155,238 @@ public:
       const std::vector<std::string>& record_ids,
       bool parse_response = true);
 
+  // Typed versions of the above functions, which read and write rows of a
+  // user-defined struct directly instead of Records (see TypedRecords.hh). For
+  // the list functions, if options->fields is empty, only the fields bound in
+  // RowT's mapping are requested. create_records returns the created rows,
+  // with their IDs filled in if RowT's mapping has an id member.
+  template <MappedRecord RowT>
+  asio::awaitable<std::pair<std::vector<RowT>, std::string>> list_records_page(
+      const std::string& base_id,
+      const std::string& table_name,
+      const ListRecordsOptions* options,
+      const std::string& offset = "") {
+    auto mapped_options = this->options_for_mapped_record<RowT>(options);
+    std::vector<RowT> rows;
+    auto next_offset = co_await this->read_mapped_records_page(base_id, table_name, &mapped_options, offset, rows);
+    co_return std::make_pair(std::move(rows), std::move(next_offset));
+  }
+
+  template <MappedRecord RowT>
+  asio::awaitable<std::vector<RowT>> list_records(
+      const std::string& base_id, const std::string& table_name, const ListRecordsOptions* options) {
+    auto mapped_options = this->options_for_mapped_record<RowT>(options);
+    std::vector<RowT> rows;
+    std::string offset;
+    do {
+      offset = co_await this->read_mapped_records_page(base_id, table_name, &mapped_options, offset, rows);
+    } while (!offset.empty());
+    co_return rows;
+  }
+
+  template <MappedRecord RowT>
+  asio::awaitable<RowT> get_record(const std::string& base_id, const std::string& table_name, const std::string& record_id) {
+    ApiCallContext call(this, "get_record", base_id, table_name);
+    auto resp = co_await this->make_raw_api_call(
+        call, HTTPRequest::Method::GET, "/v0/" + base_id + "/" + table_name + "/" + record_id);
+    ScopedPhaseTimer parse_timer(call.metrics, RequestPhase::PARSE);
+    TraceSpan parse_span(&call.span, "parse");
+    JSONReader r(resp.data);
+    co_return read_mapped_record<RowT>(r);
+  }
+
+  template <MappedRecord RowT>
+  asio::awaitable<std::vector<RowT>> create_records(
+      const std::string& base_id,
+      const std::string& table_name,
+      const std::vector<RowT>& rows,
+      bool parse_response = true) {
+    JSONWriter w;
+    w.begin_object();
+    w.write_key("records");
+    w.begin_array();
+    for (const auto& row : rows) {
+      write_mapped_record_for_create(w, row);
+    }
+    w.end_array();
+    w.end_object();
+
+    ApiCallContext call(this, "create_records", base_id, table_name);
+    call.span.set_attribute("records", static_cast<int64_t>(rows.size()));
+    auto resp = co_await this->make_raw_api_call(
+        call, HTTPRequest::Method::POST, "/v0/" + base_id + "/" + table_name, {}, w.take());
+    if (!parse_response) {
+      co_return std::vector<RowT>();
+    }
+    co_return co_await this->run_cpu_work(call, [&]() -> std::vector<RowT> {
+      return this->parse_mapped_records<RowT>(resp.data);
+    });
+  }
+
+  template <MappedRecordWithID RowT>
+  asio::awaitable<std::vector<RowT>> update_records(
+      const std::string& base_id,
+      const std::string& table_name,
+      const std::vector<RowT>& rows,
+      bool parse_response = true) {
+    JSONWriter w;
+    w.begin_object();
+    w.write_key("records");
+    w.begin_array();
+    for (const auto& row : rows) {
+      write_mapped_record_for_update(w, row);
+    }
+    w.end_array();
+    w.end_object();
+
+    ApiCallContext call(this, "update_records", base_id, table_name);
+    call.span.set_attribute("records", static_cast<int64_t>(rows.size()));
+    auto resp = co_await this->make_raw_api_call(
+        call, HTTPRequest::Method::PATCH, "/v0/" + base_id + "/" + table_name, {}, w.take());
+    if (!parse_response) {
+      co_return std::vector<RowT>();
+    }
+    co_return co_await this->run_cpu_work(call, [&]() -> std::vector<RowT> {
+      return this->parse_mapped_records<RowT>(resp.data);
+    });
+  }
+
+  // The field names of all Records returned by this client are interned here,
+  // so each distinct name is stored only once (see RecordFields)
+  inline const std::shared_ptr<StringInterner>& get_field_name_interner() const {
+    return this->field_name_interner;
+  }
+
+  // If a CPU pool is set, response bodies are parsed and records are decoded
+  // on it instead of on the io_context's thread, so other requests' network
+  // I/O isn't blocked while a large page is parsed, and multiple pages can be
+  // parsed in parallel. In this mode, list responses are received completely
+  // before parsing begins rather than parsed as they arrive. (Single-record
+  // responses from get_record are still parsed in place, since they're too
+  // small for the hand-off to be worthwhile.) The pool may be shared by
+  // multiple clients. This must not be changed while any requests are in
+  // progress.
+  void set_cpu_pool(std::shared_ptr<CPUThreadPool> pool);
+  inline const std::shared_ptr<CPUThreadPool>& get_cpu_pool() const {
+    return this->cpu_pool;
+  }
+
+  // Metrics (see AsyncHTTPClient::set_metrics) are broken down by API method
+  // (list_records, get_record, create_records, update_records,
+  // delete_records, list_bases, or get_base_schema) and by base ID. In
+  // addition to the HTTP-level metrics, the client records the time spent
+  // parsing each response and the number of retries. All of the list
+  // functions count as list_records.
+  //
+  // When tracing is enabled (see AsyncHTTPClient::set_tracer), each API call
+  // is traced as a root span named after its API method, with child spans for
+  // each attempt (whose children are the HTTP request's steps), each wait
+  // before retrying, and parsing the response. When a page of records is
+  // parsed as it arrives, the parsing time is recorded in the API call span's
+  // parse_usecs attribute instead, since it overlaps with reading the body.
+  virtual void set_metrics(std::shared_ptr<ClientMetrics> metrics);
+
 private:
+  // The metrics series and trace span for an API call. metrics is null if
+  // metrics are disabled, and span is inactive if tracing is disabled.
+  struct ApiCallContext {
+    RequestMetrics* metrics;
+    TraceSpan span;
+
+    ApiCallContext(
+        AirtableClient* client,
+        const char* api_method,
+        const std::string& base_id,
+        const std::string& table_name = "");
+  };
+
+  // Makes an API call, retrying if needed, and returns the raw response. If
+  // json_data is not empty, it's sent as the request body. If on_body_data is
+  // given, the response body is passed to it as it arrives instead of being
+  // stored in the returned response. The call's metrics and spans are
+  // recorded in call.
+  asio::awaitable<HTTPResponse> make_raw_api_call(
+      ApiCallContext& call,
+      HTTPRequest::Method method,
+      std::string&& path,
+      std::unordered_multimap<std::string, std::string>&& query_params = {},
+      std::string&& json_data = "",
+      const BodyDataCallback* on_body_data = nullptr);
   asio::awaitable<phosg::JSON> make_api_call(
+      ApiCallContext& call,
       HTTPRequest::Method method,
       std::string&& path,
       std::unordered_multimap<std::string, std::string>&& query_params = {},
-      const phosg::JSON* json = nullptr,
+      std::string&& json_data = "",
       bool parse_response = true);
 
+  // Runs fn on the CPU pool if one is set, or directly otherwise. The time fn
+  // takes is recorded as parsing time in call's metrics and as a parse span.
+  template <typename FnT, typename ResultT = std::invoke_result_t<FnT&>>
+  asio::awaitable<ResultT> run_cpu_work(ApiCallContext& call, FnT fn) {
+    auto timed_fn = [&fn, &call]() -> ResultT {
+      ScopedPhaseTimer parse_timer(call.metrics, RequestPhase::PARSE);
+      TraceSpan parse_span(&call.span, "parse");
+      return fn();
+    };
+    if (this->cpu_pool) {
+      co_return co_await this->cpu_pool->async_run(std::move(timed_fn));
+    } else {
+      co_return timed_fn();
+    }
+  }
+
+  static std::unordered_multimap<std::string, std::string> list_records_query_params(
+      const ListRecordsOptions* options, const std::string& offset);
+  // Requests a page of records and passes the response to parser as it
+  // arrives. The offset for the next page is available from the parser
+  // afterward.
+  asio::awaitable<void> stream_records_page(
+      const std::string& base_id,
+      const std::string& table_name,
+      const ListRecordsOptions* options,
+      const std::string& offset,
+      RecordStreamParser& parser);
+
+  template <MappedRecord RowT>
+  static ListRecordsOptions options_for_mapped_record(const ListRecordsOptions* options) {
+    ListRecordsOptions ret = options ? *options : ListRecordsOptions();
+    if (ret.fields.empty()) {
+      ret.fields = mapped_field_names<RowT>();
+    }
+    return ret;
+  }
+
+  // Reads a page of records, appending them to rows. Returns the offset for
+  // the next page.
+  template <MappedRecord RowT>
+  asio::awaitable<std::string> read_mapped_records_page(
+      const std::string& base_id,
+      const std::string& table_name,
+      const ListRecordsOptions* options,
+      const std::string& offset,
+      std::vector<RowT>& rows) {
+    RecordStreamParser parser([&rows](JSONReader& r) -> void {
+      read_mapped_record(r, rows.emplace_back());
+    });
+    co_await this->stream_records_page(base_id, table_name, options, offset, parser);
+    co_return parser.get_offset();
+  }
+
+  template <MappedRecord RowT>
+  static std::vector<RowT> parse_mapped_records(const std::string& data) {
+    std::vector<RowT> ret;
+    RecordStreamParser parser([&ret](JSONReader& r) -> void {
+      read_mapped_record(r, ret.emplace_back());
+    });
+    parser.feed(data);
+    parser.finish();
+    return ret;
+  }
+
   std::string access_token;
   std::string hostname;
   uint16_t port;
+  std::shared_ptr<StringInterner> field_name_interner;
+  std::shared_ptr<CPUThreadPool> cpu_pool;
 };
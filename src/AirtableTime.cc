@@ -0,0 +1,165 @@
+#include "AirtableTime.hh"
+
+#include <stdexcept>
+
+using namespace std;
+
+// Day counts are relative to 1970-01-01. These use the era-based algorithms
+// from Howard Hinnant's "chrono-Compatible Low-Level Date Algorithms", which
+// need no tables or loops.
+static inline int64_t days_from_civil(int64_t year, uint32_t month, uint32_t day) {
+  year -= (month <= 2);
+  int64_t era = (year >= 0 ? year : year - 399) / 400;
+  uint32_t year_of_era = static_cast<uint32_t>(year - era * 400);
+  uint32_t day_of_year = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+  uint32_t day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+  return era * 146097 + static_cast<int64_t>(day_of_era) - 719468;
+}
+
+static inline void civil_from_days(uint64_t days, uint64_t& year, uint32_t& month, uint32_t& day) {
+  days += 719468;
+  uint64_t era = days / 146097;
+  uint32_t day_of_era = static_cast<uint32_t>(days - era * 146097);
+  uint32_t year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365;
+  uint32_t day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+  uint32_t shifted_month = (5 * day_of_year + 2) / 153;
+  day = day_of_year - (153 * shifted_month + 2) / 5 + 1;
+  month = shifted_month < 10 ? shifted_month + 3 : shifted_month - 9;
+  year = year_of_era + era * 400 + (month <= 2);
+}
+
+static inline bool is_leap_year(uint32_t year) {
+  return ((year % 4) == 0) && (((year % 100) != 0) || ((year % 400) == 0));
+}
+
+static inline uint32_t days_in_month(uint32_t year, uint32_t month) {
+  static constexpr uint8_t DAYS[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+  return DAYS[month - 1] + ((month == 2) && is_leap_year(year));
+}
+
+// Returns the value of the digit at s[offset]. Instead of branching on each
+// character, invalid characters are accumulated into invalid, which is
+// checked once all the fields have been parsed.
+static inline uint32_t parse_digit(const char* s, size_t offset, uint32_t& invalid) {
+  uint32_t value = static_cast<uint8_t>(s[offset]) - static_cast<uint32_t>('0');
+  invalid |= (value > 9);
+  return value;
+}
+
+static inline uint32_t parse_2_digits(const char* s, size_t offset, uint32_t& invalid) {
+  return parse_digit(s, offset, invalid) * 10 + parse_digit(s, offset + 1, invalid);
+}
+
+uint64_t parse_airtable_time(string_view time) {
+  static constexpr uint64_t FRACTION_SCALES[7] = {1000000, 100000, 10000, 1000, 100, 10, 1};
+
+  // The fixed-width part is "YYYY-MM-DDTHH:MM:SS"; it's followed by an
+  // optional fraction (".F" through ".FFFFFF") and a 'Z'
+  if (time.size() < 20 || time.back() != 'Z') {
+    throw runtime_error("invalid time format");
+  }
+  const char* s = time.data();
+  uint32_t invalid = (s[4] != '-') | (s[7] != '-') | (s[10] != 'T') | (s[13] != ':') | (s[16] != ':');
+  uint32_t year = parse_2_digits(s, 0, invalid) * 100 + parse_2_digits(s, 2, invalid);
+  uint32_t month = parse_2_digits(s, 5, invalid);
+  uint32_t day = parse_2_digits(s, 8, invalid);
+  uint32_t hour = parse_2_digits(s, 11, invalid);
+  uint32_t minute = parse_2_digits(s, 14, invalid);
+  uint32_t second = parse_2_digits(s, 17, invalid);
+
+  uint64_t frac = 0;
+  if (time.size() > 20) {
+    size_t frac_length = time.size() - 21;
+    invalid |= (s[19] != '.') | (frac_length == 0);
+    if (invalid) {
+      throw runtime_error("invalid time format");
+    }
+    if (frac_length > 6) {
+      throw runtime_error("time is more precise than microseconds");
+    }
+    for (size_t z = 0; z < frac_length; z++) {
+      frac = frac * 10 + parse_digit(s, 20 + z, invalid);
+    }
+    frac *= FRACTION_SCALES[frac_length];
+  }
+
+  invalid |= (month - 1 > 11) | (hour > 23) | (minute > 59) | (second > 59);
+  if (invalid || (day - 1 >= days_in_month(year, month))) {
+    throw runtime_error("invalid time format");
+  }
+
+  int64_t days = days_from_civil(year, month, day);
+  if (days < 0) {
+    throw runtime_error("time is before 1970");
+  }
+  uint64_t secs = static_cast<uint64_t>(days) * 86400 + hour * 3600 + minute * 60 + second;
+  return secs * 1000000 + frac;
+}
+
+void format_airtable_time(char* out, uint64_t time) {
+  static constexpr char DIGIT_PAIRS[] =
+      "00010203040506070809"
+      "10111213141516171819"
+      "20212223242526272829"
+      "30313233343536373839"
+      "40414243444546474849"
+      "50515253545556575859"
+      "60616263646566676869"
+      "70717273747576777879"
+      "80818283848586878889"
+      "90919293949596979899";
+  auto write_2_digits = [&](size_t offset, uint32_t value) -> void {
+    out[offset] = DIGIT_PAIRS[value * 2];
+    out[offset + 1] = DIGIT_PAIRS[value * 2 + 1];
+  };
+
+  uint64_t secs = time / 1000000;
+  uint32_t msecs = (time % 1000000) / 1000;
+  uint32_t secs_of_day = secs % 86400;
+  uint64_t year;
+  uint32_t month, day;
+  civil_from_days(secs / 86400, year, month, day);
+  if (year > 9999) {
+    throw runtime_error("time is too far in the future to format");
+  }
+
+  write_2_digits(0, year / 100);
+  write_2_digits(2, year % 100);
+  out[4] = '-';
+  write_2_digits(5, month);
+  out[7] = '-';
+  write_2_digits(8, day);
+  out[10] = 'T';
+  write_2_digits(11, secs_of_day / 3600);
+  out[13] = ':';
+  write_2_digits(14, (secs_of_day / 60) % 60);
+  out[16] = ':';
+  write_2_digits(17, secs_of_day % 60);
+  out[19] = '.';
+  out[20] = '0' + msecs / 100;
+  write_2_digits(21, msecs % 100);
+  out[23] = 'Z';
+}
+
+string format_airtable_time(uint64_t time) {
+  string ret(AIRTABLE_TIME_LENGTH, '\0');
+  format_airtable_time(ret.data(), time);
+  return ret;
+}
+
+void parse_airtable_times(span<const string_view> times, span<uint64_t> out) {
+  if (times.size() != out.size()) {
+    throw invalid_argument("input and output sizes do not match");
+  }
+  for (size_t z = 0; z < times.size(); z++) {
+    out[z] = parse_airtable_time(times[z]);
+  }
+}
+
+string format_airtable_times(span<const uint64_t> times) {
+  string ret(times.size() * AIRTABLE_TIME_LENGTH, '\0');
+  for (size_t z = 0; z < times.size(); z++) {
+    format_airtable_time(ret.data() + z * AIRTABLE_TIME_LENGTH, times[z]);
+  }
+  return ret;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <span>
+#include <string>
+#include <string_view>
+
+// Airtable timestamps are ISO-8601 UTC times like "2024-03-05T17:04:11.000Z".
+// Within this library they're represented as microseconds since the Unix
+// epoch. These functions convert between the two representations with plain
+// calendar arithmetic; they don't call any libc time functions, so they're
+// independent of the process's timezone and locale and don't take any locks.
+
+// The length of the strings produced by format_airtable_time
+constexpr size_t AIRTABLE_TIME_LENGTH = 24;
+
+// Parses a timestamp with between 0 and 6 fractional digits (Airtable always
+// sends 3). Throws std::runtime_error if the string isn't a valid UTC
+// timestamp, if it's more precise than microseconds, or if it's before 1970.
+uint64_t parse_airtable_time(std::string_view time);
+
+// Formats a timestamp with millisecond precision, as Airtable does. Any
+// sub-millisecond part of the time is truncated.
+std::string format_airtable_time(uint64_t time);
+// Writes exactly AIRTABLE_TIME_LENGTH characters to out (without a trailing
+// null byte)
+void format_airtable_time(char* out, uint64_t time);
+
+// Column versions of the above. parse_airtable_times throws
+// std::invalid_argument if the spans aren't the same size, and
+// std::runtime_error (as above) if any timestamp is invalid.
+// format_airtable_times returns all of the formatted timestamps back-to-back;
+// timestamp N is at offset N * AIRTABLE_TIME_LENGTH.
+void parse_airtable_times(std::span<const std::string_view> times, std::span<uint64_t> out);
+std::string format_airtable_times(std::span<const uint64_t> times);
@@ -3,7 +3,9 @@
 #include <inttypes.h>
 #include <stdlib.h>
 
+#include <chrono>
 #include <format>
+#include <optional>
 #include <phosg/Strings.hh>
 #include <string>
 #include <vector>
@@ -59,6 +61,7 @@ std::string HTTPRequest::serialize_without_data() const {
     bool first = true;
     for (const auto& [k, v] : this->query_params) {
       ret += std::format("{:c}{}={}", first ? '?' : '&', url_encode(k), url_encode(v));
+      first = false;
     }
   }
   if (!this->fragment.empty()) {
@@ -91,21 +94,46 @@ const std::string* HTTPResponse::get_header(const std::string& name) const {
 AsyncHTTPClient::AsyncHTTPClient(asio::io_context& io_context)
     : io_context(io_context), ssl_context(create_default_ssl_context()) {}
 
+void AsyncHTTPClient::set_metrics(shared_ptr<ClientMetrics> metrics) {
+  this->metrics = std::move(metrics);
+}
+
+void AsyncHTTPClient::set_tracer(shared_ptr<Tracer> tracer) {
+  this->tracer = std::move(tracer);
+}
+
 template <typename SocketT>
-asio::awaitable<HTTPResponse> make_request_on_stream(SocketT& stream, const HTTPRequest& req) {
+asio::awaitable<HTTPResponse> make_request_on_stream(
+    SocketT& stream,
+    const HTTPRequest& req,
+    const AsyncHTTPClient::BodyDataCallback* on_body_data,
+    RequestMetrics* request_metrics = nullptr,
+    const TraceSpan* span = nullptr) {
+  RequestTimer timer;
   string req_str = req.serialize_without_data();
 
   array<asio::const_buffer, 2> bufs = {
       asio::const_buffer(req_str.data(), req_str.size()),
       asio::const_buffer(req.data.data(), req.data.size())};
 
+  TraceSpan write_span(span, "write");
   co_await asio::async_write(stream, bufs, asio::use_awaitable);
+  write_span.end();
+  TraceSpan read_headers_span(span, "read_headers");
 
+  // The response's lines are usually all received in the first few reads, so
+  // most of them are taken from the reader's buffer via try_read_line, which
+  // avoids creating a coroutine frame for each line. line is reused for each
+  // header and chunk header so its allocation is reused too.
   AsyncSocketReader r(stream);
+  std::string line;
 
   HTTPResponse resp;
   {
-    std::string response_line = co_await r.read_line("\r\n", 4096);
+    std::string response_line;
+    if (!r.try_read_line(response_line, "\r\n", 4096)) {
+      response_line = co_await r.read_line("\r\n", 4096);
+    }
     size_t first_space_pos = response_line.find(' ');
     if (first_space_pos == string::npos) {
       throw std::runtime_error("Malformed response line");
@@ -119,10 +147,16 @@ asio::awaitable<HTTPResponse> make_request_on_stream(SocketT& stream, const HTTP
     resp.response_reason = response_line.substr(second_space_pos + 1);
     phosg::strip_trailing_whitespace(resp.response_reason);
   }
+  if (request_metrics) {
+    request_metrics->record(RequestPhase::FIRST_BYTE, timer.lap_usecs());
+    request_metrics->request_bytes.fetch_add(req_str.size() + req.data.size(), std::memory_order_relaxed);
+  }
 
   auto prev_header_it = resp.headers.end();
   for (;;) {
-    std::string line = co_await r.read_line("\r\n", 4096);
+    if (!r.try_read_line(line, "\r\n", 4096)) {
+      line = co_await r.read_line("\r\n", 4096);
+    }
     if (line.empty()) {
       break;
     }
@@ -147,11 +181,23 @@ asio::awaitable<HTTPResponse> make_request_on_stream(SocketT& stream, const HTTP
     }
   }
 
+  read_headers_span.end();
+
+  if (on_body_data && (resp.response_code < 200 || resp.response_code > 299)) {
+    on_body_data = nullptr;
+  }
+  auto append_to_data = [&resp](const char* data, size_t size) -> void {
+    resp.data.append(data, size);
+  };
+
+  TraceSpan read_body_span(span, "read_body");
+  size_t body_bytes = 0;
   auto transfer_encoding_header = resp.get_header("transfer-encoding");
   if (transfer_encoding_header && phosg::tolower(*transfer_encoding_header) == "chunked") {
-    deque<string> chunks;
     for (;;) {
-      auto line = co_await r.read_line("\r\n", 0x20);
+      if (!r.try_read_line(line, "\r\n", 0x20)) {
+        line = co_await r.read_line("\r\n", 0x20);
+      }
       size_t parse_offset = 0;
       size_t chunk_size = stoull(line, &parse_offset, 16);
       if (parse_offset != line.size()) {
@@ -160,29 +206,145 @@ asio::awaitable<HTTPResponse> make_request_on_stream(SocketT& stream, const HTTP
       if (chunk_size == 0) {
         break;
       }
-      chunks.emplace_back(co_await r.read_data(chunk_size));
-      auto after_chunk_data = co_await r.read_line("\r\n", 0x20);
-      if (!after_chunk_data.empty()) {
+      body_bytes += chunk_size;
+      if (on_body_data) {
+        if (!r.try_read_data_chunks(chunk_size, *on_body_data)) {
+          co_await r.read_data_chunks(chunk_size, *on_body_data);
+        }
+      } else if (!r.try_read_data_chunks(chunk_size, append_to_data)) {
+        co_await r.read_data_chunks(chunk_size, append_to_data);
+      }
+      if (!r.try_read_line(line, "\r\n", 0x20)) {
+        line = co_await r.read_line("\r\n", 0x20);
+      }
+      if (!line.empty()) {
         throw std::runtime_error("Incorrect trailing sequence after chunk data");
       }
     }
   } else {
     auto content_length_header = resp.get_header("content-length");
     size_t content_length = content_length_header ? stoull(*content_length_header) : 0;
+    body_bytes = content_length;
     if (content_length > 0) {
-      resp.data = co_await r.read_data(content_length);
+      if (on_body_data) {
+        if (!r.try_read_data_chunks(content_length, *on_body_data)) {
+          co_await r.read_data_chunks(content_length, *on_body_data);
+        }
+      } else if (!r.try_read_data(resp.data, content_length)) {
+        resp.data = co_await r.read_data(content_length);
+      }
     }
   }
 
+  if (request_metrics) {
+    request_metrics->record(RequestPhase::BODY_TRANSFER, timer.elapsed_usecs());
+    request_metrics->response_body_bytes.fetch_add(body_bytes, std::memory_order_relaxed);
+  }
+  read_body_span.set_attribute("bytes", static_cast<int64_t>(body_bytes));
   co_return resp;
 }
 
-asio::awaitable<HTTPResponse> AsyncHTTPClient::make_request(const HTTPRequest& req) {
+static void record_connect_timings(
+    RequestMetrics* request_metrics, const TraceSpan* span, const ConnectTimings& timings, bool https) {
+  if (request_metrics) {
+    request_metrics->record(RequestPhase::RESOLVE, timings.resolve_usecs);
+    request_metrics->record(RequestPhase::CONNECT, timings.connect_usecs);
+    if (https) {
+      request_metrics->record(RequestPhase::TLS_HANDSHAKE, timings.tls_handshake_usecs);
+    }
+  }
+  if (span->active()) {
+    auto resolved = timings.start + chrono::microseconds(timings.resolve_usecs);
+    auto connected = resolved + chrono::microseconds(timings.connect_usecs);
+    span->add_child("resolve", timings.start, resolved);
+    span->add_child("connect", resolved, connected);
+    if (https) {
+      span->add_child("tls_handshake", connected, connected + chrono::microseconds(timings.tls_handshake_usecs));
+    }
+  }
+}
+
+// metrics and request_metrics are either both null or both non-null. span may
+// be inactive, but not null.
+static asio::awaitable<HTTPResponse> make_request_on_connection(
+    asio::ssl::context& ssl_context,
+    const HTTPRequest& req,
+    const AsyncHTTPClient::BodyDataCallback* on_body_data,
+    ClientMetrics* metrics,
+    RequestMetrics* request_metrics,
+    const TraceSpan* span) {
+  // The connection's sockets are bound to the executor this coroutine runs
+  // on, which is the connection's strand (see make_request)
+  auto executor = co_await asio::this_coro::executor;
+  ConnectTimings timings;
+  ConnectTimings* timings_ptr = (request_metrics || span->active()) ? &timings : nullptr;
+  optional<ClientMetrics::GaugeIncrement> open_connection;
   if (req.https) {
-    auto stream = co_await async_connect_tcp_ssl(this->io_context, this->ssl_context, req.domain, req.port, req.domain);
-    co_return co_await make_request_on_stream(stream, req);
+    auto stream = co_await async_connect_tcp_ssl(executor, ssl_context, req.domain, req.port, req.domain, timings_ptr);
+    record_connect_timings(request_metrics, span, timings, true);
+    if (metrics) {
+      open_connection.emplace(metrics->open_connections);
+    }
+    co_return co_await make_request_on_stream(stream, req, on_body_data, request_metrics, span);
+  } else {
+    auto stream = co_await async_connect_tcp(req.domain, req.port, timings_ptr);
+    record_connect_timings(request_metrics, span, timings, false);
+    if (metrics) {
+      open_connection.emplace(metrics->open_connections);
+    }
+    co_return co_await make_request_on_stream(stream, req, on_body_data, request_metrics, span);
+  }
+}
+
+asio::awaitable<HTTPResponse> AsyncHTTPClient::make_request(
+    const HTTPRequest& req, const BodyDataCallback* on_body_data, RequestMetrics* request_metrics, TraceSpan* span) {
+  optional<ClientMetrics::GaugeIncrement> in_flight;
+  if (this->metrics) {
+    if (!request_metrics) {
+      request_metrics = &this->metrics->get_series(name_for_method(req.method), "");
+    }
+    in_flight.emplace(this->metrics->in_flight_requests);
+    request_metrics->requests.fetch_add(1, memory_order_relaxed);
   } else {
-    auto stream = co_await async_connect_tcp(req.domain, req.port);
-    co_return co_await make_request_on_stream(stream, req);
+    request_metrics = nullptr;
   }
+
+  // own_span is inactive if the caller gave a span or tracing is disabled
+  TraceSpan own_span(span ? nullptr : this->tracer.get(), "http_request");
+  if (!span) {
+    span = &own_span;
+  }
+  span->set_attribute("http.method", name_for_method(req.method));
+  span->set_attribute("server.address", req.domain);
+  span->set_attribute("url.path", req.path);
+
+  // Each connection runs on its own strand, so when the io_context is run by
+  // multiple threads, a connection's handlers (including TLS processing and
+  // on_body_data) never run concurrently with each other, but different
+  // connections can make progress on different threads at the same time
+  RequestTimer timer;
+  HTTPResponse resp;
+  try {
+    resp = co_await asio::co_spawn(
+        asio::make_strand(this->io_context),
+        make_request_on_connection(this->ssl_context, req, on_body_data, this->metrics.get(), request_metrics, span),
+        asio::use_awaitable);
+  } catch (const exception& e) {
+    if (request_metrics) {
+      request_metrics->errors.fetch_add(1, memory_order_relaxed);
+    }
+    span->set_error(e.what());
+    throw;
+  }
+  span->set_attribute("http.status_code", static_cast<int64_t>(resp.response_code));
+
+  if (request_metrics) {
+    request_metrics->record(RequestPhase::REQUEST, timer.elapsed_usecs());
+    if (resp.response_code == 429) {
+      request_metrics->responses_429.fetch_add(1, memory_order_relaxed);
+    } else if ((resp.response_code >= 500) && (resp.response_code <= 599)) {
+      request_metrics->responses_5xx.fetch_add(1, memory_order_relaxed);
+    }
+  }
+  co_return resp;
 }
@@ -2,10 +2,15 @@
 
 #include <asio.hpp>
 #include <asio/ssl.hpp>
+#include <functional>
 #include <map>
+#include <memory>
 #include <stdexcept>
 #include <string>
 
+#include "Metrics.hh"
+#include "Tracing.hh"
+
 class HTTPError : public std::runtime_error {
 public:
   HTTPError(int code, const std::string& what);
@@ -54,6 +59,10 @@ struct HTTPResponse {
   const std::string* get_header(const std::string& name) const;
 };
 
+// An AsyncHTTPClient may be shared by coroutines running on multiple threads
+// (e.g. on an IOThreadPool). It has no mutable state of its own: each request
+// opens its own connection, which runs on its own strand, and the SSL context
+// is only read after construction, which OpenSSL allows from multiple threads.
 class AsyncHTTPClient {
 public:
   explicit AsyncHTTPClient(asio::io_context& io_context);
@@ -63,9 +72,63 @@ public:
   AsyncHTTPClient& operator=(AsyncHTTPClient&&) = delete;
   virtual ~AsyncHTTPClient() = default;
 
-  asio::awaitable<HTTPResponse> make_request(const HTTPRequest& req);
+  // Called with each piece of a response body as it arrives. The data pointer
+  // is only valid during the call.
+  using BodyDataCallback = std::function<void(const char*, size_t)>;
+
+  // Sends a request and reads the response. If on_body_data is given and the
+  // response code is 2xx, the body is passed to on_body_data as it arrives
+  // instead of being stored in the returned response's data field (so the
+  // caller can process it while the rest is still being received). Non-2xx
+  // response bodies are always stored in data. on_body_data is called on the
+  // connection's strand, which may be on a different thread than the caller
+  // when the io_context is run by multiple threads; the caller is suspended
+  // for the duration of the request, so it doesn't need to synchronize.
+  //
+  // If metrics are enabled (see set_metrics), the request's phases and
+  // counters are recorded in request_metrics, or in the series for the HTTP
+  // method (with an empty base ID) if request_metrics is null.
+  //
+  // If span is given, the request's attributes (method, host, path, and
+  // response code) are set on it, and its steps (resolve, connect,
+  // tls_handshake, write, read_headers, and read_body) are recorded as child
+  // spans. If span is null and tracing is enabled (see set_tracer), the
+  // request gets its own root span instead.
+  asio::awaitable<HTTPResponse> make_request(
+      const HTTPRequest& req,
+      const BodyDataCallback* on_body_data = nullptr,
+      RequestMetrics* request_metrics = nullptr,
+      TraceSpan* span = nullptr);
+
+  // Enables recording metrics for all requests made by this client, or
+  // disables it if metrics is null. The same ClientMetrics may be shared by
+  // multiple clients. This must not be changed while any requests are in
+  // progress.
+  virtual void set_metrics(std::shared_ptr<ClientMetrics> metrics);
+  inline const std::shared_ptr<ClientMetrics>& get_metrics() const {
+    return this->metrics;
+  }
+
+  // Enables tracing for all requests made by this client, or disables it if
+  // tracer is null. Like metrics, the same Tracer may be shared by multiple
+  // clients, and this must not be changed while any requests are in
+  // progress.
+  void set_tracer(std::shared_ptr<Tracer> tracer);
+  inline const std::shared_ptr<Tracer>& get_tracer() const {
+    return this->tracer;
+  }
+
+  // The SSL context used for HTTPS requests. It's created with the system's
+  // CA certificates; callers may change its settings (e.g. to trust another
+  // CA, or to set the verification mode), but only before any requests are
+  // made.
+  inline asio::ssl::context& get_ssl_context() {
+    return this->ssl_context;
+  }
 
 protected:
   asio::io_context& io_context;
   asio::ssl::context ssl_context;
+  std::shared_ptr<ClientMetrics> metrics;
+  std::shared_ptr<Tracer> tracer;
 };
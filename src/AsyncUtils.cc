@@ -2,23 +2,33 @@
 
 #include <asio.hpp>
 #include <asio/ssl.hpp>
+#include <chrono>
 #include <exception>
 #include <functional>
+#include <list>
 #include <optional>
 #include <phosg/Strings.hh>
+#include <stdexcept>
 #include <string>
 
 using namespace std;
 
-asio::awaitable<asio::ip::tcp::socket> async_connect_tcp(string host, uint16_t port) {
+asio::awaitable<asio::ip::tcp::socket> async_connect_tcp(string host, uint16_t port, ConnectTimings* timings) {
   auto executor = co_await asio::this_coro::executor;
 
+  auto start = chrono::steady_clock::now();
   asio::ip::tcp::resolver resolver(executor);
   auto endpoints = co_await resolver.async_resolve(host, std::format("{}", port), asio::use_awaitable);
+  auto resolved = chrono::steady_clock::now();
 
   asio::ip::tcp::socket sock(executor);
   co_await asio::async_connect(sock, endpoints, asio::use_awaitable);
 
+  if (timings) {
+    timings->start = start;
+    timings->resolve_usecs = chrono::duration_cast<chrono::microseconds>(resolved - start).count();
+    timings->connect_usecs = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - resolved).count();
+  }
   co_return sock;
 }
 
@@ -29,26 +39,351 @@ asio::ssl::context create_default_ssl_context() {
 }
 
 asio::awaitable<asio::ssl::stream<asio::ip::tcp::socket>> async_connect_tcp_ssl(
-    asio::io_context& io_context,
+    const asio::any_io_executor& executor,
     asio::ssl::context& ssl_context,
     const std::string host,
     uint16_t port,
-    const std::string& sni_hostname) {
-  asio::ip::tcp::resolver resolver(io_context);
-  asio::ssl::stream<asio::ip::tcp::socket> ssl_stream(io_context, ssl_context);
+    const std::string& sni_hostname,
+    ConnectTimings* timings) {
+  asio::ip::tcp::resolver resolver(executor);
+  asio::ssl::stream<asio::ip::tcp::socket> ssl_stream(executor, ssl_context);
 
   if (!sni_hostname.empty() &&
       !SSL_set_tlsext_host_name(ssl_stream.native_handle(), sni_hostname.c_str())) {
     throw std::runtime_error("Failed to set SNI hostname");
   }
 
+  auto start = chrono::steady_clock::now();
   auto endpoints = co_await resolver.async_resolve(host, std::format("{}", port));
+  auto resolved = chrono::steady_clock::now();
   co_await asio::async_connect(ssl_stream.next_layer(), endpoints);
+  auto connected = chrono::steady_clock::now();
   co_await ssl_stream.async_handshake(asio::ssl::stream_base::client);
+
+  if (timings) {
+    timings->start = start;
+    timings->resolve_usecs = chrono::duration_cast<chrono::microseconds>(resolved - start).count();
+    timings->connect_usecs = chrono::duration_cast<chrono::microseconds>(connected - resolved).count();
+    timings->tls_handshake_usecs = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - connected).count();
+  }
   co_return ssl_stream;
 }
 
+asio::awaitable<asio::ssl::stream<asio::ip::tcp::socket>> async_connect_tcp_ssl(
+    asio::io_context& io_context,
+    asio::ssl::context& ssl_context,
+    const std::string host,
+    uint16_t port,
+    const std::string& sni_hostname,
+    ConnectTimings* timings) {
+  co_return co_await async_connect_tcp_ssl(io_context.get_executor(), ssl_context, host, port, sni_hostname, timings);
+}
+
 asio::awaitable<void> async_sleep(chrono::steady_clock::duration duration) {
   asio::steady_timer timer(co_await asio::this_coro::executor, duration);
   co_await timer.async_wait(asio::use_awaitable);
 }
+
+static exception_ptr make_operation_aborted_exception() {
+  return make_exception_ptr(asio::system_error(asio::error::operation_aborted));
+}
+
+struct AsyncTaskGroup::State {
+  asio::any_io_executor executor;
+  asio::strand<asio::any_io_executor> strand;
+  bool cancel_on_first_completion;
+
+  // Everything below is only accessed on strand
+  size_t num_running = 0;
+  size_t num_spawned = 0;
+  size_t first_completed_index = NOT_FOUND;
+  bool cancelled = false;
+  exception_ptr first_exception;
+  // One signal per running coroutine. This is a list so each coroutine's
+  // entry can be removed when it finishes without affecting the others.
+  list<asio::cancellation_signal> signals;
+  // The coroutine waiting in join() or wait_for_capacity(), if any. Only the
+  // coroutine that owns the group waits on it, so there's at most one.
+  move_only_function<void()> waiter;
+  size_t waiter_max_running = 0;
+  bool waiter_is_join = false;
+
+  State(const asio::any_io_executor& executor, bool cancel_on_first_completion)
+      : executor(executor),
+        strand(asio::make_strand(executor)),
+        cancel_on_first_completion(cancel_on_first_completion) {}
+
+  void cancel(exception_ptr reason) {
+    if (reason && !this->first_exception) {
+      this->first_exception = reason;
+    }
+    if (!this->cancelled) {
+      this->cancelled = true;
+      for (auto& signal : this->signals) {
+        signal.emit(asio::cancellation_type::terminal);
+      }
+    }
+    this->check_waiter();
+  }
+
+  void on_task_finished(size_t index, list<asio::cancellation_signal>::iterator signal_it, exception_ptr exc) {
+    this->signals.erase(signal_it);
+    this->num_running--;
+    if (this->first_completed_index == NOT_FOUND) {
+      this->first_completed_index = index;
+    }
+    // Once the group is cancelled, the remaining coroutines' exceptions are
+    // probably just the result of the cancellation, so they're ignored
+    if (!this->cancelled) {
+      if (exc) {
+        this->first_exception = exc;
+        this->cancel(nullptr);
+      } else if (this->cancel_on_first_completion) {
+        this->cancel(nullptr);
+      }
+    }
+    this->check_waiter();
+  }
+
+  void check_waiter() {
+    if (!this->waiter) {
+      return;
+    }
+    bool ready = this->waiter_is_join
+        ? (this->num_running == 0)
+        : (this->cancelled || (this->num_running < this->waiter_max_running));
+    if (ready) {
+      auto waiter = std::move(this->waiter);
+      this->waiter = nullptr;
+      waiter();
+    }
+  }
+
+  // Makes handler the group's waiter. When it's ready, it's called on its
+  // own executor with result_fn(state) as its argument.
+  template <typename HandlerT, typename ResultFnT>
+  static void start_wait(
+      shared_ptr<State> state, HandlerT&& handler, size_t max_running, bool is_join, ResultFnT result_fn) {
+    // Cancelling the waiting coroutine cancels the whole group
+    auto slot = asio::get_associated_cancellation_slot(handler);
+    if (slot.is_connected()) {
+      slot.assign([state](asio::cancellation_type) -> void {
+        asio::dispatch(state->strand, [state]() -> void {
+          state->cancel(make_operation_aborted_exception());
+        });
+      });
+    }
+
+    auto executor = asio::prefer(asio::get_associated_executor(handler), asio::execution::outstanding_work.tracked);
+    asio::dispatch(state->strand, [state, max_running, is_join, result_fn, slot, executor = std::move(executor), handler = std::forward<HandlerT>(handler)]() mutable -> void {
+      state->waiter = [state = state.get(), result_fn, slot, executor = std::move(executor), handler = std::move(handler)]() mutable -> void {
+        asio::post(executor, [slot, handler = std::move(handler), result = result_fn(*state)]() mutable -> void {
+          slot.clear();
+          std::move(handler)(std::move(result));
+        });
+      };
+      state->waiter_max_running = max_running;
+      state->waiter_is_join = is_join;
+      state->check_waiter();
+    });
+  }
+};
+
+AsyncTaskGroup::AsyncTaskGroup(const asio::any_io_executor& executor, bool cancel_on_first_completion)
+    : state(make_shared<State>(executor, cancel_on_first_completion)) {}
+
+void AsyncTaskGroup::spawn(asio::awaitable<void>&& task) {
+  auto state = this->state;
+  asio::dispatch(state->strand, [state, task = std::move(task)]() mutable -> void {
+    if (state->cancelled) {
+      return;
+    }
+    size_t index = state->num_spawned++;
+    state->num_running++;
+    auto signal_it = state->signals.emplace(state->signals.end());
+    auto on_finished = [state, index, signal_it](exception_ptr exc) -> void {
+      state->on_task_finished(index, signal_it, exc);
+    };
+    asio::co_spawn(
+        state->executor,
+        std::move(task),
+        asio::bind_cancellation_slot(signal_it->slot(), asio::bind_executor(state->strand, std::move(on_finished))));
+  });
+}
+
+asio::awaitable<bool> AsyncTaskGroup::wait_for_capacity(size_t max_running) {
+  if (max_running == 0) {
+    throw invalid_argument("max_running must be at least 1");
+  }
+  co_return co_await asio::async_initiate<const asio::use_awaitable_t<>&, void(bool)>(
+      [this, max_running](auto handler) -> void {
+        State::start_wait(this->state, std::move(handler), max_running, false, [](const State& state) -> bool {
+          return !state.cancelled;
+        });
+      },
+      asio::use_awaitable);
+}
+
+asio::awaitable<void> AsyncTaskGroup::join() {
+  co_await asio::async_initiate<const asio::use_awaitable_t<>&, void(exception_ptr)>(
+      [this](auto handler) -> void {
+        State::start_wait(this->state, std::move(handler), 0, true, [](const State& state) -> exception_ptr {
+          return state.first_exception;
+        });
+      },
+      asio::use_awaitable);
+}
+
+void AsyncTaskGroup::cancel() {
+  auto state = this->state;
+  asio::dispatch(state->strand, [state]() -> void {
+    state->cancel(make_operation_aborted_exception());
+  });
+}
+
+size_t AsyncTaskGroup::first_completed_index() const {
+  return this->state->first_completed_index;
+}
+
+asio::awaitable<void> when_all(vector<asio::awaitable<void>> tasks) {
+  AsyncTaskGroup group(co_await asio::this_coro::executor);
+  for (auto& task : tasks) {
+    group.spawn(std::move(task));
+  }
+  co_await group.join();
+}
+
+asio::awaitable<size_t> when_any(vector<asio::awaitable<void>> tasks) {
+  if (tasks.empty()) {
+    throw invalid_argument("when_any requires at least one coroutine");
+  }
+  AsyncTaskGroup group(co_await asio::this_coro::executor, true);
+  for (auto& task : tasks) {
+    group.spawn(std::move(task));
+  }
+  co_await group.join();
+  co_return group.first_completed_index();
+}
+
+asio::awaitable<void> AsyncConditionVariable::wait(unique_lock<mutex>& g) {
+  exception_ptr exc;
+  try {
+    co_await asio::async_initiate<const asio::use_awaitable_t<>&, void(asio::error_code)>(
+        [this, &g](auto handler) -> void {
+          auto slot = asio::get_associated_cancellation_slot(handler);
+          auto executor = asio::prefer(asio::get_associated_executor(handler), asio::execution::outstanding_work.tracked);
+          {
+            lock_guard waiters_g(this->lock);
+            uint64_t id = this->next_waiter_id++;
+            // The cancellation handler can only be called from the waiting
+            // coroutine's context, which is here, so it can't run before the
+            // waiter is added
+            if (slot.is_connected()) {
+              slot.assign([this, id](asio::cancellation_type) -> void {
+                this->cancel_waiter(id);
+              });
+            }
+            this->waiters.emplace_back(Waiter{
+                .id = id,
+                .complete = [slot, executor = std::move(executor), handler = std::move(handler)](asio::error_code ec) mutable -> void {
+                  asio::post(executor, [slot, handler = std::move(handler), ec]() mutable -> void {
+                    slot.clear();
+                    std::move(handler)(ec);
+                  });
+                },
+            });
+            // The waiter must be added before g is unlocked, so a
+            // notification sent right after the condition changes can't be
+            // missed. g must also be unlocked before the waiter can be
+            // notified, since the coroutine (which owns g) may then resume
+            // on another thread immediately.
+            g.unlock();
+          }
+        },
+        asio::use_awaitable);
+  } catch (...) {
+    exc = current_exception();
+  }
+  g.lock();
+  if (exc) {
+    rethrow_exception(exc);
+  }
+}
+
+void AsyncConditionVariable::notify_one() {
+  move_only_function<void(asio::error_code)> complete;
+  {
+    lock_guard g(this->lock);
+    if (this->waiters.empty()) {
+      return;
+    }
+    complete = std::move(this->waiters.front().complete);
+    this->waiters.pop_front();
+  }
+  complete(asio::error_code());
+}
+
+void AsyncConditionVariable::notify_all() {
+  deque<Waiter> waiters;
+  {
+    lock_guard g(this->lock);
+    waiters.swap(this->waiters);
+  }
+  for (auto& waiter : waiters) {
+    waiter.complete(asio::error_code());
+  }
+}
+
+void AsyncConditionVariable::cancel_waiter(uint64_t id) {
+  move_only_function<void(asio::error_code)> complete;
+  {
+    lock_guard g(this->lock);
+    for (auto it = this->waiters.begin(); it != this->waiters.end(); it++) {
+      if (it->id == id) {
+        complete = std::move(it->complete);
+        this->waiters.erase(it);
+        break;
+      }
+    }
+  }
+  // If the waiter isn't found, it was already notified
+  if (complete) {
+    complete(asio::error::operation_aborted);
+  }
+}
+
+AsyncSemaphore::AsyncSemaphore(size_t count) : count(count) {}
+
+asio::awaitable<void> AsyncSemaphore::acquire() {
+  unique_lock g(this->lock);
+  while (this->count == 0) {
+    co_await this->cv.wait(g);
+  }
+  this->count--;
+}
+
+bool AsyncSemaphore::try_acquire() {
+  lock_guard g(this->lock);
+  if (this->count == 0) {
+    return false;
+  }
+  this->count--;
+  return true;
+}
+
+void AsyncSemaphore::release(size_t count) {
+  {
+    lock_guard g(this->lock);
+    this->count += count;
+  }
+  if (count == 1) {
+    this->cv.notify_one();
+  } else {
+    this->cv.notify_all();
+  }
+}
+
+size_t AsyncSemaphore::available() const {
+  lock_guard g(this->lock);
+  return this->count;
+}
@@ -4,8 +4,18 @@
 
 #include <asio.hpp>
 #include <asio/ssl.hpp>
+#include <chrono>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
 #include <string>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 template <typename StreamT>
 class AsyncSocketReader {
@@ -17,20 +27,50 @@ public:
   AsyncSocketReader& operator=(AsyncSocketReader&&) = delete;
   ~AsyncSocketReader() = default;
 
+  // The try_* functions below complete a read from already-buffered data
+  // without suspending, and return false (consuming nothing) if not enough
+  // data is buffered. Calling a coroutine costs a frame allocation and a
+  // resumption even when it never suspends, and most reads (e.g. each header
+  // line of an HTTP response) are satisfied by data read along with an
+  // earlier line, so callers on hot paths should call the try_* version first
+  // and co_await the coroutine version only if it returns false.
+
   // Reads one line from the socket, buffering any extra data read. The
-  // delimiter is not included in the returned line. max_length = 0 means no
-  // maximum length is enforced.
-  asio::awaitable<std::string> read_line(const char* delimiter = "\n", size_t max_length = 0) {
+  // delimiter is not included in the returned line. max_length is the maximum
+  // length of the line including the delimiter; if the line is longer, throws
+  // std::runtime_error. max_length = 0 means no maximum length is enforced.
+  bool try_read_line(std::string& out, const char* delimiter = "\n", size_t max_length = 0) {
     size_t delimiter_size = strlen(delimiter);
     if (delimiter_size == 0) {
       throw std::logic_error("delimiter is empty");
     }
+    size_t delimiter_pos = this->pending_data.find(delimiter, this->pending_offset);
+    if (delimiter_pos == std::string::npos) {
+      return false;
+    }
+    if (max_length && (delimiter_pos + delimiter_size - this->pending_offset > max_length)) {
+      throw std::runtime_error("line exceeds max length");
+    }
+    out.assign(this->pending_data, this->pending_offset, delimiter_pos - this->pending_offset);
+    this->consume_pending(delimiter_pos + delimiter_size - this->pending_offset);
+    return true;
+  }
+
+  asio::awaitable<std::string> read_line(const char* delimiter = "\n", size_t max_length = 0) {
+    std::string ret;
+    if (this->try_read_line(ret, delimiter, max_length)) {
+      co_return ret;
+    }
+
+    size_t delimiter_size = strlen(delimiter);
     size_t delimiter_backup_bytes = delimiter_size - 1;
+    this->compact_pending();
 
-    size_t delimiter_pos = this->pending_data.find(delimiter);
+    size_t delimiter_pos = std::string::npos;
     while ((delimiter_pos == std::string::npos) && (!max_length || (this->pending_data.size() < max_length))) {
       size_t pre_size = this->pending_data.size();
-      this->pending_data.resize(std::min(max_length, this->pending_data.size() + 0x400));
+      size_t new_size = this->pending_data.size() + 0x400;
+      this->pending_data.resize(max_length ? std::min(max_length, new_size) : new_size);
 
       auto buf = asio::buffer(this->pending_data.data() + pre_size, this->pending_data.size() - pre_size);
       size_t bytes_read = co_await this->sock.async_read_some(buf, asio::use_awaitable);
@@ -44,40 +84,427 @@ public:
       throw std::runtime_error("line exceeds max length");
     }
 
-    std::string ret = this->pending_data.substr(0, delimiter_pos);
-    // TODO: It's not great that we copy the data here. This shouldn't be hard to fix.
-    this->pending_data = this->pending_data.substr(delimiter_pos + delimiter_size);
+    ret.assign(this->pending_data, 0, delimiter_pos);
+    this->consume_pending(delimiter_pos + delimiter_size);
     co_return ret;
   }
 
+  bool try_read_data(std::string& out, size_t size) {
+    size_t pending_size = this->pending_data.size() - this->pending_offset;
+    if (pending_size < size) {
+      return false;
+    }
+    if ((this->pending_offset == 0) && (pending_size == size)) {
+      out.clear();
+      this->pending_data.swap(out);
+    } else {
+      out.assign(this->pending_data, this->pending_offset, size);
+      this->consume_pending(size);
+    }
+    return true;
+  }
+
   asio::awaitable<std::string> read_data(size_t size) {
     std::string ret;
-    if (this->pending_data.size() == size) {
-      this->pending_data.swap(ret);
-    } else if (this->pending_data.size() > size) {
-      ret = this->pending_data.substr(0, size);
-      this->pending_data = this->pending_data.substr(size);
-    } else {
-      size_t bytes_to_read = size - this->pending_data.size();
-      this->pending_data.swap(ret);
+    if (!this->try_read_data(ret, size)) {
+      size_t bytes_to_read = size - (this->pending_data.size() - this->pending_offset);
+      if (this->pending_offset == 0) {
+        this->pending_data.swap(ret);
+      } else {
+        ret.assign(this->pending_data, this->pending_offset);
+        this->pending_data.clear();
+        this->pending_offset = 0;
+      }
       ret.resize(size);
       co_await asio::async_read(this->sock, asio::buffer(ret.data() + size - bytes_to_read, bytes_to_read), asio::use_awaitable);
     }
     co_return ret;
   }
 
+  // Reads exactly size bytes, but instead of collecting them into a string,
+  // calls fn(data, size) for each piece as it arrives. The data pointer passed
+  // to fn is only valid during the call.
+  template <typename FnT>
+  bool try_read_data_chunks(size_t size, const FnT& fn) {
+    if (this->pending_data.size() - this->pending_offset < size) {
+      return false;
+    }
+    if (size > 0) {
+      fn(this->pending_data.data() + this->pending_offset, size);
+      this->consume_pending(size);
+    }
+    return true;
+  }
+
+  template <typename FnT>
+  asio::awaitable<void> read_data_chunks(size_t size, const FnT& fn) {
+    size_t bytes_from_pending = std::min(size, this->pending_data.size() - this->pending_offset);
+    if (bytes_from_pending > 0) {
+      fn(this->pending_data.data() + this->pending_offset, bytes_from_pending);
+      this->consume_pending(bytes_from_pending);
+      size -= bytes_from_pending;
+    }
+    if (size > 0 && this->chunk_buffer.empty()) {
+      this->chunk_buffer.resize(0x4000);
+    }
+    while (size > 0) {
+      auto buf = asio::buffer(this->chunk_buffer.data(), std::min(size, this->chunk_buffer.size()));
+      size_t bytes_read = co_await this->sock.async_read_some(buf, asio::use_awaitable);
+      fn(this->chunk_buffer.data(), bytes_read);
+      size -= bytes_read;
+    }
+  }
+
 private:
-  std::string pending_data; // Data read but not yet returned to the caller
+  // Marks size bytes at pending_offset as returned to the caller. Once all
+  // pending data has been returned, the buffer is reset (keeping its
+  // allocation) so the next read starts at the beginning of it.
+  void consume_pending(size_t size) {
+    this->pending_offset += size;
+    if (this->pending_offset >= this->pending_data.size()) {
+      this->pending_data.clear();
+      this->pending_offset = 0;
+    }
+  }
+
+  // Moves the data not yet returned to the caller to the beginning of the
+  // buffer, so more data can be read after it
+  void compact_pending() {
+    if (this->pending_offset > 0) {
+      this->pending_data.erase(0, this->pending_offset);
+      this->pending_offset = 0;
+    }
+  }
+
+  // Data read but not yet returned to the caller is in pending_data, starting
+  // at pending_offset. Reads advance the offset instead of erasing the
+  // returned data, so returning a line doesn't copy the rest of the buffer.
+  std::string pending_data;
+  size_t pending_offset = 0;
+  std::string chunk_buffer; // Used by read_data_chunks
   StreamT& sock;
 };
 
+// How long each step of opening a connection took, in microseconds. The
+// connect functions below fill this in if it's given. The steps happen in
+// order, starting at start.
+struct ConnectTimings {
+  std::chrono::steady_clock::time_point start;
+  uint64_t resolve_usecs = 0;
+  uint64_t connect_usecs = 0;
+  uint64_t tls_handshake_usecs = 0;
+};
+
 asio::ssl::context create_default_ssl_context();
-asio::awaitable<asio::ip::tcp::socket> async_connect_tcp(std::string host, uint16_t port);
+asio::awaitable<asio::ip::tcp::socket> async_connect_tcp(std::string host, uint16_t port, ConnectTimings* timings = nullptr);
+// The returned stream is bound to executor (or io_context's executor)
+asio::awaitable<asio::ssl::stream<asio::ip::tcp::socket>> async_connect_tcp_ssl(
+    const asio::any_io_executor& executor,
+    asio::ssl::context& ssl_context,
+    const std::string host,
+    uint16_t port,
+    const std::string& sni_hostname,
+    ConnectTimings* timings = nullptr);
 asio::awaitable<asio::ssl::stream<asio::ip::tcp::socket>> async_connect_tcp_ssl(
     asio::io_context& io_context,
     asio::ssl::context& ssl_context,
     const std::string host,
     uint16_t port,
-    const std::string& sni_hostname);
+    const std::string& sni_hostname,
+    ConnectTimings* timings = nullptr);
 
 asio::awaitable<void> async_sleep(std::chrono::steady_clock::duration duration);
+
+// Runs a set of coroutines concurrently and waits for all of them to finish.
+// If any of them throws, the others are cancelled, and join() rethrows the
+// first exception once they've all finished. Cancelling the coroutine that's
+// waiting in join() or wait_for_capacity() cancels all of the group's
+// coroutines, and join() then throws asio::error::operation_aborted.
+//
+// The group's coroutines run on the executor given to the constructor, and
+// may run in parallel if it's run by multiple threads. The group's own
+// bookkeeping runs on a strand, so spawn(), cancel(), and the waits may be
+// called from any thread. join() must be awaited before the group is
+// destroyed; it's the caller's responsibility to keep any objects that the
+// coroutines refer to alive until then.
+//
+// This is the building block for parallel_for_each, when_all, and when_any
+// below, which are easier to use directly.
+class AsyncTaskGroup {
+public:
+  static constexpr size_t NOT_FOUND = static_cast<size_t>(-1);
+
+  // If cancel_on_first_completion is true, the group cancels all its other
+  // coroutines as soon as any of them finishes, even if it didn't throw
+  explicit AsyncTaskGroup(const asio::any_io_executor& executor, bool cancel_on_first_completion = false);
+  AsyncTaskGroup(const AsyncTaskGroup&) = delete;
+  AsyncTaskGroup(AsyncTaskGroup&&) = delete;
+  AsyncTaskGroup& operator=(const AsyncTaskGroup&) = delete;
+  AsyncTaskGroup& operator=(AsyncTaskGroup&&) = delete;
+  ~AsyncTaskGroup() = default;
+
+  // Starts running task. If the group has already been cancelled (or a
+  // coroutine in it has failed), task is destroyed without being run.
+  void spawn(asio::awaitable<void>&& task);
+  // Waits until fewer than max_running of the group's coroutines are running.
+  // Returns false (immediately, if needed) if the group has been cancelled or
+  // a coroutine has failed, in which case the caller should stop spawning new
+  // coroutines and call join().
+  asio::awaitable<bool> wait_for_capacity(size_t max_running);
+  // Waits until all of the group's coroutines have finished, then rethrows
+  // the first exception thrown by any of them, if any
+  asio::awaitable<void> join();
+  // Cancels all running coroutines; join() will throw
+  // asio::error::operation_aborted unless a coroutine failed first
+  void cancel();
+
+  // Returns the index (in order of spawn() calls) of the coroutine that
+  // finished first, or NOT_FOUND if none have finished. This is only valid
+  // after join() returns.
+  size_t first_completed_index() const;
+
+private:
+  struct State;
+  std::shared_ptr<State> state;
+};
+
+// Stores the result of task in result. This is used by when_all and when_any
+// to run coroutines that return values in an AsyncTaskGroup.
+template <typename T>
+asio::awaitable<void> async_store_result(asio::awaitable<T> task, std::optional<T>& result) {
+  result.emplace(co_await std::move(task));
+}
+
+// Calls fn(item) for each item in range, which must return an
+// asio::awaitable<void>, and runs up to max_concurrency of the returned
+// coroutines at once (or all of them, if max_concurrency is zero). If any of
+// them throws, no more are started, the running ones are cancelled, and the
+// first exception is rethrown once they've all finished. range and fn must
+// remain valid until this returns.
+template <typename RangeT, typename FnT>
+asio::awaitable<void> parallel_for_each(RangeT&& range, size_t max_concurrency, FnT fn) {
+  AsyncTaskGroup group(co_await asio::this_coro::executor);
+  size_t max_running = max_concurrency ? max_concurrency : static_cast<size_t>(-1);
+  for (auto&& item : range) {
+    if (!co_await group.wait_for_capacity(max_running)) {
+      break;
+    }
+    group.spawn(fn(item));
+  }
+  co_await group.join();
+}
+
+// Runs all of the given coroutines concurrently and returns their results in
+// the same order. If any of them throws, the others are cancelled, and the
+// first exception is rethrown once they've all finished.
+template <typename T>
+asio::awaitable<std::vector<T>> when_all(std::vector<asio::awaitable<T>> tasks) {
+  AsyncTaskGroup group(co_await asio::this_coro::executor);
+  std::vector<std::optional<T>> results(tasks.size());
+  for (size_t z = 0; z < tasks.size(); z++) {
+    group.spawn(async_store_result(std::move(tasks[z]), results[z]));
+  }
+  co_await group.join();
+
+  std::vector<T> ret;
+  ret.reserve(results.size());
+  for (auto& result : results) {
+    ret.emplace_back(std::move(*result));
+  }
+  co_return ret;
+}
+asio::awaitable<void> when_all(std::vector<asio::awaitable<void>> tasks);
+
+// Runs all of the given coroutines concurrently until any of them finishes,
+// then cancels the others and waits for them to finish. Returns the index
+// and result of the first one to finish, or rethrows its exception if it
+// threw. Throws std::invalid_argument if tasks is empty.
+template <typename T>
+asio::awaitable<std::pair<size_t, T>> when_any(std::vector<asio::awaitable<T>> tasks) {
+  if (tasks.empty()) {
+    throw std::invalid_argument("when_any requires at least one coroutine");
+  }
+  AsyncTaskGroup group(co_await asio::this_coro::executor, true);
+  std::vector<std::optional<T>> results(tasks.size());
+  for (size_t z = 0; z < tasks.size(); z++) {
+    group.spawn(async_store_result(std::move(tasks[z]), results[z]));
+  }
+  co_await group.join();
+
+  size_t index = group.first_completed_index();
+  co_return std::make_pair(index, std::move(*results.at(index)));
+}
+// Returns the index of the first coroutine to finish
+asio::awaitable<size_t> when_any(std::vector<asio::awaitable<void>> tasks);
+
+// Like std::condition_variable, but suspends the calling coroutine instead
+// of blocking its thread. This is thread-safe.
+class AsyncConditionVariable {
+public:
+  AsyncConditionVariable() = default;
+  AsyncConditionVariable(const AsyncConditionVariable&) = delete;
+  AsyncConditionVariable(AsyncConditionVariable&&) = delete;
+  AsyncConditionVariable& operator=(const AsyncConditionVariable&) = delete;
+  AsyncConditionVariable& operator=(AsyncConditionVariable&&) = delete;
+  ~AsyncConditionVariable() = default;
+
+  // g must be locked. Unlocks g, waits until notify_one() or notify_all() is
+  // called, then locks g again. Like std::condition_variable, this can wake
+  // up without the condition being true, so callers should check it in a
+  // loop. If the calling coroutine is cancelled while waiting, throws
+  // asio::error::operation_aborted (with g locked).
+  asio::awaitable<void> wait(std::unique_lock<std::mutex>& g);
+  // Wakes up one waiting coroutine, if any are waiting
+  void notify_one();
+  // Wakes up all waiting coroutines
+  void notify_all();
+
+private:
+  struct Waiter {
+    uint64_t id;
+    std::move_only_function<void(asio::error_code)> complete;
+  };
+
+  void cancel_waiter(uint64_t id);
+
+  std::mutex lock;
+  uint64_t next_waiter_id = 0;
+  std::deque<Waiter> waiters;
+};
+
+// A counting semaphore for coroutines. acquire() suspends the calling
+// coroutine (instead of blocking its thread) until a unit is available. This
+// is thread-safe.
+class AsyncSemaphore {
+public:
+  explicit AsyncSemaphore(size_t count);
+  AsyncSemaphore(const AsyncSemaphore&) = delete;
+  AsyncSemaphore(AsyncSemaphore&&) = delete;
+  AsyncSemaphore& operator=(const AsyncSemaphore&) = delete;
+  AsyncSemaphore& operator=(AsyncSemaphore&&) = delete;
+  ~AsyncSemaphore() = default;
+
+  // Waits until a unit is available, then takes it. If the calling coroutine
+  // is cancelled while waiting, throws asio::error::operation_aborted and
+  // doesn't take a unit.
+  asio::awaitable<void> acquire();
+  // Takes a unit if one is available; returns false if none are
+  bool try_acquire();
+  // Returns units taken by acquire() or try_acquire()
+  void release(size_t count = 1);
+  size_t available() const;
+
+private:
+  mutable std::mutex lock;
+  size_t count;
+  AsyncConditionVariable cv;
+};
+
+// A queue for passing values between coroutines, with a maximum size.
+// Senders wait while the channel is full, so a slow consumer slows down its
+// producers instead of letting the queue grow without bound. This is
+// thread-safe, and any number of coroutines may send and receive at once.
+template <typename T>
+class AsyncChannel {
+public:
+  // capacity must be at least 1
+  explicit AsyncChannel(size_t capacity) : max_size(capacity) {
+    if (capacity == 0) {
+      throw std::invalid_argument("channel capacity must be at least 1");
+    }
+  }
+  AsyncChannel(const AsyncChannel&) = delete;
+  AsyncChannel(AsyncChannel&&) = delete;
+  AsyncChannel& operator=(const AsyncChannel&) = delete;
+  AsyncChannel& operator=(AsyncChannel&&) = delete;
+  ~AsyncChannel() = default;
+
+  // Waits until there's space in the channel, then adds value. If the channel
+  // is closed (before or while waiting), rethrows the exception it was
+  // closed with, or throws std::runtime_error if there isn't one. If the
+  // calling coroutine is cancelled while waiting, throws
+  // asio::error::operation_aborted.
+  asio::awaitable<void> send(T value) {
+    {
+      std::unique_lock g(this->lock);
+      while (!this->closed && (this->items.size() >= this->max_size)) {
+        co_await this->senders_cv.wait(g);
+      }
+      this->throw_if_closed();
+      this->items.emplace_back(std::move(value));
+    }
+    this->receivers_cv.notify_one();
+  }
+
+  // Waits until a value is available, then removes and returns it. If the
+  // channel is closed and empty (before or while waiting), rethrows the
+  // exception it was closed with, or returns std::nullopt if there isn't
+  // one. Values sent before the channel was closed are still returned. If
+  // the calling coroutine is cancelled while waiting, throws
+  // asio::error::operation_aborted.
+  asio::awaitable<std::optional<T>> receive() {
+    std::optional<T> ret;
+    {
+      std::unique_lock g(this->lock);
+      while (!this->closed && this->items.empty()) {
+        co_await this->receivers_cv.wait(g);
+      }
+      if (this->items.empty()) {
+        if (this->close_exception) {
+          std::rethrow_exception(this->close_exception);
+        }
+        co_return std::nullopt;
+      }
+      ret.emplace(std::move(this->items.front()));
+      this->items.pop_front();
+    }
+    this->senders_cv.notify_one();
+    co_return ret;
+  }
+
+  // Closes the channel, waking up all waiting senders and receivers. If exc
+  // is given, it's rethrown to senders and to receivers once the channel is
+  // empty, so a failing producer can pass its error downstream. Only the
+  // first call has any effect.
+  void close(std::exception_ptr exc = nullptr) {
+    {
+      std::lock_guard g(this->lock);
+      if (this->closed) {
+        return;
+      }
+      this->closed = true;
+      this->close_exception = exc;
+    }
+    this->senders_cv.notify_all();
+    this->receivers_cv.notify_all();
+  }
+
+  inline size_t capacity() const {
+    return this->max_size;
+  }
+  size_t size() const {
+    std::lock_guard g(this->lock);
+    return this->items.size();
+  }
+  bool is_closed() const {
+    std::lock_guard g(this->lock);
+    return this->closed;
+  }
+
+private:
+  void throw_if_closed() const {
+    if (this->close_exception) {
+      std::rethrow_exception(this->close_exception);
+    } else if (this->closed) {
+      throw std::runtime_error("channel is closed");
+    }
+  }
+
+  size_t max_size;
+  mutable std::mutex lock;
+  std::deque<T> items;
+  bool closed = false;
+  std::exception_ptr close_exception;
+  AsyncConditionVariable senders_cv;
+  AsyncConditionVariable receivers_cv;
+};
@@ -0,0 +1,128 @@
+#include "CPUThreadPool.hh"
+
+#include <stdexcept>
+
+using namespace std;
+
+// The pool and queue index of the current thread, if it belongs to a pool
+static thread_local const CPUThreadPool* current_pool = nullptr;
+static thread_local size_t current_queue_index = 0;
+
+CPUThreadPool::CPUThreadPool(size_t num_threads, ErrorHandler error_handler)
+    : error_handler(std::move(error_handler)) {
+  if (num_threads == 0) {
+    num_threads = thread::hardware_concurrency();
+  }
+  if (num_threads == 0) {
+    num_threads = 1;
+  }
+  for (size_t z = 0; z < num_threads; z++) {
+    this->queues.emplace_back(make_unique<Queue>());
+  }
+  this->threads.reserve(num_threads);
+  for (size_t z = 0; z < num_threads; z++) {
+    this->threads.emplace_back(&CPUThreadPool::thread_fn, this, z);
+  }
+}
+
+CPUThreadPool::~CPUThreadPool() {
+  {
+    lock_guard g(this->sleep_lock);
+    this->should_exit = true;
+  }
+  this->sleep_cv.notify_all();
+  for (auto& t : this->threads) {
+    t.join();
+  }
+}
+
+void CPUThreadPool::post(Task&& task) {
+  if (!task) {
+    throw logic_error("cannot post an empty task");
+  }
+  size_t queue_index = (current_pool == this)
+      ? current_queue_index
+      : (this->next_queue_index.fetch_add(1, memory_order_relaxed) % this->queues.size());
+  {
+    auto& queue = *this->queues[queue_index];
+    lock_guard g(queue.lock);
+    queue.tasks.emplace_back(std::move(task));
+  }
+  {
+    // This is done under sleep_lock so a thread can't check the count and
+    // then miss the notification before it waits
+    lock_guard g(this->sleep_lock);
+    this->num_pending_tasks++;
+  }
+  this->sleep_cv.notify_one();
+}
+
+exception_ptr CPUThreadPool::take_first_error() {
+  lock_guard g(this->first_error_lock);
+  return std::exchange(this->first_error, nullptr);
+}
+
+void CPUThreadPool::handle_error(exception_ptr exc) {
+  if (this->error_handler) {
+    try {
+      this->error_handler(exc);
+    } catch (...) {
+      // The handler itself failed; there's nowhere left to report this
+    }
+  } else {
+    lock_guard g(this->first_error_lock);
+    if (!this->first_error) {
+      this->first_error = exc;
+    }
+  }
+}
+
+bool CPUThreadPool::try_take_task(size_t thread_index, Task& task) {
+  {
+    auto& queue = *this->queues[thread_index];
+    lock_guard g(queue.lock);
+    if (!queue.tasks.empty()) {
+      task = std::move(queue.tasks.back());
+      queue.tasks.pop_back();
+      return true;
+    }
+  }
+  for (size_t z = 1; z < this->queues.size(); z++) {
+    auto& queue = *this->queues[(thread_index + z) % this->queues.size()];
+    lock_guard g(queue.lock);
+    if (!queue.tasks.empty()) {
+      task = std::move(queue.tasks.front());
+      queue.tasks.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+void CPUThreadPool::thread_fn(size_t thread_index) {
+  current_pool = this;
+  current_queue_index = thread_index;
+
+  for (;;) {
+    Task task;
+    if (this->try_take_task(thread_index, task)) {
+      this->num_pending_tasks--;
+      try {
+        task();
+      } catch (...) {
+        this->handle_error(current_exception());
+      }
+      continue;
+    }
+
+    // If num_pending_tasks is nonzero but no task was found, another thread
+    // took it and hasn't decremented the count yet; just try again
+    unique_lock g(this->sleep_lock);
+    this->sleep_cv.wait(g, [&]() -> bool {
+      return (this->num_pending_tasks > 0) || this->should_exit;
+    });
+    if (this->should_exit && (this->num_pending_tasks == 0)) {
+      return;
+    }
+  }
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <asio.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// A pool of threads for CPU-bound work (e.g. parsing response bodies), so that
+// it doesn't run on (and block) the threads running an io_context. Each thread
+// has its own task queue; tasks posted from a pool thread go to that thread's
+// queue, and tasks posted from other threads are distributed among the queues
+// round-robin. A thread whose queue is empty steals tasks from the others,
+// so the pool stays busy even when tasks are uneven in size.
+//
+// Coroutines use the pool via async_run(), which runs a function on the pool
+// and resumes the coroutine on its own executor when the function returns.
+class CPUThreadPool {
+public:
+  using Task = std::move_only_function<void()>;
+  // Called with any exception thrown by a task passed to post(), on the
+  // thread that ran the task, so it must be thread-safe
+  using ErrorHandler = std::function<void(std::exception_ptr exc)>;
+
+  // num_threads = 0 means to use one thread per core. If no error handler is
+  // given, the first exception thrown by a task is kept for
+  // take_first_error().
+  explicit CPUThreadPool(size_t num_threads = 0, ErrorHandler error_handler = nullptr);
+  CPUThreadPool(const CPUThreadPool&) = delete;
+  CPUThreadPool(CPUThreadPool&&) = delete;
+  CPUThreadPool& operator=(const CPUThreadPool&) = delete;
+  CPUThreadPool& operator=(CPUThreadPool&&) = delete;
+  // Runs all tasks that have already been posted, then waits for the threads
+  // to exit. This must not be called from one of the pool's threads.
+  ~CPUThreadPool();
+
+  inline size_t num_threads() const {
+    return this->threads.size();
+  }
+
+  // Runs task on one of the pool's threads. If task throws, the exception is
+  // passed to the error handler (see the constructor).
+  void post(Task&& task);
+
+  // Returns the first exception thrown by a posted task since the last call,
+  // or null if there were none. Always returns null if the pool has an error
+  // handler.
+  std::exception_ptr take_first_error();
+
+  // Runs fn() on one of the pool's threads, then resumes the calling
+  // coroutine on its own executor and returns fn's result (or rethrows the
+  // exception fn threw). The calling coroutine's io_context is kept running
+  // while fn runs, even if it has no other work.
+  template <typename FnT, typename ResultT = std::invoke_result_t<FnT&>>
+  asio::awaitable<ResultT> async_run(FnT fn) {
+    if constexpr (std::is_void_v<ResultT>) {
+      co_await asio::async_initiate<const asio::use_awaitable_t<>&, void(std::exception_ptr)>(
+          [this, &fn](auto handler) -> void {
+            auto io_executor = asio::prefer(asio::get_associated_executor(handler), asio::execution::outstanding_work.tracked);
+            this->post([handler = std::move(handler), io_executor = std::move(io_executor), &fn]() mutable -> void {
+              std::exception_ptr exc;
+              try {
+                fn();
+              } catch (...) {
+                exc = std::current_exception();
+              }
+              asio::post(io_executor, [handler = std::move(handler), exc]() mutable -> void {
+                std::move(handler)(exc);
+              });
+            });
+          },
+          asio::use_awaitable);
+    } else {
+      // The result is wrapped in an optional so ResultT doesn't need a default
+      // constructor
+      auto ret = co_await asio::async_initiate<const asio::use_awaitable_t<>&, void(std::exception_ptr, std::optional<ResultT>)>(
+          [this, &fn](auto handler) -> void {
+            auto io_executor = asio::prefer(asio::get_associated_executor(handler), asio::execution::outstanding_work.tracked);
+            this->post([handler = std::move(handler), io_executor = std::move(io_executor), &fn]() mutable -> void {
+              std::exception_ptr exc;
+              std::optional<ResultT> ret;
+              try {
+                ret.emplace(fn());
+              } catch (...) {
+                exc = std::current_exception();
+              }
+              asio::post(io_executor, [handler = std::move(handler), exc, ret = std::move(ret)]() mutable -> void {
+                std::move(handler)(exc, std::move(ret));
+              });
+            });
+          },
+          asio::use_awaitable);
+      co_return std::move(*ret);
+    }
+  }
+
+private:
+  struct Queue {
+    std::mutex lock;
+    std::deque<Task> tasks;
+  };
+
+  // Takes a task from the thread's own queue (newest first), or steals one
+  // from another thread's queue (oldest first)
+  bool try_take_task(size_t thread_index, Task& task);
+  void handle_error(std::exception_ptr exc);
+  void thread_fn(size_t thread_index);
+
+  ErrorHandler error_handler;
+  std::mutex first_error_lock;
+  std::exception_ptr first_error;
+
+  std::vector<std::unique_ptr<Queue>> queues;
+  std::atomic<size_t> next_queue_index = 0;
+  // Incremented (under sleep_lock) after a task is added to a queue, and
+  // decremented after a task is taken from one
+  std::atomic<size_t> num_pending_tasks = 0;
+  std::mutex sleep_lock;
+  std::condition_variable sleep_cv;
+  bool should_exit = false; // Protected by sleep_lock
+  std::vector<std::thread> threads;
+};
@@ -0,0 +1,298 @@
+#include "CellValue.hh"
+
+#include <string.h>
+
+#include <stdexcept>
+#include <type_traits>
+
+using namespace std;
+
+CompactString::CompactString() {
+  this->storage[MAX_INLINE_SIZE] = 0;
+}
+
+CompactString::CompactString(string_view s) {
+  this->assign(s);
+}
+
+CompactString::CompactString(const CompactString& other) {
+  this->assign(other.view());
+}
+
+CompactString::CompactString(CompactString&& other) noexcept {
+  // Heap strings just transfer ownership of the pointer, so copying the raw
+  // storage works for both representations
+  memcpy(this->storage, other.storage, sizeof(this->storage));
+  other.storage[MAX_INLINE_SIZE] = 0;
+}
+
+CompactString& CompactString::operator=(const CompactString& other) {
+  if (this != &other) {
+    this->release();
+    this->assign(other.view());
+  }
+  return *this;
+}
+
+CompactString& CompactString::operator=(CompactString&& other) noexcept {
+  if (this != &other) {
+    this->release();
+    memcpy(this->storage, other.storage, sizeof(this->storage));
+    other.storage[MAX_INLINE_SIZE] = 0;
+  }
+  return *this;
+}
+
+CompactString::~CompactString() {
+  this->release();
+}
+
+const char* CompactString::heap_data() const {
+  const char* ret;
+  memcpy(&ret, this->storage, sizeof(ret));
+  return ret;
+}
+
+size_t CompactString::heap_size() const {
+  size_t ret;
+  memcpy(&ret, this->storage + sizeof(char*), sizeof(ret));
+  return ret;
+}
+
+void CompactString::assign(string_view s) {
+  if (s.size() <= MAX_INLINE_SIZE) {
+    memcpy(this->storage, s.data(), s.size());
+    this->storage[MAX_INLINE_SIZE] = static_cast<char>(s.size());
+  } else {
+    char* data = new char[s.size()];
+    memcpy(data, s.data(), s.size());
+    size_t size = s.size();
+    memcpy(this->storage, &data, sizeof(data));
+    memcpy(this->storage + sizeof(char*), &size, sizeof(size));
+    this->storage[MAX_INLINE_SIZE] = static_cast<char>(HEAP_TAG);
+  }
+}
+
+void CompactString::release() {
+  if (!this->is_inline()) {
+    delete[] this->heap_data();
+    this->storage[MAX_INLINE_SIZE] = 0;
+  }
+}
+
+CellValue::CellValue(string_view value) : value(in_place_type<CompactString>, value) {}
+CellValue::CellValue(const char* value) : value(in_place_type<CompactString>, value) {}
+CellValue::CellValue(int64_t value) : value(value) {}
+CellValue::CellValue(double value) : value(value) {}
+CellValue::CellValue(bool value) : value(value) {}
+CellValue::CellValue(vector<CompactString>&& value) : value(std::move(value)) {}
+CellValue::CellValue(vector<double>&& value) : value(std::move(value)) {}
+
+// Returns a new copy of a collaborator, button, or attachment Field
+static shared_ptr<Field> copy_object_field(const Field& field) {
+  switch (field.type) {
+    case Field::ValueType::Collaborator:
+      return make_shared<CollaboratorField>(static_cast<const CollaboratorField&>(field));
+    case Field::ValueType::CollaboratorArray:
+      return make_shared<MultiCollaboratorField>(static_cast<const MultiCollaboratorField&>(field));
+    case Field::ValueType::Button:
+      return make_shared<ButtonField>(static_cast<const ButtonField&>(field));
+    case Field::ValueType::AttachmentArray:
+      return make_shared<AttachmentField>(static_cast<const AttachmentField&>(field));
+    default:
+      throw logic_error("invalid field type");
+  }
+}
+
+// Converts a Field to a CellValue. If take_ownership is true, collaborator,
+// button, and attachment Fields are kept instead of copied; this is only done
+// for Fields that nothing else refers to (e.g. ones that were just parsed).
+static CellValue convert_field(const shared_ptr<Field>& field, bool take_ownership) {
+  switch (field->type) {
+    case Field::ValueType::String:
+      return CellValue(string_view(static_cast<const StringField&>(*field).value));
+    case Field::ValueType::Integer:
+      return CellValue(static_cast<const IntegerField&>(*field).value);
+    case Field::ValueType::Float:
+      return CellValue(static_cast<const FloatField&>(*field).value);
+    case Field::ValueType::Checkbox:
+      return CellValue(static_cast<const CheckboxField&>(*field).value);
+    case Field::ValueType::StringArray: {
+      const auto& items = static_cast<const StringArrayField&>(*field).value;
+      return CellValue(vector<CompactString>(items.begin(), items.end()));
+    }
+    case Field::ValueType::NumberArray: {
+      auto items = static_cast<const NumberArrayField&>(*field).value;
+      return CellValue(std::move(items));
+    }
+    case Field::ValueType::Collaborator:
+    case Field::ValueType::CollaboratorArray:
+    case Field::ValueType::Button:
+    case Field::ValueType::AttachmentArray: {
+      CellValue ret;
+      ret.value = shared_ptr<const Field>(take_ownership ? field : copy_object_field(*field));
+      return ret;
+    }
+    default:
+      throw logic_error("invalid field type");
+  }
+}
+
+CellValue CellValue::from_field(const shared_ptr<Field>& field) {
+  return convert_field(field, false);
+}
+
+shared_ptr<Field> CellValue::to_field() const {
+  return std::visit([](const auto& v) -> shared_ptr<Field> {
+    using T = decay_t<decltype(v)>;
+    if constexpr (is_same_v<T, monostate>) {
+      throw logic_error("cannot convert empty cell value to Field");
+    } else if constexpr (is_same_v<T, CompactString>) {
+      return make_shared<StringField>(v.str());
+    } else if constexpr (is_same_v<T, int64_t>) {
+      return make_shared<IntegerField>(v);
+    } else if constexpr (is_same_v<T, double>) {
+      return make_shared<FloatField>(v);
+    } else if constexpr (is_same_v<T, bool>) {
+      return make_shared<CheckboxField>(v);
+    } else if constexpr (is_same_v<T, vector<CompactString>>) {
+      vector<string> values;
+      values.reserve(v.size());
+      for (const auto& item : v) {
+        values.emplace_back(item.view());
+      }
+      return make_shared<StringArrayField>(std::move(values));
+    } else if constexpr (is_same_v<T, vector<double>>) {
+      return make_shared<NumberArrayField>(v);
+    } else {
+      // The caller may modify the returned Field, so it can't be the one that
+      // this CellValue (and its copies) refer to
+      return copy_object_field(*v);
+    }
+  },
+      this->value);
+}
+
+CellValue CellValue::read(JSONReader& r) {
+  switch (r.peek()) {
+    case 'n':
+      r.read_null();
+      return CellValue();
+
+    case '\"': {
+      string scratch;
+      return CellValue(r.read_string_view(scratch));
+    }
+
+    case 't':
+    case 'f':
+      return CellValue(r.read_bool());
+
+    case '[': {
+      // Lists of strings and numbers are read directly; anything else is
+      // reread from the beginning by parse_field
+      JSONReader list_start = r;
+      r.expect('[');
+      if (r.consume(']')) {
+        return CellValue(vector<CompactString>());
+      }
+      char item0_ch = r.peek();
+      if (item0_ch == '\"') {
+        vector<CompactString> values;
+        string scratch;
+        do {
+          values.emplace_back(r.read_string_view(scratch));
+        } while (r.consume(','));
+        r.expect(']');
+        return CellValue(std::move(values));
+      } else if (item0_ch == '-' || (item0_ch >= '0' && item0_ch <= '9')) {
+        vector<double> values;
+        do {
+          values.emplace_back(r.read_number().as_float);
+        } while (r.consume(','));
+        r.expect(']');
+        return CellValue(std::move(values));
+      }
+      r = list_start;
+      return convert_field(Record::parse_field(r), true);
+    }
+
+    case '{':
+      return convert_field(Record::parse_field(r), true);
+
+    default: {
+      auto num = r.read_number();
+      return num.is_integer ? CellValue(num.as_int) : CellValue(num.as_float);
+    }
+  }
+}
+
+void CellValue::write_json(JSONWriter& w) const {
+  std::visit([&w](const auto& v) -> void {
+    using T = decay_t<decltype(v)>;
+    if constexpr (is_same_v<T, monostate>) {
+      w.write_null();
+    } else if constexpr (is_same_v<T, CompactString>) {
+      w.write_string(v.view());
+    } else if constexpr (is_same_v<T, int64_t>) {
+      w.write_int(v);
+    } else if constexpr (is_same_v<T, double>) {
+      w.write_float(v);
+    } else if constexpr (is_same_v<T, bool>) {
+      w.write_bool(v);
+    } else if constexpr (is_same_v<T, vector<CompactString>>) {
+      w.begin_array();
+      for (const auto& item : v) {
+        w.write_string(item.view());
+      }
+      w.end_array();
+    } else if constexpr (is_same_v<T, vector<double>>) {
+      w.begin_array();
+      for (double item : v) {
+        w.write_float(item);
+      }
+      w.end_array();
+    } else {
+      v->write_json(w);
+    }
+  },
+      this->value);
+}
+
+Field::ValueType CellValue::type() const {
+  return std::visit([](const auto& v) -> Field::ValueType {
+    using T = decay_t<decltype(v)>;
+    if constexpr (is_same_v<T, monostate>) {
+      throw logic_error("empty cell value has no type");
+    } else if constexpr (is_same_v<T, CompactString>) {
+      return Field::ValueType::String;
+    } else if constexpr (is_same_v<T, int64_t>) {
+      return Field::ValueType::Integer;
+    } else if constexpr (is_same_v<T, double>) {
+      return Field::ValueType::Float;
+    } else if constexpr (is_same_v<T, bool>) {
+      return Field::ValueType::Checkbox;
+    } else if constexpr (is_same_v<T, vector<CompactString>>) {
+      return Field::ValueType::StringArray;
+    } else if constexpr (is_same_v<T, vector<double>>) {
+      return Field::ValueType::NumberArray;
+    } else {
+      return v->type;
+    }
+  },
+      this->value);
+}
+
+double CellValue::as_float() const {
+  const int64_t* int_value = std::get_if<int64_t>(&this->value);
+  return int_value ? static_cast<double>(*int_value) : std::get<double>(this->value);
+}
+
+bool CellValue::operator==(const CellValue& other) const {
+  const auto* this_field = std::get_if<shared_ptr<const Field>>(&this->value);
+  const auto* other_field = std::get_if<shared_ptr<const Field>>(&other.value);
+  if (this_field && other_field) {
+    return (*this_field == *other_field) || ((*this_field)->to_json() == (*other_field)->to_json());
+  }
+  return this->value == other.value;
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+#include "FieldTypes.hh"
+#include "JSONReader.hh"
+#include "JSONWriter.hh"
+
+// A string that stores up to 23 bytes inline, in the same 24 bytes that a
+// pointer and size would take up. Most Airtable cell strings (selects, names,
+// short text, dates) fit inline, so they don't require any allocation, and the
+// object is smaller than std::string (usually 32 bytes with only 15 bytes of
+// inline storage).
+class CompactString {
+public:
+  static constexpr size_t MAX_INLINE_SIZE = 23;
+
+  CompactString();
+  CompactString(std::string_view s);
+  CompactString(const CompactString& other);
+  CompactString(CompactString&& other) noexcept;
+  CompactString& operator=(const CompactString& other);
+  CompactString& operator=(CompactString&& other) noexcept;
+  ~CompactString();
+
+  inline bool is_inline() const {
+    return static_cast<uint8_t>(this->storage[MAX_INLINE_SIZE]) != HEAP_TAG;
+  }
+  inline size_t size() const {
+    return this->is_inline() ? static_cast<uint8_t>(this->storage[MAX_INLINE_SIZE]) : this->heap_size();
+  }
+  inline bool empty() const {
+    return this->size() == 0;
+  }
+  inline const char* data() const {
+    return this->is_inline() ? this->storage : this->heap_data();
+  }
+  inline std::string_view view() const {
+    return std::string_view(this->data(), this->size());
+  }
+  inline operator std::string_view() const {
+    return this->view();
+  }
+  inline std::string str() const {
+    return std::string(this->view());
+  }
+
+  inline bool operator==(const CompactString& other) const {
+    return this->view() == other.view();
+  }
+  inline bool operator==(std::string_view other) const {
+    return this->view() == other;
+  }
+
+private:
+  static constexpr uint8_t HEAP_TAG = 0xFF;
+
+  // Heap strings store their pointer and size at the beginning of storage
+  const char* heap_data() const;
+  size_t heap_size() const;
+  void assign(std::string_view s);
+  void release();
+
+  // The last byte is the inline size, or HEAP_TAG if the string is on the heap
+  alignas(char*) char storage[MAX_INLINE_SIZE + 1];
+};
+
+// A single cell value, stored by value instead of as a heap-allocated Field.
+// Strings, numbers, checkboxes, and lists of strings or numbers (which make up
+// the vast majority of cells) are stored directly. Less common cell types
+// (collaborators, buttons, and attachments) are stored as pointers to their
+// immutable Field objects, so copying a CellValue never deep-copies them.
+//
+// An empty CellValue represents a cell with no value; Airtable omits these
+// from records entirely.
+class CellValue {
+public:
+  using Storage = std::variant<
+      std::monostate,
+      CompactString,
+      int64_t,
+      double,
+      bool,
+      std::vector<CompactString>,
+      std::vector<double>,
+      std::shared_ptr<const Field>>;
+
+  CellValue() = default;
+  explicit CellValue(std::string_view value);
+  explicit CellValue(const char* value);
+  explicit CellValue(int64_t value);
+  explicit CellValue(double value);
+  explicit CellValue(bool value);
+  explicit CellValue(std::vector<CompactString>&& value);
+  explicit CellValue(std::vector<double>&& value);
+  CellValue(const CellValue&) = default;
+  CellValue(CellValue&&) = default;
+  CellValue& operator=(const CellValue&) = default;
+  CellValue& operator=(CellValue&&) = default;
+  ~CellValue() = default;
+
+  // Converts to and from the Field classes. Both directions copy the cell's
+  // contents, so the CellValue and the Field can be modified independently.
+  static CellValue from_field(const std::shared_ptr<Field>& field);
+  std::shared_ptr<Field> to_field() const;
+
+  // Reads a cell value directly from JSON text. The result has the same type
+  // that Record::parse_field would produce, except that null becomes an empty
+  // CellValue instead of an error.
+  static CellValue read(JSONReader& r);
+  // Writes the same JSON as the equivalent Field's write_json. Empty values
+  // are written as null.
+  void write_json(JSONWriter& w) const;
+
+  inline bool is_empty() const {
+    return std::holds_alternative<std::monostate>(this->value);
+  }
+  // Returns the type that to_field would produce. Throws std::logic_error if
+  // the value is empty.
+  Field::ValueType type() const;
+
+  // These throw std::bad_variant_access if the value isn't of the requested
+  // type. as_float also accepts integers.
+  inline std::string_view as_string() const {
+    return std::get<CompactString>(this->value).view();
+  }
+  inline int64_t as_int() const {
+    return std::get<int64_t>(this->value);
+  }
+  double as_float() const;
+  inline bool as_bool() const {
+    return std::get<bool>(this->value);
+  }
+  inline const std::vector<CompactString>& as_string_list() const {
+    return std::get<std::vector<CompactString>>(this->value);
+  }
+  inline const std::vector<double>& as_number_list() const {
+    return std::get<std::vector<double>>(this->value);
+  }
+  // Returns the Field for collaborator, button, and attachment values
+  inline const Field& as_field() const {
+    return *std::get<std::shared_ptr<const Field>>(this->value);
+  }
+
+  // Values stored as Fields are compared by contents, not by pointer
+  bool operator==(const CellValue& other) const;
+
+  Storage value;
+};
@@ -0,0 +1,138 @@
+#include "CompactRecord.hh"
+
+#include <string.h>
+
+#include <stdexcept>
+
+using namespace std;
+
+FieldDictionary::FieldDictionary(const TableSchema& schema, bool key_by_field_id) {
+  for (const auto& [field_id, field] : schema.fields) {
+    this->add(key_by_field_id ? field_id : field.name);
+  }
+}
+
+size_t FieldDictionary::index_for_name(string_view name) const {
+  auto it = this->indexes.find(name);
+  return (it == this->indexes.end()) ? NOT_FOUND : it->second;
+}
+
+size_t FieldDictionary::add(string_view name) {
+  auto it = this->indexes.find(name);
+  if (it != this->indexes.end()) {
+    return it->second;
+  }
+  size_t index = this->names.size();
+  const auto& stored_name = this->names.emplace_back(name);
+  this->indexes.emplace(stored_name, index);
+  return index;
+}
+
+CompactRecord::CompactRecord(shared_ptr<FieldDictionary> dictionary) : dictionary(std::move(dictionary)) {
+  this->id[0] = 0;
+}
+
+CompactRecord::CompactRecord(JSONReader& r, shared_ptr<FieldDictionary> dictionary)
+    : dictionary(std::move(dictionary)) {
+  bool has_id = false;
+  bool has_creation_time = false;
+  string scratch;
+  r.read_object([&](string_view key) -> void {
+    if (key == "id") {
+      string_view id = r.read_string_view(scratch);
+      if (id.size() != 17) {
+        throw runtime_error("Record ID length is incorrect");
+      }
+      memcpy(this->id, id.data(), 17);
+      this->id[17] = 0;
+      has_id = true;
+    } else if (key == "createdTime") {
+      this->creation_time = parse_airtable_time(r.read_string_view(scratch));
+      has_creation_time = true;
+    } else if (key == "fields") {
+      this->cells.resize(this->dictionary->size());
+      r.read_object([&](string_view field_key) -> void {
+        size_t index = this->dictionary->add(field_key);
+        if (index >= this->cells.size()) {
+          this->cells.resize(index + 1);
+        }
+        this->cells[index] = CellValue::read(r);
+      });
+    } else if (key == "commentCount") {
+      this->comment_count = r.read_number().as_int;
+    } else {
+      r.skip_value();
+    }
+  });
+  if (!has_id || !has_creation_time) {
+    throw runtime_error("Record is missing id or createdTime");
+  }
+}
+
+CompactRecord::CompactRecord(const Record& record, shared_ptr<FieldDictionary> dictionary)
+    : creation_time(record.creation_time),
+      comment_count(record.comment_count),
+      dictionary(std::move(dictionary)) {
+  memcpy(this->id, record.id, sizeof(this->id));
+  for (const auto& [field_name, field] : record.fields) {
+    this->set(field_name) = CellValue::from_field(field);
+  }
+}
+
+const CellValue& CompactRecord::get(string_view field_name) const {
+  return this->get(this->dictionary->index_for_name(field_name));
+}
+
+const CellValue& CompactRecord::get(size_t field_index) const {
+  static const CellValue empty_value;
+  return (field_index < this->cells.size()) ? this->cells[field_index] : empty_value;
+}
+
+CellValue& CompactRecord::set(string_view field_name) {
+  size_t index = this->dictionary->add(field_name);
+  if (index >= this->cells.size()) {
+    this->cells.resize(index + 1);
+  }
+  return this->cells[index];
+}
+
+Record CompactRecord::to_record() const {
+  Record ret;
+  memcpy(ret.id, this->id, sizeof(ret.id));
+  ret.creation_time = this->creation_time;
+  ret.comment_count = this->comment_count;
+  ret.fields = RecordFields(this->dictionary->get_record_field_name_interner());
+  for (size_t z = 0; z < this->cells.size(); z++) {
+    if (!this->cells[z].is_empty()) {
+      ret.fields.append(this->dictionary->name_for_index(z), this->cells[z].to_field());
+    }
+  }
+  ret.fields.finish_appending();
+  return ret;
+}
+
+void CompactRecord::write_fields_json(JSONWriter& w) const {
+  w.write_key("fields");
+  w.begin_object();
+  for (size_t z = 0; z < this->cells.size(); z++) {
+    if (!this->cells[z].is_empty()) {
+      w.write_key(this->dictionary->name_for_index(z));
+      this->cells[z].write_json(w);
+    }
+  }
+  w.end_object();
+}
+
+void CompactRecord::write_json_for_create(JSONWriter& w) const {
+  w.begin_object();
+  this->write_fields_json(w);
+  w.end_object();
+}
+
+void CompactRecord::write_json_for_update(JSONWriter& w) const {
+  w.begin_object();
+  w.write_key("id");
+  w.write_string(this->id);
+  this->write_fields_json(w);
+  w.end_object();
+}
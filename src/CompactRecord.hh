@@ -0,0 +1,115 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "CellValue.hh"
+#include "FieldTypes.hh"
+#include "JSONReader.hh"
+#include "JSONWriter.hh"
+
+// Assigns a small integer index to each field name (or ID) in a table, so
+// that records can store their cells in a flat vector instead of each keeping
+// its own map with its own copy of every field name. One dictionary is shared
+// by all the CompactRecords from a table; fields are added as they're first
+// seen, and indexes never change once assigned.
+//
+// FieldDictionary is not thread-safe. Records that share a dictionary may be
+// read concurrently, but not while new records are being parsed into it.
+class FieldDictionary {
+public:
+  static constexpr size_t NOT_FOUND = static_cast<size_t>(-1);
+
+  FieldDictionary() = default;
+  // Preassigns indexes to all of a table's fields, keyed by name or ID
+  FieldDictionary(const TableSchema& schema, bool key_by_field_id);
+  FieldDictionary(const FieldDictionary&) = delete;
+  FieldDictionary(FieldDictionary&&) = delete;
+  FieldDictionary& operator=(const FieldDictionary&) = delete;
+  FieldDictionary& operator=(FieldDictionary&&) = delete;
+  ~FieldDictionary() = default;
+
+  // Returns the field's index, or NOT_FOUND if it hasn't been added
+  size_t index_for_name(std::string_view name) const;
+  // Returns the field's index, adding it if needed
+  size_t add(std::string_view name);
+  inline const std::string& name_for_index(size_t index) const {
+    return this->names.at(index);
+  }
+  inline size_t size() const {
+    return this->names.size();
+  }
+  // The interner used for the field names of Records made by
+  // CompactRecord::to_record
+  inline const std::shared_ptr<StringInterner>& get_record_field_name_interner() const {
+    return this->record_field_name_interner;
+  }
+
+private:
+  struct KeyHash {
+    using is_transparent = void;
+    inline size_t operator()(std::string_view s) const {
+      return std::hash<std::string_view>()(s);
+    }
+  };
+  // The map's keys point into names, which is a deque so they remain valid as
+  // names are added
+  std::deque<std::string> names;
+  std::unordered_map<std::string_view, size_t, KeyHash, std::equal_to<>> indexes;
+  std::shared_ptr<StringInterner> record_field_name_interner = std::make_shared<StringInterner>();
+};
+
+// A Record that stores its cells by value (see CellValue) in a vector indexed
+// by a shared FieldDictionary, instead of as a map of heap-allocated Fields.
+// Parsing a record this way makes one allocation for the cell vector plus one
+// for each long string or list, instead of several for every cell.
+//
+// Cells that are absent from the record are empty CellValues, and the cell
+// vector may be shorter than the dictionary if fields were added after the
+// record was parsed; get() handles both cases.
+struct CompactRecord {
+  char id[18]; // always 17 chars long (+ \0)
+  uint64_t creation_time = 0;
+  // Only populated if the records were listed with
+  // ListRecordsOptions::include_comment_count
+  size_t comment_count = 0;
+  std::shared_ptr<FieldDictionary> dictionary;
+  std::vector<CellValue> cells;
+
+  explicit CompactRecord(std::shared_ptr<FieldDictionary> dictionary);
+  // Reads a record object directly from JSON text, adding any new fields to
+  // the dictionary
+  CompactRecord(JSONReader& r, std::shared_ptr<FieldDictionary> dictionary);
+  // Converts from a Record. The cells are copied (see CellValue::from_field).
+  CompactRecord(const Record& record, std::shared_ptr<FieldDictionary> dictionary);
+  CompactRecord(const CompactRecord&) = default;
+  CompactRecord(CompactRecord&&) = default;
+  CompactRecord& operator=(const CompactRecord&) = default;
+  CompactRecord& operator=(CompactRecord&&) = default;
+  ~CompactRecord() = default;
+
+  // Returns the cell for the given field, or an empty CellValue if the record
+  // has no value for it
+  const CellValue& get(std::string_view field_name) const;
+  const CellValue& get(size_t field_index) const;
+  // Returns a reference to the cell for the given field, adding the field to
+  // the dictionary if needed
+  CellValue& set(std::string_view field_name);
+
+  // Converts to a Record with the same contents. The Record's Fields are new
+  // objects, so modifying them doesn't affect this CompactRecord.
+  Record to_record() const;
+
+  // Like Record's write_json_for_* functions. Empty cells are omitted.
+  void write_json_for_create(JSONWriter& w) const;
+  void write_json_for_update(JSONWriter& w) const;
+
+private:
+  void write_fields_json(JSONWriter& w) const;
+};
@@ -1,40 +1,15 @@
 #include "FieldTypes.hh"
 
+#include <algorithm>
 #include <phosg/Strings.hh>
 #include <fmt/core.h>
 
-using namespace std;
-
-uint64_t parse_airtable_time(const string& time) {
-  struct tm t;
-  const char* frac_start = strptime(time.c_str(), "%Y-%m-%dT%H:%M:%S.", &t);
-  if (frac_start == nullptr) {
-    throw runtime_error("invalid time format");
-  }
-  size_t frac_length = strlen(frac_start);
-  if (frac_length < 2 || frac_start[frac_length - 1] != 'Z') {
-    throw runtime_error("invalid time format");
-  }
-  frac_length--;
-  if (frac_length > 6) {
-    throw runtime_error("time is more precise than microseconds");
-  }
-  uint64_t frac = strtoull(frac_start, nullptr, 10);
-  for (size_t place = frac_length; place < 6; place++) {
-    frac *= 10;
-  }
-  return mktime(&t) * 1000000 + frac;
-}
+#include "JSONReader.hh"
+#include "JSONWriter.hh"
+#include "PageArena.hh"
+#include "TableDecoder.hh"
 
-string format_airtable_time(uint64_t time) {
-  struct tm t;
-  time_t t_secs = time;
-  localtime_r(&t_secs, &t);
-
-  string str(0x40, '\0');
-  str.resize(strftime(const_cast<char*>(str.data()), str.size(), "%Y-%m-%dT%H:%M:%S", &t));
-  return fmt::format("{}.{:03}Z", str, (time % 1000000) / 1000);
-}
+using namespace std;
 
 Field::Field(ValueType type) : type(type) {}
 
@@ -44,18 +19,27 @@ StringField::StringField(string&& value) : Field(ValueType::String), value(std::
 phosg::JSON StringField::to_json() const {
   return this->value;
 }
+void StringField::write_json(JSONWriter& w) const {
+  w.write_string(this->value);
+}
 
 IntegerField::IntegerField() : Field(ValueType::Integer), value(0) {}
 IntegerField::IntegerField(int64_t value) : Field(ValueType::Integer), value(value) {}
 phosg::JSON IntegerField::to_json() const {
   return this->value;
 }
+void IntegerField::write_json(JSONWriter& w) const {
+  w.write_int(this->value);
+}
 
 FloatField::FloatField() : Field(ValueType::Float), value(0.0) {}
 FloatField::FloatField(double value) : Field(ValueType::Float), value(value) {}
 phosg::JSON FloatField::to_json() const {
   return this->value;
 }
+void FloatField::write_json(JSONWriter& w) const {
+  w.write_float(this->value);
+}
 
 ButtonField::ButtonField() : Field(ValueType::Button) {}
 ButtonField::ButtonField(const string& url, const string& label) : Field(ValueType::Button), url(url), label(label) {}
@@ -63,12 +47,23 @@ ButtonField::ButtonField(string&& url, string&& label) : Field(ValueType::Button
 phosg::JSON ButtonField::to_json() const {
   return phosg::JSON::dict({{"url", this->url}, {"label", this->label}});
 }
+void ButtonField::write_json(JSONWriter& w) const {
+  w.begin_object();
+  w.write_key("url");
+  w.write_string(this->url);
+  w.write_key("label");
+  w.write_string(this->label);
+  w.end_object();
+}
 
 CheckboxField::CheckboxField() : Field(ValueType::Checkbox), value(false) {}
 CheckboxField::CheckboxField(bool value) : Field(ValueType::Checkbox), value(value) {}
 phosg::JSON CheckboxField::to_json() const {
   return this->value;
 }
+void CheckboxField::write_json(JSONWriter& w) const {
+  w.write_bool(this->value);
+}
 
 StringArrayField::StringArrayField() : Field(ValueType::StringArray) {}
 StringArrayField::StringArrayField(const vector<string>& value) : Field(ValueType::StringArray), value(value) {}
@@ -80,6 +75,13 @@ phosg::JSON StringArrayField::to_json() const {
   }
   return ret;
 }
+void StringArrayField::write_json(JSONWriter& w) const {
+  w.begin_array();
+  for (const auto& it : this->value) {
+    w.write_string(it);
+  }
+  w.end_array();
+}
 
 NumberArrayField::NumberArrayField() : Field(ValueType::StringArray) {}
 NumberArrayField::NumberArrayField(const vector<double>& value) : Field(ValueType::NumberArray), value(value) {}
@@ -91,6 +93,13 @@ phosg::JSON NumberArrayField::to_json() const {
   }
   return ret;
 }
+void NumberArrayField::write_json(JSONWriter& w) const {
+  w.begin_array();
+  for (const auto& it : this->value) {
+    w.write_float(it);
+  }
+  w.end_array();
+}
 
 CollaboratorField::CollaboratorField() : Field(ValueType::Collaborator) {}
 CollaboratorField::CollaboratorField(const string& name, const string& email, const string& user_id)
@@ -100,6 +109,19 @@ CollaboratorField::CollaboratorField(string&& name, string&& email, string&& use
       name(std::move(name)),
       email(std::move(email)),
       user_id(std::move(user_id)) {}
+CollaboratorField::CollaboratorField(JSONReader& r) : Field(ValueType::Collaborator) {
+  r.read_object([&](string_view key) -> void {
+    if (key == "name") {
+      this->name = r.read_string();
+    } else if (key == "email") {
+      this->email = r.read_string();
+    } else if (key == "id") {
+      this->user_id = r.read_string();
+    } else {
+      r.skip_value();
+    }
+  });
+}
 phosg::JSON CollaboratorField::to_json() const {
   return phosg::JSON::dict({
       {"name", this->name},
@@ -107,6 +129,16 @@ phosg::JSON CollaboratorField::to_json() const {
       {"id", this->user_id},
   });
 }
+void CollaboratorField::write_json(JSONWriter& w) const {
+  w.begin_object();
+  w.write_key("name");
+  w.write_string(this->name);
+  w.write_key("email");
+  w.write_string(this->email);
+  w.write_key("id");
+  w.write_string(this->user_id);
+  w.end_object();
+}
 
 MultiCollaboratorField::MultiCollaboratorField() : Field(ValueType::CollaboratorArray) {}
 MultiCollaboratorField::MultiCollaboratorField(const vector<CollaboratorField>& value)
@@ -120,33 +152,92 @@ phosg::JSON MultiCollaboratorField::to_json() const {
   }
   return ret;
 }
+void MultiCollaboratorField::write_json(JSONWriter& w) const {
+  w.begin_array();
+  for (const auto& it : this->value) {
+    it.write_json(w);
+  }
+  w.end_array();
+}
 
 Attachment::Attachment(const phosg::JSON& json) {
-  this->attachment_id = json.at("id").as_string();
-  this->mime_type = json.at("type").as_string();
-  this->size = json.at("size").as_int();
-  this->filename = json.at("filename").as_string();
-  try {
-    this->height = json.at("height").as_int();
-    this->width = json.at("width").as_int();
-  } catch (const std::runtime_error&) {
-  }
-  try {
-    this->url = json.at("url").as_string();
-  } catch (const std::runtime_error&) {
-  }
-  try {
-    auto& thumbs_json_dict = json.at("thumbnails").as_dict();
-    for (const auto& [name, thumb_json_it] : thumbs_json_dict) {
+  const auto& dict = json.as_dict();
+  this->attachment_id = dict.at("id")->as_string();
+  this->mime_type = dict.at("type")->as_string();
+  this->size = dict.at("size")->as_int();
+  this->filename = dict.at("filename")->as_string();
+
+  // The remaining keys are optional; these are looked up without throwing
+  // since they're often absent (e.g. for non-image attachments)
+  auto get_int = [](const phosg::JSON::dict_type& dict, const char* key) -> size_t {
+    auto it = dict.find(key);
+    return (it != dict.end() && it->second->is_int()) ? it->second->as_int() : 0;
+  };
+  this->height = get_int(dict, "height");
+  this->width = get_int(dict, "width");
+  auto url_it = dict.find("url");
+  if (url_it != dict.end() && url_it->second->is_string()) {
+    this->url = url_it->second->as_string();
+  }
+  auto thumbs_it = dict.find("thumbnails");
+  if (thumbs_it != dict.end() && thumbs_it->second->is_dict()) {
+    for (const auto& [name, thumb_json] : thumbs_it->second->as_dict()) {
+      if (!thumb_json->is_dict()) {
+        continue;
+      }
+      const auto& thumb_dict = thumb_json->as_dict();
       Thumbnail& thumb = this->thumbnails[name];
-      thumb.url = thumb_json_it->at("url").as_string();
-      thumb.width = thumb_json_it->at("width").as_int();
-      thumb.height = thumb_json_it->at("height").as_int();
+      auto thumb_url_it = thumb_dict.find("url");
+      if (thumb_url_it != thumb_dict.end() && thumb_url_it->second->is_string()) {
+        thumb.url = thumb_url_it->second->as_string();
+      }
+      thumb.width = get_int(thumb_dict, "width");
+      thumb.height = get_int(thumb_dict, "height");
     }
-  } catch (const std::runtime_error&) {
   }
 }
 
+static void read_thumbnails(JSONReader& r, unordered_map<string, Attachment::Thumbnail>& thumbnails) {
+  r.read_object([&](string_view thumb_name) -> void {
+    Attachment::Thumbnail& thumb = thumbnails[string(thumb_name)];
+    r.read_object([&](string_view thumb_key) -> void {
+      if (thumb_key == "url") {
+        thumb.url = r.read_string();
+      } else if (thumb_key == "width") {
+        thumb.width = r.read_number().as_int;
+      } else if (thumb_key == "height") {
+        thumb.height = r.read_number().as_int;
+      } else {
+        r.skip_value();
+      }
+    });
+  });
+}
+
+Attachment::Attachment(JSONReader& r) {
+  r.read_object([&](string_view key) -> void {
+    if (key == "id") {
+      this->attachment_id = r.read_string();
+    } else if (key == "type") {
+      this->mime_type = r.read_string();
+    } else if (key == "size") {
+      this->size = r.read_number().as_int;
+    } else if (key == "filename") {
+      this->filename = r.read_string();
+    } else if (key == "url") {
+      this->url = r.read_string();
+    } else if (key == "width") {
+      this->width = r.read_number().as_int;
+    } else if (key == "height") {
+      this->height = r.read_number().as_int;
+    } else if (key == "thumbnails") {
+      read_thumbnails(r, this->thumbnails);
+    } else {
+      r.skip_value();
+    }
+  });
+}
+
 phosg::JSON Attachment::to_json() const {
   auto dict = phosg::JSON::dict({
       {"type", this->mime_type},
@@ -178,6 +269,48 @@ phosg::JSON Attachment::to_json() const {
   }
   return dict;
 }
+void Attachment::write_json(JSONWriter& w) const {
+  w.begin_object();
+  w.write_key("type");
+  w.write_string(this->mime_type);
+  w.write_key("size");
+  w.write_uint(this->size);
+  w.write_key("filename");
+  w.write_string(this->filename);
+  if (this->height && this->width) {
+    w.write_key("height");
+    w.write_uint(this->height);
+    w.write_key("width");
+    w.write_uint(this->width);
+  }
+  if (!this->url.empty()) {
+    w.write_key("url");
+    w.write_string(this->url);
+  }
+  if (!this->attachment_id.empty()) {
+    w.write_key("id");
+    w.write_string(this->attachment_id);
+  }
+  if (!this->thumbnails.empty()) {
+    w.write_key("thumbnails");
+    w.begin_object();
+    for (const auto& [name, thumb] : this->thumbnails) {
+      w.write_key(name);
+      w.begin_object();
+      w.write_key("url");
+      w.write_string(thumb.url);
+      if (thumb.height && thumb.width) {
+        w.write_key("height");
+        w.write_uint(thumb.height);
+        w.write_key("width");
+        w.write_uint(thumb.width);
+      }
+      w.end_object();
+    }
+    w.end_object();
+  }
+  w.end_object();
+}
 
 AttachmentField::AttachmentField() : Field(ValueType::AttachmentArray) {}
 AttachmentField::AttachmentField(const vector<Attachment>& value) : Field(ValueType::AttachmentArray), value(value) {}
@@ -189,6 +322,13 @@ phosg::JSON AttachmentField::to_json() const {
   }
   return ret;
 }
+void AttachmentField::write_json(JSONWriter& w) const {
+  w.begin_array();
+  for (const auto& att : this->value) {
+    att.write_json(w);
+  }
+  w.end_array();
+}
 
 shared_ptr<Field> Record::parse_field(const phosg::JSON& json) {
   if (json.is_int()) {
@@ -267,6 +407,348 @@ shared_ptr<Field> Record::parse_field(const phosg::JSON& json) {
   }
 }
 
+// When reading cells with JSONReader, the type of a dict cell (or of the
+// items in a list cell) can't be determined until all of its keys have been
+// seen, so the members that parse_field looks at are collected here first.
+namespace {
+struct DictCellContents {
+  enum Key : uint8_t {
+    ID = 0x01,
+    NAME = 0x02,
+    EMAIL = 0x04,
+    URL = 0x08,
+    LABEL = 0x10,
+    FILENAME = 0x20,
+    TYPE = 0x40,
+    SIZE = 0x80,
+  };
+  uint8_t keys_present = 0;
+  string id;
+  string name;
+  string email;
+  string url;
+  string label;
+  string filename;
+  string type;
+  size_t size = 0;
+  size_t width = 0;
+  size_t height = 0;
+  unordered_map<string, Attachment::Thumbnail> thumbnails;
+
+  inline bool has(uint8_t keys) const {
+    return (this->keys_present & keys) == keys;
+  }
+  inline bool is_button() const {
+    return this->has(Key::URL | Key::LABEL);
+  }
+  inline bool is_collaborator() const {
+    return this->has(Key::NAME | Key::EMAIL | Key::ID);
+  }
+  inline bool is_attachment() const {
+    return this->has(Key::ID | Key::FILENAME | Key::TYPE | Key::URL | Key::SIZE);
+  }
+
+  void read(JSONReader& r) {
+    r.read_object([&](string_view key) -> void {
+      if (key == "id") {
+        this->id = r.read_string();
+        this->keys_present |= Key::ID;
+      } else if (key == "name") {
+        this->name = r.read_string();
+        this->keys_present |= Key::NAME;
+      } else if (key == "email") {
+        this->email = r.read_string();
+        this->keys_present |= Key::EMAIL;
+      } else if (key == "url") {
+        this->url = r.read_string();
+        this->keys_present |= Key::URL;
+      } else if (key == "label") {
+        this->label = r.read_string();
+        this->keys_present |= Key::LABEL;
+      } else if (key == "filename") {
+        this->filename = r.read_string();
+        this->keys_present |= Key::FILENAME;
+      } else if (key == "type") {
+        this->type = r.read_string();
+        this->keys_present |= Key::TYPE;
+      } else if (key == "size") {
+        this->size = r.read_number().as_int;
+        this->keys_present |= Key::SIZE;
+      } else if (key == "width") {
+        this->width = r.read_number().as_int;
+      } else if (key == "height") {
+        this->height = r.read_number().as_int;
+      } else if (key == "thumbnails") {
+        read_thumbnails(r, this->thumbnails);
+      } else {
+        r.skip_value();
+      }
+    });
+  }
+
+  CollaboratorField to_collaborator() && {
+    return CollaboratorField(std::move(this->name), std::move(this->email), std::move(this->id));
+  }
+
+  Attachment to_attachment() && {
+    Attachment ret;
+    ret.attachment_id = std::move(this->id);
+    ret.mime_type = std::move(this->type);
+    ret.size = this->size;
+    ret.filename = std::move(this->filename);
+    ret.url = std::move(this->url);
+    ret.width = this->width;
+    ret.height = this->height;
+    ret.thumbnails = std::move(this->thumbnails);
+    return ret;
+  }
+};
+} // namespace
+
+shared_ptr<Field> Record::parse_field(JSONReader& r, const shared_ptr<PageArena>& arena) {
+  switch (r.peek()) {
+    case '\"':
+      return make_shared_in_arena<StringField>(arena, r.read_string());
+
+    case 't':
+    case 'f':
+      return make_shared_in_arena<CheckboxField>(arena, r.read_bool());
+
+    case '{': {
+      DictCellContents dict;
+      dict.read(r);
+      if (dict.is_button()) {
+        return make_shared_in_arena<ButtonField>(arena, std::move(dict.url), std::move(dict.label));
+      } else if (dict.is_collaborator()) {
+        return make_shared_in_arena<CollaboratorField>(arena, std::move(dict).to_collaborator());
+      } else {
+        throw runtime_error("unrecognized dict cell format");
+      }
+    }
+
+    case '[': {
+      r.expect('[');
+      if (r.consume(']')) {
+        return make_shared_in_arena<StringArrayField>(arena);
+      }
+
+      char item0_ch = r.peek();
+      if (item0_ch == '\"') {
+        vector<string> values;
+        do {
+          values.emplace_back(r.read_string());
+        } while (r.consume(','));
+        r.expect(']');
+        return make_shared_in_arena<StringArrayField>(arena, std::move(values));
+
+      } else if (item0_ch == '-' || (item0_ch >= '0' && item0_ch <= '9')) {
+        vector<double> values;
+        do {
+          values.emplace_back(r.read_number().as_float);
+        } while (r.consume(','));
+        r.expect(']');
+        return make_shared_in_arena<NumberArrayField>(arena, std::move(values));
+
+      } else if (item0_ch == '{') {
+        vector<DictCellContents> items;
+        do {
+          items.emplace_back().read(r);
+        } while (r.consume(','));
+        r.expect(']');
+
+        if (items[0].is_collaborator()) {
+          vector<CollaboratorField> values;
+          values.reserve(items.size());
+          for (auto& item : items) {
+            if (!item.is_collaborator()) {
+              throw runtime_error("Inconsistent list subcell format");
+            }
+            values.emplace_back(std::move(item).to_collaborator());
+          }
+          return make_shared_in_arena<MultiCollaboratorField>(arena, std::move(values));
+
+        } else if (items[0].is_attachment()) {
+          vector<Attachment> values;
+          values.reserve(items.size());
+          for (auto& item : items) {
+            values.emplace_back(std::move(item).to_attachment());
+          }
+          return make_shared_in_arena<AttachmentField>(arena, std::move(values));
+
+        } else {
+          throw runtime_error("Unrecognized list subcell format");
+        }
+      } else {
+        throw runtime_error("Unrecognized list cell format");
+      }
+    }
+
+    default: {
+      auto num = r.read_number();
+      if (num.is_integer) {
+        return make_shared_in_arena<IntegerField>(arena, num.as_int);
+      } else {
+        return make_shared_in_arena<FloatField>(arena, num.as_float);
+      }
+    }
+  }
+}
+
+RecordFields::RecordFields(shared_ptr<StringInterner> interner) : interner(std::move(interner)) {}
+
+RecordFields::RecordFields(const unordered_map<string, shared_ptr<Field>>& fields) {
+  this->reserve(fields.size());
+  for (const auto& [key, field] : fields) {
+    this->append(key, field);
+  }
+  this->finish_appending();
+}
+
+RecordFields& RecordFields::operator=(const RecordFields& other) {
+  // value_type isn't assignable, so copy the cells into a new vector instead
+  // of into this one's existing elements
+  this->interner = other.interner;
+  this->entries = vector<value_type>(other.entries);
+  this->appended_entries = other.appended_entries;
+  return *this;
+}
+
+string_view RecordFields::intern(string_view key) {
+  if (!this->interner) {
+    // This interner is only used by this object and its copies, so it doesn't
+    // need more than one shard
+    this->interner = make_shared<StringInterner>(1);
+  }
+  return this->interner->intern(key);
+}
+
+static inline bool entry_key_less(const RecordFields::value_type& entry, string_view key) {
+  return entry.first < key;
+}
+
+RecordFields::iterator RecordFields::find(string_view key) {
+  auto it = lower_bound(this->entries.begin(), this->entries.end(), key, entry_key_less);
+  return ((it != this->entries.end()) && (it->first == key)) ? it : this->entries.end();
+}
+
+RecordFields::const_iterator RecordFields::find(string_view key) const {
+  auto it = lower_bound(this->entries.begin(), this->entries.end(), key, entry_key_less);
+  return ((it != this->entries.end()) && (it->first == key)) ? it : this->entries.end();
+}
+
+shared_ptr<Field>& RecordFields::at(string_view key) {
+  auto it = this->find(key);
+  if (it == this->entries.end()) {
+    throw out_of_range(fmt::format("record does not have field {}", key));
+  }
+  return it->second;
+}
+
+const shared_ptr<Field>& RecordFields::at(string_view key) const {
+  auto it = this->find(key);
+  if (it == this->entries.end()) {
+    throw out_of_range(fmt::format("record does not have field {}", key));
+  }
+  return it->second;
+}
+
+shared_ptr<Field>& RecordFields::operator[](string_view key) {
+  return this->emplace(key, nullptr).first->second;
+}
+
+pair<RecordFields::iterator, bool> RecordFields::emplace(string_view key, shared_ptr<Field> field) {
+  auto it = lower_bound(this->entries.begin(), this->entries.end(), key, entry_key_less);
+  if ((it != this->entries.end()) && (it->first == key)) {
+    return make_pair(it, false);
+  }
+  size_t index = it - this->entries.begin();
+  string_view interned_key = this->intern(key);
+  if (index == this->entries.size()) {
+    this->entries.emplace_back(interned_key, std::move(field));
+  } else {
+    // value_type's key is const, so the later cells can't be move-assigned
+    // into their new positions; instead, each one is destroyed and recreated
+    // one position later
+    this->entries.emplace_back(std::move(this->entries.back()));
+    for (size_t z = this->entries.size() - 2; z > index; z--) {
+      std::destroy_at(&this->entries[z]);
+      std::construct_at(&this->entries[z], std::move(this->entries[z - 1]));
+    }
+    std::destroy_at(&this->entries[index]);
+    std::construct_at(&this->entries[index], interned_key, std::move(field));
+  }
+  return make_pair(this->entries.begin() + index, true);
+}
+
+RecordFields::iterator RecordFields::erase(const_iterator it) {
+  // As in emplace(), the later cells are recreated one position earlier
+  size_t index = it - this->entries.cbegin();
+  for (size_t z = index; z + 1 < this->entries.size(); z++) {
+    std::destroy_at(&this->entries[z]);
+    std::construct_at(&this->entries[z], std::move(this->entries[z + 1]));
+  }
+  this->entries.pop_back();
+  return this->entries.begin() + index;
+}
+
+size_t RecordFields::erase(string_view key) {
+  auto it = this->find(key);
+  if (it == this->entries.end()) {
+    return 0;
+  }
+  this->erase(it);
+  return 1;
+}
+
+unordered_map<string, shared_ptr<Field>> RecordFields::to_map() const {
+  unordered_map<string, shared_ptr<Field>> ret;
+  for (const auto& [key, field] : this->entries) {
+    ret.emplace(key, field);
+  }
+  return ret;
+}
+
+void RecordFields::append(string_view key, shared_ptr<Field> field) {
+  this->appended_entries.emplace_back(this->intern(key), std::move(field));
+}
+
+void RecordFields::finish_appending() {
+  if (this->appended_entries.empty()) {
+    return;
+  }
+  auto key_less = [](const AppendedEntry& a, const AppendedEntry& b) -> bool {
+    return a.first < b.first;
+  };
+  if (!is_sorted(this->appended_entries.begin(), this->appended_entries.end(), key_less)) {
+    stable_sort(this->appended_entries.begin(), this->appended_entries.end(), key_less);
+  }
+
+  // Merge the appended cells into the existing ones. If a key appears more
+  // than once, keep the existing cell, or the first appended one if there
+  // isn't an existing cell.
+  vector<value_type> new_entries;
+  new_entries.reserve(this->entries.size() + this->appended_entries.size());
+  auto existing_it = this->entries.begin();
+  for (auto& [key, field] : this->appended_entries) {
+    for (; (existing_it != this->entries.end()) && (existing_it->first < key); existing_it++) {
+      new_entries.emplace_back(std::move(*existing_it));
+    }
+    if (((existing_it != this->entries.end()) && (existing_it->first == key)) ||
+        (!new_entries.empty() && (new_entries.back().first == key))) {
+      continue;
+    }
+    new_entries.emplace_back(key, std::move(field));
+  }
+  for (; existing_it != this->entries.end(); existing_it++) {
+    new_entries.emplace_back(std::move(*existing_it));
+  }
+  new_entries.shrink_to_fit();
+  this->entries = std::move(new_entries);
+  // Free the appended cells' memory, since most records are never appended to
+  // again
+  this->appended_entries = vector<AppendedEntry>();
+}
+
 Record::Record(const phosg::JSON& json) {
   const auto& dict = json.as_dict();
   const auto& id_from_dict = dict.at("id")->as_string();
@@ -275,8 +757,59 @@ Record::Record(const phosg::JSON& json) {
   }
   strcpy(this->id, id_from_dict.c_str());
   this->creation_time = parse_airtable_time(dict.at("createdTime")->as_string());
-  for (const auto& it : dict.at("fields")->as_dict()) {
-    this->fields.emplace(it.first, this->parse_field(*it.second));
+  const auto& fields_dict = dict.at("fields")->as_dict();
+  this->fields.reserve(fields_dict.size());
+  for (const auto& it : fields_dict) {
+    this->fields.append(it.first, this->parse_field(*it.second));
+  }
+  this->fields.finish_appending();
+  auto comment_count_it = dict.find("commentCount");
+  if (comment_count_it != dict.end()) {
+    this->comment_count = comment_count_it->second->as_int();
+  }
+}
+
+Record::Record(
+    JSONReader& r,
+    const TableDecoder* decoder,
+    const shared_ptr<PageArena>& arena,
+    const shared_ptr<StringInterner>& interner)
+    : creation_time(0),
+      fields(interner) {
+  bool has_id = false;
+  bool has_creation_time = false;
+  string scratch;
+  r.read_object([&](string_view key) -> void {
+    if (key == "id") {
+      string_view id = r.read_string_view(scratch);
+      if (id.size() != 17) {
+        throw runtime_error("Record ID length is incorrect");
+      }
+      memcpy(this->id, id.data(), 17);
+      this->id[17] = 0;
+      has_id = true;
+    } else if (key == "createdTime") {
+      this->creation_time = parse_airtable_time(r.read_string_view(scratch));
+      has_creation_time = true;
+    } else if (key == "fields") {
+      if (decoder) {
+        r.read_object([&](string_view field_key) -> void {
+          this->fields.append(field_key, decoder->decode_field(field_key, r, arena));
+        });
+      } else {
+        r.read_object([&](string_view field_key) -> void {
+          this->fields.append(field_key, Record::parse_field(r, arena));
+        });
+      }
+      this->fields.finish_appending();
+    } else if (key == "commentCount") {
+      this->comment_count = r.read_number().as_int;
+    } else {
+      r.skip_value();
+    }
+  });
+  if (!has_id || !has_creation_time) {
+    throw runtime_error("Record is missing id or createdTime");
   }
 }
 
@@ -285,14 +818,34 @@ string Record::str() const {
       this->id, format_airtable_time(this->creation_time), this->json_for_create().serialize());
 }
 
-phosg::JSON Record::json_for_create(const unordered_map<string, shared_ptr<Field>>& fields) {
+template <typename FieldsT>
+static phosg::JSON json_for_create_t(const FieldsT& fields) {
   auto fields_dict = phosg::JSON::dict();
   for (const auto& it : fields) {
-    fields_dict.emplace(it.first, it.second->to_json());
+    fields_dict.emplace(string(it.first), it.second->to_json());
   }
   return phosg::JSON::dict({{"fields", std::move(fields_dict)}});
 }
 
+template <typename FieldsT>
+static void write_fields_json_t(JSONWriter& w, const FieldsT& fields) {
+  w.write_key("fields");
+  w.begin_object();
+  for (const auto& it : fields) {
+    w.write_key(it.first);
+    it.second->write_json(w);
+  }
+  w.end_object();
+}
+
+phosg::JSON Record::json_for_create(const unordered_map<string, shared_ptr<Field>>& fields) {
+  return json_for_create_t(fields);
+}
+
+phosg::JSON Record::json_for_create(const RecordFields& fields) {
+  return json_for_create_t(fields);
+}
+
 phosg::JSON Record::json_for_create() const {
   return Record::json_for_create(this->fields);
 }
@@ -302,3 +855,83 @@ phosg::JSON Record::json_for_update() const {
   json.emplace("id", this->id);
   return json;
 }
+
+void Record::write_json_for_create(JSONWriter& w, const unordered_map<string, shared_ptr<Field>>& fields) {
+  w.begin_object();
+  write_fields_json_t(w, fields);
+  w.end_object();
+}
+
+void Record::write_json_for_create(JSONWriter& w, const RecordFields& fields) {
+  w.begin_object();
+  write_fields_json_t(w, fields);
+  w.end_object();
+}
+
+void Record::write_json_for_update(
+    JSONWriter& w, const string& record_id, const unordered_map<string, shared_ptr<Field>>& fields) {
+  w.begin_object();
+  w.write_key("id");
+  w.write_string(record_id);
+  write_fields_json_t(w, fields);
+  w.end_object();
+}
+
+void Record::write_json_for_update(JSONWriter& w, const string& record_id, const RecordFields& fields) {
+  w.begin_object();
+  w.write_key("id");
+  w.write_string(record_id);
+  write_fields_json_t(w, fields);
+  w.end_object();
+}
+
+void Record::write_json_for_create(JSONWriter& w) const {
+  Record::write_json_for_create(w, this->fields);
+}
+
+void Record::write_json_for_update(JSONWriter& w) const {
+  Record::write_json_for_update(w, this->id, this->fields);
+}
+
+TableSchema::TableSchema(const phosg::JSON& json) {
+  this->name = json.at("name").as_string();
+  this->primary_field_id = json.at("primary_field_id").as_string();
+  for (const auto& [field_id, field_json] : json.at("fields").as_dict()) {
+    FieldSchema& field = this->fields[field_id];
+    field.name = field_json->at("name").as_string();
+    field.type = field_json->at("type").as_string();
+    const auto& field_dict = field_json->as_dict();
+    auto options_it = field_dict.find("options");
+    if (options_it != field_dict.end()) {
+      field.options = *options_it->second;
+    }
+  }
+  for (const auto& [view_id, view_json] : json.at("views").as_dict()) {
+    ViewSchema& view = this->views[view_id];
+    view.name = view_json->at("name").as_string();
+    view.type = view_json->at("type").as_string();
+  }
+}
+
+phosg::JSON TableSchema::to_json() const {
+  auto fields_dict = phosg::JSON::dict();
+  for (const auto& [field_id, field] : this->fields) {
+    auto field_dict = phosg::JSON::dict({{"name", field.name}, {"type", field.type}});
+    if (!field.options.is_null()) {
+      field_dict.insert("options", field.options);
+    }
+    fields_dict.emplace(field_id, std::move(field_dict));
+  }
+
+  auto views_dict = phosg::JSON::dict();
+  for (const auto& [view_id, view] : this->views) {
+    views_dict.emplace(view_id, phosg::JSON::dict({{"name", view.name}, {"type", view.type}}));
+  }
+
+  return phosg::JSON::dict({
+      {"name", this->name},
+      {"primary_field_id", this->primary_field_id},
+      {"fields", std::move(fields_dict)},
+      {"views", std::move(views_dict)},
+  });
+}
@@ -5,11 +5,18 @@
 #include <memory>
 #include <phosg/JSON.hh>
 #include <string>
+#include <string_view>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
-uint64_t parse_airtable_time(const std::string& time);
-std::string format_airtable_time(uint64_t time);
+#include "AirtableTime.hh"
+#include "StringInterner.hh"
+
+class JSONReader;
+class JSONWriter;
+class PageArena;
+class TableDecoder;
 
 class Field {
 public:
@@ -29,6 +36,8 @@ public:
   ValueType type;
 
   virtual phosg::JSON to_json() const = 0;
+  // Writes the same JSON that to_json returns, without building a DOM
+  virtual void write_json(JSONWriter& w) const = 0;
 
   virtual ~Field() = default;
 
@@ -45,6 +54,7 @@ public:
   explicit StringField(std::string&& value);
   virtual ~StringField() = default;
   virtual phosg::JSON to_json() const;
+  virtual void write_json(JSONWriter& w) const;
 };
 
 class IntegerField : public Field {
@@ -55,6 +65,7 @@ public:
   explicit IntegerField(int64_t value);
   virtual ~IntegerField() = default;
   virtual phosg::JSON to_json() const;
+  virtual void write_json(JSONWriter& w) const;
 };
 
 class FloatField : public Field {
@@ -65,6 +76,7 @@ public:
   explicit FloatField(double value);
   virtual ~FloatField() = default;
   virtual phosg::JSON to_json() const;
+  virtual void write_json(JSONWriter& w) const;
 };
 
 class ButtonField : public Field {
@@ -77,6 +89,7 @@ public:
   ButtonField(std::string&& url, std::string&& label);
   virtual ~ButtonField() = default;
   virtual phosg::JSON to_json() const;
+  virtual void write_json(JSONWriter& w) const;
 };
 
 class CheckboxField : public Field {
@@ -87,6 +100,7 @@ public:
   explicit CheckboxField(bool value);
   virtual ~CheckboxField() = default;
   virtual phosg::JSON to_json() const;
+  virtual void write_json(JSONWriter& w) const;
 };
 
 class StringArrayField : public Field {
@@ -98,6 +112,7 @@ public:
   explicit StringArrayField(std::vector<std::string>&& value);
   virtual ~StringArrayField() = default;
   virtual phosg::JSON to_json() const;
+  virtual void write_json(JSONWriter& w) const;
 };
 
 class NumberArrayField : public Field {
@@ -109,6 +124,7 @@ public:
   explicit NumberArrayField(std::vector<double>&& value);
   virtual ~NumberArrayField() = default;
   virtual phosg::JSON to_json() const;
+  virtual void write_json(JSONWriter& w) const;
 };
 
 class CollaboratorField : public Field {
@@ -126,8 +142,11 @@ public:
       std::string&& name,
       std::string&& email,
       std::string&& user_id);
+  // Reads a collaborator object directly from JSON text
+  explicit CollaboratorField(JSONReader& r);
   virtual ~CollaboratorField() = default;
   virtual phosg::JSON to_json() const;
+  virtual void write_json(JSONWriter& w) const;
 };
 
 class MultiCollaboratorField : public Field {
@@ -139,25 +158,30 @@ public:
   explicit MultiCollaboratorField(std::vector<CollaboratorField>&& value);
   virtual ~MultiCollaboratorField() = default;
   virtual phosg::JSON to_json() const;
+  virtual void write_json(JSONWriter& w) const;
 };
 
 struct Attachment {
   std::string mime_type;
-  size_t size;
+  size_t size = 0;
   std::string filename;
   std::string url;
   std::string attachment_id;
-  size_t width; // Zero if not an image
-  size_t height; // Zero if not an image
+  size_t width = 0; // Zero if not an image
+  size_t height = 0; // Zero if not an image
   struct Thumbnail {
-    size_t width;
-    size_t height;
+    size_t width = 0;
+    size_t height = 0;
     std::string url;
   };
   std::unordered_map<std::string, Thumbnail> thumbnails; // Empty if not an image
 
+  Attachment() = default;
   Attachment(const phosg::JSON& json);
+  // Reads an attachment object directly from JSON text
+  explicit Attachment(JSONReader& r);
   phosg::JSON to_json() const;
+  void write_json(JSONWriter& w) const;
 };
 
 class AttachmentField : public Field {
@@ -169,22 +193,156 @@ public:
   explicit AttachmentField(std::vector<Attachment>&& value);
   virtual ~AttachmentField() = default;
   virtual phosg::JSON to_json() const;
+  virtual void write_json(JSONWriter& w) const;
+};
+
+// A Record's cells, keyed by field name (or ID). This has most of the
+// interface of the unordered_map that it replaced, but its keys are views of
+// strings stored in a StringInterner, so if the records from a table share an
+// interner (as the ones returned by an AirtableClient do), the table's field
+// names are stored once instead of once per record. The cells are kept in a
+// vector sorted by key, so a record costs one allocation for its cells instead
+// of one per cell, and lookups are a binary search.
+//
+// Iteration yields (const std::string_view, std::shared_ptr<Field>) pairs in
+// key order. Like with unordered_map, adding or removing cells invalidates
+// iterators. Unlike unordered_map, adding or removing a cell anywhere but at
+// the end takes time proportional to the number of cells.
+class RecordFields {
+public:
+  using value_type = std::pair<const std::string_view, std::shared_ptr<Field>>;
+  using iterator = std::vector<value_type>::iterator;
+  using const_iterator = std::vector<value_type>::const_iterator;
+
+  // If no interner is given, the object creates its own the first time a cell
+  // is added, which holds only this object's keys (and those of its copies).
+  // To share keys between many records, give them all the same interner.
+  RecordFields() = default;
+  explicit RecordFields(std::shared_ptr<StringInterner> interner);
+  RecordFields(const std::unordered_map<std::string, std::shared_ptr<Field>>& fields);
+  RecordFields(const RecordFields&) = default;
+  RecordFields(RecordFields&&) = default;
+  RecordFields& operator=(const RecordFields& other);
+  RecordFields& operator=(RecordFields&&) = default;
+  ~RecordFields() = default;
+
+  inline iterator begin() {
+    return this->entries.begin();
+  }
+  inline iterator end() {
+    return this->entries.end();
+  }
+  inline const_iterator begin() const {
+    return this->entries.begin();
+  }
+  inline const_iterator end() const {
+    return this->entries.end();
+  }
+  inline size_t size() const {
+    return this->entries.size();
+  }
+  inline bool empty() const {
+    return this->entries.empty();
+  }
+  inline void clear() {
+    this->entries.clear();
+    this->appended_entries.clear();
+  }
+
+  iterator find(std::string_view key);
+  const_iterator find(std::string_view key) const;
+  inline bool contains(std::string_view key) const {
+    return this->find(key) != this->end();
+  }
+  inline size_t count(std::string_view key) const {
+    return this->contains(key) ? 1 : 0;
+  }
+  // Throws std::out_of_range if the key isn't present
+  std::shared_ptr<Field>& at(std::string_view key);
+  const std::shared_ptr<Field>& at(std::string_view key) const;
+  // Adds a null cell if the key isn't present
+  std::shared_ptr<Field>& operator[](std::string_view key);
+  // Does nothing (and returns false) if the key is already present
+  std::pair<iterator, bool> emplace(std::string_view key, std::shared_ptr<Field> field);
+  iterator erase(const_iterator it);
+  size_t erase(std::string_view key);
+
+  std::unordered_map<std::string, std::shared_ptr<Field>> to_map() const;
+
+  // For adding many cells at once (e.g. when parsing a record), which is
+  // faster than calling emplace for each one. append() adds a cell without
+  // keeping the cells sorted or checking for duplicate keys; after the last
+  // call to append(), call finish_appending() before using the object in any
+  // other way. It sorts the cells and removes duplicates, keeping the first
+  // one as emplace would.
+  void append(std::string_view key, std::shared_ptr<Field> field);
+  void finish_appending();
+  inline void reserve(size_t count) {
+    this->appended_entries.reserve(count);
+  }
+
+  // Returns null if no interner was given and no cells have been added yet
+  inline const std::shared_ptr<StringInterner>& get_interner() const {
+    return this->interner;
+  }
+
+private:
+  // value_type's key is const, so it can't be sorted or moved within a vector;
+  // append() uses this type instead, and the cells are converted to
+  // value_type in finish_appending()
+  using AppendedEntry = std::pair<std::string_view, std::shared_ptr<Field>>;
+
+  std::string_view intern(std::string_view key);
+
+  std::shared_ptr<StringInterner> interner;
+  std::vector<value_type> entries;
+  std::vector<AppendedEntry> appended_entries;
 };
 
 struct Record {
   char id[18]; // always 17 chars long (+ \0)
   uint64_t creation_time;
-  std::unordered_map<std::string, std::shared_ptr<Field>> fields;
+  // Keyed by field name, or by field ID if the records were listed with
+  // ListRecordsOptions::return_fields_by_field_id
+  RecordFields fields;
+  // Only populated if the records were listed with
+  // ListRecordsOptions::include_comment_count
+  size_t comment_count = 0;
 
   Record() = default;
   Record(const phosg::JSON& json);
+  // Reads a record object directly from JSON text, without building a DOM.
+  // Without a decoder, produces the same result as the phosg::JSON
+  // constructor. With a decoder, cells are decoded according to the table's
+  // schema instead of by guessing their types from their contents (see
+  // TableDecoder). If an arena is given, the Field objects are allocated from
+  // it (see PageArena). If an interner is given, field names are interned in
+  // it; otherwise, the record gets its own (see RecordFields).
+  explicit Record(
+      JSONReader& r,
+      const TableDecoder* decoder = nullptr,
+      const std::shared_ptr<PageArena>& arena = nullptr,
+      const std::shared_ptr<StringInterner>& interner = nullptr);
 
   static std::shared_ptr<Field> parse_field(const phosg::JSON& json);
+  static std::shared_ptr<Field> parse_field(JSONReader& r, const std::shared_ptr<PageArena>& arena = nullptr);
 
   static phosg::JSON json_for_create(const std::unordered_map<std::string, std::shared_ptr<Field>>& fields);
+  static phosg::JSON json_for_create(const RecordFields& fields);
   phosg::JSON json_for_create() const;
   phosg::JSON json_for_update() const;
 
+  // Like the json_for_* functions, but write directly to a JSONWriter
+  static void write_json_for_create(JSONWriter& w, const std::unordered_map<std::string, std::shared_ptr<Field>>& fields);
+  static void write_json_for_create(JSONWriter& w, const RecordFields& fields);
+  static void write_json_for_update(
+      JSONWriter& w,
+      const std::string& record_id,
+      const std::unordered_map<std::string, std::shared_ptr<Field>>& fields);
+  static void write_json_for_update(JSONWriter& w, const std::string& record_id, const RecordFields& fields);
+  void write_json_for_create(JSONWriter& w) const;
+  void write_json_for_update(JSONWriter& w) const;
+
   std::string str() const;
 };
 
@@ -205,6 +363,11 @@ struct TableSchema {
     std::string type;
   };
   std::unordered_map<std::string, ViewSchema> views;
+
+  TableSchema() = default;
+  // Parses the format produced by to_json (not the Airtable API's format)
+  explicit TableSchema(const phosg::JSON& json);
+  phosg::JSON to_json() const;
 };
 
 struct BaseInfo {
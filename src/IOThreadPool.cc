@@ -0,0 +1,84 @@
+#include "IOThreadPool.hh"
+
+#include <exception>
+
+using namespace std;
+
+static size_t resolve_num_threads(size_t num_threads) {
+  if (num_threads == 0) {
+    num_threads = thread::hardware_concurrency();
+  }
+  return num_threads ? num_threads : 1;
+}
+
+IOThreadPool::IOThreadPool(size_t num_threads, ErrorHandler error_handler)
+    : error_handler(std::move(error_handler)),
+      io_context(static_cast<int>(resolve_num_threads(num_threads))),
+      work_guard(asio::make_work_guard(this->io_context)) {
+  num_threads = resolve_num_threads(num_threads);
+  this->threads.reserve(num_threads);
+  for (size_t z = 0; z < num_threads; z++) {
+    this->threads.emplace_back([this]() -> void {
+      // An exception escaping from a handler would otherwise terminate the
+      // process; report it and keep running the remaining work instead
+      for (;;) {
+        try {
+          this->io_context.run();
+          break;
+        } catch (...) {
+          this->handle_error(current_exception());
+        }
+      }
+    });
+  }
+}
+
+IOThreadPool::~IOThreadPool() {
+  // Unlike join(), this doesn't rethrow handlers' exceptions
+  this->stop();
+  this->join_threads();
+}
+
+void IOThreadPool::handle_error(exception_ptr exc) {
+  if (this->error_handler) {
+    try {
+      this->error_handler(exc);
+    } catch (...) {
+      // The handler itself failed; there's nowhere left to report this
+    }
+  } else {
+    lock_guard g(this->first_error_lock);
+    if (!this->first_error) {
+      this->first_error = exc;
+    }
+  }
+}
+
+void IOThreadPool::finish() {
+  this->work_guard.reset();
+}
+
+void IOThreadPool::stop() {
+  this->work_guard.reset();
+  this->io_context.stop();
+}
+
+void IOThreadPool::join_threads() {
+  for (auto& t : this->threads) {
+    if (t.joinable()) {
+      t.join();
+    }
+  }
+}
+
+void IOThreadPool::join() {
+  this->join_threads();
+  exception_ptr exc;
+  {
+    lock_guard g(this->first_error_lock);
+    exc = std::exchange(this->first_error, nullptr);
+  }
+  if (exc) {
+    rethrow_exception(exc);
+  }
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <asio.hpp>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Runs an io_context on a fixed number of threads, so a single AirtableClient
+// (and everything else using the same io_context) can use all of them. The
+// threads start when the pool is constructed and run until stop() is called
+// or the pool is destroyed; the pool keeps the io_context running even when
+// it has no work.
+//
+// AsyncHTTPClient runs each connection on its own strand, and the client's
+// shared state (the field name interner, decoders' select caches, and
+// SchemaCache) is safe to use from multiple threads, so one client can be
+// shared by all the coroutines running on the pool. Objects that a single
+// coroutine creates and uses (e.g. a TableSnapshot or LazyRecord) are not
+// thread-safe, and should not be shared between coroutines without a strand.
+class IOThreadPool {
+public:
+  // Called with any exception that escapes from a handler on the io_context
+  // (for example, from a coroutine spawned with asio::detached). The thread
+  // that ran the handler continues running the io_context afterward. The
+  // handler is called on that thread, so it must be thread-safe.
+  using ErrorHandler = std::function<void(std::exception_ptr exc)>;
+
+  // num_threads = 0 means to use one thread per core. If no error handler is
+  // given, join() rethrows the first exception that escapes from a handler.
+  explicit IOThreadPool(size_t num_threads = 0, ErrorHandler error_handler = nullptr);
+  IOThreadPool(const IOThreadPool&) = delete;
+  IOThreadPool(IOThreadPool&&) = delete;
+  IOThreadPool& operator=(const IOThreadPool&) = delete;
+  IOThreadPool& operator=(IOThreadPool&&) = delete;
+  // Stops the io_context (abandoning any coroutines still running on it) and
+  // waits for the threads to exit. Like join(), this must not be called from
+  // one of the pool's threads.
+  ~IOThreadPool();
+
+  inline asio::io_context& get_io_context() {
+    return this->io_context;
+  }
+  inline size_t num_threads() const {
+    return this->threads.size();
+  }
+
+  // Allows the threads to exit once all work on the io_context is done. The
+  // io_context can still be used until then.
+  void finish();
+  // Stops the io_context immediately, abandoning any pending work
+  void stop();
+  // Waits for all threads to exit. This does not return until finish() or
+  // stop() is called (from another thread or from a coroutine on the pool),
+  // and must not be called from one of the pool's threads. If the pool has no
+  // error handler and a handler threw an exception, this rethrows the first
+  // such exception after the threads have exited.
+  void join();
+
+  // Runs a coroutine on the pool and blocks the calling thread until it
+  // completes, then returns its result (or rethrows its exception). This must
+  // not be called from one of the pool's threads.
+  template <typename T>
+  T run_sync(asio::awaitable<T> aw) {
+    return asio::co_spawn(this->io_context, std::move(aw), asio::use_future).get();
+  }
+
+private:
+  void handle_error(std::exception_ptr exc);
+  void join_threads();
+
+  ErrorHandler error_handler;
+  std::mutex first_error_lock;
+  std::exception_ptr first_error;
+  asio::io_context io_context;
+  asio::executor_work_guard<asio::io_context::executor_type> work_guard;
+  std::vector<std::thread> threads;
+};
@@ -0,0 +1,212 @@
+#include "IncrementalSync.hh"
+
+#include <inttypes.h>
+
+#include <chrono>
+#include <format>
+#include <stdexcept>
+#include <unordered_set>
+
+using namespace std;
+
+// Airtable limits the length of formulas, so record ID lookups (used to fetch
+// records that a deletion scan found but the replica doesn't have) are split
+// into batches of this size.
+static constexpr size_t RECORD_ID_LOOKUP_BATCH_SIZE = 50;
+
+static uint64_t now_usecs() {
+  return chrono::duration_cast<chrono::microseconds>(chrono::system_clock::now().time_since_epoch()).count();
+}
+
+TableSyncer::TableSyncer(
+    AirtableClient& client,
+    const string& base_id,
+    const string& table_name,
+    const Options& options)
+    : client(client),
+      base_id(base_id),
+      table_name(table_name),
+      options(options),
+      hwm(0),
+      cycles_since_deletion_scan(0) {
+  if (!this->options.last_modified_field.empty() && !this->options.fields.empty()) {
+    bool found = false;
+    for (const auto& field : this->options.fields) {
+      found |= (field == this->options.last_modified_field);
+    }
+    if (!found) {
+      this->options.fields.emplace_back(this->options.last_modified_field);
+    }
+  }
+}
+
+void TableSyncer::seed(vector<Record>&& records, uint64_t high_water_mark) {
+  this->replica.clear();
+  for (auto& record : records) {
+    this->replica.upsert(std::move(record));
+  }
+  this->hwm = high_water_mark;
+  this->cycles_since_deletion_scan = 0;
+}
+
+string TableSyncer::modified_since_formula(uint64_t since_usecs) const {
+  string formula = std::format("IS_AFTER(LAST_MODIFIED_TIME(), DATETIME_PARSE('{}'))", format_airtable_time(since_usecs));
+  if (this->options.filter_formula.empty()) {
+    return formula;
+  }
+  return std::format("AND({}, {})", this->options.filter_formula, formula);
+}
+
+void TableSyncer::merge_record(Record&& record, CycleResult& result) {
+  this->update_high_water_mark_from_record(record);
+
+  string id = record.id;
+  const Record* existing = this->replica.get(id);
+  if (!existing) {
+    result.added_ids.emplace_back(std::move(id));
+    this->replica.upsert(std::move(record));
+    return;
+  }
+
+  // Records modified within the overlap window are fetched on every cycle
+  // until the window passes them, so only report actual content changes
+  if (existing->json_for_create() != record.json_for_create()) {
+    result.updated_ids.emplace_back(std::move(id));
+    this->replica.upsert(std::move(record));
+  }
+}
+
+void TableSyncer::update_high_water_mark_from_record(const Record& record) {
+  if (this->options.last_modified_field.empty()) {
+    return;
+  }
+  auto field_it = record.fields.find(this->options.last_modified_field);
+  if (field_it == record.fields.end() || field_it->second->type != Field::ValueType::String) {
+    return;
+  }
+  try {
+    uint64_t t = parse_airtable_time(static_cast<const StringField&>(*field_it->second).value);
+    this->hwm = max<uint64_t>(this->hwm, t);
+  } catch (const runtime_error&) {
+    // The field isn't a timestamp; ignore it
+  }
+}
+
+asio::awaitable<void> TableSyncer::fetch_into_replica(
+    const AirtableClient::ListRecordsOptions& list_options, CycleResult& result, unordered_set<string>* seen_ids) {
+  string offset;
+  do {
+    auto page = co_await this->client.list_records_page(this->base_id, this->table_name, &list_options, offset);
+    result.pages_fetched++;
+    for (auto& record : page.first) {
+      if (seen_ids) {
+        seen_ids->emplace(record.id);
+      }
+      this->merge_record(std::move(record), result);
+    }
+    offset = std::move(page.second);
+  } while (!offset.empty());
+}
+
+asio::awaitable<void> TableSyncer::run_deletion_scan(CycleResult& result) {
+  AirtableClient::ListRecordsOptions scan_options;
+  scan_options.filter_formula = this->options.filter_formula;
+  scan_options.page_size = this->options.page_size;
+  scan_options.decoder = this->options.decoder;
+  if (!this->options.id_scan_field.empty()) {
+    scan_options.fields.emplace_back(this->options.id_scan_field);
+  } else {
+    scan_options.fields = this->options.fields;
+  }
+
+  unordered_set<string> live_ids;
+  string offset;
+  do {
+    auto page = co_await this->client.list_records_page(this->base_id, this->table_name, &scan_options, offset);
+    result.pages_fetched++;
+    for (const auto& record : page.first) {
+      live_ids.emplace(record.id);
+    }
+    offset = std::move(page.second);
+  } while (!offset.empty());
+
+  for (const auto& it : this->replica.all()) {
+    if (!live_ids.erase(it.first)) {
+      result.deleted_ids.emplace_back(it.first);
+    }
+  }
+  for (const auto& id : result.deleted_ids) {
+    this->replica.erase(id);
+  }
+
+  // Anything left in live_ids exists on the server but not in the replica.
+  // This can happen if a record started matching the filter formula without
+  // being modified (e.g. because the formula depends on the current time), so
+  // fetch these records explicitly.
+  vector<string> missing_ids(live_ids.begin(), live_ids.end());
+  for (size_t start = 0; start < missing_ids.size(); start += RECORD_ID_LOOKUP_BATCH_SIZE) {
+    size_t end = min<size_t>(start + RECORD_ID_LOOKUP_BATCH_SIZE, missing_ids.size());
+    string formula = "OR(";
+    for (size_t z = start; z < end; z++) {
+      formula += std::format("{}RECORD_ID()='{}'", (z == start) ? "" : ",", missing_ids[z]);
+    }
+    formula += ")";
+
+    AirtableClient::ListRecordsOptions lookup_options;
+    lookup_options.fields = this->options.fields;
+    lookup_options.filter_formula = std::move(formula);
+    lookup_options.page_size = this->options.page_size;
+    lookup_options.decoder = this->options.decoder;
+    co_await this->fetch_into_replica(lookup_options, result);
+  }
+
+  this->cycles_since_deletion_scan = 0;
+  result.ran_deletion_scan = true;
+}
+
+asio::awaitable<TableSyncer::CycleResult> TableSyncer::sync() {
+  CycleResult result;
+  uint64_t cycle_start_time = now_usecs();
+
+  AirtableClient::ListRecordsOptions list_options;
+  list_options.fields = this->options.fields;
+  list_options.page_size = this->options.page_size;
+  list_options.decoder = this->options.decoder;
+
+  if (this->hwm == 0) {
+    // No high-water mark yet, so read the entire table. Anything in the
+    // replica that isn't returned has been deleted.
+    result.was_full_read = true;
+    list_options.filter_formula = this->options.filter_formula;
+    unordered_set<string> seen_ids;
+    co_await this->fetch_into_replica(list_options, result, &seen_ids);
+    for (const auto& it : this->replica.all()) {
+      if (!seen_ids.count(it.first)) {
+        result.deleted_ids.emplace_back(it.first);
+      }
+    }
+    for (const auto& id : result.deleted_ids) {
+      this->replica.erase(id);
+    }
+    this->cycles_since_deletion_scan = 0;
+
+  } else {
+    uint64_t since = (this->hwm > this->options.overlap_usecs) ? (this->hwm - this->options.overlap_usecs) : 0;
+    list_options.filter_formula = this->modified_since_formula(since);
+    co_await this->fetch_into_replica(list_options, result);
+
+    this->cycles_since_deletion_scan++;
+    if (this->options.deletion_scan_interval &&
+        (this->cycles_since_deletion_scan >= this->options.deletion_scan_interval)) {
+      co_await this->run_deletion_scan(result);
+    }
+  }
+
+  // If there's no last modified field (or it was empty in every record we've
+  // seen so far), fall back to the local clock
+  if (this->options.last_modified_field.empty() || (this->hwm == 0)) {
+    this->hwm = cycle_start_time;
+  }
+  result.high_water_mark = this->hwm;
+  co_return result;
+}
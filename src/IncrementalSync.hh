@@ -0,0 +1,118 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <asio.hpp>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "AirtableClient.hh"
+#include "FieldTypes.hh"
+#include "RecordIndex.hh"
+#include "TableDecoder.hh"
+
+// Keeps a local replica of a single table up to date. The first sync cycle
+// reads the entire table; subsequent cycles only fetch records whose
+// LAST_MODIFIED_TIME() is newer than the table's high-water mark, and
+// periodically run a cheap ID-only scan to detect deleted records.
+class TableSyncer {
+public:
+  struct Options {
+    // If not empty, only records for which this formula is truthy are
+    // replicated. Records that stop matching the formula are removed from the
+    // replica during the next deletion scan.
+    std::string filter_formula;
+    // If not empty, only these fields are replicated.
+    std::vector<std::string> fields;
+    // Name or ID of a "last modified time" field in the table. If given, the
+    // high-water mark is the latest value seen in this field (that is, it uses
+    // the server's clock); otherwise, it is the local time at which the
+    // previous cycle started.
+    std::string last_modified_field;
+    // Name or ID of the field to request during deletion scans. This should be
+    // a small field, such as a short primary field. If empty, deletion scans
+    // request all replicated fields, which is much less efficient.
+    std::string id_scan_field;
+    // The high-water mark is moved back by this much when generating the
+    // filter formula, to tolerate clock skew and the one-second precision of
+    // LAST_MODIFIED_TIME(). Records modified within this window are fetched
+    // again, which is harmless since they're merged into the replica.
+    uint64_t overlap_usecs = 5000000;
+    // Run a deletion scan every this many cycles. 0 means deletions are never
+    // detected (the first cycle is always a full read and needs no scan).
+    size_t deletion_scan_interval = 1;
+    size_t page_size = 100; // cannot be zero; maximum is 100
+    // If not null, used to decode fetched records (see TableDecoder)
+    std::shared_ptr<const TableDecoder> decoder;
+  };
+
+  // Changes applied to the replica during one call to sync().
+  struct CycleResult {
+    std::vector<std::string> added_ids;
+    std::vector<std::string> updated_ids;
+    std::vector<std::string> deleted_ids;
+    size_t pages_fetched = 0;
+    bool was_full_read = false;
+    bool ran_deletion_scan = false;
+    uint64_t high_water_mark = 0; // After the cycle
+  };
+
+  TableSyncer(
+      AirtableClient& client,
+      const std::string& base_id,
+      const std::string& table_name,
+      const Options& options);
+  TableSyncer(const TableSyncer&) = delete;
+  TableSyncer(TableSyncer&&) = delete;
+  TableSyncer& operator=(const TableSyncer&) = delete;
+  TableSyncer& operator=(TableSyncer&&) = delete;
+  ~TableSyncer() = default;
+
+  // Replaces the replica with the given records (for example, from a snapshot
+  // on disk) so the next sync() can be incremental instead of a full read.
+  // high_water_mark should be the value returned by high_water_mark() at the
+  // time the records were saved.
+  void seed(std::vector<Record>&& records, uint64_t high_water_mark);
+
+  // Runs one sync cycle and returns the changes that were applied.
+  asio::awaitable<CycleResult> sync();
+
+  // The replica is an IndexedRecordSet, so callers can declare secondary
+  // indexes on it; they're kept up to date as each cycle is applied. Callers
+  // that write to the table through AirtableClient can also apply their writes
+  // to the replica directly (see IndexedRecordSet::apply_created, etc.)
+  inline IndexedRecordSet& records() {
+    return this->replica;
+  }
+  inline const IndexedRecordSet& records() const {
+    return this->replica;
+  }
+  inline uint64_t high_water_mark() const {
+    return this->hwm;
+  }
+
+  // Returns the filterByFormula string used to fetch records modified after
+  // the given time, combined with the user's filter formula (if any).
+  std::string modified_since_formula(uint64_t since_usecs) const;
+
+private:
+  void merge_record(Record&& record, CycleResult& result);
+  void update_high_water_mark_from_record(const Record& record);
+  asio::awaitable<void> fetch_into_replica(
+      const AirtableClient::ListRecordsOptions& list_options,
+      CycleResult& result,
+      std::unordered_set<std::string>* seen_ids = nullptr);
+  asio::awaitable<void> run_deletion_scan(CycleResult& result);
+
+  AirtableClient& client;
+  std::string base_id;
+  std::string table_name;
+  Options options;
+
+  IndexedRecordSet replica;
+  uint64_t hwm;
+  size_t cycles_since_deletion_scan;
+};
@@ -0,0 +1,294 @@
+#include "JSONReader.hh"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <charconv>
+#include <format>
+#include <stdexcept>
+
+#include "JSONScan.hh"
+
+using namespace std;
+
+static void append_utf8(string& out, uint32_t cp) {
+  if (cp < 0x80) {
+    out.push_back(cp);
+  } else if (cp < 0x800) {
+    out.push_back(0xC0 | (cp >> 6));
+    out.push_back(0x80 | (cp & 0x3F));
+  } else if (cp < 0x10000) {
+    out.push_back(0xE0 | (cp >> 12));
+    out.push_back(0x80 | ((cp >> 6) & 0x3F));
+    out.push_back(0x80 | (cp & 0x3F));
+  } else {
+    out.push_back(0xF0 | (cp >> 18));
+    out.push_back(0x80 | ((cp >> 12) & 0x3F));
+    out.push_back(0x80 | ((cp >> 6) & 0x3F));
+    out.push_back(0x80 | (cp & 0x3F));
+  }
+}
+
+JSONReader::JSONReader(const char* data, size_t size)
+    : start(data),
+      p(data),
+      end(data + size) {}
+
+JSONReader::JSONReader(string_view data)
+    : JSONReader(data.data(), data.size()) {}
+
+void JSONReader::throw_error(const char* what) const {
+  throw runtime_error(std::format("JSON parse error at offset {}: {}", this->offset(), what));
+}
+
+void JSONReader::skip_whitespace() {
+  while (this->p < this->end && (*this->p == ' ' || *this->p == '\n' || *this->p == '\r' || *this->p == '\t')) {
+    this->p++;
+  }
+}
+
+char JSONReader::peek() {
+  this->skip_whitespace();
+  return (this->p < this->end) ? *this->p : '\0';
+}
+
+bool JSONReader::consume(char ch) {
+  this->skip_whitespace();
+  if (this->p < this->end && *this->p == ch) {
+    this->p++;
+    return true;
+  }
+  return false;
+}
+
+void JSONReader::expect(char ch) {
+  if (!this->consume(ch)) {
+    this->throw_error("unexpected character");
+  }
+}
+
+bool JSONReader::at_end() {
+  this->skip_whitespace();
+  return this->p >= this->end;
+}
+
+string JSONReader::read_string() {
+  string scratch;
+  string_view ret = this->read_string_view(scratch);
+  return (ret.data() == scratch.data()) ? std::move(scratch) : string(ret);
+}
+
+string_view JSONReader::read_string_view(string& scratch) {
+  this->expect('\"');
+
+  // Fast path: if there are no escape sequences, return a view of the input
+  const char* str_start = this->p;
+  const char* q = find_quote_or_backslash(str_start, this->end);
+  if (q >= this->end) {
+    this->throw_error("unterminated string");
+  }
+  if (*q == '\"') {
+    this->p = q + 1;
+    return string_view(str_start, q - str_start);
+  }
+
+  scratch.assign(str_start, q - str_start);
+  this->p = q;
+  for (;;) {
+    q = find_quote_or_backslash(this->p, this->end);
+    if (q >= this->end) {
+      this->throw_error("unterminated string");
+    }
+    scratch.append(this->p, q - this->p);
+    this->p = q + 1;
+    if (*q == '\"') {
+      return scratch;
+    }
+
+    if (this->p >= this->end) {
+      this->throw_error("unterminated escape sequence");
+    }
+    char esc = *(this->p++);
+    switch (esc) {
+      case '\"':
+      case '\\':
+      case '/':
+        scratch.push_back(esc);
+        break;
+      case 'b':
+        scratch.push_back('\b');
+        break;
+      case 'f':
+        scratch.push_back('\f');
+        break;
+      case 'n':
+        scratch.push_back('\n');
+        break;
+      case 'r':
+        scratch.push_back('\r');
+        break;
+      case 't':
+        scratch.push_back('\t');
+        break;
+      case 'u': {
+        auto read_hex4 = [&]() -> uint32_t {
+          if (this->end - this->p < 4) {
+            this->throw_error("incomplete unicode escape");
+          }
+          uint32_t v = 0;
+          auto res = from_chars(this->p, this->p + 4, v, 16);
+          if (res.ptr != this->p + 4) {
+            this->throw_error("invalid unicode escape");
+          }
+          this->p += 4;
+          return v;
+        };
+        uint32_t cp = read_hex4();
+        if (cp >= 0xD800 && cp < 0xDC00 && (this->end - this->p >= 6) && this->p[0] == '\\' && this->p[1] == 'u') {
+          this->p += 2;
+          uint32_t low = read_hex4();
+          if (low >= 0xDC00 && low < 0xE000) {
+            cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+          } else {
+            append_utf8(scratch, cp);
+            cp = low;
+          }
+        }
+        append_utf8(scratch, cp);
+        break;
+      }
+      default:
+        this->throw_error("invalid escape sequence");
+    }
+  }
+}
+
+JSONReader::Number JSONReader::read_number() {
+  this->skip_whitespace();
+  const char* num_start = this->p;
+  bool is_integer = true;
+  while (this->p < this->end) {
+    char ch = *this->p;
+    if (ch == '.' || ch == 'e' || ch == 'E') {
+      is_integer = false;
+    } else if (!((ch >= '0' && ch <= '9') || ch == '-' || ch == '+')) {
+      break;
+    }
+    this->p++;
+  }
+  if (this->p == num_start) {
+    this->throw_error("expected number");
+  }
+
+  Number ret;
+  ret.is_integer = false;
+  ret.as_int = 0;
+  if (is_integer) {
+    auto res = from_chars(num_start, this->p, ret.as_int, 10);
+    if (res.ec == errc() && res.ptr == this->p) {
+      ret.is_integer = true;
+      ret.as_float = ret.as_int;
+      return ret;
+    }
+    // Out of range for int64_t; parse as a float instead
+  }
+
+  // strtod needs a null-terminated string
+  char buf[64];
+  size_t len = this->p - num_start;
+  if (len >= sizeof(buf)) {
+    this->throw_error("number is too long");
+  }
+  memcpy(buf, num_start, len);
+  buf[len] = 0;
+  char* parse_end = nullptr;
+  ret.as_float = strtod(buf, &parse_end);
+  if (parse_end != buf + len) {
+    this->throw_error("invalid number");
+  }
+  return ret;
+}
+
+bool JSONReader::read_bool() {
+  this->skip_whitespace();
+  if ((this->end - this->p >= 4) && !memcmp(this->p, "true", 4)) {
+    this->p += 4;
+    return true;
+  }
+  if ((this->end - this->p >= 5) && !memcmp(this->p, "false", 5)) {
+    this->p += 5;
+    return false;
+  }
+  this->throw_error("expected true or false");
+}
+
+void JSONReader::read_null() {
+  this->skip_whitespace();
+  if ((this->end - this->p >= 4) && !memcmp(this->p, "null", 4)) {
+    this->p += 4;
+    return;
+  }
+  this->throw_error("expected null");
+}
+
+string_view JSONReader::skip_value() {
+  char ch = this->peek();
+  const char* value_start = this->p;
+  switch (ch) {
+    case '\"': {
+      this->p++;
+      for (;;) {
+        const char* q = find_quote_or_backslash(this->p, this->end);
+        if (q >= this->end) {
+          this->throw_error("unterminated string");
+        }
+        if (*q == '\"') {
+          this->p = q + 1;
+          break;
+        }
+        this->p = q + 2; // Skip the escaped character
+      }
+      break;
+    }
+    case '{':
+    case '[': {
+      // Only brackets and strings matter here; everything else is skipped
+      // without being validated
+      size_t depth = 0;
+      while (this->p < this->end) {
+        this->p = find_structural_char(this->p, this->end);
+        if (this->p >= this->end) {
+          break;
+        }
+        char c = *this->p;
+        if (c == '\"') {
+          this->skip_value();
+          continue;
+        }
+        this->p++;
+        if (c == '{' || c == '[') {
+          depth++;
+        } else if (c == '}' || c == ']') {
+          if (--depth == 0) {
+            break;
+          }
+        }
+      }
+      if (depth) {
+        this->throw_error("unterminated object or array");
+      }
+      break;
+    }
+    case 't':
+    case 'f':
+      this->read_bool();
+      break;
+    case 'n':
+      this->read_null();
+      break;
+    default:
+      this->read_number();
+      break;
+  }
+  return string_view(value_start, this->p - value_start);
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <string_view>
+
+// A minimal pull parser for JSON text held in a contiguous buffer. Unlike
+// phosg::JSON::parse, this doesn't build a DOM; callers read values directly
+// into their own structures. Whitespace is skipped automatically. All
+// functions throw std::runtime_error on malformed input.
+class JSONReader {
+public:
+  JSONReader(const char* data, size_t size);
+  explicit JSONReader(std::string_view data);
+  JSONReader(const JSONReader&) = default;
+  JSONReader(JSONReader&&) = default;
+  JSONReader& operator=(const JSONReader&) = default;
+  JSONReader& operator=(JSONReader&&) = default;
+  ~JSONReader() = default;
+
+  // Returns the next non-whitespace character without consuming it, or \0 if
+  // the end of the input has been reached.
+  char peek();
+  // Consumes the next non-whitespace character if it's ch. consume returns
+  // false if it isn't; expect throws instead.
+  bool consume(char ch);
+  void expect(char ch);
+  bool at_end();
+  inline size_t offset() const {
+    return this->p - this->start;
+  }
+
+  std::string read_string();
+  // Returns the contents of a string without copying it, if possible. If the
+  // string contains escape sequences, it is decoded into scratch, and the
+  // returned view refers to scratch's contents.
+  std::string_view read_string_view(std::string& scratch);
+
+  struct Number {
+    bool is_integer;
+    int64_t as_int; // Only valid if is_integer is true
+    double as_float; // Always valid
+  };
+  Number read_number();
+  bool read_bool();
+  void read_null();
+  // Skips an entire value (including nested objects and arrays), and returns
+  // a view of its raw text
+  std::string_view skip_value();
+
+  // Calls fn(key) for each member of an object. fn must consume exactly one
+  // value (the member's value). The key view is only valid during the call.
+  template <typename FnT>
+  void read_object(FnT&& fn) {
+    this->expect('{');
+    if (this->consume('}')) {
+      return;
+    }
+    std::string scratch;
+    do {
+      std::string_view key = this->read_string_view(scratch);
+      this->expect(':');
+      fn(key);
+    } while (this->consume(','));
+    this->expect('}');
+  }
+
+  // Calls fn() for each item in an array. fn must consume exactly one value.
+  template <typename FnT>
+  void read_array(FnT&& fn) {
+    this->expect('[');
+    if (this->consume(']')) {
+      return;
+    }
+    do {
+      fn();
+    } while (this->consume(','));
+    this->expect(']');
+  }
+
+  [[noreturn]] void throw_error(const char* what) const;
+
+private:
+  void skip_whitespace();
+
+  const char* start;
+  const char* p;
+  const char* end;
+};
@@ -0,0 +1,203 @@
+#include "JSONScan.hh"
+
+#include <atomic>
+#include <mutex>
+#include <stdexcept>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define JSON_SCAN_HAS_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+static const char* find_quote_or_backslash_scalar(const char* p, const char* end) {
+  for (; p < end; p++) {
+    if (*p == '\"' || *p == '\\') {
+      break;
+    }
+  }
+  return p;
+}
+
+static const char* find_structural_char_scalar(const char* p, const char* end) {
+  for (; p < end; p++) {
+    char ch = *p;
+    if (ch == '\"' || ch == '{' || ch == '}' || ch == '[' || ch == ']') {
+      break;
+    }
+  }
+  return p;
+}
+
+#ifdef JSON_SCAN_HAS_X86_SIMD
+
+// The SSE4.2 versions use PCMPESTRI, which compares 16 bytes against a set of
+// up to 16 characters in one instruction and returns the index of the first
+// match (or 16 if there are none)
+
+static constexpr int SSE42_MATCH_ANY_FLAGS = _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_LEAST_SIGNIFICANT;
+
+__attribute__((target("sse4.2"))) static const char* find_quote_or_backslash_sse42(const char* p, const char* end) {
+  const __m128i chars = _mm_setr_epi8('\"', '\\', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+  for (; end - p >= 16; p += 16) {
+    __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    int index = _mm_cmpestri(chars, 2, data, 16, SSE42_MATCH_ANY_FLAGS);
+    if (index < 16) {
+      return p + index;
+    }
+  }
+  return find_quote_or_backslash_scalar(p, end);
+}
+
+__attribute__((target("sse4.2"))) static const char* find_structural_char_sse42(const char* p, const char* end) {
+  const __m128i chars = _mm_setr_epi8('\"', '{', '}', '[', ']', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+  for (; end - p >= 16; p += 16) {
+    __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    int index = _mm_cmpestri(chars, 5, data, 16, SSE42_MATCH_ANY_FLAGS);
+    if (index < 16) {
+      return p + index;
+    }
+  }
+  return find_structural_char_scalar(p, end);
+}
+
+// The AVX2 versions compare 32 bytes against each character separately and
+// combine the results into a bitmask
+
+__attribute__((target("avx2,bmi"))) static const char* find_quote_or_backslash_avx2(const char* p, const char* end) {
+  const __m256i quote = _mm256_set1_epi8('\"');
+  const __m256i backslash = _mm256_set1_epi8('\\');
+  for (; end - p >= 32; p += 32) {
+    __m256i data = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    __m256i matches = _mm256_or_si256(_mm256_cmpeq_epi8(data, quote), _mm256_cmpeq_epi8(data, backslash));
+    uint32_t mask = _mm256_movemask_epi8(matches);
+    if (mask) {
+      return p + _tzcnt_u32(mask);
+    }
+  }
+  return find_quote_or_backslash_sse42(p, end);
+}
+
+__attribute__((target("avx2,bmi"))) static const char* find_structural_char_avx2(const char* p, const char* end) {
+  const __m256i quote = _mm256_set1_epi8('\"');
+  const __m256i open_brace = _mm256_set1_epi8('{');
+  const __m256i close_brace = _mm256_set1_epi8('}');
+  const __m256i open_bracket = _mm256_set1_epi8('[');
+  const __m256i close_bracket = _mm256_set1_epi8(']');
+  for (; end - p >= 32; p += 32) {
+    __m256i data = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    __m256i matches = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(data, quote), _mm256_cmpeq_epi8(data, open_brace)),
+        _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(data, close_brace), _mm256_cmpeq_epi8(data, open_bracket)),
+            _mm256_cmpeq_epi8(data, close_bracket)));
+    uint32_t mask = _mm256_movemask_epi8(matches);
+    if (mask) {
+      return p + _tzcnt_u32(mask);
+    }
+  }
+  return find_structural_char_sse42(p, end);
+}
+
+#endif // JSON_SCAN_HAS_X86_SIMD
+
+using FindFn = const char* (*)(const char*, const char*);
+
+struct JSONScanImplementation {
+  JSONScanLevel level;
+  FindFn find_quote_or_backslash;
+  FindFn find_structural_char;
+};
+
+static constexpr JSONScanImplementation SCALAR_IMPLEMENTATION = {
+    JSONScanLevel::SCALAR, find_quote_or_backslash_scalar, find_structural_char_scalar};
+#ifdef JSON_SCAN_HAS_X86_SIMD
+static constexpr JSONScanImplementation SSE42_IMPLEMENTATION = {
+    JSONScanLevel::SSE42, find_quote_or_backslash_sse42, find_structural_char_sse42};
+static constexpr JSONScanImplementation AVX2_IMPLEMENTATION = {
+    JSONScanLevel::AVX2, find_quote_or_backslash_avx2, find_structural_char_avx2};
+#endif
+
+static const JSONScanImplementation* implementation_for_level(JSONScanLevel level) {
+  switch (level) {
+    case JSONScanLevel::SCALAR:
+      return &SCALAR_IMPLEMENTATION;
+#ifdef JSON_SCAN_HAS_X86_SIMD
+    case JSONScanLevel::SSE42:
+      return &SSE42_IMPLEMENTATION;
+    case JSONScanLevel::AVX2:
+      return &AVX2_IMPLEMENTATION;
+#endif
+    default:
+      throw invalid_argument("JSON scan level is not supported");
+  }
+}
+
+JSONScanLevel max_supported_json_scan_level() {
+#ifdef JSON_SCAN_HAS_X86_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi")) {
+    return JSONScanLevel::AVX2;
+  }
+  if (__builtin_cpu_supports("sse4.2")) {
+    return JSONScanLevel::SSE42;
+  }
+#endif
+  return JSONScanLevel::SCALAR;
+}
+
+// This is constant-initialized, so it's valid even when other files' static
+// initializers parse JSON before this file's dynamic initialization has run.
+// The implementations are immutable, so relaxed loads are enough.
+static constinit atomic<const JSONScanImplementation*> current_implementation = &SCALAR_IMPLEMENTATION;
+static constinit once_flag default_implementation_flag;
+
+// Switches to the best implementation for this CPU, unless this has already
+// been done. set_json_scan_level calls this first, so the default can't
+// overwrite a level that was set explicitly.
+static void install_default_implementation() {
+  call_once(default_implementation_flag, []() -> void {
+    current_implementation.store(
+        implementation_for_level(max_supported_json_scan_level()), memory_order_relaxed);
+  });
+}
+
+// Install the default during static initialization, so the search functions
+// don't have to check whether it's been installed. Anything that runs before
+// this uses the scalar implementation, which returns the same results.
+[[maybe_unused]] static const bool default_implementation_installed = (install_default_implementation(), true);
+
+const char* find_quote_or_backslash(const char* p, const char* end) {
+  return current_implementation.load(memory_order_relaxed)->find_quote_or_backslash(p, end);
+}
+
+const char* find_structural_char(const char* p, const char* end) {
+  return current_implementation.load(memory_order_relaxed)->find_structural_char(p, end);
+}
+
+JSONScanLevel get_json_scan_level() {
+  install_default_implementation();
+  return current_implementation.load(memory_order_relaxed)->level;
+}
+
+void set_json_scan_level(JSONScanLevel level) {
+  if (static_cast<int>(level) > static_cast<int>(max_supported_json_scan_level())) {
+    throw invalid_argument("JSON scan level is not supported by this CPU");
+  }
+  install_default_implementation();
+  current_implementation.store(implementation_for_level(level), memory_order_relaxed);
+}
+
+const char* name_for_json_scan_level(JSONScanLevel level) {
+  switch (level) {
+    case JSONScanLevel::SCALAR:
+      return "scalar";
+    case JSONScanLevel::SSE42:
+      return "sse4.2";
+    case JSONScanLevel::AVX2:
+      return "avx2";
+    default:
+      throw invalid_argument("invalid JSON scan level");
+  }
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdint.h>
+
+// Bulk character searches used by JSONReader and RecordStreamParser. These are
+// the inner loops of JSON parsing: locating the end of a string, and skipping
+// over the contents of objects and arrays.
+//
+// On x86-64, vectorized implementations (SSE4.2 and AVX2) are selected at
+// startup based on what the CPU supports; elsewhere, or on older CPUs, scalar
+// implementations are used. All implementations return the same results.
+
+enum class JSONScanLevel {
+  SCALAR = 0,
+  SSE42,
+  AVX2,
+};
+
+// Returns a pointer to the first " or \ character in [p, end), or end if there
+// are none
+const char* find_quote_or_backslash(const char* p, const char* end);
+// Returns a pointer to the first ", {, }, [, or ] character in [p, end), or
+// end if there are none. Within an object or array (but outside of strings),
+// these are the only characters that affect nesting.
+const char* find_structural_char(const char* p, const char* end);
+
+// Returns the best level supported by this CPU
+JSONScanLevel max_supported_json_scan_level();
+JSONScanLevel get_json_scan_level();
+// Changes which implementation is used (e.g. for benchmarking). Throws
+// std::invalid_argument if the CPU doesn't support the given level. This may
+// be called while other threads are parsing; each search uses either the old
+// or the new implementation.
+void set_json_scan_level(JSONScanLevel level);
+const char* name_for_json_scan_level(JSONScanLevel level);
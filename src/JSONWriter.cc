@@ -0,0 +1,154 @@
+#include "JSONWriter.hh"
+
+#include <math.h>
+
+#include <charconv>
+#include <stdexcept>
+
+using namespace std;
+
+JSONWriter::JSONWriter(string&& buffer) : buffer(std::move(buffer)) {
+  this->buffer.clear();
+}
+
+void JSONWriter::begin_object() {
+  this->begin_value();
+  this->buffer.push_back('{');
+  this->needs_comma = false;
+}
+
+void JSONWriter::end_object() {
+  this->buffer.push_back('}');
+  this->needs_comma = true;
+}
+
+void JSONWriter::begin_array() {
+  this->begin_value();
+  this->buffer.push_back('[');
+  this->needs_comma = false;
+}
+
+void JSONWriter::end_array() {
+  this->buffer.push_back(']');
+  this->needs_comma = true;
+}
+
+void JSONWriter::write_key(string_view key) {
+  this->write_string(key);
+  this->buffer.push_back(':');
+  this->needs_comma = false;
+}
+
+void JSONWriter::write_string(string_view value) {
+  static const char* hex_digits = "0123456789abcdef";
+
+  this->begin_value();
+  this->buffer.push_back('\"');
+  // Copy runs of characters that don't need escaping all at once
+  const char* p = value.data();
+  const char* end = p + value.size();
+  const char* run_start = p;
+  for (; p < end; p++) {
+    uint8_t ch = *p;
+    if (ch >= 0x20 && ch != '\"' && ch != '\\') {
+      continue;
+    }
+    this->buffer.append(run_start, p - run_start);
+    run_start = p + 1;
+    switch (ch) {
+      case '\"':
+        this->buffer.append("\\\"", 2);
+        break;
+      case '\\':
+        this->buffer.append("\\\\", 2);
+        break;
+      case '\n':
+        this->buffer.append("\\n", 2);
+        break;
+      case '\r':
+        this->buffer.append("\\r", 2);
+        break;
+      case '\t':
+        this->buffer.append("\\t", 2);
+        break;
+      case '\b':
+        this->buffer.append("\\b", 2);
+        break;
+      case '\f':
+        this->buffer.append("\\f", 2);
+        break;
+      default: {
+        char esc[6] = {'\\', 'u', '0', '0', hex_digits[ch >> 4], hex_digits[ch & 0x0F]};
+        this->buffer.append(esc, 6);
+        break;
+      }
+    }
+  }
+  this->buffer.append(run_start, end - run_start);
+  this->buffer.push_back('\"');
+}
+
+void JSONWriter::write_int(int64_t value) {
+  this->begin_value();
+  char buf[24];
+  auto res = to_chars(buf, buf + sizeof(buf), value);
+  this->buffer.append(buf, res.ptr - buf);
+}
+
+void JSONWriter::write_uint(uint64_t value) {
+  this->begin_value();
+  char buf[24];
+  auto res = to_chars(buf, buf + sizeof(buf), value);
+  this->buffer.append(buf, res.ptr - buf);
+}
+
+void JSONWriter::write_float(double value) {
+  if (!isfinite(value)) {
+    throw invalid_argument("NaN and infinity cannot be represented in JSON");
+  }
+  this->begin_value();
+  char buf[32];
+  auto res = to_chars(buf, buf + sizeof(buf), value);
+  this->buffer.append(buf, res.ptr - buf);
+  bool has_fraction_or_exponent = false;
+  for (const char* p = buf; p < res.ptr; p++) {
+    if (*p == '.' || *p == 'e') {
+      has_fraction_or_exponent = true;
+      break;
+    }
+  }
+  if (!has_fraction_or_exponent) {
+    this->buffer.append(".0", 2);
+  }
+}
+
+void JSONWriter::write_bool(bool value) {
+  this->begin_value();
+  if (value) {
+    this->buffer.append("true", 4);
+  } else {
+    this->buffer.append("false", 5);
+  }
+}
+
+void JSONWriter::write_null() {
+  this->begin_value();
+  this->buffer.append("null", 4);
+}
+
+void JSONWriter::write_raw(string_view json) {
+  this->begin_value();
+  this->buffer.append(json);
+}
+
+string JSONWriter::take() {
+  string ret;
+  ret.swap(this->buffer);
+  this->needs_comma = false;
+  return ret;
+}
+
+void JSONWriter::clear() {
+  this->buffer.clear();
+  this->needs_comma = false;
+}
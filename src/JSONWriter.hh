@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <string_view>
+
+// Writes JSON text directly into a string buffer, without building a DOM
+// first. The caller is responsible for producing a well-formed structure (for
+// example, every begin_object must be matched by an end_object, and every
+// value in an object must be preceded by a key); commas and colons are added
+// automatically.
+//
+// The buffer can be reused for multiple documents: clear() discards the
+// contents but keeps the allocated memory, and the constructor can take an
+// existing string's memory.
+class JSONWriter {
+public:
+  JSONWriter() = default;
+  explicit JSONWriter(std::string&& buffer);
+  JSONWriter(const JSONWriter&) = delete;
+  JSONWriter(JSONWriter&&) = default;
+  JSONWriter& operator=(const JSONWriter&) = delete;
+  JSONWriter& operator=(JSONWriter&&) = default;
+  ~JSONWriter() = default;
+
+  void begin_object();
+  void end_object();
+  void begin_array();
+  void end_array();
+  void write_key(std::string_view key);
+
+  void write_string(std::string_view value);
+  void write_int(int64_t value);
+  void write_uint(uint64_t value);
+  // Writes the shortest representation that parses back to the same value.
+  // Integral values are written with a trailing .0 so they are read back as
+  // floats. Throws std::invalid_argument for NaN and infinities, which JSON
+  // can't represent.
+  void write_float(double value);
+  void write_bool(bool value);
+  void write_null();
+  // Writes a value that's already serialized as JSON (e.g. one returned by
+  // JSONReader::skip_value) without checking it
+  void write_raw(std::string_view json);
+
+  inline const std::string& str() const {
+    return this->buffer;
+  }
+  // Returns the buffer's contents and leaves the writer empty
+  std::string take();
+  void clear();
+  inline void reserve(size_t size) {
+    this->buffer.reserve(size);
+  }
+
+private:
+  inline void begin_value() {
+    if (this->needs_comma) {
+      this->buffer.push_back(',');
+    }
+    this->needs_comma = true;
+  }
+
+  std::string buffer;
+  bool needs_comma = false;
+};
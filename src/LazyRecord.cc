@@ -0,0 +1,150 @@
+#include "LazyRecord.hh"
+
+#include <string.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "RecordStreamParser.hh"
+
+using namespace std;
+
+LazyRecord::LazyRecord(
+    JSONReader& r,
+    shared_ptr<const string> data,
+    shared_ptr<const TableDecoder> decoder,
+    const shared_ptr<StringInterner>& interner)
+    : data(std::move(data)),
+      decoder(std::move(decoder)),
+      interner(interner) {
+  const char* data_start = this->data->data();
+  const char* data_end = data_start + this->data->size();
+  auto is_in_data = [&](string_view s) -> bool {
+    return (s.data() >= data_start) && (s.data() + s.size() <= data_end);
+  };
+
+  bool has_id = false;
+  bool has_creation_time = false;
+  string scratch;
+  r.read_object([&](string_view key) -> void {
+    if (key == "id") {
+      string_view id = r.read_string_view(scratch);
+      if (id.size() != 17) {
+        throw runtime_error("Record ID length is incorrect");
+      }
+      memcpy(this->id, id.data(), 17);
+      this->id[17] = 0;
+      has_id = true;
+    } else if (key == "createdTime") {
+      this->creation_time = parse_airtable_time(r.read_string_view(scratch));
+      has_creation_time = true;
+    } else if (key == "fields") {
+      r.read_object([&](string_view field_key) -> void {
+        string_view raw_json = r.skip_value();
+        if (!is_in_data(raw_json)) {
+          throw logic_error("LazyRecord must be read from its response buffer");
+        }
+        if (!is_in_data(field_key) && !this->interner) {
+          // Most records have no escaped field names, so the interner is only
+          // created when one is found
+          this->interner = make_shared<StringInterner>(1);
+        }
+        string_view name = is_in_data(field_key) ? field_key : this->interner->intern(field_key);
+        this->cells.emplace_back(Cell{name, raw_json, nullptr});
+      });
+    } else if (key == "commentCount") {
+      this->comment_count = r.read_number().as_int;
+    } else {
+      r.skip_value();
+    }
+  });
+  if (!has_id || !has_creation_time) {
+    throw runtime_error("Record is missing id or createdTime");
+  }
+
+  auto name_less = [](const Cell& a, const Cell& b) -> bool {
+    return a.name < b.name;
+  };
+  if (!is_sorted(this->cells.begin(), this->cells.end(), name_less)) {
+    stable_sort(this->cells.begin(), this->cells.end(), name_less);
+  }
+}
+
+pair<vector<LazyRecord>, string> LazyRecord::parse_page(
+    shared_ptr<const string> data,
+    shared_ptr<const TableDecoder> decoder,
+    const shared_ptr<StringInterner>& interner) {
+  // The whole response is fed at once, so the parser reads each record
+  // directly from data instead of copying it. If no interner was given, the
+  // page's records share one.
+  shared_ptr<StringInterner> page_interner = interner ? interner : make_shared<StringInterner>();
+  vector<LazyRecord> records;
+  RecordStreamParser parser([&](JSONReader& r) -> void {
+    records.emplace_back(r, data, decoder, page_interner);
+  });
+  parser.feed(*data);
+  parser.finish();
+  return make_pair(std::move(records), parser.get_offset());
+}
+
+size_t LazyRecord::index_for_field(string_view name) const {
+  auto it = lower_bound(this->cells.begin(), this->cells.end(), name, [](const Cell& cell, string_view name) -> bool {
+    return cell.name < name;
+  });
+  return ((it != this->cells.end()) && (it->name == name)) ? (it - this->cells.begin()) : NOT_FOUND;
+}
+
+string_view LazyRecord::raw_json(string_view name) const {
+  size_t index = this->index_for_field(name);
+  return (index == NOT_FOUND) ? string_view() : this->cells[index].raw_json;
+}
+
+const shared_ptr<Field>& LazyRecord::get(string_view name) const {
+  static const shared_ptr<Field> empty_field;
+  size_t index = this->index_for_field(name);
+  return (index == NOT_FOUND) ? empty_field : this->get(index);
+}
+
+const shared_ptr<Field>& LazyRecord::get(size_t index) const {
+  const auto& cell = this->cells.at(index);
+  if (!cell.field) {
+    // Don't cache the Field until the whole cell has been validated (which
+    // decode_cell does), so a malformed cell throws on every access instead of
+    // only the first
+    cell.field = this->decode_cell(cell);
+  }
+  return cell.field;
+}
+
+shared_ptr<Field> LazyRecord::decode_cell(const Cell& cell) const {
+  JSONReader r(cell.raw_json);
+  auto field = this->decoder ? this->decoder->decode_field(cell.name, r) : Record::parse_field(r);
+  if (!r.at_end()) {
+    throw runtime_error("extra data after cell value");
+  }
+  return field;
+}
+
+size_t LazyRecord::num_decoded_fields() const {
+  size_t ret = 0;
+  for (const auto& cell : this->cells) {
+    ret += (cell.field != nullptr);
+  }
+  return ret;
+}
+
+Record LazyRecord::to_record() const {
+  Record ret;
+  memcpy(ret.id, this->id, sizeof(ret.id));
+  ret.creation_time = this->creation_time;
+  ret.comment_count = this->comment_count;
+  ret.fields = RecordFields(this->interner);
+  ret.fields.reserve(this->cells.size());
+  // The Record gets its own Fields, not the cached ones, so modifying it
+  // doesn't change what get() returns
+  for (const auto& cell : this->cells) {
+    ret.fields.append(cell.name, this->decode_cell(cell));
+  }
+  ret.fields.finish_appending();
+  return ret;
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "FieldTypes.hh"
+#include "JSONReader.hh"
+#include "StringInterner.hh"
+#include "TableDecoder.hh"
+
+// A Record that doesn't decode its cells until they're accessed. Parsing a
+// LazyRecord only finds the byte range of each cell's JSON within the
+// response; the response buffer is kept alive (shared by all the records from
+// the same page), and each cell is decoded into a Field the first time it's
+// accessed, then cached. This makes scans that only touch a few of each
+// record's fields much cheaper than parsing full Records, since the other
+// cells (e.g. attachments with their thumbnail maps) are never decoded.
+//
+// The tradeoff is that the whole response body stays in memory as long as
+// any record from it does. For tables that are kept resident and fully read,
+// Record or CompactRecord is a better choice.
+//
+// get() is const but caches decoded cells, so a LazyRecord must not be
+// accessed from multiple threads at once without external synchronization.
+struct LazyRecord {
+  static constexpr size_t NOT_FOUND = static_cast<size_t>(-1);
+
+  char id[18]; // always 17 chars long (+ \0)
+  uint64_t creation_time = 0;
+  // Only populated if the records were listed with
+  // ListRecordsOptions::include_comment_count
+  size_t comment_count = 0;
+
+  // Reads a record object from r, which must be reading from data (the views
+  // of the cells' JSON point into it); throws std::logic_error if it isn't.
+  // If a decoder is given, cells are decoded with it when accessed (see
+  // TableDecoder). Field names point into data, except for names that
+  // contain escape sequences, which are interned in interner (or, if it's
+  // null, in an interner that's created only if the record has such names).
+  // to_record also uses interner.
+  LazyRecord(
+      JSONReader& r,
+      std::shared_ptr<const std::string> data,
+      std::shared_ptr<const TableDecoder> decoder = nullptr,
+      const std::shared_ptr<StringInterner>& interner = nullptr);
+  LazyRecord(const LazyRecord&) = default;
+  LazyRecord(LazyRecord&&) = default;
+  LazyRecord& operator=(const LazyRecord&) = default;
+  LazyRecord& operator=(LazyRecord&&) = default;
+  ~LazyRecord() = default;
+
+  // Parses a complete list records response body. Returns (records, offset).
+  static std::pair<std::vector<LazyRecord>, std::string> parse_page(
+      std::shared_ptr<const std::string> data,
+      std::shared_ptr<const TableDecoder> decoder = nullptr,
+      const std::shared_ptr<StringInterner>& interner = nullptr);
+
+  // Fields are indexed in order of their names
+  inline size_t num_fields() const {
+    return this->cells.size();
+  }
+  inline std::string_view field_name(size_t index) const {
+    return this->cells.at(index).name;
+  }
+  // Returns NOT_FOUND if the record has no value for the field
+  size_t index_for_field(std::string_view name) const;
+  inline bool has_field(std::string_view name) const {
+    return this->index_for_field(name) != NOT_FOUND;
+  }
+
+  // Returns the cell's undecoded JSON text, or an empty view if the record
+  // has no value for the field
+  std::string_view raw_json(std::string_view name) const;
+  inline std::string_view raw_json(size_t index) const {
+    return this->cells.at(index).raw_json;
+  }
+
+  // Returns the decoded cell, decoding it if this is the first access, or
+  // nullptr if the record has no value for the field. Throws
+  // std::runtime_error if the cell can't be decoded.
+  const std::shared_ptr<Field>& get(std::string_view name) const;
+  const std::shared_ptr<Field>& get(size_t index) const;
+  // Returns the number of cells that have been decoded so far
+  size_t num_decoded_fields() const;
+
+  // Decodes all cells and returns the equivalent Record. The Record's Fields
+  // are decoded separately from the ones cached by get(), so they can be
+  // modified without affecting this LazyRecord.
+  Record to_record() const;
+
+private:
+  struct Cell {
+    std::string_view name;
+    std::string_view raw_json;
+    mutable std::shared_ptr<Field> field; // Null until decoded
+  };
+
+  // Decodes the cell's JSON into a new Field. Throws std::runtime_error if
+  // it's malformed.
+  std::shared_ptr<Field> decode_cell(const Cell& cell) const;
+
+  std::shared_ptr<const std::string> data;
+  std::shared_ptr<const TableDecoder> decoder;
+  std::shared_ptr<StringInterner> interner;
+  std::vector<Cell> cells;
+};
@@ -0,0 +1,1116 @@
+#include "LocalQuery.hh"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <deque>
+#include <format>
+#include <numeric>
+#include <string_view>
+#include <unordered_map>
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////
+// Columns
+
+namespace {
+
+// The result of evaluating an expression (or extracting a field) for every
+// record. All vectors have one entry per record; if blank[z] is nonzero, the
+// corresponding entry in num or str is meaningless.
+struct Column {
+  enum class Type {
+    NUMBER = 0,
+    STRING,
+  };
+  Type type = Type::NUMBER;
+  vector<double> num; // Only used if type == NUMBER
+  vector<string_view> str; // Only used if type == STRING
+  vector<uint8_t> blank;
+
+  static Column numbers(size_t count) {
+    Column ret;
+    ret.type = Type::NUMBER;
+    ret.num.resize(count, 0.0);
+    ret.blank.resize(count, 0);
+    return ret;
+  }
+  static Column strings(size_t count) {
+    Column ret;
+    ret.type = Type::STRING;
+    ret.str.resize(count);
+    ret.blank.resize(count, 0);
+    return ret;
+  }
+  static Column blanks(size_t count) {
+    Column ret = Column::numbers(count);
+    ret.blank.assign(count, 1);
+    return ret;
+  }
+
+  inline size_t size() const {
+    return this->blank.size();
+  }
+};
+
+// Computed strings (e.g. results of LOWER() or numbers converted to strings)
+// are stored here, so columns can refer to them with string_views. A deque is
+// used so that existing strings never move.
+class StringArena {
+public:
+  string_view add(string&& s) {
+    return this->strings.emplace_back(std::move(s));
+  }
+
+private:
+  deque<string> strings;
+};
+
+string format_number(double v) {
+  return std::format("{}", v);
+}
+
+// Returns the text that Airtable's formula language would use for a cell. The
+// string is stored in arena if it isn't already owned by the field.
+bool field_to_string(const Field& field, StringArena& arena, string_view& out) {
+  auto join = [&](const auto& items, auto&& item_fn) -> string_view {
+    string ret;
+    for (const auto& item : items) {
+      if (!ret.empty()) {
+        ret += ", ";
+      }
+      ret += item_fn(item);
+    }
+    return arena.add(std::move(ret));
+  };
+
+  switch (field.type) {
+    case Field::ValueType::String:
+      out = static_cast<const StringField&>(field).value;
+      return true;
+    case Field::ValueType::Integer:
+      out = arena.add(std::format("{}", static_cast<const IntegerField&>(field).value));
+      return true;
+    case Field::ValueType::Float:
+      out = arena.add(format_number(static_cast<const FloatField&>(field).value));
+      return true;
+    case Field::ValueType::Checkbox:
+      out = static_cast<const CheckboxField&>(field).value ? "1" : "0";
+      return true;
+    case Field::ValueType::Collaborator:
+      out = static_cast<const CollaboratorField&>(field).name;
+      return true;
+    case Field::ValueType::Button:
+      out = static_cast<const ButtonField&>(field).label;
+      return true;
+    case Field::ValueType::StringArray:
+      out = join(static_cast<const StringArrayField&>(field).value, [](const string& s) -> const string& { return s; });
+      return true;
+    case Field::ValueType::NumberArray:
+      out = join(static_cast<const NumberArrayField&>(field).value, format_number);
+      return true;
+    case Field::ValueType::CollaboratorArray:
+      out = join(static_cast<const MultiCollaboratorField&>(field).value, [](const CollaboratorField& c) -> const string& { return c.name; });
+      return true;
+    case Field::ValueType::AttachmentArray:
+      out = join(static_cast<const AttachmentField&>(field).value, [](const Attachment& a) -> const string& { return a.filename; });
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Converts a column to strings in place (no-op if it's already strings)
+void convert_to_strings(Column& col, StringArena& arena) {
+  if (col.type == Column::Type::STRING) {
+    return;
+  }
+  col.str.resize(col.size());
+  for (size_t z = 0; z < col.size(); z++) {
+    if (!col.blank[z]) {
+      col.str[z] = arena.add(format_number(col.num[z]));
+    }
+  }
+  col.num.clear();
+  col.type = Column::Type::STRING;
+}
+
+// Converts a column to numbers in place (no-op if it's already numbers).
+// Strings that aren't entirely numeric become blank.
+void convert_to_numbers(Column& col) {
+  if (col.type == Column::Type::NUMBER) {
+    return;
+  }
+  col.num.resize(col.size());
+  for (size_t z = 0; z < col.size(); z++) {
+    if (col.blank[z] || col.str[z].empty()) {
+      col.blank[z] = 1;
+      continue;
+    }
+    string s(col.str[z]);
+    char* end = nullptr;
+    col.num[z] = strtod(s.c_str(), &end);
+    if (end != s.c_str() + s.size()) {
+      col.blank[z] = 1;
+    }
+  }
+  col.str.clear();
+  col.type = Column::Type::NUMBER;
+}
+
+// Returns a vector of 0/1 values indicating whether each entry is truthy
+vector<uint8_t> truthiness(const Column& col) {
+  vector<uint8_t> ret(col.size());
+  if (col.type == Column::Type::NUMBER) {
+    for (size_t z = 0; z < col.size(); z++) {
+      ret[z] = !col.blank[z] && (col.num[z] != 0.0);
+    }
+  } else {
+    for (size_t z = 0; z < col.size(); z++) {
+      ret[z] = !col.blank[z] && !col.str[z].empty();
+    }
+  }
+  return ret;
+}
+
+Column column_from_bools(const vector<uint8_t>& values) {
+  Column ret = Column::numbers(values.size());
+  for (size_t z = 0; z < values.size(); z++) {
+    ret.num[z] = values[z];
+  }
+  return ret;
+}
+
+} // namespace
+
+////////////////////////////////////////////////////////////////////////////////
+// Record sources
+
+// Adapts a set of records (in memory or in a snapshot) for evaluation
+class LocalQuery::RecordSource {
+public:
+  virtual ~RecordSource() = default;
+  virtual size_t size() const = 0;
+  virtual string_view record_id(size_t index) const = 0;
+  // Extracts the named field from all records into a typed column. If any
+  // non-blank cell isn't numeric, the column is returned as strings.
+  virtual Column extract_column(const string& field_name, StringArena& arena) const = 0;
+  // Decodes a record, including only the given fields (or all fields if the
+  // list is empty)
+  virtual Record materialize(size_t index, const vector<string>& fields) const = 0;
+};
+
+namespace {
+
+class VectorRecordSource : public LocalQuery::RecordSource {
+public:
+  explicit VectorRecordSource(const vector<Record>& records) : records(records) {}
+  virtual ~VectorRecordSource() = default;
+
+  virtual size_t size() const {
+    return this->records.size();
+  }
+
+  virtual string_view record_id(size_t index) const {
+    return this->records[index].id;
+  }
+
+  virtual Column extract_column(const string& field_name, StringArena& arena) const {
+    size_t count = this->records.size();
+    vector<const Field*> cells(count, nullptr);
+    bool all_numeric = true;
+    for (size_t z = 0; z < count; z++) {
+      auto it = this->records[z].fields.find(field_name);
+      if (it == this->records[z].fields.end()) {
+        continue;
+      }
+      cells[z] = it->second.get();
+      auto type = cells[z]->type;
+      all_numeric &= (type == Field::ValueType::Integer) || (type == Field::ValueType::Float) || (type == Field::ValueType::Checkbox);
+    }
+
+    if (all_numeric) {
+      Column ret = Column::numbers(count);
+      for (size_t z = 0; z < count; z++) {
+        const Field* f = cells[z];
+        if (!f) {
+          ret.blank[z] = 1;
+        } else if (f->type == Field::ValueType::Integer) {
+          ret.num[z] = static_cast<const IntegerField*>(f)->value;
+        } else if (f->type == Field::ValueType::Float) {
+          ret.num[z] = static_cast<const FloatField*>(f)->value;
+        } else {
+          ret.num[z] = static_cast<const CheckboxField*>(f)->value ? 1.0 : 0.0;
+        }
+      }
+      return ret;
+    }
+
+    Column ret = Column::strings(count);
+    for (size_t z = 0; z < count; z++) {
+      if (!cells[z] || !field_to_string(*cells[z], arena, ret.str[z])) {
+        ret.blank[z] = 1;
+      }
+    }
+    return ret;
+  }
+
+  virtual Record materialize(size_t index, const vector<string>& fields) const {
+    const Record& src = this->records[index];
+    if (fields.empty()) {
+      return src;
+    }
+    Record ret;
+    memcpy(ret.id, src.id, sizeof(ret.id));
+    ret.creation_time = src.creation_time;
+    ret.comment_count = src.comment_count;
+    ret.fields = RecordFields(src.fields.get_interner());
+    for (const auto& field_name : fields) {
+      auto it = src.fields.find(field_name);
+      if (it != src.fields.end()) {
+        ret.fields.emplace(it->first, it->second);
+      }
+    }
+    return ret;
+  }
+
+private:
+  const vector<Record>& records;
+};
+
+class SnapshotRecordSource : public LocalQuery::RecordSource {
+public:
+  explicit SnapshotRecordSource(const TableSnapshot& snapshot) : snapshot(snapshot) {}
+  virtual ~SnapshotRecordSource() = default;
+
+  virtual size_t size() const {
+    return this->snapshot.num_records();
+  }
+
+  virtual string_view record_id(size_t index) const {
+    return this->snapshot.record_id(index);
+  }
+
+  virtual Column extract_column(const string& field_name, StringArena& arena) const {
+    using CellType = TableSnapshot::CellType;
+    size_t count = this->snapshot.num_records();
+    auto field_index = this->snapshot.field_index(field_name);
+    if (!field_index) {
+      return Column::blanks(count);
+    }
+    size_t fi = *field_index;
+
+    bool all_numeric = true;
+    for (size_t z = 0; z < count && all_numeric; z++) {
+      auto type = this->snapshot.cell_type(z, fi);
+      all_numeric = (type == CellType::ABSENT) || (type == CellType::INTEGER) || (type == CellType::FLOAT) || (type == CellType::CHECKBOX);
+    }
+
+    Column ret = all_numeric ? Column::numbers(count) : Column::strings(count);
+    for (size_t z = 0; z < count; z++) {
+      switch (this->snapshot.cell_type(z, fi)) {
+        case CellType::ABSENT:
+          ret.blank[z] = 1;
+          break;
+        case CellType::INTEGER:
+          if (all_numeric) {
+            ret.num[z] = this->snapshot.cell_integer(z, fi);
+          } else {
+            ret.str[z] = arena.add(std::format("{}", this->snapshot.cell_integer(z, fi)));
+          }
+          break;
+        case CellType::FLOAT:
+          if (all_numeric) {
+            ret.num[z] = this->snapshot.cell_float(z, fi);
+          } else {
+            ret.str[z] = arena.add(format_number(this->snapshot.cell_float(z, fi)));
+          }
+          break;
+        case CellType::CHECKBOX:
+          if (all_numeric) {
+            ret.num[z] = this->snapshot.cell_checkbox(z, fi) ? 1.0 : 0.0;
+          } else {
+            ret.str[z] = this->snapshot.cell_checkbox(z, fi) ? "1" : "0";
+          }
+          break;
+        case CellType::STRING:
+          ret.str[z] = this->snapshot.cell_string(z, fi);
+          break;
+        case CellType::JSON: {
+          // Complex cells have to be decoded to produce their text. The
+          // decoded field is discarded, so anything the string refers to must
+          // be copied into the arena.
+          auto field = this->snapshot.get_field(z, fi);
+          string_view sv;
+          if (field && field_to_string(*field, arena, sv)) {
+            ret.str[z] = arena.add(string(sv));
+          } else {
+            ret.blank[z] = 1;
+          }
+          break;
+        }
+        default:
+          ret.blank[z] = 1;
+      }
+    }
+    return ret;
+  }
+
+  virtual Record materialize(size_t index, const vector<string>& fields) const {
+    if (fields.empty()) {
+      return this->snapshot.get_record(index);
+    }
+    Record ret;
+    string_view id = this->snapshot.record_id(index);
+    memcpy(ret.id, id.data(), id.size());
+    ret.id[id.size()] = 0;
+    ret.creation_time = this->snapshot.creation_time(index);
+    ret.fields = RecordFields(this->snapshot.get_field_name_interner());
+    for (const auto& field_name : fields) {
+      auto field_index = this->snapshot.field_index(field_name);
+      if (field_index) {
+        auto field = this->snapshot.get_field(index, *field_index);
+        if (field) {
+          ret.fields.emplace(field_name, std::move(field));
+        }
+      }
+    }
+    return ret;
+  }
+
+private:
+  const TableSnapshot& snapshot;
+};
+
+} // namespace
+
+////////////////////////////////////////////////////////////////////////////////
+// Formula parsing
+
+struct LocalQuery::Expr {
+  enum class Kind {
+    NUMBER_LITERAL = 0,
+    STRING_LITERAL,
+    FIELD,
+    UNARY_MINUS,
+    BINARY_OPERATOR,
+    FUNCTION,
+  };
+  Kind kind;
+  double number = 0.0;
+  string str; // String literal, field name, operator, or function name
+  vector<unique_ptr<Expr>> args;
+};
+
+namespace {
+
+using Expr = LocalQuery::Expr;
+
+class FormulaParser {
+public:
+  explicit FormulaParser(const string& formula) : text(formula), offset(0) {}
+
+  unique_ptr<Expr> parse() {
+    auto ret = this->parse_comparison();
+    this->skip_whitespace();
+    if (this->offset != this->text.size()) {
+      throw UnsupportedQueryError(std::format("unexpected text in formula at offset {}", this->offset));
+    }
+    return ret;
+  }
+
+private:
+  void skip_whitespace() {
+    while (this->offset < this->text.size() && isspace(static_cast<unsigned char>(this->text[this->offset]))) {
+      this->offset++;
+    }
+  }
+
+  // Consumes the given operator if it's next in the input
+  bool consume(const char* op) {
+    this->skip_whitespace();
+    size_t len = strlen(op);
+    if (this->text.compare(this->offset, len, op) == 0) {
+      this->offset += len;
+      return true;
+    }
+    return false;
+  }
+
+  void expect(const char* op) {
+    if (!this->consume(op)) {
+      throw UnsupportedQueryError(std::format("expected {} at offset {}", op, this->offset));
+    }
+  }
+
+  static unique_ptr<Expr> make_binary(const char* op, unique_ptr<Expr>&& left, unique_ptr<Expr>&& right) {
+    auto ret = make_unique<Expr>();
+    ret->kind = Expr::Kind::BINARY_OPERATOR;
+    ret->str = op;
+    ret->args.emplace_back(std::move(left));
+    ret->args.emplace_back(std::move(right));
+    return ret;
+  }
+
+  unique_ptr<Expr> parse_comparison() {
+    auto left = this->parse_concatenation();
+    for (;;) {
+      // Order matters here: two-character operators must be checked first
+      const char* op = nullptr;
+      if (this->consume("!=") || this->consume("<>")) {
+        op = "!=";
+      } else if (this->consume("<=")) {
+        op = "<=";
+      } else if (this->consume(">=")) {
+        op = ">=";
+      } else if (this->consume("=")) {
+        op = "=";
+      } else if (this->consume("<")) {
+        op = "<";
+      } else if (this->consume(">")) {
+        op = ">";
+      } else {
+        return left;
+      }
+      left = this->make_binary(op, std::move(left), this->parse_concatenation());
+    }
+  }
+
+  unique_ptr<Expr> parse_concatenation() {
+    auto left = this->parse_additive();
+    while (this->consume("&")) {
+      left = this->make_binary("&", std::move(left), this->parse_additive());
+    }
+    return left;
+  }
+
+  unique_ptr<Expr> parse_additive() {
+    auto left = this->parse_multiplicative();
+    for (;;) {
+      if (this->consume("+")) {
+        left = this->make_binary("+", std::move(left), this->parse_multiplicative());
+      } else if (this->consume("-")) {
+        left = this->make_binary("-", std::move(left), this->parse_multiplicative());
+      } else {
+        return left;
+      }
+    }
+  }
+
+  unique_ptr<Expr> parse_multiplicative() {
+    auto left = this->parse_unary();
+    for (;;) {
+      if (this->consume("*")) {
+        left = this->make_binary("*", std::move(left), this->parse_unary());
+      } else if (this->consume("/")) {
+        left = this->make_binary("/", std::move(left), this->parse_unary());
+      } else {
+        return left;
+      }
+    }
+  }
+
+  unique_ptr<Expr> parse_unary() {
+    if (this->consume("-")) {
+      auto ret = make_unique<Expr>();
+      ret->kind = Expr::Kind::UNARY_MINUS;
+      ret->args.emplace_back(this->parse_unary());
+      return ret;
+    }
+    return this->parse_primary();
+  }
+
+  unique_ptr<Expr> parse_primary() {
+    this->skip_whitespace();
+    if (this->offset >= this->text.size()) {
+      throw UnsupportedQueryError("unexpected end of formula");
+    }
+
+    char ch = this->text[this->offset];
+    if (ch == '(') {
+      this->offset++;
+      auto ret = this->parse_comparison();
+      this->expect(")");
+      return ret;
+    }
+
+    if (ch == '{') {
+      size_t end = this->text.find('}', this->offset + 1);
+      if (end == string::npos) {
+        throw UnsupportedQueryError("unterminated field reference");
+      }
+      auto ret = make_unique<Expr>();
+      ret->kind = Expr::Kind::FIELD;
+      ret->str = this->text.substr(this->offset + 1, end - this->offset - 1);
+      this->offset = end + 1;
+      return ret;
+    }
+
+    if (ch == '\'' || ch == '\"') {
+      auto ret = make_unique<Expr>();
+      ret->kind = Expr::Kind::STRING_LITERAL;
+      for (this->offset++;; this->offset++) {
+        if (this->offset >= this->text.size()) {
+          throw UnsupportedQueryError("unterminated string literal");
+        }
+        char str_ch = this->text[this->offset];
+        if (str_ch == ch) {
+          this->offset++;
+          break;
+        }
+        if (str_ch == '\\' && this->offset + 1 < this->text.size()) {
+          str_ch = this->text[++this->offset];
+          if (str_ch == 'n') {
+            str_ch = '\n';
+          } else if (str_ch == 't') {
+            str_ch = '\t';
+          }
+        }
+        ret->str.push_back(str_ch);
+      }
+      return ret;
+    }
+
+    if (isdigit(static_cast<unsigned char>(ch)) || ch == '.') {
+      const char* start = this->text.c_str() + this->offset;
+      char* end = nullptr;
+      auto ret = make_unique<Expr>();
+      ret->kind = Expr::Kind::NUMBER_LITERAL;
+      ret->number = strtod(start, &end);
+      this->offset += end - start;
+      return ret;
+    }
+
+    if (isalpha(static_cast<unsigned char>(ch)) || ch == '_') {
+      size_t start = this->offset;
+      while (this->offset < this->text.size() &&
+          (isalnum(static_cast<unsigned char>(this->text[this->offset])) || this->text[this->offset] == '_')) {
+        this->offset++;
+      }
+      string name = this->text.substr(start, this->offset - start);
+
+      // A bare identifier not followed by ( is a reference to a field whose
+      // name has no spaces, except for TRUE and FALSE
+      if (!this->consume("(")) {
+        string upper_name = name;
+        for (auto& c : upper_name) {
+          c = toupper(static_cast<unsigned char>(c));
+        }
+        auto ret = make_unique<Expr>();
+        if (upper_name == "TRUE" || upper_name == "FALSE") {
+          ret->kind = Expr::Kind::NUMBER_LITERAL;
+          ret->number = (upper_name == "TRUE") ? 1.0 : 0.0;
+        } else {
+          ret->kind = Expr::Kind::FIELD;
+          ret->str = std::move(name);
+        }
+        return ret;
+      }
+
+      auto ret = make_unique<Expr>();
+      ret->kind = Expr::Kind::FUNCTION;
+      ret->str = std::move(name);
+      for (auto& c : ret->str) {
+        c = toupper(static_cast<unsigned char>(c));
+      }
+      if (!this->consume(")")) {
+        do {
+          ret->args.emplace_back(this->parse_comparison());
+        } while (this->consume(","));
+        this->expect(")");
+      }
+      this->check_function(*ret);
+      return ret;
+    }
+
+    throw UnsupportedQueryError(std::format("unexpected character in formula at offset {}", this->offset));
+  }
+
+  static void check_function(const Expr& expr) {
+    struct ArgCountRange {
+      size_t min;
+      size_t max;
+    };
+    static const unordered_map<string, ArgCountRange> supported_functions = {
+        {"AND", {1, SIZE_MAX}},
+        {"OR", {1, SIZE_MAX}},
+        {"NOT", {1, 1}},
+        {"IF", {2, 3}},
+        {"BLANK", {0, 0}},
+        {"TRUE", {0, 0}},
+        {"FALSE", {0, 0}},
+        {"LEN", {1, 1}},
+        {"LOWER", {1, 1}},
+        {"UPPER", {1, 1}},
+        {"TRIM", {1, 1}},
+        {"FIND", {2, 3}},
+        {"CONCATENATE", {1, SIZE_MAX}},
+        {"RECORD_ID", {0, 0}},
+    };
+    auto it = supported_functions.find(expr.str);
+    if (it == supported_functions.end()) {
+      throw UnsupportedQueryError(std::format("function {} is not supported locally", expr.str));
+    }
+    if (expr.args.size() < it->second.min || expr.args.size() > it->second.max) {
+      throw UnsupportedQueryError(std::format("incorrect argument count for {}", expr.str));
+    }
+  }
+
+  const string& text;
+  size_t offset;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Formula evaluation
+
+class Evaluator {
+public:
+  Evaluator(const LocalQuery::RecordSource& source) : source(source), count(source.size()) {}
+
+  const Column& field_column(const string& field_name) {
+    auto it = this->field_columns.find(field_name);
+    if (it == this->field_columns.end()) {
+      it = this->field_columns.emplace(field_name, this->source.extract_column(field_name, this->arena)).first;
+    }
+    return it->second;
+  }
+
+  Column evaluate(const Expr& expr) {
+    switch (expr.kind) {
+      case Expr::Kind::NUMBER_LITERAL: {
+        Column ret = Column::numbers(this->count);
+        ret.num.assign(this->count, expr.number);
+        return ret;
+      }
+      case Expr::Kind::STRING_LITERAL: {
+        Column ret = Column::strings(this->count);
+        ret.str.assign(this->count, expr.str);
+        return ret;
+      }
+      case Expr::Kind::FIELD:
+        return this->field_column(expr.str);
+      case Expr::Kind::UNARY_MINUS: {
+        Column ret = this->evaluate(*expr.args[0]);
+        convert_to_numbers(ret);
+        for (auto& v : ret.num) {
+          v = -v;
+        }
+        return ret;
+      }
+      case Expr::Kind::BINARY_OPERATOR:
+        return this->evaluate_binary(expr);
+      case Expr::Kind::FUNCTION:
+        return this->evaluate_function(expr);
+      default:
+        throw logic_error("invalid expression kind");
+    }
+  }
+
+  StringArena arena;
+
+private:
+  static bool is_blank_literal(const Expr& expr) {
+    return (expr.kind == Expr::Kind::FUNCTION) && (expr.str == "BLANK");
+  }
+
+  Column evaluate_binary(const Expr& expr) {
+    const string& op = expr.str;
+
+    // Comparisons against BLANK() check for blank (or empty) values, instead
+    // of treating BLANK() as 0 or ''
+    if ((op == "=" || op == "!=") && (is_blank_literal(*expr.args[0]) || is_blank_literal(*expr.args[1]))) {
+      const Expr& other_expr = is_blank_literal(*expr.args[0]) ? *expr.args[1] : *expr.args[0];
+      Column other = this->evaluate(other_expr);
+      Column ret = Column::numbers(this->count);
+      bool want_blank = (op == "=");
+      for (size_t z = 0; z < this->count; z++) {
+        bool is_blank = other.blank[z] || ((other.type == Column::Type::STRING) && other.str[z].empty());
+        ret.num[z] = (is_blank == want_blank);
+      }
+      return ret;
+    }
+
+    Column left = this->evaluate(*expr.args[0]);
+    Column right = this->evaluate(*expr.args[1]);
+
+    if (op == "&") {
+      convert_to_strings(left, this->arena);
+      convert_to_strings(right, this->arena);
+      Column ret = Column::strings(this->count);
+      for (size_t z = 0; z < this->count; z++) {
+        string s;
+        if (!left.blank[z]) {
+          s += left.str[z];
+        }
+        if (!right.blank[z]) {
+          s += right.str[z];
+        }
+        ret.str[z] = this->arena.add(std::move(s));
+      }
+      return ret;
+    }
+
+    if (op == "+" || op == "-" || op == "*" || op == "/") {
+      convert_to_numbers(left);
+      convert_to_numbers(right);
+      Column ret = Column::numbers(this->count);
+      char op_ch = op[0];
+      for (size_t z = 0; z < this->count; z++) {
+        // Blank operands act as 0
+        double l = left.blank[z] ? 0.0 : left.num[z];
+        double r = right.blank[z] ? 0.0 : right.num[z];
+        switch (op_ch) {
+          case '+':
+            ret.num[z] = l + r;
+            break;
+          case '-':
+            ret.num[z] = l - r;
+            break;
+          case '*':
+            ret.num[z] = l * r;
+            break;
+          case '/':
+            // Airtable returns an error value here, which is falsy
+            if (r == 0.0) {
+              ret.blank[z] = 1;
+            } else {
+              ret.num[z] = l / r;
+            }
+            break;
+        }
+      }
+      return ret;
+    }
+
+    // All that's left are comparisons. If either side is a string, compare as
+    // strings; otherwise, compare as numbers.
+    Column ret = Column::numbers(this->count);
+    auto apply = [&](auto&& get_cmp) -> void {
+      for (size_t z = 0; z < this->count; z++) {
+        int cmp = get_cmp(z);
+        bool result;
+        if (op == "=") {
+          result = (cmp == 0);
+        } else if (op == "!=") {
+          result = (cmp != 0);
+        } else if (op == "<") {
+          result = (cmp < 0);
+        } else if (op == "<=") {
+          result = (cmp <= 0);
+        } else if (op == ">") {
+          result = (cmp > 0);
+        } else if (op == ">=") {
+          result = (cmp >= 0);
+        } else {
+          throw logic_error("invalid operator");
+        }
+        ret.num[z] = result;
+      }
+    };
+    if (left.type == Column::Type::STRING || right.type == Column::Type::STRING) {
+      convert_to_strings(left, this->arena);
+      convert_to_strings(right, this->arena);
+      apply([&](size_t z) -> int {
+        string_view l = left.blank[z] ? string_view() : left.str[z];
+        string_view r = right.blank[z] ? string_view() : right.str[z];
+        return l.compare(r);
+      });
+    } else {
+      apply([&](size_t z) -> int {
+        double l = left.blank[z] ? 0.0 : left.num[z];
+        double r = right.blank[z] ? 0.0 : right.num[z];
+        return (l < r) ? -1 : ((l > r) ? 1 : 0);
+      });
+    }
+    return ret;
+  }
+
+  Column evaluate_function(const Expr& expr) {
+    const string& name = expr.str;
+
+    if (name == "AND" || name == "OR") {
+      bool is_and = (name == "AND");
+      vector<uint8_t> result(this->count, is_and ? 1 : 0);
+      for (const auto& arg : expr.args) {
+        auto arg_truth = truthiness(this->evaluate(*arg));
+        for (size_t z = 0; z < this->count; z++) {
+          result[z] = is_and ? (result[z] & arg_truth[z]) : (result[z] | arg_truth[z]);
+        }
+      }
+      return column_from_bools(result);
+    }
+
+    if (name == "NOT") {
+      auto truth = truthiness(this->evaluate(*expr.args[0]));
+      for (auto& v : truth) {
+        v = !v;
+      }
+      return column_from_bools(truth);
+    }
+
+    if (name == "IF") {
+      // Both branches are evaluated for all records, then merged
+      auto cond = truthiness(this->evaluate(*expr.args[0]));
+      Column if_true = this->evaluate(*expr.args[1]);
+      Column if_false = (expr.args.size() > 2) ? this->evaluate(*expr.args[2]) : Column::blanks(this->count);
+      if (if_true.type != if_false.type) {
+        convert_to_strings(if_true, this->arena);
+        convert_to_strings(if_false, this->arena);
+      }
+      for (size_t z = 0; z < this->count; z++) {
+        if (!cond[z]) {
+          if_true.blank[z] = if_false.blank[z];
+          if (if_true.type == Column::Type::NUMBER) {
+            if_true.num[z] = if_false.num[z];
+          } else {
+            if_true.str[z] = if_false.str[z];
+          }
+        }
+      }
+      return if_true;
+    }
+
+    if (name == "BLANK") {
+      return Column::blanks(this->count);
+    }
+    if (name == "TRUE" || name == "FALSE") {
+      Column ret = Column::numbers(this->count);
+      ret.num.assign(this->count, (name == "TRUE") ? 1.0 : 0.0);
+      return ret;
+    }
+
+    if (name == "RECORD_ID") {
+      Column ret = Column::strings(this->count);
+      for (size_t z = 0; z < this->count; z++) {
+        ret.str[z] = this->source.record_id(z);
+      }
+      return ret;
+    }
+
+    if (name == "LEN") {
+      Column arg = this->evaluate(*expr.args[0]);
+      convert_to_strings(arg, this->arena);
+      Column ret = Column::numbers(this->count);
+      for (size_t z = 0; z < this->count; z++) {
+        ret.num[z] = arg.blank[z] ? 0 : arg.str[z].size();
+      }
+      return ret;
+    }
+
+    if (name == "LOWER" || name == "UPPER" || name == "TRIM") {
+      Column arg = this->evaluate(*expr.args[0]);
+      convert_to_strings(arg, this->arena);
+      for (size_t z = 0; z < this->count; z++) {
+        if (arg.blank[z]) {
+          continue;
+        }
+        if (name == "TRIM") {
+          string_view& sv = arg.str[z];
+          while (!sv.empty() && isspace(static_cast<unsigned char>(sv.front()))) {
+            sv.remove_prefix(1);
+          }
+          while (!sv.empty() && isspace(static_cast<unsigned char>(sv.back()))) {
+            sv.remove_suffix(1);
+          }
+        } else {
+          string s(arg.str[z]);
+          for (auto& c : s) {
+            c = (name == "LOWER") ? tolower(static_cast<unsigned char>(c)) : toupper(static_cast<unsigned char>(c));
+          }
+          arg.str[z] = this->arena.add(std::move(s));
+        }
+      }
+      return arg;
+    }
+
+    if (name == "FIND") {
+      Column needle = this->evaluate(*expr.args[0]);
+      Column haystack = this->evaluate(*expr.args[1]);
+      convert_to_strings(needle, this->arena);
+      convert_to_strings(haystack, this->arena);
+      Column start;
+      if (expr.args.size() > 2) {
+        start = this->evaluate(*expr.args[2]);
+        convert_to_numbers(start);
+      }
+      Column ret = Column::numbers(this->count);
+      for (size_t z = 0; z < this->count; z++) {
+        string_view n = needle.blank[z] ? string_view() : needle.str[z];
+        string_view h = haystack.blank[z] ? string_view() : haystack.str[z];
+        size_t start_offset = 0;
+        if (start.size() && !start.blank[z] && start.num[z] > 1.0) {
+          start_offset = static_cast<size_t>(start.num[z]) - 1;
+        }
+        size_t pos = (start_offset <= h.size()) ? h.find(n, start_offset) : string_view::npos;
+        ret.num[z] = (pos == string_view::npos) ? 0.0 : (pos + 1);
+      }
+      return ret;
+    }
+
+    if (name == "CONCATENATE") {
+      vector<Column> args;
+      for (const auto& arg_expr : expr.args) {
+        args.emplace_back(this->evaluate(*arg_expr));
+        convert_to_strings(args.back(), this->arena);
+      }
+      Column ret = Column::strings(this->count);
+      for (size_t z = 0; z < this->count; z++) {
+        string s;
+        for (const auto& arg : args) {
+          if (!arg.blank[z]) {
+            s += arg.str[z];
+          }
+        }
+        ret.str[z] = this->arena.add(std::move(s));
+      }
+      return ret;
+    }
+
+    // FormulaParser::check_function should have prevented this
+    throw logic_error("unimplemented function " + name);
+  }
+
+  const LocalQuery::RecordSource& source;
+  size_t count;
+  unordered_map<string, Column> field_columns;
+};
+
+// Appends the names of the fields that expr refers to, if they're not
+// already in names
+void collect_field_names(const Expr& expr, vector<string>& names) {
+  if ((expr.kind == Expr::Kind::FIELD) && (find(names.begin(), names.end(), expr.str) == names.end())) {
+    names.emplace_back(expr.str);
+  }
+  for (const auto& arg : expr.args) {
+    collect_field_names(*arg, names);
+  }
+}
+
+} // namespace
+
+////////////////////////////////////////////////////////////////////////////////
+// LocalQuery
+
+LocalQuery::LocalQuery(const AirtableClient::ListRecordsOptions& options)
+    : fields(options.fields),
+      sort_fields(options.sort_fields),
+      max_records(options.max_records) {
+  if (!options.view.empty()) {
+    throw UnsupportedQueryError("views cannot be evaluated locally");
+  }
+  if (options.cell_format != AirtableClient::ListRecordsOptions::CellFormat::JSON) {
+    throw UnsupportedQueryError("string cell format cannot be evaluated locally");
+  }
+  if (options.return_fields_by_field_id) {
+    throw UnsupportedQueryError("field ID keys cannot be evaluated locally");
+  }
+  if (!options.filter_formula.empty()) {
+    this->filter = FormulaParser(options.filter_formula).parse();
+  }
+}
+
+LocalQuery::LocalQuery(LocalQuery&&) = default;
+LocalQuery& LocalQuery::operator=(LocalQuery&&) = default;
+LocalQuery::~LocalQuery() = default;
+
+bool LocalQuery::is_supported(const AirtableClient::ListRecordsOptions& options) {
+  try {
+    LocalQuery q(options);
+    return true;
+  } catch (const UnsupportedQueryError&) {
+    return false;
+  }
+}
+
+vector<string> LocalQuery::filter_field_names() const {
+  vector<string> ret;
+  if (this->filter) {
+    collect_field_names(*this->filter, ret);
+  }
+  return ret;
+}
+
+vector<Record> LocalQuery::run(const vector<Record>& records) const {
+  return this->run(VectorRecordSource(records));
+}
+
+vector<Record> LocalQuery::run(const TableSnapshot& snapshot) const {
+  return this->run(SnapshotRecordSource(snapshot));
+}
+
+vector<Record> LocalQuery::run(const RecordSource& source) const {
+  Evaluator ev(source);
+
+  vector<size_t> indexes;
+  if (this->filter) {
+    auto matches = truthiness(ev.evaluate(*this->filter));
+    for (size_t z = 0; z < matches.size(); z++) {
+      if (matches[z]) {
+        indexes.emplace_back(z);
+      }
+    }
+  } else {
+    indexes.resize(source.size());
+    iota(indexes.begin(), indexes.end(), 0);
+  }
+
+  if (!this->sort_fields.empty()) {
+    vector<const Column*> sort_columns;
+    for (const auto& sort : this->sort_fields) {
+      sort_columns.emplace_back(&ev.field_column(sort.first));
+    }
+    stable_sort(indexes.begin(), indexes.end(), [&](size_t a, size_t b) -> bool {
+      for (size_t z = 0; z < sort_columns.size(); z++) {
+        const Column& col = *sort_columns[z];
+        int cmp;
+        if (col.blank[a] || col.blank[b]) {
+          cmp = static_cast<int>(col.blank[b]) - static_cast<int>(col.blank[a]);
+        } else if (col.type == Column::Type::NUMBER) {
+          cmp = (col.num[a] < col.num[b]) ? -1 : ((col.num[a] > col.num[b]) ? 1 : 0);
+        } else {
+          cmp = col.str[a].compare(col.str[b]);
+        }
+        if (cmp != 0) {
+          return this->sort_fields[z].second ? (cmp < 0) : (cmp > 0);
+        }
+      }
+      return false;
+    });
+  }
+
+  if (this->max_records && indexes.size() > this->max_records) {
+    indexes.resize(this->max_records);
+  }
+
+  vector<Record> ret;
+  ret.reserve(indexes.size());
+  for (size_t index : indexes) {
+    ret.emplace_back(source.materialize(index, this->fields));
+  }
+  return ret;
+}
+
+asio::awaitable<vector<Record>> list_records_locally_or_remotely(
+    AirtableClient& client,
+    const string& base_id,
+    const string& table_name,
+    const vector<Record>& local_records,
+    const AirtableClient::ListRecordsOptions* options) {
+  if (!options) {
+    co_return LocalQuery(AirtableClient::ListRecordsOptions()).run(local_records);
+  }
+
+  unique_ptr<LocalQuery> query;
+  try {
+    query = make_unique<LocalQuery>(*options);
+  } catch (const UnsupportedQueryError&) {
+  }
+
+  if (query) {
+    co_return query->run(local_records);
+  }
+  co_return co_await client.list_records(base_id, table_name, options);
+}
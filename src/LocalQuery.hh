@@ -0,0 +1,81 @@
+#pragma once
+
+#include <asio.hpp>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "AirtableClient.hh"
+#include "FieldTypes.hh"
+#include "TableSnapshot.hh"
+
+// Thrown when a query uses formula syntax, functions, or options that the
+// local evaluator doesn't support. Callers should fall back to the API.
+class UnsupportedQueryError : public std::runtime_error {
+public:
+  using std::runtime_error::runtime_error;
+};
+
+// Evaluates a ListRecordsOptions query (fields projection, filter_formula,
+// sort_fields, and max_records) against records held locally, such as a
+// TableSyncer replica or a TableSnapshot, instead of making API calls.
+//
+// The supported formula subset is:
+// - Literals: numbers, 'strings' and "strings", TRUE(), FALSE(), BLANK()
+// - Field references: {Field Name}, or FieldName for names without spaces
+// - Operators: = != < > <= >= & + - * / and parentheses
+// - Functions: AND, OR, NOT, IF, LEN, LOWER, UPPER, TRIM, FIND, CONCATENATE,
+//   RECORD_ID
+// Anything else (including date functions and views) causes the constructor to
+// throw UnsupportedQueryError. Semantics follow Airtable's where practical:
+// blank cells compare equal to BLANK() and to '', and act as 0 or '' in other
+// expressions; checkboxes are 1 or 0; lists (multiple selects, lookups, etc.)
+// are joined with ", " as in Airtable's formula language. Blank values sort
+// before all others in ascending order.
+//
+// Evaluation is column-at-a-time: each referenced field is first extracted
+// into a typed column (numbers or strings), and then each node of the formula
+// is applied to entire columns at once.
+class LocalQuery {
+public:
+  explicit LocalQuery(const AirtableClient::ListRecordsOptions& options);
+  LocalQuery(const LocalQuery&) = delete;
+  LocalQuery(LocalQuery&&);
+  LocalQuery& operator=(const LocalQuery&) = delete;
+  LocalQuery& operator=(LocalQuery&&);
+  ~LocalQuery();
+
+  // Returns true if the options can be evaluated locally
+  static bool is_supported(const AirtableClient::ListRecordsOptions& options);
+
+  // Returns the names of the fields that the filter formula refers to, in the
+  // order they first appear
+  std::vector<std::string> filter_field_names() const;
+
+  std::vector<Record> run(const std::vector<Record>& records) const;
+  // Only the cells of the returned records (after filtering and limiting) are
+  // decoded; the filter and sort operate directly on the snapshot's typed
+  // columns.
+  std::vector<Record> run(const TableSnapshot& snapshot) const;
+
+  struct Expr;
+  class RecordSource;
+
+private:
+  std::vector<Record> run(const RecordSource& source) const;
+
+  std::unique_ptr<Expr> filter; // nullptr = all records match
+  std::vector<std::string> fields; // empty = all fields
+  std::vector<std::pair<std::string, bool>> sort_fields;
+  size_t max_records;
+};
+
+// Runs the query locally if possible; if not (for example, if the formula uses
+// unsupported functions), calls list_records on the given client instead.
+asio::awaitable<std::vector<Record>> list_records_locally_or_remotely(
+    AirtableClient& client,
+    const std::string& base_id,
+    const std::string& table_name,
+    const std::vector<Record>& local_records,
+    const AirtableClient::ListRecordsOptions* options);
@@ -0,0 +1,223 @@
+#include "Metrics.hh"
+
+#include <algorithm>
+#include <bit>
+#include <format>
+#include <mutex>
+#include <stdexcept>
+
+using namespace std;
+
+uint64_t LatencyHistogram::Snapshot::percentile(double fraction) const {
+  if (this->count == 0) {
+    return 0;
+  }
+  uint64_t target = static_cast<uint64_t>(fraction * this->count);
+  target = clamp<uint64_t>(target, 1, this->count);
+  uint64_t cumulative = 0;
+  for (size_t z = 0; z < this->bucket_counts.size(); z++) {
+    cumulative += this->bucket_counts[z];
+    if (cumulative >= target) {
+      return min(LatencyHistogram::bucket_upper_bound(z), this->max_usecs);
+    }
+  }
+  return this->max_usecs;
+}
+
+size_t LatencyHistogram::bucket_for_value(uint64_t usecs) {
+  if (usecs < SUB_BUCKET_COUNT) {
+    return usecs;
+  }
+  size_t exponent = bit_width(usecs) - 1;
+  if (exponent >= MAX_VALUE_BITS) {
+    return NUM_BUCKETS - 1;
+  }
+  size_t sub_bucket = (usecs >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKET_COUNT - 1);
+  return (exponent - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT + sub_bucket;
+}
+
+uint64_t LatencyHistogram::bucket_lower_bound(size_t bucket_index) {
+  if (bucket_index >= NUM_BUCKETS) {
+    throw out_of_range("invalid histogram bucket index");
+  }
+  if (bucket_index < SUB_BUCKET_COUNT) {
+    return bucket_index;
+  }
+  size_t exponent = (bucket_index / SUB_BUCKET_COUNT) + SUB_BUCKET_BITS - 1;
+  size_t sub_bucket = bucket_index % SUB_BUCKET_COUNT;
+  return static_cast<uint64_t>(SUB_BUCKET_COUNT + sub_bucket) << (exponent - SUB_BUCKET_BITS);
+}
+
+uint64_t LatencyHistogram::bucket_upper_bound(size_t bucket_index) {
+  if (bucket_index == NUM_BUCKETS - 1) {
+    return UINT64_MAX;
+  }
+  return LatencyHistogram::bucket_lower_bound(bucket_index + 1) - 1;
+}
+
+void LatencyHistogram::record(uint64_t usecs) {
+  this->bucket_counts[LatencyHistogram::bucket_for_value(usecs)].fetch_add(1, memory_order_relaxed);
+  this->count.fetch_add(1, memory_order_relaxed);
+  this->sum_usecs.fetch_add(usecs, memory_order_relaxed);
+  uint64_t prev_max = this->max_usecs.load(memory_order_relaxed);
+  while ((usecs > prev_max) && !this->max_usecs.compare_exchange_weak(prev_max, usecs, memory_order_relaxed)) {
+  }
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::snapshot() const {
+  // The fields are read separately, so if values are being recorded
+  // concurrently, count and sum may not exactly match the buckets. count is
+  // recomputed from the buckets so percentiles are consistent.
+  Snapshot ret;
+  ret.bucket_counts.resize(NUM_BUCKETS);
+  for (size_t z = 0; z < NUM_BUCKETS; z++) {
+    ret.bucket_counts[z] = this->bucket_counts[z].load(memory_order_relaxed);
+    ret.count += ret.bucket_counts[z];
+  }
+  ret.sum_usecs = this->sum_usecs.load(memory_order_relaxed);
+  ret.max_usecs = this->max_usecs.load(memory_order_relaxed);
+  return ret;
+}
+
+const char* name_for_request_phase(RequestPhase phase) {
+  switch (phase) {
+    case RequestPhase::RESOLVE:
+      return "resolve";
+    case RequestPhase::CONNECT:
+      return "connect";
+    case RequestPhase::TLS_HANDSHAKE:
+      return "tls_handshake";
+    case RequestPhase::FIRST_BYTE:
+      return "first_byte";
+    case RequestPhase::BODY_TRANSFER:
+      return "body_transfer";
+    case RequestPhase::REQUEST:
+      return "request";
+    case RequestPhase::PARSE:
+      return "parse";
+    default:
+      throw logic_error("invalid request phase");
+  }
+}
+
+RequestMetrics& ClientMetrics::get_series(const char* api_method, const string& base_id) {
+  string key = api_method;
+  key.push_back('\0');
+  key += base_id;
+  {
+    shared_lock g(this->series_lock);
+    auto it = this->series.find(key);
+    if (it != this->series.end()) {
+      return *it->second;
+    }
+  }
+  unique_lock g(this->series_lock);
+  auto& ret = this->series[key];
+  if (!ret) {
+    ret = make_unique<RequestMetrics>();
+  }
+  return *ret;
+}
+
+ClientMetricsSnapshot ClientMetrics::snapshot() const {
+  ClientMetricsSnapshot ret;
+  ret.in_flight_requests = this->in_flight_requests.load(memory_order_relaxed);
+  ret.open_connections = this->open_connections.load(memory_order_relaxed);
+  ret.cpu_pool_threads = this->cpu_pool_threads.load(memory_order_relaxed);
+
+  shared_lock g(this->series_lock);
+  for (const auto& [key, metrics] : this->series) {
+    auto& s = ret.series.emplace_back();
+    size_t separator_pos = key.find('\0');
+    s.api_method = key.substr(0, separator_pos);
+    s.base_id = key.substr(separator_pos + 1);
+    for (size_t z = 0; z < metrics->phases.size(); z++) {
+      s.phases[z] = metrics->phases[z].snapshot();
+    }
+    s.requests = metrics->requests.load(memory_order_relaxed);
+    s.errors = metrics->errors.load(memory_order_relaxed);
+    s.request_bytes = metrics->request_bytes.load(memory_order_relaxed);
+    s.response_body_bytes = metrics->response_body_bytes.load(memory_order_relaxed);
+    s.retries = metrics->retries.load(memory_order_relaxed);
+    s.responses_429 = metrics->responses_429.load(memory_order_relaxed);
+    s.responses_5xx = metrics->responses_5xx.load(memory_order_relaxed);
+  }
+  g.unlock();
+
+  sort(ret.series.begin(), ret.series.end(), [](const RequestMetricsSnapshot& a, const RequestMetricsSnapshot& b) -> bool {
+    return (a.api_method != b.api_method) ? (a.api_method < b.api_method) : (a.base_id < b.base_id);
+  });
+  return ret;
+}
+
+static string escape_prometheus_label_value(const string& s) {
+  string ret;
+  for (char ch : s) {
+    if (ch == '\\' || ch == '\"') {
+      ret.push_back('\\');
+      ret.push_back(ch);
+    } else if (ch == '\n') {
+      ret += "\\n";
+    } else {
+      ret.push_back(ch);
+    }
+  }
+  return ret;
+}
+
+string ClientMetricsSnapshot::to_prometheus(const string& prefix) const {
+  static const double QUANTILES[] = {0.5, 0.9, 0.99, 0.999};
+
+  string ret;
+  auto write_header = [&](const char* name, const char* type, const char* help) -> void {
+    ret += std::format("# HELP {}_{} {}\n# TYPE {}_{} {}\n", prefix, name, help, prefix, name, type);
+  };
+
+  vector<string> labels;
+  labels.reserve(this->series.size());
+  for (const auto& s : this->series) {
+    labels.emplace_back(std::format("method=\"{}\",base=\"{}\"",
+        escape_prometheus_label_value(s.api_method), escape_prometheus_label_value(s.base_id)));
+  }
+
+  write_header("request_phase_seconds", "summary", "Time spent in each phase of a request");
+  for (size_t z = 0; z < this->series.size(); z++) {
+    for (size_t phase = 0; phase < this->series[z].phases.size(); phase++) {
+      const auto& h = this->series[z].phases[phase];
+      if (h.count == 0) {
+        continue;
+      }
+      string phase_labels = std::format("{},phase=\"{}\"", labels[z], name_for_request_phase(static_cast<RequestPhase>(phase)));
+      for (double q : QUANTILES) {
+        ret += std::format("{}_request_phase_seconds{{{},quantile=\"{}\"}} {}\n",
+            prefix, phase_labels, q, h.percentile(q) / 1000000.0);
+      }
+      ret += std::format("{}_request_phase_seconds_sum{{{}}} {}\n", prefix, phase_labels, h.sum_usecs / 1000000.0);
+      ret += std::format("{}_request_phase_seconds_count{{{}}} {}\n", prefix, phase_labels, h.count);
+    }
+  }
+
+  auto write_counter = [&](const char* name, const char* help, uint64_t RequestMetricsSnapshot::* field) -> void {
+    write_header(name, "counter", help);
+    for (size_t z = 0; z < this->series.size(); z++) {
+      ret += std::format("{}_{}{{{}}} {}\n", prefix, name, labels[z], this->series[z].*field);
+    }
+  };
+  write_counter("requests_total", "HTTP requests made, including retries", &RequestMetricsSnapshot::requests);
+  write_counter("request_errors_total", "HTTP requests that failed without a response", &RequestMetricsSnapshot::errors);
+  write_counter("request_bytes_total", "Bytes sent in requests", &RequestMetricsSnapshot::request_bytes);
+  write_counter("response_body_bytes_total", "Response body bytes received", &RequestMetricsSnapshot::response_body_bytes);
+  write_counter("retries_total", "API calls retried", &RequestMetricsSnapshot::retries);
+  write_counter("responses_429_total", "Responses with HTTP status 429 (rate limited)", &RequestMetricsSnapshot::responses_429);
+  write_counter("responses_5xx_total", "Responses with HTTP status 5xx", &RequestMetricsSnapshot::responses_5xx);
+
+  auto write_gauge = [&](const char* name, const char* help, int64_t value) -> void {
+    write_header(name, "gauge", help);
+    ret += std::format("{}_{} {}\n", prefix, name, value);
+  };
+  write_gauge("in_flight_requests", "Requests currently in progress", this->in_flight_requests);
+  write_gauge("open_connections", "Connections currently open", this->open_connections);
+  write_gauge("cpu_pool_threads", "Threads in the CPU pool used for parsing", this->cpu_pool_threads);
+
+  return ret;
+}
@@ -0,0 +1,231 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Request metrics for AsyncHTTPClient and AirtableClient. Recording a value
+// only does a few relaxed atomic operations, so metrics can be left enabled
+// in production; reading them (via ClientMetrics::snapshot) copies everything
+// and is much slower, but doesn't block recording.
+
+// A histogram of durations in microseconds with log-linear buckets, in the
+// style of HdrHistogram: each power of 2 is divided into 8 equal buckets, so
+// each value is recorded with at most 12.5% relative error. Values of 2^32
+// usecs (about 71 minutes) or more are recorded in the last bucket. Recording
+// is lock-free and may be done from any number of threads at once.
+class LatencyHistogram {
+public:
+  static constexpr size_t SUB_BUCKET_BITS = 3;
+  static constexpr size_t SUB_BUCKET_COUNT = 1 << SUB_BUCKET_BITS;
+  static constexpr size_t MAX_VALUE_BITS = 32;
+  static constexpr size_t NUM_BUCKETS = (MAX_VALUE_BITS - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT;
+
+  struct Snapshot {
+    uint64_t count = 0;
+    uint64_t sum_usecs = 0;
+    uint64_t max_usecs = 0;
+    std::vector<uint64_t> bucket_counts;
+
+    // Returns the value at or below which the given fraction (0-1) of the
+    // recorded values fall, or 0 if there are none
+    uint64_t percentile(double fraction) const;
+  };
+
+  LatencyHistogram() = default;
+  LatencyHistogram(const LatencyHistogram&) = delete;
+  LatencyHistogram(LatencyHistogram&&) = delete;
+  LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+  LatencyHistogram& operator=(LatencyHistogram&&) = delete;
+  ~LatencyHistogram() = default;
+
+  void record(uint64_t usecs);
+  Snapshot snapshot() const;
+
+  static size_t bucket_for_value(uint64_t usecs);
+  // Returns the smallest value that would be recorded in bucket_index
+  static uint64_t bucket_lower_bound(size_t bucket_index);
+  // Returns the largest value that would be recorded in bucket_index
+  static uint64_t bucket_upper_bound(size_t bucket_index);
+
+private:
+  std::array<std::atomic<uint64_t>, NUM_BUCKETS> bucket_counts = {};
+  std::atomic<uint64_t> count = 0;
+  std::atomic<uint64_t> sum_usecs = 0;
+  std::atomic<uint64_t> max_usecs = 0;
+};
+
+// The phases of a request that are timed separately
+enum class RequestPhase {
+  // Resolving the server's hostname
+  RESOLVE = 0,
+  // Opening the TCP connection
+  CONNECT,
+  // The TLS handshake (not recorded for plain HTTP requests)
+  TLS_HANDSHAKE,
+  // From starting to send the request until the response's status line is
+  // received
+  FIRST_BYTE,
+  // From receiving the response's status line until the end of the body. When
+  // the response is parsed as it arrives, this includes parsing time.
+  BODY_TRANSFER,
+  // An entire HTTP request, from resolving the hostname to the end of the
+  // body. A retried API call records this once per try.
+  REQUEST,
+  // Parsing the response body (recorded only by AirtableClient)
+  PARSE,
+  NUM_PHASES,
+};
+
+const char* name_for_request_phase(RequestPhase phase);
+
+// Metrics for one kind of request (one API method on one base, for
+// AirtableClient). Everything here may be updated from any number of threads
+// at once.
+struct RequestMetrics {
+  std::array<LatencyHistogram, static_cast<size_t>(RequestPhase::NUM_PHASES)> phases;
+  // HTTP requests made, including retries
+  std::atomic<uint64_t> requests = 0;
+  // HTTP requests that failed without a response (e.g. the connection failed)
+  std::atomic<uint64_t> errors = 0;
+  // Bytes sent, including request lines and headers
+  std::atomic<uint64_t> request_bytes = 0;
+  // Response body bytes received
+  std::atomic<uint64_t> response_body_bytes = 0;
+  // API calls retried (after a 429 response)
+  std::atomic<uint64_t> retries = 0;
+  std::atomic<uint64_t> responses_429 = 0;
+  std::atomic<uint64_t> responses_5xx = 0;
+
+  inline void record(RequestPhase phase, uint64_t usecs) {
+    this->phases[static_cast<size_t>(phase)].record(usecs);
+  }
+};
+
+// Measures elapsed time for RequestMetrics::record
+class RequestTimer {
+public:
+  RequestTimer() : start(std::chrono::steady_clock::now()) {}
+
+  uint64_t elapsed_usecs() const {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - this->start).count();
+  }
+  // Returns the elapsed time and starts timing again from now
+  uint64_t lap_usecs() {
+    auto now = std::chrono::steady_clock::now();
+    uint64_t ret = std::chrono::duration_cast<std::chrono::microseconds>(now - this->start).count();
+    this->start = now;
+    return ret;
+  }
+
+private:
+  std::chrono::steady_clock::time_point start;
+};
+
+// Records the time from its construction to its destruction as phase in
+// request_metrics, unless request_metrics is null
+class ScopedPhaseTimer {
+public:
+  ScopedPhaseTimer(RequestMetrics* request_metrics, RequestPhase phase)
+      : request_metrics(request_metrics), phase(phase) {}
+  ScopedPhaseTimer(const ScopedPhaseTimer&) = delete;
+  ScopedPhaseTimer(ScopedPhaseTimer&&) = delete;
+  ScopedPhaseTimer& operator=(const ScopedPhaseTimer&) = delete;
+  ScopedPhaseTimer& operator=(ScopedPhaseTimer&&) = delete;
+  ~ScopedPhaseTimer() {
+    if (this->request_metrics) {
+      this->request_metrics->record(this->phase, this->timer.elapsed_usecs());
+    }
+  }
+
+private:
+  RequestMetrics* request_metrics;
+  RequestPhase phase;
+  RequestTimer timer;
+};
+
+struct RequestMetricsSnapshot {
+  std::string api_method;
+  std::string base_id;
+  std::array<LatencyHistogram::Snapshot, static_cast<size_t>(RequestPhase::NUM_PHASES)> phases;
+  uint64_t requests = 0;
+  uint64_t errors = 0;
+  uint64_t request_bytes = 0;
+  uint64_t response_body_bytes = 0;
+  uint64_t retries = 0;
+  uint64_t responses_429 = 0;
+  uint64_t responses_5xx = 0;
+};
+
+struct ClientMetricsSnapshot {
+  int64_t in_flight_requests = 0;
+  int64_t open_connections = 0;
+  int64_t cpu_pool_threads = 0;
+  // Sorted by api_method, then base_id
+  std::vector<RequestMetricsSnapshot> series;
+
+  // Returns the metrics in the Prometheus text exposition format. Each phase
+  // histogram is exported as a summary with the 0.5, 0.9, 0.99, and 0.999
+  // quantiles, in seconds. All metric names begin with prefix followed by an
+  // underscore.
+  std::string to_prometheus(const std::string& prefix = "airtable") const;
+};
+
+// The metrics for a client (or several clients, if they share it). Metrics
+// are broken down by API method and base ID; for requests made directly
+// through AsyncHTTPClient, the API method is the HTTP method and the base ID
+// is empty.
+class ClientMetrics {
+public:
+  ClientMetrics() = default;
+  ClientMetrics(const ClientMetrics&) = delete;
+  ClientMetrics(ClientMetrics&&) = delete;
+  ClientMetrics& operator=(const ClientMetrics&) = delete;
+  ClientMetrics& operator=(ClientMetrics&&) = delete;
+  ~ClientMetrics() = default;
+
+  // Returns the metrics for the given API method and base, creating them if
+  // needed. The returned reference is valid for the lifetime of this object.
+  RequestMetrics& get_series(const char* api_method, const std::string& base_id);
+
+  ClientMetricsSnapshot snapshot() const;
+
+  // Requests currently in progress, not counting time spent waiting to retry
+  std::atomic<int64_t> in_flight_requests = 0;
+  // Connections currently open. Each request opens its own connection, so
+  // this is the size of the (implicit) connection pool.
+  std::atomic<int64_t> open_connections = 0;
+  // Threads in the client's CPU pool, or 0 if it has none
+  std::atomic<int64_t> cpu_pool_threads = 0;
+
+  // Increments a gauge, and decrements it again when destroyed
+  class GaugeIncrement {
+  public:
+    explicit GaugeIncrement(std::atomic<int64_t>& gauge) : gauge(gauge) {
+      this->gauge.fetch_add(1, std::memory_order_relaxed);
+    }
+    GaugeIncrement(const GaugeIncrement&) = delete;
+    GaugeIncrement(GaugeIncrement&&) = delete;
+    GaugeIncrement& operator=(const GaugeIncrement&) = delete;
+    GaugeIncrement& operator=(GaugeIncrement&&) = delete;
+    ~GaugeIncrement() {
+      this->gauge.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+  private:
+    std::atomic<int64_t>& gauge;
+  };
+
+private:
+  // Keyed by api_method + '\0' + base_id. Entries are never removed, so
+  // references to them remain valid without holding the lock.
+  mutable std::shared_mutex series_lock;
+  std::unordered_map<std::string, std::unique_ptr<RequestMetrics>> series;
+};
@@ -0,0 +1,816 @@
+#include "MockAirtableServer.hh"
+
+#include <ctype.h>
+#include <openssl/evp.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+#include <string.h>
+
+#include <algorithm>
+#include <charconv>
+#include <format>
+#include <phosg/Strings.hh>
+#include <stdexcept>
+#include <unordered_set>
+
+#include "AirtableTime.hh"
+#include "AsyncHTTPClient.hh"
+#include "AsyncUtils.hh"
+#include "JSONReader.hh"
+#include "LocalQuery.hh"
+
+using namespace std;
+
+// Airtable's limit on the number of records in a create, update, or delete
+// request
+static constexpr size_t MAX_RECORDS_PER_WRITE = 10;
+static constexpr size_t MAX_PAGE_SIZE = 100;
+
+namespace {
+
+// Thrown while handling a request to return an error response
+class APIError : public HTTPError {
+public:
+  APIError(int code, const char* type, const string& message) : HTTPError(code, message), type(type) {}
+  const char* type;
+};
+
+} // namespace
+
+static void use_self_signed_certificate(asio::ssl::context& ssl_context) {
+  unique_ptr<EVP_PKEY, decltype(&EVP_PKEY_free)> key(EVP_EC_gen("P-256"), EVP_PKEY_free);
+  if (!key) {
+    throw runtime_error("Failed to generate TLS key");
+  }
+  unique_ptr<X509, decltype(&X509_free)> cert(X509_new(), X509_free);
+  if (!cert) {
+    throw runtime_error("Failed to create TLS certificate");
+  }
+  X509_set_version(cert.get(), 2);
+  ASN1_INTEGER_set(X509_get_serialNumber(cert.get()), 1);
+  X509_gmtime_adj(X509_getm_notBefore(cert.get()), 0);
+  X509_gmtime_adj(X509_getm_notAfter(cert.get()), 60 * 60 * 24 * 365);
+  X509_set_pubkey(cert.get(), key.get());
+  X509_NAME* name = X509_get_subject_name(cert.get());
+  X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char*>("localhost"), -1, -1, 0);
+  X509_set_issuer_name(cert.get(), name);
+  if (!X509_sign(cert.get(), key.get(), EVP_sha256())) {
+    throw runtime_error("Failed to sign TLS certificate");
+  }
+  if ((SSL_CTX_use_certificate(ssl_context.native_handle(), cert.get()) != 1) ||
+      (SSL_CTX_use_PrivateKey(ssl_context.native_handle(), key.get()) != 1)) {
+    throw runtime_error("Failed to set TLS certificate");
+  }
+}
+
+static string url_decode(string_view s) {
+  string ret;
+  for (size_t z = 0; z < s.size(); z++) {
+    if (s[z] == '+') {
+      ret.push_back(' ');
+    } else if ((s[z] == '%') && (z + 2 < s.size()) && isxdigit(static_cast<unsigned char>(s[z + 1])) &&
+        isxdigit(static_cast<unsigned char>(s[z + 2]))) {
+      ret.push_back(static_cast<char>(stoul(string(s.substr(z + 1, 2)), nullptr, 16)));
+      z += 2;
+    } else {
+      ret.push_back(s[z]);
+    }
+  }
+  return ret;
+}
+
+static unordered_multimap<string, string> parse_query_string(string_view query) {
+  unordered_multimap<string, string> ret;
+  while (!query.empty()) {
+    size_t amp_pos = query.find('&');
+    string_view item = query.substr(0, amp_pos);
+    query = (amp_pos == string_view::npos) ? string_view() : query.substr(amp_pos + 1);
+    if (item.empty()) {
+      continue;
+    }
+    size_t equals_pos = item.find('=');
+    if (equals_pos == string_view::npos) {
+      ret.emplace(url_decode(item), "");
+    } else {
+      ret.emplace(url_decode(item.substr(0, equals_pos)), url_decode(item.substr(equals_pos + 1)));
+    }
+  }
+  return ret;
+}
+
+static const string* get_query_param(const unordered_multimap<string, string>& query_params, const string& key) {
+  auto it = query_params.find(key);
+  return (it == query_params.end()) ? nullptr : &it->second;
+}
+
+static size_t parse_size_param(const string& value, const char* name) {
+  size_t ret = 0;
+  auto res = from_chars(value.data(), value.data() + value.size(), ret);
+  if ((res.ec != errc()) || (res.ptr != value.data() + value.size())) {
+    throw APIError(422, "INVALID_REQUEST_UNKNOWN", std::format("Invalid value for {}: {}", name, value));
+  }
+  return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Server
+
+const string* MockAirtableServer::StoredRecord::get_field(string_view name) const {
+  for (const auto& [field_name, value] : this->fields) {
+    if (field_name == name) {
+      return &value;
+    }
+  }
+  return nullptr;
+}
+
+static const char* reason_for_code(int code) {
+  switch (code) {
+    case 200:
+      return "OK";
+    case 401:
+      return "Unauthorized";
+    case 404:
+      return "Not Found";
+    case 422:
+      return "Unprocessable Entity";
+    default:
+      return "Error";
+  }
+}
+
+MockAirtableServer::MockAirtableServer(asio::io_context& io_context, const Options& options, uint16_t port)
+    : io_context(io_context),
+      options(options),
+      ssl_context(asio::ssl::context::tls_server),
+      acceptor(asio::make_strand(io_context), asio::ip::tcp::endpoint(asio::ip::address_v4::loopback(), port)),
+      listen_port(this->acceptor.local_endpoint().port()) {
+  if (this->options.use_tls) {
+    use_self_signed_certificate(this->ssl_context);
+  }
+}
+
+MockAirtableServer::MockAirtableServer(asio::io_context& io_context, uint16_t port)
+    : MockAirtableServer(io_context, Options(), port) {}
+
+void MockAirtableServer::start() {
+  asio::co_spawn(this->acceptor.get_executor(), this->accept_connections(), asio::detached);
+}
+
+void MockAirtableServer::stop() {
+  // The acceptor isn't thread-safe, so it's closed on its own strand
+  asio::post(this->acceptor.get_executor(), [this]() -> void {
+    this->acceptor.close();
+  });
+}
+
+asio::awaitable<void> MockAirtableServer::accept_connections() {
+  for (;;) {
+    asio::ip::tcp::socket sock(asio::make_strand(this->io_context));
+    asio::error_code ec;
+    co_await this->acceptor.async_accept(sock, asio::redirect_error(asio::use_awaitable, ec));
+    if (ec) {
+      co_return; // The acceptor was closed
+    }
+    auto executor = sock.get_executor();
+    asio::co_spawn(executor, this->serve_connection(std::move(sock)), asio::detached);
+  }
+}
+
+asio::awaitable<void> MockAirtableServer::serve_connection(asio::ip::tcp::socket sock) {
+  try {
+    sock.set_option(asio::ip::tcp::no_delay(true));
+    if (this->options.use_tls) {
+      asio::ssl::stream<asio::ip::tcp::socket> stream(std::move(sock), this->ssl_context);
+      co_await stream.async_handshake(asio::ssl::stream_base::server, asio::use_awaitable);
+      co_await this->serve_requests(stream);
+    } else {
+      co_await this->serve_requests(sock);
+    }
+  } catch (const exception&) {
+    // The client closed the connection or sent an invalid request; either
+    // way, there's nothing more to do with it
+  }
+}
+
+template <typename StreamT>
+asio::awaitable<void> MockAirtableServer::serve_requests(StreamT& stream) {
+  AsyncSocketReader r(stream);
+  string line;
+  for (;;) {
+    if (!r.try_read_line(line, "\r\n", 0x10000)) {
+      line = co_await r.read_line("\r\n", 0x10000);
+    }
+    size_t first_space_pos = line.find(' ');
+    size_t second_space_pos = (first_space_pos == string::npos) ? string::npos : line.find(' ', first_space_pos + 1);
+    if (second_space_pos == string::npos) {
+      throw runtime_error("Malformed request line");
+    }
+    string method = line.substr(0, first_space_pos);
+    string target = line.substr(first_space_pos + 1, second_space_pos - first_space_pos - 1);
+
+    size_t content_length = 0;
+    bool keep_alive = true;
+    bool authorized = false;
+    for (;;) {
+      if (!r.try_read_line(line, "\r\n", 0x10000)) {
+        line = co_await r.read_line("\r\n", 0x10000);
+      }
+      if (line.empty()) {
+        break;
+      }
+      size_t colon_pos = line.find(':');
+      if (colon_pos == string::npos) {
+        throw runtime_error("Malformed header line");
+      }
+      string key = phosg::tolower(line.substr(0, colon_pos));
+      string value = line.substr(colon_pos + 1);
+      phosg::strip_whitespace(key);
+      phosg::strip_whitespace(value);
+      if (key == "content-length") {
+        content_length = stoull(value);
+      } else if (key == "connection") {
+        keep_alive = (phosg::tolower(value) != "close");
+      } else if (key == "authorization") {
+        authorized = value.starts_with("Bearer ") && (value.size() > 7);
+      }
+    }
+
+    string body;
+    if ((content_length > 0) && !r.try_read_data(body, content_length)) {
+      body = co_await r.read_data(content_length);
+    }
+
+    Response resp;
+    {
+      lock_guard g(this->lock);
+      resp = this->handle_request(method, target, authorized, body);
+    }
+    string data = std::format(
+        "HTTP/1.1 {} {}\r\nContent-Type: application/json; charset=utf-8\r\nContent-Length: {}\r\n{}\r\n",
+        resp.code, reason_for_code(resp.code), resp.body.size(), keep_alive ? "" : "Connection: close\r\n");
+    data += resp.body;
+
+    if (this->options.latency > chrono::steady_clock::duration::zero()) {
+      co_await async_sleep(this->options.latency);
+    }
+    co_await this->write_response(stream, data);
+    if (!keep_alive) {
+      co_return;
+    }
+  }
+}
+
+template <typename StreamT>
+asio::awaitable<void> MockAirtableServer::write_response(StreamT& stream, const string& data) {
+  if (!this->options.bytes_per_second) {
+    co_await asio::async_write(stream, asio::buffer(data), asio::use_awaitable);
+    co_return;
+  }
+
+  // Send the data in pieces of about 10ms' worth each, and after each piece,
+  // wait until the time it would have finished at the configured rate
+  size_t piece_size = max<size_t>(this->options.bytes_per_second / 100, 0x400);
+  auto start = chrono::steady_clock::now();
+  for (size_t offset = 0; offset < data.size(); offset += piece_size) {
+    size_t size = min<size_t>(piece_size, data.size() - offset);
+    co_await asio::async_write(stream, asio::buffer(data.data() + offset, size), asio::use_awaitable);
+    auto finish_time = start + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(
+                                   static_cast<double>(offset + size) / this->options.bytes_per_second));
+    auto now = chrono::steady_clock::now();
+    if (finish_time > now) {
+      co_await async_sleep(finish_time - now);
+    }
+  }
+}
+
+MockAirtableServer::Response MockAirtableServer::handle_request(
+    const string& method, const string& target, bool authorized, const string& body) {
+  this->request_count.fetch_add(1, memory_order_relaxed);
+
+  try {
+    if (!authorized) {
+      throw APIError(401, "AUTHENTICATION_REQUIRED", "Authentication required");
+    }
+
+    size_t query_pos = target.find('?');
+    string_view path = string_view(target).substr(0, query_pos);
+    auto query_params = (query_pos == string::npos)
+        ? unordered_multimap<string, string>()
+        : parse_query_string(string_view(target).substr(query_pos + 1));
+
+    vector<string> segments;
+    for (size_t offset = 1; offset <= path.size();) {
+      size_t slash_pos = path.find('/', offset);
+      segments.emplace_back(url_decode(path.substr(offset, slash_pos - offset)));
+      offset = (slash_pos == string_view::npos) ? (path.size() + 1) : (slash_pos + 1);
+    }
+
+    if ((segments.size() >= 3) && (segments[0] == "v0") && (segments[1] == "meta") && (segments[2] == "bases") && (method == "GET")) {
+      if (segments.size() == 3) {
+        return this->handle_list_bases();
+      } else if ((segments.size() == 5) && (segments[4] == "tables")) {
+        return this->handle_get_base_schema(segments[3]);
+      }
+    } else if ((segments.size() == 3) && (segments[0] == "v0")) {
+      Table& table = this->get_table(segments[1], segments[2]);
+      if (method == "GET") {
+        return this->handle_list_records(table, query_params);
+      } else if (method == "POST") {
+        return this->handle_create_records(table, body);
+      } else if (method == "PATCH") {
+        return this->handle_update_records(table, body);
+      } else if (method == "DELETE") {
+        return this->handle_delete_records(table, query_params);
+      }
+    } else if ((segments.size() == 4) && (segments[0] == "v0") && (method == "GET")) {
+      return this->handle_get_record(this->get_table(segments[1], segments[2]), segments[3]);
+    }
+    throw APIError(404, "NOT_FOUND", std::format("Could not find what you are looking for: {} {}", method, path));
+
+  } catch (const APIError& e) {
+    JSONWriter w;
+    w.begin_object();
+    w.write_key("error");
+    w.begin_object();
+    w.write_key("type");
+    w.write_string(e.type);
+    w.write_key("message");
+    w.write_string(e.what());
+    w.end_object();
+    w.end_object();
+    return Response{e.code, w.take()};
+
+  } catch (const runtime_error& e) {
+    // JSONReader throws runtime_error for malformed request bodies
+    JSONWriter w;
+    w.begin_object();
+    w.write_key("error");
+    w.begin_object();
+    w.write_key("type");
+    w.write_string("INVALID_REQUEST_UNKNOWN");
+    w.write_key("message");
+    w.write_string(e.what());
+    w.end_object();
+    w.end_object();
+    return Response{422, w.take()};
+  }
+}
+
+MockAirtableServer::Response MockAirtableServer::handle_list_bases() const {
+  vector<const Base*> bases;
+  for (const auto& it : this->bases) {
+    bases.emplace_back(it.second.get());
+  }
+  sort(bases.begin(), bases.end(), [](const Base* a, const Base* b) -> bool {
+    return a->id < b->id;
+  });
+
+  JSONWriter w;
+  w.begin_object();
+  w.write_key("bases");
+  w.begin_array();
+  for (const auto* base : bases) {
+    w.begin_object();
+    w.write_key("id");
+    w.write_string(base->id);
+    w.write_key("name");
+    w.write_string(base->name);
+    w.write_key("permissionLevel");
+    w.write_string("create");
+    w.end_object();
+  }
+  w.end_array();
+  w.end_object();
+  return Response{200, w.take()};
+}
+
+MockAirtableServer::Response MockAirtableServer::handle_get_base_schema(const string& base_id) const {
+  const Base& base = this->get_base(base_id);
+
+  JSONWriter w;
+  w.begin_object();
+  w.write_key("tables");
+  w.begin_array();
+  for (const auto& table : base.tables) {
+    w.begin_object();
+    w.write_key("id");
+    w.write_string(table->id);
+    w.write_key("name");
+    w.write_string(table->name);
+    w.write_key("primaryFieldId");
+    w.write_string(table->fields.empty() ? "" : table->fields[0].first);
+    w.write_key("fields");
+    w.begin_array();
+    for (const auto& [field_id, field] : table->fields) {
+      w.begin_object();
+      w.write_key("id");
+      w.write_string(field_id);
+      w.write_key("name");
+      w.write_string(field.name);
+      w.write_key("type");
+      w.write_string(field.type);
+      w.end_object();
+    }
+    w.end_array();
+    // Every table has a single grid view, whose ID is derived from the
+    // table's
+    w.write_key("views");
+    w.begin_array();
+    w.begin_object();
+    w.write_key("id");
+    w.write_string("viw" + table->id.substr(3));
+    w.write_key("name");
+    w.write_string("Grid view");
+    w.write_key("type");
+    w.write_string("grid");
+    w.end_object();
+    w.end_array();
+    w.end_object();
+  }
+  w.end_array();
+  w.end_object();
+  return Response{200, w.take()};
+}
+
+MockAirtableServer::Response MockAirtableServer::handle_list_records(
+    const Table& table, const unordered_multimap<string, string>& query_params) const {
+  size_t page_size = MAX_PAGE_SIZE;
+  if (const auto* value = get_query_param(query_params, "pageSize")) {
+    page_size = parse_size_param(*value, "pageSize");
+    if ((page_size == 0) || (page_size > MAX_PAGE_SIZE)) {
+      throw APIError(422, "INVALID_REQUEST_UNKNOWN", std::format("pageSize must be between 1 and {}", MAX_PAGE_SIZE));
+    }
+  }
+  size_t max_records = 0;
+  if (const auto* value = get_query_param(query_params, "maxRecords")) {
+    max_records = parse_size_param(*value, "maxRecords");
+  }
+  size_t start_index = 0;
+  if (const auto* value = get_query_param(query_params, "offset")) {
+    if (!value->starts_with("itr")) {
+      throw APIError(422, "LIST_RECORDS_ITERATOR_NOT_AVAILABLE", "Invalid offset");
+    }
+    start_index = parse_size_param(value->substr(3), "offset");
+  }
+  const string* key_by_field_id_value = get_query_param(query_params, "returnFieldsByFieldId");
+  bool key_by_field_id = key_by_field_id_value && ((*key_by_field_id_value == "true") || (*key_by_field_id_value == "1"));
+
+  vector<string> field_names;
+  auto field_its = query_params.equal_range("fields[]");
+  for (auto it = field_its.first; it != field_its.second; it++) {
+    if (!table.field_id_for_name.count(it->second)) {
+      throw APIError(422, "UNKNOWN_FIELD_NAME", std::format("Unknown field name: \"{}\"", it->second));
+    }
+    field_names.emplace_back(it->second);
+  }
+
+  vector<pair<string, bool>> sort_fields; // (name, descending)
+  for (size_t z = 0;; z++) {
+    const auto* name = get_query_param(query_params, std::format("sort[{}][field]", z));
+    if (!name) {
+      break;
+    }
+    if (!table.field_id_for_name.count(*name)) {
+      throw APIError(422, "UNKNOWN_FIELD_NAME", std::format("Unknown field name: \"{}\"", *name));
+    }
+    const auto* direction = get_query_param(query_params, std::format("sort[{}][direction]", z));
+    sort_fields.emplace_back(*name, direction && (*direction == "desc"));
+  }
+
+  // Filtering and sorting are done by LocalQuery, which implements the same
+  // formula language as AirtableClient's local queries. It only needs the
+  // cells that the formula and sort refer to.
+  vector<const StoredRecord*> records;
+  const auto* formula = get_query_param(query_params, "filterByFormula");
+  if ((formula && !formula->empty()) || !sort_fields.empty()) {
+    AirtableClient::ListRecordsOptions query_options;
+    if (formula) {
+      query_options.filter_formula = *formula;
+    }
+    for (const auto& [name, descending] : sort_fields) {
+      query_options.sort_fields.emplace_back(name, !descending);
+    }
+    unique_ptr<LocalQuery> query;
+    try {
+      query = make_unique<LocalQuery>(query_options);
+    } catch (const UnsupportedQueryError& e) {
+      throw APIError(422, "INVALID_FILTER_BY_FORMULA", std::format("Invalid formula: {}", e.what()));
+    }
+    vector<string> query_field_names = query->filter_field_names();
+    for (const auto& name : query_field_names) {
+      if (!table.field_id_for_name.count(name)) {
+        throw APIError(422, "INVALID_FILTER_BY_FORMULA", std::format("Unknown field name in formula: \"{}\"", name));
+      }
+    }
+    for (const auto& [name, descending] : sort_fields) {
+      if (find(query_field_names.begin(), query_field_names.end(), name) == query_field_names.end()) {
+        query_field_names.emplace_back(name);
+      }
+    }
+
+    vector<Record> query_records;
+    query_records.reserve(table.records.size());
+    for (const auto& stored_record : table.records) {
+      auto& record = query_records.emplace_back();
+      memcpy(record.id, stored_record.id.data(), sizeof(record.id) - 1);
+      record.id[sizeof(record.id) - 1] = 0;
+      record.creation_time = stored_record.creation_time;
+      for (const auto& name : query_field_names) {
+        const string* value = stored_record.get_field(name);
+        if (value) {
+          JSONReader r(*value);
+          record.fields.emplace(name, Record::parse_field(r));
+        }
+      }
+    }
+    for (const auto& record : query->run(query_records)) {
+      records.emplace_back(&table.records[table.record_index_for_id.at(record.id)]);
+    }
+  } else {
+    for (const auto& record : table.records) {
+      records.emplace_back(&record);
+    }
+  }
+  if (max_records && (records.size() > max_records)) {
+    records.resize(max_records);
+  }
+  size_t end_index = min(start_index + page_size, records.size());
+
+  JSONWriter w;
+  w.begin_object();
+  w.write_key("records");
+  w.begin_array();
+  for (size_t z = start_index; z < end_index; z++) {
+    write_record(w, table, *records[z], field_names.empty() ? nullptr : &field_names, key_by_field_id);
+  }
+  w.end_array();
+  if (end_index < records.size()) {
+    w.write_key("offset");
+    w.write_string(std::format("itr{}", end_index));
+  }
+  w.end_object();
+  return Response{200, w.take()};
+}
+
+MockAirtableServer::Response MockAirtableServer::handle_get_record(const Table& table, const string& record_id) const {
+  auto it = table.record_index_for_id.find(record_id);
+  if (it == table.record_index_for_id.end()) {
+    throw APIError(404, "NOT_FOUND", std::format("Record not found: {}", record_id));
+  }
+  JSONWriter w;
+  write_record(w, table, table.records[it->second]);
+  return Response{200, w.take()};
+}
+
+// Checks the number of records in a write request
+static void check_write_count(size_t count) {
+  if (count == 0) {
+    throw APIError(422, "INVALID_RECORDS", "At least one record must be given");
+  }
+  if (count > MAX_RECORDS_PER_WRITE) {
+    throw APIError(422, "INVALID_RECORDS", std::format("At most {} records may be given per request", MAX_RECORDS_PER_WRITE));
+  }
+}
+
+MockAirtableServer::Response MockAirtableServer::handle_create_records(Table& table, const string& body) {
+  // Nothing is added until the whole request is validated, so a failed
+  // request doesn't create some of its records
+  vector<StoredRecord> new_records;
+  JSONReader r(body);
+  r.read_object([&](string_view key) -> void {
+    if (key != "records") {
+      r.skip_value(); // e.g. typecast, which is ignored
+      return;
+    }
+    r.read_array([&]() -> void {
+      auto& record = new_records.emplace_back();
+      r.read_object([&](string_view key) -> void {
+        if (key == "fields") {
+          set_fields(table, record, r.skip_value());
+        } else {
+          r.skip_value();
+        }
+      });
+    });
+  });
+  check_write_count(new_records.size());
+
+  uint64_t now_usecs = chrono::duration_cast<chrono::microseconds>(chrono::system_clock::now().time_since_epoch()).count();
+  JSONWriter w;
+  w.begin_object();
+  w.write_key("records");
+  w.begin_array();
+  for (auto& record : new_records) {
+    record.id = this->next_id("rec");
+    record.creation_time = now_usecs;
+    table.record_index_for_id.emplace(record.id, table.records.size());
+    write_record(w, table, table.records.emplace_back(std::move(record)));
+  }
+  w.end_array();
+  w.end_object();
+  return Response{200, w.take()};
+}
+
+MockAirtableServer::Response MockAirtableServer::handle_update_records(Table& table, const string& body) {
+  // The updates are applied to copies of the records, which replace the
+  // originals only once the whole request is validated
+  vector<pair<size_t, StoredRecord>> updated_records;
+  JSONReader r(body);
+  r.read_object([&](string_view key) -> void {
+    if (key != "records") {
+      r.skip_value();
+      return;
+    }
+    r.read_array([&]() -> void {
+      string record_id;
+      string_view fields_json;
+      r.read_object([&](string_view key) -> void {
+        if (key == "id") {
+          record_id = r.read_string();
+        } else if (key == "fields") {
+          fields_json = r.skip_value();
+        } else {
+          r.skip_value();
+        }
+      });
+      auto it = table.record_index_for_id.find(record_id);
+      if (it == table.record_index_for_id.end()) {
+        throw APIError(404, "NOT_FOUND", std::format("Record not found: {}", record_id));
+      }
+      auto& update = updated_records.emplace_back(it->second, table.records[it->second]);
+      if (!fields_json.empty()) {
+        set_fields(table, update.second, fields_json);
+      }
+    });
+  });
+  check_write_count(updated_records.size());
+
+  JSONWriter w;
+  w.begin_object();
+  w.write_key("records");
+  w.begin_array();
+  for (auto& [index, record] : updated_records) {
+    table.records[index] = std::move(record);
+    write_record(w, table, table.records[index]);
+  }
+  w.end_array();
+  w.end_object();
+  return Response{200, w.take()};
+}
+
+MockAirtableServer::Response MockAirtableServer::handle_delete_records(
+    Table& table, const unordered_multimap<string, string>& query_params) {
+  unordered_set<string> record_ids;
+  auto its = query_params.equal_range("records[]");
+  for (auto it = its.first; it != its.second; it++) {
+    if (!table.record_index_for_id.count(it->second)) {
+      throw APIError(404, "NOT_FOUND", std::format("Record not found: {}", it->second));
+    }
+    record_ids.emplace(it->second);
+  }
+  check_write_count(record_ids.size());
+
+  erase_if(table.records, [&](const StoredRecord& record) -> bool {
+    return record_ids.count(record.id);
+  });
+  table.record_index_for_id.clear();
+  for (size_t z = 0; z < table.records.size(); z++) {
+    table.record_index_for_id.emplace(table.records[z].id, z);
+  }
+
+  JSONWriter w;
+  w.begin_object();
+  w.write_key("records");
+  w.begin_array();
+  for (const auto& record_id : record_ids) {
+    w.begin_object();
+    w.write_key("id");
+    w.write_string(record_id);
+    w.write_key("deleted");
+    w.write_bool(true);
+    w.end_object();
+  }
+  w.end_array();
+  w.end_object();
+  return Response{200, w.take()};
+}
+
+MockAirtableServer::Base& MockAirtableServer::get_base(const string& base_id) const {
+  auto it = this->bases.find(base_id);
+  if (it == this->bases.end()) {
+    throw APIError(404, "NOT_FOUND", std::format("Base not found: {}", base_id));
+  }
+  return *it->second;
+}
+
+MockAirtableServer::Table& MockAirtableServer::get_table(const string& base_id, const string& table) const {
+  for (auto& t : this->get_base(base_id).tables) {
+    if ((t->id == table) || (t->name == table)) {
+      return *t;
+    }
+  }
+  throw APIError(404, "TABLE_NOT_FOUND", std::format("Table not found: {}", table));
+}
+
+void MockAirtableServer::set_fields(const Table& table, StoredRecord& record, string_view fields_json) {
+  JSONReader r(fields_json);
+  r.read_object([&](string_view name) -> void {
+    string name_str(name);
+    if (!table.field_id_for_name.count(name_str)) {
+      throw APIError(422, "UNKNOWN_FIELD_NAME", std::format("Unknown field name: \"{}\"", name_str));
+    }
+    string_view value = r.skip_value();
+    auto it = find_if(record.fields.begin(), record.fields.end(), [&](const auto& field) -> bool {
+      return field.first == name_str;
+    });
+    // Like Airtable, don't store empty values at all
+    if ((value == "null") || (value == "false") || (value == "\"\"") || (value == "[]")) {
+      if (it != record.fields.end()) {
+        record.fields.erase(it);
+      }
+    } else if (it != record.fields.end()) {
+      it->second = value;
+    } else {
+      record.fields.emplace_back(std::move(name_str), string(value));
+    }
+  });
+}
+
+void MockAirtableServer::write_record(
+    JSONWriter& w,
+    const Table& table,
+    const StoredRecord& record,
+    const vector<string>* field_names,
+    bool key_by_field_id) {
+  char created_time[AIRTABLE_TIME_LENGTH];
+  format_airtable_time(created_time, record.creation_time);
+
+  w.begin_object();
+  w.write_key("id");
+  w.write_string(record.id);
+  w.write_key("createdTime");
+  w.write_string(string_view(created_time, AIRTABLE_TIME_LENGTH));
+  w.write_key("fields");
+  w.begin_object();
+  for (const auto& [name, value] : record.fields) {
+    if (field_names && (find(field_names->begin(), field_names->end(), name) == field_names->end())) {
+      continue;
+    }
+    w.write_key(key_by_field_id ? table.field_id_for_name.at(name) : name);
+    w.write_raw(value);
+  }
+  w.end_object();
+  w.end_object();
+}
+
+string MockAirtableServer::next_id(const char* prefix) {
+  static const char* alphabet = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+  string ret(17, '0');
+  memcpy(ret.data(), prefix, 3);
+  for (uint64_t n = this->next_id_counter++, z = 16; n > 0; n /= 62, z--) {
+    ret[z] = alphabet[n % 62];
+  }
+  return ret;
+}
+
+void MockAirtableServer::add_base(const string& base_id, const string& name) {
+  lock_guard g(this->lock);
+  auto& base = this->bases[base_id];
+  if (base) {
+    throw invalid_argument("Base already exists: " + base_id);
+  }
+  base = make_unique<Base>();
+  base->id = base_id;
+  base->name = name;
+}
+
+string MockAirtableServer::add_table(const string& base_id, const string& name, const vector<FieldSpec>& fields) {
+  lock_guard g(this->lock);
+  Base& base = this->get_base(base_id);
+  auto& table = base.tables.emplace_back(make_unique<Table>());
+  table->id = this->next_id("tbl");
+  table->name = name;
+  for (const auto& field : fields) {
+    string field_id = this->next_id("fld");
+    table->field_id_for_name.emplace(field.name, field_id);
+    table->fields.emplace_back(std::move(field_id), field);
+  }
+  return table->id;
+}
+
+string MockAirtableServer::add_record(const string& base_id, const string& table, string_view fields_json) {
+  lock_guard g(this->lock);
+  Table& t = this->get_table(base_id, table);
+  StoredRecord record;
+  set_fields(t, record, fields_json);
+  record.id = this->next_id("rec");
+  record.creation_time = chrono::duration_cast<chrono::microseconds>(chrono::system_clock::now().time_since_epoch()).count();
+  t.record_index_for_id.emplace(record.id, t.records.size());
+  return t.records.emplace_back(std::move(record)).id;
+}
+
+size_t MockAirtableServer::num_records(const string& base_id, const string& table) const {
+  lock_guard g(this->lock);
+  return this->get_table(base_id, table).records.size();
+}
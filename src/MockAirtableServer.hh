@@ -0,0 +1,184 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <asio.hpp>
+#include <asio/ssl.hpp>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "JSONWriter.hh"
+
+// A local server that implements enough of the Airtable API for
+// AirtableClient to run against it, so the client can be benchmarked (or
+// tested) without network access or rate limits. It supports:
+// - Listing bases (GET /v0/meta/bases) and getting a base's schema (GET
+//   /v0/meta/bases/{base}/tables).
+// - Listing records (GET /v0/{base}/{table}), with the pageSize, offset,
+//   maxRecords, fields[], sort[N][field], sort[N][direction],
+//   returnFieldsByFieldId, and filterByFormula parameters. Filtering and
+//   sorting are done by LocalQuery, so formulas may use the subset of the
+//   formula language that it supports; other formulas fail with HTTP 422.
+//   Other parameters are ignored.
+// - Getting a record (GET /v0/{base}/{table}/{record}).
+// - Creating (POST), updating (PATCH), and deleting (DELETE) records, with
+//   Airtable's limit of 10 records per request.
+// Tables can be referred to by name or ID. Cell values are stored as JSON text
+// and returned as they were given, except that (as with Airtable) null, false,
+// empty strings, and empty arrays are omitted. Errors are returned with the
+// same status codes as Airtable uses, and a body like {"error": {"type":
+// "NOT_FOUND", "message": "..."}}.
+//
+// By default, the server accepts TLS connections using a self-signed
+// certificate generated when it's constructed, so clients must be configured
+// not to verify it (for AirtableClient, via get_ssl_context()). Each
+// connection is handled on its own strand, so the io_context may be run by
+// multiple threads.
+class MockAirtableServer {
+public:
+  struct Options {
+    // Each response is delayed by this long after its request is received
+    std::chrono::steady_clock::duration latency = std::chrono::steady_clock::duration::zero();
+    // Each response is sent at no more than this rate (including headers); 0
+    // means there's no limit
+    size_t bytes_per_second = 0;
+    // If false, the server accepts plain HTTP connections instead
+    bool use_tls = true;
+  };
+
+  struct FieldSpec {
+    std::string name;
+    std::string type;
+  };
+
+  // Listens on the given port (or an unused port, if port is 0) on the
+  // loopback interface. Connections are not accepted until start() is called.
+  MockAirtableServer(asio::io_context& io_context, const Options& options, uint16_t port = 0);
+  explicit MockAirtableServer(asio::io_context& io_context, uint16_t port = 0);
+  MockAirtableServer(const MockAirtableServer&) = delete;
+  MockAirtableServer(MockAirtableServer&&) = delete;
+  MockAirtableServer& operator=(const MockAirtableServer&) = delete;
+  MockAirtableServer& operator=(MockAirtableServer&&) = delete;
+  // The server's coroutines refer to it, so the io_context must be stopped
+  // (or must have run out of work, after stop() is called and all clients
+  // have disconnected) before the server is destroyed.
+  ~MockAirtableServer() = default;
+
+  inline uint16_t port() const {
+    return this->listen_port;
+  }
+
+  // Starts accepting connections on the io_context
+  void start();
+  // Stops accepting connections. Connections already accepted are served
+  // until the client closes them. This may be called from any thread.
+  void stop();
+
+  // The functions below may be called from any thread, including while
+  // requests are being served.
+
+  void add_base(const std::string& base_id, const std::string& name);
+  // Adds a table and returns its ID. The table's records may only use the
+  // given fields; creating or updating a record with any other field fails
+  // with HTTP 422, as with Airtable.
+  std::string add_table(const std::string& base_id, const std::string& name, const std::vector<FieldSpec>& fields);
+  // Adds a record and returns its ID. fields_json is a JSON object mapping
+  // field names to cell values.
+  std::string add_record(const std::string& base_id, const std::string& table, std::string_view fields_json);
+  size_t num_records(const std::string& base_id, const std::string& table) const;
+
+  // The number of requests received, including ones that failed
+  inline size_t num_requests() const {
+    return this->request_count.load(std::memory_order_relaxed);
+  }
+
+private:
+  struct StoredRecord {
+    std::string id;
+    uint64_t creation_time;
+    // Cells' values as JSON text, keyed by field name, in the order they were
+    // first set
+    std::vector<std::pair<std::string, std::string>> fields;
+
+    const std::string* get_field(std::string_view name) const;
+  };
+
+  struct Table {
+    std::string id;
+    std::string name;
+    std::vector<std::pair<std::string, FieldSpec>> fields; // (id, spec) pairs
+    std::unordered_map<std::string, std::string> field_id_for_name;
+    // In creation order, which is the default order for listing records
+    std::vector<StoredRecord> records;
+    std::unordered_map<std::string, size_t> record_index_for_id;
+  };
+
+  struct Base {
+    std::string id;
+    std::string name;
+    std::vector<std::unique_ptr<Table>> tables;
+  };
+
+  struct Response {
+    int code = 200;
+    std::string body;
+  };
+
+  asio::awaitable<void> accept_connections();
+  asio::awaitable<void> serve_connection(asio::ip::tcp::socket sock);
+  template <typename StreamT>
+  asio::awaitable<void> serve_requests(StreamT& stream);
+  // Sends data, limiting the rate if options.bytes_per_second is set
+  template <typename StreamT>
+  asio::awaitable<void> write_response(StreamT& stream, const std::string& data);
+
+  // Handles a request and returns the response. This does no I/O, and is
+  // called with lock held.
+  Response handle_request(
+      const std::string& method, const std::string& target, bool authorized, const std::string& body);
+  Response handle_list_bases() const;
+  Response handle_get_base_schema(const std::string& base_id) const;
+  Response handle_list_records(
+      const Table& table, const std::unordered_multimap<std::string, std::string>& query_params) const;
+  Response handle_get_record(const Table& table, const std::string& record_id) const;
+  Response handle_create_records(Table& table, const std::string& body);
+  Response handle_update_records(Table& table, const std::string& body);
+  Response handle_delete_records(Table& table, const std::unordered_multimap<std::string, std::string>& query_params);
+
+  // These fail the request (with HTTP 404) if the base or table doesn't exist
+  Base& get_base(const std::string& base_id) const;
+  Table& get_table(const std::string& base_id, const std::string& table) const;
+  // Sets the given cells in record. Fails the request (with HTTP 422) if any
+  // field isn't in the table's schema.
+  static void set_fields(const Table& table, StoredRecord& record, std::string_view fields_json);
+  // Writes a record object as the API returns it. If field_names is not
+  // null, only those fields are included.
+  static void write_record(
+      JSONWriter& w,
+      const Table& table,
+      const StoredRecord& record,
+      const std::vector<std::string>* field_names = nullptr,
+      bool key_by_field_id = false);
+  // Returns a new ID in Airtable's format (the prefix followed by 14
+  // characters). Must be called with lock held.
+  std::string next_id(const char* prefix);
+
+  asio::io_context& io_context;
+  Options options;
+  asio::ssl::context ssl_context;
+  asio::ip::tcp::acceptor acceptor;
+  uint16_t listen_port;
+  std::atomic<size_t> request_count = 0;
+
+  mutable std::mutex lock;
+  // Everything below is protected by lock
+  std::unordered_map<std::string, std::unique_ptr<Base>> bases;
+  uint64_t next_id_counter = 1;
+};
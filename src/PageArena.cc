@@ -0,0 +1,8 @@
+#include "PageArena.hh"
+
+using namespace std;
+
+PageArena::PageArena(size_t initial_size)
+    : resource(initial_size, pmr::new_delete_resource()),
+      bytes_allocated(0),
+      num_allocations(0) {}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <memory>
+#include <memory_resource>
+#include <utility>
+
+// A monotonic arena for the objects parsed from one page of records. Each
+// allocation just advances a pointer within a large block, and nothing is
+// freed until the arena itself is destroyed, at which point all of its blocks
+// are freed together. This replaces the thousands of small malloc/free pairs
+// that parsing a page would otherwise cost.
+//
+// Objects allocated with ArenaAllocator hold a reference to their arena, so
+// the arena lives until the last such object is destroyed (for example, until
+// the last Record from the page and any Fields copied out of it are gone).
+// Allocating from an arena is not thread-safe, but objects allocated from it
+// may be used and destroyed on any thread.
+class PageArena {
+public:
+  static constexpr size_t DEFAULT_INITIAL_SIZE = 64 * 1024;
+
+  explicit PageArena(size_t initial_size = DEFAULT_INITIAL_SIZE);
+  PageArena(const PageArena&) = delete;
+  PageArena(PageArena&&) = delete;
+  PageArena& operator=(const PageArena&) = delete;
+  PageArena& operator=(PageArena&&) = delete;
+  ~PageArena() = default;
+
+  inline void* allocate(size_t size, size_t alignment) {
+    this->bytes_allocated += size;
+    this->num_allocations++;
+    return this->resource.allocate(size, alignment);
+  }
+
+  inline std::pmr::memory_resource* get_resource() {
+    return &this->resource;
+  }
+  inline size_t get_bytes_allocated() const {
+    return this->bytes_allocated;
+  }
+  inline size_t get_num_allocations() const {
+    return this->num_allocations;
+  }
+
+private:
+  std::pmr::monotonic_buffer_resource resource;
+  size_t bytes_allocated;
+  size_t num_allocations;
+};
+
+// An allocator that allocates from a PageArena and keeps it alive. Memory is
+// never returned to the arena individually; deallocate does nothing.
+template <typename T>
+class ArenaAllocator {
+public:
+  using value_type = T;
+
+  explicit ArenaAllocator(std::shared_ptr<PageArena> arena) : arena(std::move(arena)) {}
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+  inline T* allocate(size_t n) {
+    return static_cast<T*>(this->arena->allocate(n * sizeof(T), alignof(T)));
+  }
+  inline void deallocate(T*, size_t) {}
+
+  template <typename U>
+  inline bool operator==(const ArenaAllocator<U>& other) const {
+    return this->arena == other.arena;
+  }
+
+  std::shared_ptr<PageArena> arena;
+};
+
+// Like std::make_shared, but allocates the object (and its reference counts)
+// from arena if it's not null
+template <typename T, typename... ArgsT>
+std::shared_ptr<T> make_shared_in_arena(const std::shared_ptr<PageArena>& arena, ArgsT&&... args) {
+  if (arena) {
+    return std::allocate_shared<T>(ArenaAllocator<T>(arena), std::forward<ArgsT>(args)...);
+  }
+  return std::make_shared<T>(std::forward<ArgsT>(args)...);
+}
@@ -0,0 +1,567 @@
+#include "RecordBatch.hh"
+
+#include <bit>
+#include <stdexcept>
+
+using namespace std;
+
+static inline size_t bitmap_words_for_rows(size_t num_rows) {
+  return (num_rows + 63) >> 6;
+}
+
+static inline bool is_number_start(char ch) {
+  return (ch == '-') || (ch >= '0' && ch <= '9');
+}
+
+RecordBatch::Column::Column(const string& name) : name(name), type(ColumnType::NONE), num_rows(0) {}
+
+size_t RecordBatch::Column::null_count() const {
+  size_t valid_count = 0;
+  for (uint64_t word : this->validity) {
+    valid_count += popcount(word);
+  }
+  return this->num_rows - valid_count;
+}
+
+void RecordBatch::Column::check_type(ColumnType expected_type) const {
+  if (this->type != expected_type) {
+    throw logic_error("column is not of the requested type");
+  }
+}
+
+span<const int64_t> RecordBatch::Column::int64_values() const {
+  this->check_type(ColumnType::INT64);
+  return this->int64_data;
+}
+
+span<const double> RecordBatch::Column::float64_values() const {
+  if (this->type != ColumnType::FLOAT64 && this->type != ColumnType::FLOAT64_LIST) {
+    throw logic_error("column is not of the requested type");
+  }
+  return this->float64_data;
+}
+
+span<const uint64_t> RecordBatch::Column::bool_bitmap() const {
+  this->check_type(ColumnType::BOOL);
+  return this->bool_data;
+}
+
+bool RecordBatch::Column::bool_value(size_t row) const {
+  this->check_type(ColumnType::BOOL);
+  return (this->bool_data.at(row >> 6) >> (row & 63)) & 1;
+}
+
+string_view RecordBatch::Column::string_value(size_t row) const {
+  if (this->type != ColumnType::STRING && this->type != ColumnType::JSON) {
+    throw logic_error("column is not of the requested type");
+  }
+  uint64_t start = this->value_offsets.at(row);
+  return string_view(this->arena).substr(start, this->value_offsets.at(row + 1) - start);
+}
+
+size_t RecordBatch::Column::list_size(size_t row) const {
+  if (this->type != ColumnType::STRING_LIST && this->type != ColumnType::FLOAT64_LIST) {
+    throw logic_error("column is not of the requested type");
+  }
+  return this->value_offsets.at(row + 1) - this->value_offsets.at(row);
+}
+
+string_view RecordBatch::Column::string_list_item(size_t row, size_t index) const {
+  this->check_type(ColumnType::STRING_LIST);
+  if (index >= this->list_size(row)) {
+    throw out_of_range("list item index out of range");
+  }
+  size_t item = this->value_offsets[row] + index;
+  uint64_t start = this->string_item_offsets[item];
+  return string_view(this->arena).substr(start, this->string_item_offsets[item + 1] - start);
+}
+
+span<const double> RecordBatch::Column::float64_list(size_t row) const {
+  this->check_type(ColumnType::FLOAT64_LIST);
+  uint64_t start = this->value_offsets.at(row);
+  return span<const double>(this->float64_data).subspan(start, this->value_offsets.at(row + 1) - start);
+}
+
+void RecordBatch::Column::set_type(ColumnType new_type) {
+  if (this->type == ColumnType::NONE) {
+    // All existing rows are null; create placeholder values for them
+    switch (new_type) {
+      case ColumnType::INT64:
+        this->int64_data.assign(this->num_rows, 0);
+        break;
+      case ColumnType::FLOAT64:
+        this->float64_data.assign(this->num_rows, 0.0);
+        break;
+      case ColumnType::BOOL:
+        this->bool_data.assign(bitmap_words_for_rows(this->num_rows), 0);
+        break;
+      case ColumnType::STRING_LIST:
+        this->string_item_offsets.assign(1, 0);
+        [[fallthrough]];
+      case ColumnType::STRING:
+      case ColumnType::FLOAT64_LIST:
+      case ColumnType::JSON:
+        this->value_offsets.assign(this->num_rows + 1, 0);
+        break;
+      default:
+        throw logic_error("invalid column type");
+    }
+
+  } else if (this->type == ColumnType::STRING_LIST && new_type == ColumnType::FLOAT64_LIST) {
+    // Only valid if all lists so far have been empty (see append_cell)
+    this->string_item_offsets.clear();
+
+  } else if (this->type == ColumnType::FLOAT64_LIST && new_type == ColumnType::STRING_LIST) {
+    this->string_item_offsets.assign(1, 0);
+
+  } else {
+    throw logic_error("invalid column type change");
+  }
+  this->type = new_type;
+}
+
+void RecordBatch::Column::set_valid(size_t row) {
+  this->validity[row >> 6] |= (1ULL << (row & 63));
+}
+
+void RecordBatch::Column::pad_to(size_t num_rows) {
+  if (num_rows <= this->num_rows) {
+    return;
+  }
+  size_t count = num_rows - this->num_rows;
+  switch (this->type) {
+    case ColumnType::NONE:
+      break;
+    case ColumnType::INT64:
+      this->int64_data.resize(num_rows, 0);
+      break;
+    case ColumnType::FLOAT64:
+      this->float64_data.resize(num_rows, 0.0);
+      break;
+    case ColumnType::BOOL:
+      this->bool_data.resize(bitmap_words_for_rows(num_rows), 0);
+      break;
+    case ColumnType::STRING:
+    case ColumnType::STRING_LIST:
+    case ColumnType::FLOAT64_LIST:
+    case ColumnType::JSON:
+      this->value_offsets.insert(this->value_offsets.end(), count, this->value_offsets.back());
+      break;
+    default:
+      throw logic_error("invalid column type");
+  }
+  this->validity.resize(bitmap_words_for_rows(num_rows), 0);
+  this->num_rows = num_rows;
+}
+
+void RecordBatch::Column::append_json(string_view json_text) {
+  this->arena.append(json_text);
+  this->value_offsets.emplace_back(this->arena.size());
+}
+
+void RecordBatch::Column::append_string_list(JSONReader& r) {
+  string scratch;
+  r.read_array([&]() -> void {
+    if (r.peek() != '\"') {
+      r.throw_error("inconsistent list item types");
+    }
+    this->arena.append(r.read_string_view(scratch));
+    this->string_item_offsets.emplace_back(this->arena.size());
+  });
+  this->value_offsets.emplace_back(this->string_item_offsets.size() - 1);
+}
+
+void RecordBatch::Column::append_float64_list(JSONReader& r) {
+  r.read_array([&]() -> void {
+    if (!is_number_start(r.peek())) {
+      r.throw_error("inconsistent list item types");
+    }
+    this->float64_data.emplace_back(r.read_number().as_float);
+  });
+  this->value_offsets.emplace_back(this->float64_data.size());
+}
+
+void RecordBatch::Column::append_cell(JSONReader& r) {
+  size_t row = this->num_rows;
+  char ch = r.peek();
+  if (ch == 'n') {
+    r.read_null();
+    this->pad_to(row + 1);
+    return;
+  }
+
+  // Figure out which column type this cell needs, and whether the column can
+  // hold it without becoming a JSON column
+  ColumnType cell_type;
+  if (ch == '\"') {
+    cell_type = ColumnType::STRING;
+  } else if (ch == 't' || ch == 'f') {
+    cell_type = ColumnType::BOOL;
+  } else if (is_number_start(ch)) {
+    cell_type = ColumnType::INT64; // May become FLOAT64 below
+  } else if (ch == '[') {
+    JSONReader probe = r;
+    probe.expect('[');
+    char item_ch = probe.consume(']') ? '\0' : probe.peek();
+    if (item_ch == '\0') {
+      // Empty lists fit in either type of list column
+      cell_type = (this->type == ColumnType::FLOAT64_LIST) ? ColumnType::FLOAT64_LIST : ColumnType::STRING_LIST;
+    } else if (item_ch == '\"') {
+      cell_type = ColumnType::STRING_LIST;
+    } else if (is_number_start(item_ch)) {
+      cell_type = ColumnType::FLOAT64_LIST;
+    } else {
+      cell_type = ColumnType::JSON;
+    }
+  } else {
+    cell_type = ColumnType::JSON;
+  }
+
+  this->prepare_for_cell(cell_type);
+
+  switch (this->type) {
+    case ColumnType::INT64: {
+      auto num = r.read_number();
+      if (num.is_integer) {
+        this->int64_data.emplace_back(num.as_int);
+      } else {
+        this->convert_to_float64();
+        this->float64_data.emplace_back(num.as_float);
+      }
+      break;
+    }
+    case ColumnType::FLOAT64:
+      this->float64_data.emplace_back(r.read_number().as_float);
+      break;
+    case ColumnType::BOOL:
+      this->bool_data.resize(bitmap_words_for_rows(row + 1), 0);
+      if (r.read_bool()) {
+        this->bool_data[row >> 6] |= (1ULL << (row & 63));
+      }
+      break;
+    case ColumnType::STRING: {
+      string scratch;
+      this->arena.append(r.read_string_view(scratch));
+      this->value_offsets.emplace_back(this->arena.size());
+      break;
+    }
+    case ColumnType::STRING_LIST:
+    case ColumnType::FLOAT64_LIST: {
+      // Lists whose later items don't match the first item's type are rare,
+      // so we undo the partial append and fall back to a JSON column
+      JSONReader list_start = r;
+      size_t orig_arena_size = this->arena.size();
+      size_t orig_item_count = (this->type == ColumnType::STRING_LIST)
+          ? this->string_item_offsets.size()
+          : this->float64_data.size();
+      try {
+        if (this->type == ColumnType::STRING_LIST) {
+          this->append_string_list(r);
+        } else {
+          this->append_float64_list(r);
+        }
+      } catch (const runtime_error&) {
+        r = list_start;
+        this->arena.resize(orig_arena_size);
+        if (this->type == ColumnType::STRING_LIST) {
+          this->string_item_offsets.resize(orig_item_count);
+        } else {
+          this->float64_data.resize(orig_item_count);
+        }
+        this->convert_to_json();
+        this->append_json(r.skip_value());
+      }
+      break;
+    }
+    case ColumnType::JSON:
+      this->append_json(r.skip_value());
+      break;
+    default:
+      throw logic_error("invalid column type");
+  }
+
+  this->finish_cell(row);
+}
+
+void RecordBatch::Column::append_field(const Field& field) {
+  size_t row = this->num_rows;
+  ColumnType empty_list_type = (this->type == ColumnType::FLOAT64_LIST) ? ColumnType::FLOAT64_LIST : ColumnType::STRING_LIST;
+  ColumnType cell_type;
+  switch (field.type) {
+    case Field::ValueType::String:
+      cell_type = ColumnType::STRING;
+      break;
+    case Field::ValueType::Integer:
+      cell_type = ColumnType::INT64;
+      break;
+    case Field::ValueType::Float:
+      cell_type = ColumnType::FLOAT64;
+      break;
+    case Field::ValueType::Checkbox:
+      cell_type = ColumnType::BOOL;
+      break;
+    case Field::ValueType::StringArray:
+      cell_type = static_cast<const StringArrayField&>(field).value.empty() ? empty_list_type : ColumnType::STRING_LIST;
+      break;
+    case Field::ValueType::NumberArray:
+      cell_type = static_cast<const NumberArrayField&>(field).value.empty() ? empty_list_type : ColumnType::FLOAT64_LIST;
+      break;
+    default:
+      cell_type = ColumnType::JSON;
+      break;
+  }
+  this->prepare_for_cell(cell_type);
+
+  // If the column's type is the cell's type, or one that prepare_for_cell
+  // allows it to be stored in (e.g. an integer in a float column, or an empty
+  // list of either kind in a list column), store it directly. Otherwise the
+  // column is a JSON column.
+  switch (this->type) {
+    case ColumnType::INT64:
+      this->int64_data.emplace_back(static_cast<const IntegerField&>(field).value);
+      break;
+    case ColumnType::FLOAT64:
+      this->float64_data.emplace_back((field.type == Field::ValueType::Integer)
+              ? static_cast<double>(static_cast<const IntegerField&>(field).value)
+              : static_cast<const FloatField&>(field).value);
+      break;
+    case ColumnType::BOOL:
+      this->bool_data.resize(bitmap_words_for_rows(row + 1), 0);
+      if (static_cast<const CheckboxField&>(field).value) {
+        this->bool_data[row >> 6] |= (1ULL << (row & 63));
+      }
+      break;
+    case ColumnType::STRING:
+      this->arena.append(static_cast<const StringField&>(field).value);
+      this->value_offsets.emplace_back(this->arena.size());
+      break;
+    case ColumnType::STRING_LIST:
+      if (field.type == Field::ValueType::StringArray) {
+        for (const auto& item : static_cast<const StringArrayField&>(field).value) {
+          this->arena.append(item);
+          this->string_item_offsets.emplace_back(this->arena.size());
+        }
+      }
+      this->value_offsets.emplace_back(this->string_item_offsets.size() - 1);
+      break;
+    case ColumnType::FLOAT64_LIST:
+      if (field.type == Field::ValueType::NumberArray) {
+        const auto& items = static_cast<const NumberArrayField&>(field).value;
+        this->float64_data.insert(this->float64_data.end(), items.begin(), items.end());
+      }
+      this->value_offsets.emplace_back(this->float64_data.size());
+      break;
+    case ColumnType::JSON: {
+      JSONWriter w;
+      field.write_json(w);
+      this->append_json(w.str());
+      break;
+    }
+    default:
+      throw logic_error("invalid column type");
+  }
+
+  this->finish_cell(row);
+}
+
+void RecordBatch::Column::prepare_for_cell(ColumnType cell_type) {
+  if (this->type == ColumnType::NONE) {
+    this->set_type(cell_type);
+  } else if (this->type != cell_type && this->type != ColumnType::JSON) {
+    if (this->type == ColumnType::FLOAT64 && cell_type == ColumnType::INT64) {
+      // Integers are stored as floats in float columns
+    } else if (this->type == ColumnType::INT64 && cell_type == ColumnType::FLOAT64) {
+      this->convert_to_float64();
+    } else if (this->type == ColumnType::STRING_LIST && cell_type == ColumnType::FLOAT64_LIST &&
+        this->string_item_offsets.size() == 1) {
+      this->set_type(ColumnType::FLOAT64_LIST);
+    } else if (this->type == ColumnType::FLOAT64_LIST && cell_type == ColumnType::STRING_LIST &&
+        this->float64_data.empty()) {
+      this->set_type(ColumnType::STRING_LIST);
+    } else {
+      this->convert_to_json();
+    }
+  }
+}
+
+void RecordBatch::Column::finish_cell(size_t row) {
+  this->validity.resize(bitmap_words_for_rows(row + 1), 0);
+  this->set_valid(row);
+  this->num_rows = row + 1;
+}
+
+void RecordBatch::Column::convert_to_float64() {
+  this->float64_data.assign(this->int64_data.begin(), this->int64_data.end());
+  this->int64_data.clear();
+  this->int64_data.shrink_to_fit();
+  this->type = ColumnType::FLOAT64;
+}
+
+void RecordBatch::Column::write_value_json(JSONWriter& w, size_t row) const {
+  switch (this->type) {
+    case ColumnType::INT64:
+      w.write_int(this->int64_data[row]);
+      break;
+    case ColumnType::FLOAT64:
+      w.write_float(this->float64_data[row]);
+      break;
+    case ColumnType::BOOL:
+      w.write_bool(this->bool_value(row));
+      break;
+    case ColumnType::STRING:
+      w.write_string(this->string_value(row));
+      break;
+    case ColumnType::STRING_LIST: {
+      w.begin_array();
+      size_t count = this->list_size(row);
+      for (size_t z = 0; z < count; z++) {
+        w.write_string(this->string_list_item(row, z));
+      }
+      w.end_array();
+      break;
+    }
+    case ColumnType::FLOAT64_LIST:
+      w.begin_array();
+      for (double item : this->float64_list(row)) {
+        w.write_float(item);
+      }
+      w.end_array();
+      break;
+    default:
+      throw logic_error("invalid column type for conversion to JSON");
+  }
+}
+
+void RecordBatch::Column::convert_to_json() {
+  if (this->type == ColumnType::NONE) {
+    this->set_type(ColumnType::JSON);
+    return;
+  }
+
+  string new_arena;
+  vector<uint64_t> new_offsets;
+  new_offsets.reserve(this->num_rows + 1);
+  new_offsets.emplace_back(0);
+  JSONWriter w;
+  for (size_t row = 0; row < this->num_rows; row++) {
+    if (this->is_valid(row)) {
+      w.clear();
+      this->write_value_json(w, row);
+      new_arena.append(w.str());
+    }
+    new_offsets.emplace_back(new_arena.size());
+  }
+
+  this->int64_data = vector<int64_t>();
+  this->float64_data = vector<double>();
+  this->bool_data = vector<uint64_t>();
+  this->string_item_offsets = vector<uint64_t>();
+  this->value_offsets = std::move(new_offsets);
+  this->arena = std::move(new_arena);
+  this->type = ColumnType::JSON;
+}
+
+RecordBatch::Column& RecordBatch::column_for_name(string_view field_name) {
+  auto it = this->column_indexes.find(field_name);
+  if (it != this->column_indexes.end()) {
+    return this->columns[it->second];
+  }
+  size_t index = this->columns.size();
+  auto& column = this->columns.emplace_back(string(field_name));
+  this->column_indexes.emplace(column.name, index);
+  return column;
+}
+
+const RecordBatch::Column* RecordBatch::find_column(string_view field_name) const {
+  auto it = this->column_indexes.find(field_name);
+  return (it == this->column_indexes.end()) ? nullptr : &this->columns[it->second];
+}
+
+void RecordBatch::finish_row() {
+  size_t num_rows = this->num_rows();
+  for (auto& column : this->columns) {
+    column.pad_to(num_rows);
+  }
+}
+
+void RecordBatch::append_record(JSONReader& r) {
+  size_t row = this->num_rows();
+  uint64_t creation_time = 0;
+  uint64_t comment_count = 0;
+  bool has_id = false;
+  bool has_creation_time = false;
+  string scratch;
+  r.read_object([&](string_view key) -> void {
+    if (key == "id") {
+      string_view id = r.read_string_view(scratch);
+      if (id.size() != 17) {
+        throw runtime_error("Record ID length is incorrect");
+      }
+      this->record_ids.append(id);
+      has_id = true;
+    } else if (key == "createdTime") {
+      creation_time = parse_airtable_time(r.read_string_view(scratch));
+      has_creation_time = true;
+    } else if (key == "fields") {
+      r.read_object([&](string_view field_key) -> void {
+        auto& column = this->column_for_name(field_key);
+        column.pad_to(row);
+        if (column.size() > row) {
+          r.skip_value(); // Duplicate key; keep the first value
+        } else {
+          column.append_cell(r);
+        }
+      });
+    } else if (key == "commentCount") {
+      comment_count = r.read_number().as_int;
+    } else {
+      r.skip_value();
+    }
+  });
+  if (!has_id || !has_creation_time) {
+    throw runtime_error("Record is missing id or createdTime");
+  }
+  this->creation_times.emplace_back(creation_time);
+  this->comment_counts.emplace_back(comment_count);
+  this->finish_row();
+}
+
+void RecordBatch::append_record(const Record& record) {
+  size_t row = this->num_rows();
+  for (const auto& [field_name, field] : record.fields) {
+    auto& column = this->column_for_name(field_name);
+    column.pad_to(row);
+    if (field) {
+      column.append_field(*field);
+    } else {
+      column.pad_to(row + 1);
+    }
+  }
+  this->record_ids.append(record.id, 17);
+  this->creation_times.emplace_back(record.creation_time);
+  this->comment_counts.emplace_back(record.comment_count);
+  this->finish_row();
+}
+
+const char* name_for_column_type(RecordBatch::ColumnType type) {
+  switch (type) {
+    case RecordBatch::ColumnType::NONE:
+      return "none";
+    case RecordBatch::ColumnType::INT64:
+      return "int64";
+    case RecordBatch::ColumnType::FLOAT64:
+      return "float64";
+    case RecordBatch::ColumnType::BOOL:
+      return "bool";
+    case RecordBatch::ColumnType::STRING:
+      return "string";
+    case RecordBatch::ColumnType::STRING_LIST:
+      return "string_list";
+    case RecordBatch::ColumnType::FLOAT64_LIST:
+      return "float64_list";
+    case RecordBatch::ColumnType::JSON:
+      return "json";
+    default:
+      throw invalid_argument("invalid column type");
+  }
+}
@@ -0,0 +1,212 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "FieldTypes.hh"
+#include "JSONReader.hh"
+#include "JSONWriter.hh"
+
+// A column-oriented set of records, for consumers that scan whole fields at a
+// time (e.g. to aggregate them). Each field's values are stored in contiguous
+// typed arrays, with a validity bitmap marking which rows have values, so
+// scanning a field doesn't touch any other field's data and doesn't require
+// any hashing or type dispatch per row. The layout is similar to Apache
+// Arrow's (validity bitmaps, offset arrays, and one data buffer per column),
+// but offsets are 64-bit and string list columns use their own two-level
+// layout, so columns must be converted before being passed to Arrow-based
+// tools.
+//
+// Column types are inferred from the data as records are appended. Integer
+// columns become float columns if any non-integral value appears (Airtable
+// returns whole numbers without a decimal point even in decimal fields), and
+// columns whose cells don't all have the same type (for example, formula
+// fields that returned errors) become JSON columns, which hold each cell's
+// JSON text. Collaborator, button, and attachment cells are also stored as
+// JSON columns.
+class RecordBatch {
+public:
+  enum class ColumnType {
+    NONE = 0, // No non-null values have been appended yet
+    INT64,
+    FLOAT64,
+    BOOL,
+    STRING,
+    STRING_LIST,
+    FLOAT64_LIST,
+    JSON,
+  };
+
+  class Column {
+  public:
+    explicit Column(const std::string& name);
+    Column(const Column&) = delete;
+    Column(Column&&) = default;
+    Column& operator=(const Column&) = delete;
+    Column& operator=(Column&&) = default;
+    ~Column() = default;
+
+    inline const std::string& get_name() const {
+      return this->name;
+    }
+    inline ColumnType get_type() const {
+      return this->type;
+    }
+    inline size_t size() const {
+      return this->num_rows;
+    }
+
+    // Bit (row % 64) of word (row / 64) is set if the row has a value
+    inline bool is_valid(size_t row) const {
+      return (this->validity[row >> 6] >> (row & 63)) & 1;
+    }
+    inline std::span<const uint64_t> validity_bitmap() const {
+      return this->validity;
+    }
+    size_t null_count() const;
+
+    // The following functions return views of the column's data, which are
+    // valid until more records are appended to the batch. Null rows have
+    // zero, false, or empty values. Each function throws std::logic_error if
+    // the column isn't of the appropriate type.
+
+    // INT64 and FLOAT64 columns: one value per row
+    std::span<const int64_t> int64_values() const;
+    std::span<const double> float64_values() const;
+    // BOOL columns: a bitmap in the same format as the validity bitmap
+    std::span<const uint64_t> bool_bitmap() const;
+    bool bool_value(size_t row) const;
+
+    // STRING and JSON columns: row N's contents are the bytes of data_arena()
+    // in the range [offsets()[N], offsets()[N + 1])
+    std::string_view string_value(size_t row) const;
+    // STRING_LIST and FLOAT64_LIST columns: row N's items have the indexes
+    // [offsets()[N], offsets()[N + 1]). For FLOAT64_LIST columns, the items
+    // are in float64_values(); for STRING_LIST columns, item M's contents are
+    // the bytes of data_arena() in the range
+    // [item_offsets()[M], item_offsets()[M + 1]).
+    size_t list_size(size_t row) const;
+    std::string_view string_list_item(size_t row, size_t index) const;
+    std::span<const double> float64_list(size_t row) const;
+
+    inline std::span<const uint64_t> offsets() const {
+      return this->value_offsets;
+    }
+    inline std::span<const uint64_t> item_offsets() const {
+      return this->string_item_offsets;
+    }
+    inline std::string_view data_arena() const {
+      return this->arena;
+    }
+
+  private:
+    friend class RecordBatch;
+
+    void set_type(ColumnType new_type);
+    void set_valid(size_t row);
+    // Appends null rows until the column has num_rows rows
+    void pad_to(size_t num_rows);
+    void append_cell(JSONReader& r);
+    void append_field(const Field& field);
+    void append_string_list(JSONReader& r);
+    void append_float64_list(JSONReader& r);
+    void append_json(std::string_view json_text);
+    // Changes the column's type if needed so it can hold a cell of cell_type,
+    // converting it to a JSON column if the types are incompatible
+    void prepare_for_cell(ColumnType cell_type);
+    // Marks the cell just appended at row as valid
+    void finish_cell(size_t row);
+    void convert_to_float64();
+    void convert_to_json();
+    void write_value_json(JSONWriter& w, size_t row) const;
+    void check_type(ColumnType expected_type) const;
+
+    std::string name;
+    ColumnType type;
+    size_t num_rows;
+    std::vector<uint64_t> validity;
+    std::vector<int64_t> int64_data;
+    // Also used for FLOAT64_LIST items
+    std::vector<double> float64_data;
+    std::vector<uint64_t> bool_data;
+    // Byte offsets for STRING and JSON columns; item offsets for lists
+    std::vector<uint64_t> value_offsets;
+    std::vector<uint64_t> string_item_offsets;
+    std::string arena;
+  };
+
+  RecordBatch() = default;
+  RecordBatch(const RecordBatch&) = delete;
+  RecordBatch(RecordBatch&&) = default;
+  RecordBatch& operator=(const RecordBatch&) = delete;
+  RecordBatch& operator=(RecordBatch&&) = default;
+  ~RecordBatch() = default;
+
+  // Appends a record object directly from JSON text (as returned by the list
+  // records API), adding columns for any new fields. Throws std::runtime_error
+  // if the record is malformed, in which case the batch should be discarded.
+  void append_record(JSONReader& r);
+  // Appends an existing Record, converting its Fields directly. Column types
+  // are inferred as for JSON records, except that float cells always make a
+  // column FLOAT64, even if their values are whole numbers. Null Fields are
+  // treated as null cells.
+  void append_record(const Record& record);
+
+  inline size_t num_rows() const {
+    return this->creation_times.size();
+  }
+  inline size_t num_columns() const {
+    return this->columns.size();
+  }
+
+  // Record IDs are always 17 bytes long, so they're stored back-to-back
+  // without offsets
+  inline std::string_view record_id(size_t row) const {
+    return std::string_view(this->record_ids).substr(row * 17, 17);
+  }
+  inline std::string_view record_ids_data() const {
+    return this->record_ids;
+  }
+  inline std::span<const uint64_t> creation_time_values() const {
+    return this->creation_times;
+  }
+  // All zero unless the records were listed with
+  // ListRecordsOptions::include_comment_count
+  inline std::span<const uint64_t> comment_count_values() const {
+    return this->comment_counts;
+  }
+
+  // Columns are in the order their fields were first seen
+  inline const std::vector<Column>& get_columns() const {
+    return this->columns;
+  }
+  inline const Column& get_column(size_t index) const {
+    return this->columns.at(index);
+  }
+  // Returns nullptr if no record had a value for the field
+  const Column* find_column(std::string_view field_name) const;
+
+private:
+  Column& column_for_name(std::string_view field_name);
+  void finish_row();
+
+  struct KeyHash {
+    using is_transparent = void;
+    inline size_t operator()(std::string_view s) const {
+      return std::hash<std::string_view>()(s);
+    }
+  };
+
+  std::string record_ids;
+  std::vector<uint64_t> creation_times;
+  std::vector<uint64_t> comment_counts;
+  std::vector<Column> columns;
+  std::unordered_map<std::string, size_t, KeyHash, std::equal_to<>> column_indexes;
+};
+
+const char* name_for_column_type(RecordBatch::ColumnType type);
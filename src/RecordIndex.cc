@@ -0,0 +1,374 @@
+#include "RecordIndex.hh"
+
+#include <math.h>
+#include <string.h>
+
+#include <chrono>
+#include <format>
+#include <map>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+
+using namespace std;
+
+// Base class for all index types. Each index covers a single field.
+class IndexedRecordSet::Index {
+public:
+  explicit Index(const string& field_name) : field_name(field_name) {}
+  virtual ~Index() = default;
+
+  virtual void insert(const Record& record) = 0;
+  virtual void remove(const Record& record) = 0;
+  virtual void clear() = 0;
+  virtual void find_equal(const Key& key, vector<const Record*>& out) const = 0;
+  virtual void find_range(const optional<Key>& min_key, const optional<Key>& max_key, vector<const Record*>& out) const = 0;
+
+protected:
+  const Field* field_for_record(const Record& record) const {
+    auto it = record.fields.find(this->field_name);
+    return (it == record.fields.end()) ? nullptr : it->second.get();
+  }
+
+  string field_name;
+};
+
+namespace {
+
+template <IndexedRecordSet::KeyType Type>
+struct KeyTraits;
+
+template <>
+struct KeyTraits<IndexedRecordSet::KeyType::STRING> {
+  using KeyT = string;
+
+  template <typename FnT>
+  static void for_each_key(const Field& field, FnT&& fn) {
+    if (field.type == Field::ValueType::String) {
+      fn(static_cast<const StringField&>(field).value);
+    } else if (field.type == Field::ValueType::StringArray) {
+      for (const auto& item : static_cast<const StringArrayField&>(field).value) {
+        fn(item);
+      }
+    }
+  }
+
+  static KeyT convert_lookup_key(const IndexedRecordSet::Key& key) {
+    if (!holds_alternative<string>(key)) {
+      throw invalid_argument("string index requires string keys");
+    }
+    return get<string>(key);
+  }
+};
+
+template <>
+struct KeyTraits<IndexedRecordSet::KeyType::NUMBER> {
+  using KeyT = double;
+
+  template <typename FnT>
+  static void for_each_key(const Field& field, FnT&& fn) {
+    switch (field.type) {
+      case Field::ValueType::Integer:
+        fn(static_cast<double>(static_cast<const IntegerField&>(field).value));
+        break;
+      case Field::ValueType::Float: {
+        // NaN would break the ordered index's ordering (and could never be
+        // found or removed in the hash index), so it isn't indexed
+        double value = static_cast<const FloatField&>(field).value;
+        if (!isnan(value)) {
+          fn(value);
+        }
+        break;
+      }
+      case Field::ValueType::Checkbox:
+        fn(static_cast<const CheckboxField&>(field).value ? 1.0 : 0.0);
+        break;
+      default:
+        break;
+    }
+  }
+
+  static KeyT convert_lookup_key(const IndexedRecordSet::Key& key) {
+    if (!holds_alternative<double>(key)) {
+      throw invalid_argument("number index requires number keys");
+    }
+    // NaN doesn't compare consistently with other keys, so the index's
+    // ordering would be meaningless for it
+    double ret = get<double>(key);
+    if (isnan(ret)) {
+      throw invalid_argument("number index keys must not be NaN");
+    }
+    return ret;
+  }
+};
+
+template <>
+struct KeyTraits<IndexedRecordSet::KeyType::TIME> {
+  using KeyT = uint64_t;
+
+  template <typename FnT>
+  static void for_each_key(const Field& field, FnT&& fn) {
+    if (field.type != Field::ValueType::String) {
+      return;
+    }
+    uint64_t t;
+    try {
+      t = parse_airtable_time(static_cast<const StringField&>(field).value);
+    } catch (const runtime_error&) {
+      return;
+    }
+    fn(t);
+  }
+
+  static KeyT convert_lookup_key(const IndexedRecordSet::Key& key) {
+    if (holds_alternative<double>(key)) {
+      // Casting a double outside uint64_t's range (or NaN) is undefined
+      double usecs = get<double>(key);
+      if (!(usecs >= 0.0) || (usecs >= 18446744073709551616.0)) {
+        throw invalid_argument("time index keys must be nonnegative numbers of microseconds");
+      }
+      return static_cast<uint64_t>(usecs);
+    }
+    return parse_airtable_time(get<string>(key));
+  }
+};
+
+template <IndexedRecordSet::KeyType Type, bool Ordered>
+class TypedIndex : public IndexedRecordSet::Index {
+public:
+  using Traits = KeyTraits<Type>;
+  using KeyT = typename Traits::KeyT;
+  using MapT = conditional_t<Ordered, multimap<KeyT, const Record*>, unordered_multimap<KeyT, const Record*>>;
+
+  explicit TypedIndex(const string& field_name) : Index(field_name) {}
+  virtual ~TypedIndex() = default;
+
+  virtual void insert(const Record& record) {
+    const Field* field = this->field_for_record(record);
+    if (field) {
+      Traits::for_each_key(*field, [&](const KeyT& key) -> void {
+        this->entries.emplace(key, &record);
+      });
+    }
+  }
+
+  virtual void remove(const Record& record) {
+    const Field* field = this->field_for_record(record);
+    if (field) {
+      Traits::for_each_key(*field, [&](const KeyT& key) -> void {
+        auto its = this->entries.equal_range(key);
+        for (auto it = its.first; it != its.second; it++) {
+          if (it->second == &record) {
+            this->entries.erase(it);
+            break;
+          }
+        }
+      });
+    }
+  }
+
+  virtual void clear() {
+    this->entries.clear();
+  }
+
+  virtual void find_equal(const IndexedRecordSet::Key& key, vector<const Record*>& out) const {
+    auto its = this->entries.equal_range(Traits::convert_lookup_key(key));
+    for (auto it = its.first; it != its.second; it++) {
+      out.emplace_back(it->second);
+    }
+  }
+
+  virtual void find_range(
+      const optional<IndexedRecordSet::Key>& min_key,
+      const optional<IndexedRecordSet::Key>& max_key,
+      vector<const Record*>& out) const {
+    if constexpr (Ordered) {
+      optional<KeyT> min_converted = min_key ? optional<KeyT>(Traits::convert_lookup_key(*min_key)) : nullopt;
+      optional<KeyT> max_converted = max_key ? optional<KeyT>(Traits::convert_lookup_key(*max_key)) : nullopt;
+      // If min > max, lower_bound(min) is past upper_bound(max), so the loop
+      // below would never reach end_it
+      if (min_converted && max_converted && (*max_converted < *min_converted)) {
+        return;
+      }
+      auto it = min_converted ? this->entries.lower_bound(*min_converted) : this->entries.begin();
+      auto end_it = max_converted ? this->entries.upper_bound(*max_converted) : this->entries.end();
+      for (; it != end_it; it++) {
+        out.emplace_back(it->second);
+      }
+    } else {
+      (void)min_key;
+      (void)max_key;
+      (void)out;
+      throw logic_error("range lookups require an ordered index");
+    }
+  }
+
+private:
+  MapT entries;
+};
+
+template <bool Ordered>
+unique_ptr<IndexedRecordSet::Index> make_index(const string& field_name, IndexedRecordSet::KeyType key_type) {
+  switch (key_type) {
+    case IndexedRecordSet::KeyType::STRING:
+      return make_unique<TypedIndex<IndexedRecordSet::KeyType::STRING, Ordered>>(field_name);
+    case IndexedRecordSet::KeyType::NUMBER:
+      return make_unique<TypedIndex<IndexedRecordSet::KeyType::NUMBER, Ordered>>(field_name);
+    case IndexedRecordSet::KeyType::TIME:
+      return make_unique<TypedIndex<IndexedRecordSet::KeyType::TIME, Ordered>>(field_name);
+    default:
+      throw invalid_argument("invalid index key type");
+  }
+}
+
+} // namespace
+
+IndexedRecordSet::IndexedRecordSet() = default;
+IndexedRecordSet::~IndexedRecordSet() = default;
+
+void IndexedRecordSet::add_hash_index(const string& field_name, KeyType key_type) {
+  auto index = make_index<false>(field_name, key_type);
+  for (const auto& it : this->records) {
+    index->insert(it.second);
+  }
+  this->indexes[field_name].hash = std::move(index);
+}
+
+void IndexedRecordSet::add_ordered_index(const string& field_name, KeyType key_type) {
+  auto index = make_index<true>(field_name, key_type);
+  for (const auto& it : this->records) {
+    index->insert(it.second);
+  }
+  this->indexes[field_name].ordered = std::move(index);
+}
+
+void IndexedRecordSet::drop_indexes(const string& field_name) {
+  this->indexes.erase(field_name);
+}
+
+void IndexedRecordSet::index_record(const Record& record) {
+  for (auto& [field_name, field_indexes] : this->indexes) {
+    if (field_indexes.hash) {
+      field_indexes.hash->insert(record);
+    }
+    if (field_indexes.ordered) {
+      field_indexes.ordered->insert(record);
+    }
+  }
+}
+
+void IndexedRecordSet::unindex_record(const Record& record) {
+  for (auto& [field_name, field_indexes] : this->indexes) {
+    if (field_indexes.hash) {
+      field_indexes.hash->remove(record);
+    }
+    if (field_indexes.ordered) {
+      field_indexes.ordered->remove(record);
+    }
+  }
+}
+
+void IndexedRecordSet::upsert(Record&& record) {
+  string id = record.id;
+  auto it = this->records.find(id);
+  if (it == this->records.end()) {
+    it = this->records.emplace(std::move(id), std::move(record)).first;
+  } else {
+    // Indexes refer to records by address, which doesn't change here since
+    // the map's node is reused
+    this->unindex_record(it->second);
+    it->second = std::move(record);
+  }
+  this->index_record(it->second);
+}
+
+bool IndexedRecordSet::erase(const string& record_id) {
+  auto it = this->records.find(record_id);
+  if (it == this->records.end()) {
+    return false;
+  }
+  this->unindex_record(it->second);
+  this->records.erase(it);
+  return true;
+}
+
+void IndexedRecordSet::clear() {
+  for (auto& [field_name, field_indexes] : this->indexes) {
+    if (field_indexes.hash) {
+      field_indexes.hash->clear();
+    }
+    if (field_indexes.ordered) {
+      field_indexes.ordered->clear();
+    }
+  }
+  this->records.clear();
+}
+
+void IndexedRecordSet::apply_created(
+    const vector<string>& record_ids,
+    const vector<unordered_map<string, shared_ptr<Field>>>& contents) {
+  if (record_ids.size() != contents.size()) {
+    throw invalid_argument("record ID count does not match contents count");
+  }
+  // The API doesn't return the creation time, so use the local time instead
+  uint64_t now = chrono::duration_cast<chrono::microseconds>(chrono::system_clock::now().time_since_epoch()).count();
+  for (size_t z = 0; z < record_ids.size(); z++) {
+    if (record_ids[z].size() != 17) {
+      throw runtime_error("Record ID length is incorrect");
+    }
+    Record record;
+    strcpy(record.id, record_ids[z].c_str());
+    record.creation_time = now;
+    record.fields = contents[z];
+    this->upsert(std::move(record));
+  }
+}
+
+void IndexedRecordSet::apply_updated(vector<Record>&& records) {
+  for (auto& record : records) {
+    this->upsert(std::move(record));
+  }
+}
+
+void IndexedRecordSet::apply_deleted(const unordered_map<string, bool>& results) {
+  for (const auto& [record_id, deleted] : results) {
+    if (deleted) {
+      this->erase(record_id);
+    }
+  }
+}
+
+const Record* IndexedRecordSet::get(const string& record_id) const {
+  auto it = this->records.find(record_id);
+  return (it == this->records.end()) ? nullptr : &it->second;
+}
+
+vector<const Record*> IndexedRecordSet::find_equal(const string& field_name, const Key& key) const {
+  auto it = this->indexes.find(field_name);
+  if (it == this->indexes.end()) {
+    throw out_of_range(std::format("field {} is not indexed", field_name));
+  }
+  vector<const Record*> ret;
+  if (it->second.hash) {
+    it->second.hash->find_equal(key, ret);
+  } else {
+    it->second.ordered->find_equal(key, ret);
+  }
+  return ret;
+}
+
+const Record* IndexedRecordSet::find_one(const string& field_name, const Key& key) const {
+  auto ret = this->find_equal(field_name, key);
+  return ret.empty() ? nullptr : ret[0];
+}
+
+vector<const Record*> IndexedRecordSet::find_range(
+    const string& field_name, const optional<Key>& min_key, const optional<Key>& max_key) const {
+  auto it = this->indexes.find(field_name);
+  if (it == this->indexes.end() || !it->second.ordered) {
+    throw out_of_range(std::format("field {} does not have an ordered index", field_name));
+  }
+  vector<const Record*> ret;
+  it->second.ordered->find_range(min_key, max_key, ret);
+  return ret;
+}
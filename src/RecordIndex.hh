@@ -0,0 +1,111 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+#include "FieldTypes.hh"
+
+// A set of records held locally (for example, a TableSyncer's replica or
+// records loaded from a TableSnapshot), with user-declared secondary indexes on
+// field values. Hash indexes support equality lookups; ordered indexes support
+// equality and range lookups. Indexes are updated incrementally as records are
+// inserted, replaced, or removed.
+//
+// Each index has a key type, which determines which cells are indexed:
+// - STRING: text cells; each item of a list cell (multiple selects, linked
+//   record IDs, lookups) is indexed separately
+// - NUMBER: integer, float, and checkbox cells (checkboxes are 1 or 0); NaN
+//   floats are not indexed
+// - TIME: text cells containing timestamps in Airtable's format (e.g. created
+//   time or last modified time fields); keys are microseconds since the epoch
+// Cells that don't match the index's key type are not indexed.
+class IndexedRecordSet {
+public:
+  enum class KeyType {
+    STRING = 0,
+    NUMBER,
+    TIME,
+  };
+
+  // Keys passed to lookup functions. For TIME indexes, keys may be strings (in
+  // Airtable's timestamp format) or numbers (microseconds since the epoch).
+  using Key = std::variant<std::string, double>;
+
+  IndexedRecordSet();
+  IndexedRecordSet(const IndexedRecordSet&) = delete;
+  IndexedRecordSet(IndexedRecordSet&&) = delete;
+  IndexedRecordSet& operator=(const IndexedRecordSet&) = delete;
+  IndexedRecordSet& operator=(IndexedRecordSet&&) = delete;
+  ~IndexedRecordSet();
+
+  // Declares an index on the given field. Existing records are indexed
+  // immediately. A field may have at most one hash index and one ordered
+  // index; declaring the same kind of index again replaces it.
+  void add_hash_index(const std::string& field_name, KeyType key_type);
+  void add_ordered_index(const std::string& field_name, KeyType key_type);
+  void drop_indexes(const std::string& field_name);
+
+  // Inserts a record, or replaces the existing record with the same ID
+  void upsert(Record&& record);
+  // Returns true if the record existed
+  bool erase(const std::string& record_id);
+  void clear();
+
+  // Helpers for keeping the set consistent with writes made through
+  // AirtableClient. apply_created takes the arguments and return value of
+  // create_records; apply_updated takes the return value of update_records
+  // (which must have been called with parse_response = true); apply_deleted
+  // takes the return value of delete_records.
+  void apply_created(
+      const std::vector<std::string>& record_ids,
+      const std::vector<std::unordered_map<std::string, std::shared_ptr<Field>>>& contents);
+  void apply_updated(std::vector<Record>&& records);
+  void apply_deleted(const std::unordered_map<std::string, bool>& results);
+
+  // Returns nullptr if the record doesn't exist
+  const Record* get(const std::string& record_id) const;
+  inline const std::unordered_map<std::string, Record>& all() const {
+    return this->records;
+  }
+  inline size_t size() const {
+    return this->records.size();
+  }
+
+  // Returns all records whose indexed value equals key. Uses the field's hash
+  // index if it has one, or its ordered index otherwise. Throws
+  // std::out_of_range if the field has no index.
+  std::vector<const Record*> find_equal(const std::string& field_name, const Key& key) const;
+  // Returns the first record whose indexed value equals key, or nullptr if
+  // there are none. This is convenient for unique keys (e.g. SKUs).
+  const Record* find_one(const std::string& field_name, const Key& key) const;
+  // Returns all records whose indexed value is between min_key and max_key
+  // (inclusive), in ascending order. Either bound may be std::nullopt, meaning
+  // the range is unbounded in that direction. Returns no records if min_key is
+  // greater than max_key. Throws std::out_of_range if the field has no ordered
+  // index, or std::invalid_argument if either key is invalid for the index's
+  // key type (e.g. NaN, or a negative time).
+  std::vector<const Record*> find_range(
+      const std::string& field_name,
+      const std::optional<Key>& min_key,
+      const std::optional<Key>& max_key) const;
+
+  class Index;
+
+private:
+  struct FieldIndexes {
+    std::unique_ptr<Index> hash;
+    std::unique_ptr<Index> ordered;
+  };
+
+  void index_record(const Record& record);
+  void unindex_record(const Record& record);
+
+  std::unordered_map<std::string, Record> records;
+  std::unordered_map<std::string, FieldIndexes> indexes;
+};
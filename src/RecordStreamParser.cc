@@ -0,0 +1,299 @@
+#include "RecordStreamParser.hh"
+
+#include <format>
+#include <stdexcept>
+
+#include "JSONReader.hh"
+#include "JSONScan.hh"
+
+using namespace std;
+
+static inline bool is_json_whitespace(char ch) {
+  return (ch == ' ' || ch == '\n' || ch == '\r' || ch == '\t');
+}
+
+RecordStreamParser::RecordStreamParser(
+    const TableDecoder* decoder, shared_ptr<PageArena> arena, shared_ptr<StringInterner> interner)
+    : decoder(decoder),
+      arena(std::move(arena)),
+      interner(interner ? std::move(interner) : make_shared<StringInterner>()) {
+  this->reset();
+}
+
+RecordStreamParser::RecordStreamParser(RecordFn on_record) : decoder(nullptr), on_record(std::move(on_record)) {
+  this->reset();
+}
+
+void RecordStreamParser::reset() {
+  this->state = State::BEFORE_ROOT;
+  this->depth = 0;
+  this->in_string = false;
+  this->in_escape = false;
+  this->key.clear();
+  this->capture.clear();
+  this->bytes_consumed = 0;
+  this->records.clear();
+  this->offset.clear();
+}
+
+vector<Record> RecordStreamParser::take_records() {
+  vector<Record> ret;
+  ret.swap(this->records);
+  return ret;
+}
+
+void RecordStreamParser::throw_error(const char* what) const {
+  throw runtime_error(std::format("Malformed records response (in piece starting at offset {}): {}", this->bytes_consumed, what));
+}
+
+const char* RecordStreamParser::scan_value(const char* p, const char* end, bool is_record) {
+  while (p < end) {
+    if (this->in_string) {
+      if (this->in_escape) {
+        this->in_escape = false;
+        p++;
+        continue;
+      }
+      p = find_quote_or_backslash(p, end);
+      if (p == end) {
+        return nullptr;
+      }
+      if (*p == '\\') {
+        this->in_escape = true;
+      } else {
+        this->in_string = false;
+        if (this->depth == 0) {
+          return p + 1; // Top-level string value
+        }
+      }
+      p++;
+      continue;
+    }
+
+    if (this->depth > 0) {
+      // Inside an object or array, only quotes and brackets matter
+      p = find_structural_char(p, end);
+      if (p == end) {
+        return nullptr;
+      }
+    } else if (!is_record && (*p == ',' || *p == '}' || is_json_whitespace(*p))) {
+      return p; // End of a top-level scalar value; the delimiter isn't part of it
+    }
+    char ch = *(p++);
+    if (ch == '\"') {
+      this->in_string = true;
+    } else if (ch == '{' || ch == '[') {
+      this->depth++;
+    } else if (ch == '}' || ch == ']') {
+      if (this->depth == 0) {
+        this->throw_error("unbalanced brackets");
+      }
+      if (--this->depth == 0) {
+        return p;
+      }
+    }
+  }
+  return nullptr;
+}
+
+void RecordStreamParser::on_value_complete(string_view data, bool is_record) {
+  JSONReader r(data);
+  if (is_record) {
+    if (this->on_record) {
+      this->on_record(r);
+    } else {
+      this->records.emplace_back(r, this->decoder, this->arena, this->interner);
+    }
+  } else if (this->key == "offset") {
+    this->offset = r.read_string();
+  } else {
+    r.skip_value();
+  }
+  if (!r.at_end()) {
+    this->throw_error("extra data after value");
+  }
+}
+
+void RecordStreamParser::feed(const char* data, size_t size) {
+  const char* p = data;
+  const char* end = data + size;
+
+  auto skip_whitespace = [&]() -> bool {
+    while (p < end && is_json_whitespace(*p)) {
+      p++;
+    }
+    return (p < end);
+  };
+
+  while (p < end) {
+    switch (this->state) {
+      case State::BEFORE_ROOT:
+        if (!skip_whitespace()) {
+          break;
+        }
+        if (*p != '{') {
+          this->throw_error("response is not an object");
+        }
+        p++;
+        this->state = State::EXPECT_KEY;
+        break;
+
+      case State::EXPECT_KEY:
+        if (!skip_whitespace()) {
+          break;
+        }
+        if (*p == '\"') {
+          p++;
+          this->key.clear();
+          this->in_escape = false;
+          this->state = State::IN_KEY;
+        } else if (*p == '}') {
+          p++;
+          this->state = State::DONE;
+        } else {
+          this->throw_error("expected key");
+        }
+        break;
+
+      case State::IN_KEY: {
+        // Escape sequences are kept as-is, since the only keys we care about
+        // don't contain any
+        if (this->in_escape) {
+          this->key.push_back(*(p++));
+          this->in_escape = false;
+          break;
+        }
+        const char* q = find_quote_or_backslash(p, end);
+        this->key.append(p, q - p);
+        p = q;
+        if (p < end) {
+          if (*p == '\\') {
+            this->key.push_back('\\');
+            this->in_escape = true;
+          } else {
+            this->state = State::EXPECT_COLON;
+          }
+          p++;
+        }
+        break;
+      }
+
+      case State::EXPECT_COLON:
+        if (!skip_whitespace()) {
+          break;
+        }
+        if (*p != ':') {
+          this->throw_error("expected colon after key");
+        }
+        p++;
+        this->state = (this->key == "records") ? State::RECORDS_EXPECT_ARRAY : State::EXPECT_VALUE;
+        break;
+
+      case State::EXPECT_VALUE:
+        if (!skip_whitespace()) {
+          break;
+        }
+        this->depth = 0;
+        this->in_string = false;
+        this->in_escape = false;
+        this->capture.clear();
+        this->state = State::IN_VALUE;
+        break;
+
+      case State::RECORDS_EXPECT_ARRAY:
+        if (!skip_whitespace()) {
+          break;
+        }
+        if (*p != '[') {
+          this->throw_error("records is not a list");
+        }
+        p++;
+        this->state = State::RECORDS_EXPECT_ITEM;
+        break;
+
+      case State::RECORDS_EXPECT_ITEM:
+        if (!skip_whitespace()) {
+          break;
+        }
+        if (*p == ',') {
+          p++;
+        } else if (*p == ']') {
+          p++;
+          this->state = State::AFTER_VALUE;
+        } else if (*p == '{') {
+          this->depth = 0;
+          this->in_string = false;
+          this->in_escape = false;
+          this->capture.clear();
+          this->state = State::IN_RECORD;
+        } else {
+          this->throw_error("record is not an object");
+        }
+        break;
+
+      case State::IN_RECORD:
+      case State::IN_VALUE: {
+        bool is_record = (this->state == State::IN_RECORD);
+        const char* value_end = this->scan_value(p, end, is_record);
+        if (!value_end) {
+          // The value continues into the next piece, so we have to copy it
+          this->capture.append(p, end - p);
+          p = end;
+          break;
+        }
+        if (this->capture.empty()) {
+          if (value_end == p) {
+            this->throw_error("expected value");
+          }
+          this->on_value_complete(string_view(p, value_end - p), is_record);
+        } else {
+          this->capture.append(p, value_end - p);
+          this->on_value_complete(this->capture, is_record);
+          this->capture.clear();
+        }
+        p = value_end;
+        this->state = is_record ? State::RECORDS_EXPECT_ITEM : State::AFTER_VALUE;
+        break;
+      }
+
+      case State::AFTER_VALUE:
+        if (!skip_whitespace()) {
+          break;
+        }
+        if (*p == ',') {
+          this->state = State::EXPECT_KEY;
+        } else if (*p == '}') {
+          this->state = State::DONE;
+        } else {
+          this->throw_error("expected comma or end of object");
+        }
+        p++;
+        break;
+
+      case State::DONE:
+        if (skip_whitespace()) {
+          this->throw_error("extra data after end of response");
+        }
+        break;
+
+      default:
+        throw logic_error("invalid record stream parser state");
+    }
+  }
+
+  this->bytes_consumed += size;
+}
+
+void RecordStreamParser::finish() {
+  if (this->state != State::DONE) {
+    this->throw_error("response is incomplete");
+  }
+}
+
+pair<vector<Record>, string> RecordStreamParser::parse(
+    string_view data, const TableDecoder* decoder, shared_ptr<PageArena> arena, shared_ptr<StringInterner> interner) {
+  RecordStreamParser parser(decoder, std::move(arena), std::move(interner));
+  parser.feed(data);
+  parser.finish();
+  return make_pair(parser.take_records(), std::move(parser.offset));
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "FieldTypes.hh"
+#include "JSONReader.hh"
+#include "PageArena.hh"
+#include "StringInterner.hh"
+#include "TableDecoder.hh"
+
+// Incrementally parses a list records response body (an object of the form
+// {"records": [...], "offset": "..."}) into Records, without building a DOM
+// for the whole response. Data may be passed to feed() in pieces of any size
+// (e.g. as they arrive from the network); each record is parsed as soon as its
+// closing brace has been received. Records that are entirely contained within
+// one piece are parsed directly from it; only records that span multiple
+// pieces are copied.
+//
+// The same envelope is used by the update records API, so this can parse its
+// responses too (they just don't have an offset).
+//
+// If a decoder is given, records' cells are decoded with it (see
+// TableDecoder). The decoder must remain valid while the parser is in use. If
+// an arena is given, the records' Fields are allocated from it (see
+// PageArena). The records' field names are interned in the given interner (see
+// RecordFields), or in one owned by the parser if none is given.
+//
+// Alternatively, an on_record function may be given, which is called with a
+// reader positioned at the start of each record object instead of building a
+// Record. It must consume exactly one value (the record). This is used to read
+// records into other structures (see TypedRecords.hh).
+class RecordStreamParser {
+public:
+  using RecordFn = std::function<void(JSONReader&)>;
+
+  explicit RecordStreamParser(
+      const TableDecoder* decoder = nullptr,
+      std::shared_ptr<PageArena> arena = nullptr,
+      std::shared_ptr<StringInterner> interner = nullptr);
+  explicit RecordStreamParser(RecordFn on_record);
+  RecordStreamParser(const RecordStreamParser&) = delete;
+  RecordStreamParser(RecordStreamParser&&) = delete;
+  RecordStreamParser& operator=(const RecordStreamParser&) = delete;
+  RecordStreamParser& operator=(RecordStreamParser&&) = delete;
+  ~RecordStreamParser() = default;
+
+  // Parses the next piece of the response. Throws std::runtime_error if the
+  // data is malformed.
+  void feed(const char* data, size_t size);
+  inline void feed(std::string_view data) {
+    this->feed(data.data(), data.size());
+  }
+  // Throws std::runtime_error if the response was incomplete. Call this after
+  // all data has been fed.
+  void finish();
+  // Clears all state, so the parser can be used for another response
+  void reset();
+
+  // Returns the records parsed so far (always empty if on_record was given).
+  // take_records moves them out of the parser; this can be called between
+  // feed() calls to process records as they arrive.
+  inline const std::vector<Record>& get_records() const {
+    return this->records;
+  }
+  std::vector<Record> take_records();
+  // Returns the offset for the next page, or an empty string if there are no
+  // more pages (or if the offset hasn't been received yet)
+  inline const std::string& get_offset() const {
+    return this->offset;
+  }
+
+  // Parses a complete response body. Returns (records, offset).
+  static std::pair<std::vector<Record>, std::string> parse(
+      std::string_view data,
+      const TableDecoder* decoder = nullptr,
+      std::shared_ptr<PageArena> arena = nullptr,
+      std::shared_ptr<StringInterner> interner = nullptr);
+
+private:
+  enum class State {
+    BEFORE_ROOT = 0,
+    EXPECT_KEY,
+    IN_KEY,
+    EXPECT_COLON,
+    EXPECT_VALUE,
+    IN_VALUE,
+    RECORDS_EXPECT_ARRAY,
+    RECORDS_EXPECT_ITEM,
+    IN_RECORD,
+    AFTER_VALUE,
+    DONE,
+  };
+
+  // Scans a record or top-level value starting at p. Returns a pointer just
+  // past the value's last character, or nullptr if the value doesn't end
+  // before end.
+  const char* scan_value(const char* p, const char* end, bool is_record);
+  void on_value_complete(std::string_view data, bool is_record);
+  [[noreturn]] void throw_error(const char* what) const;
+
+  const TableDecoder* decoder;
+  std::shared_ptr<PageArena> arena;
+  std::shared_ptr<StringInterner> interner;
+  RecordFn on_record;
+  State state;
+  // Nesting depth and string state within the value currently being scanned
+  size_t depth;
+  bool in_string;
+  bool in_escape;
+  // Contents of the current key, or of a value that spans multiple pieces
+  std::string key;
+  std::string capture;
+  size_t bytes_consumed;
+
+  std::vector<Record> records;
+  std::string offset;
+};
@@ -0,0 +1,271 @@
+#include "SchemaCache.hh"
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <format>
+#include <mutex>
+#include <phosg/Filesystem.hh>
+#include <stdexcept>
+
+using namespace std;
+
+static uint64_t now_usecs() {
+  return chrono::duration_cast<chrono::microseconds>(chrono::system_clock::now().time_since_epoch()).count();
+}
+
+const string* BaseSchemaIndex::TableIndex::find_field_id(const string& name_or_id) const {
+  auto field_it = this->schema->fields.find(name_or_id);
+  if (field_it != this->schema->fields.end()) {
+    return &field_it->first;
+  }
+  auto name_it = this->field_name_to_id.find(name_or_id);
+  return (name_it == this->field_name_to_id.end()) ? nullptr : &name_it->second;
+}
+
+const TableSchema::FieldSchema* BaseSchemaIndex::TableIndex::find_field(const string& name_or_id) const {
+  const string* field_id = this->find_field_id(name_or_id);
+  return field_id ? &this->schema->fields.at(*field_id) : nullptr;
+}
+
+const string* BaseSchemaIndex::TableIndex::find_view_id(const string& name_or_id) const {
+  auto view_it = this->schema->views.find(name_or_id);
+  if (view_it != this->schema->views.end()) {
+    return &view_it->first;
+  }
+  auto name_it = this->view_name_to_id.find(name_or_id);
+  return (name_it == this->view_name_to_id.end()) ? nullptr : &name_it->second;
+}
+
+const string& BaseSchemaIndex::TableIndex::field_id(const string& name_or_id) const {
+  const string* ret = this->find_field_id(name_or_id);
+  if (!ret) {
+    throw out_of_range(std::format("field {} does not exist in table {}", name_or_id, this->schema->name));
+  }
+  return *ret;
+}
+
+const string& BaseSchemaIndex::TableIndex::field_name(const string& name_or_id) const {
+  return this->schema->fields.at(this->field_id(name_or_id)).name;
+}
+
+const string& BaseSchemaIndex::TableIndex::view_id(const string& name_or_id) const {
+  const string* ret = this->find_view_id(name_or_id);
+  if (!ret) {
+    throw out_of_range(std::format("view {} does not exist in table {}", name_or_id, this->schema->name));
+  }
+  return *ret;
+}
+
+void BaseSchemaIndex::TableIndex::rekey_fields_by_name(Record& record) const {
+  // Moving the cells into a new set avoids copying them
+  RecordFields new_fields(record.fields.get_interner());
+  new_fields.reserve(record.fields.size());
+  string key;
+  for (auto& [old_key, field] : record.fields) {
+    key = old_key;
+    auto field_it = this->schema->fields.find(key);
+    new_fields.append((field_it != this->schema->fields.end()) ? field_it->second.name : key, std::move(field));
+  }
+  new_fields.finish_appending();
+  record.fields = std::move(new_fields);
+}
+
+void BaseSchemaIndex::TableIndex::rekey_fields_by_id(Record& record) const {
+  RecordFields new_fields(record.fields.get_interner());
+  new_fields.reserve(record.fields.size());
+  string key;
+  for (auto& [old_key, field] : record.fields) {
+    key = old_key;
+    auto name_it = this->field_name_to_id.find(key);
+    new_fields.append((name_it != this->field_name_to_id.end()) ? name_it->second : key, std::move(field));
+  }
+  new_fields.finish_appending();
+  record.fields = std::move(new_fields);
+}
+
+BaseSchemaIndex::BaseSchemaIndex(unordered_map<string, TableSchema>&& tables)
+    : tables(std::move(tables)) {
+  for (const auto& [table_id, table] : this->tables) {
+    TableIndex& index = this->table_id_to_index[table_id];
+    index.table_id = table_id;
+    index.schema = &table;
+    for (const auto& [field_id, field] : table.fields) {
+      index.field_name_to_id.emplace(field.name, field_id);
+    }
+    for (const auto& [view_id, view] : table.views) {
+      index.view_name_to_id.emplace(view.name, view_id);
+    }
+    index.decoder_by_name = make_shared<TableDecoder>(table, false);
+    index.decoder_by_id = make_shared<TableDecoder>(table, true);
+    this->table_name_to_id.emplace(table.name, table_id);
+  }
+}
+
+const BaseSchemaIndex::TableIndex* BaseSchemaIndex::find_table(const string& name_or_id) const {
+  auto it = this->table_id_to_index.find(name_or_id);
+  if (it == this->table_id_to_index.end()) {
+    auto name_it = this->table_name_to_id.find(name_or_id);
+    if (name_it == this->table_name_to_id.end()) {
+      return nullptr;
+    }
+    it = this->table_id_to_index.find(name_it->second);
+  }
+  return &it->second;
+}
+
+const BaseSchemaIndex::TableIndex& BaseSchemaIndex::table(const string& name_or_id) const {
+  const auto* ret = this->find_table(name_or_id);
+  if (!ret) {
+    throw out_of_range(std::format("table {} does not exist", name_or_id));
+  }
+  return *ret;
+}
+
+AirtableClient::ListRecordsOptions BaseSchemaIndex::resolve_options(
+    const string& table_name_or_id, const AirtableClient::ListRecordsOptions& options) const {
+  const auto& table = this->table(table_name_or_id);
+  AirtableClient::ListRecordsOptions ret = options;
+  for (auto& field : ret.fields) {
+    field = table.field_id(field);
+  }
+  for (auto& sort : ret.sort_fields) {
+    sort.first = table.field_id(sort.first);
+  }
+  if (!ret.view.empty()) {
+    ret.view = table.view_id(ret.view);
+  }
+  if (!ret.decoder) {
+    ret.decoder = table.decoder(ret.return_fields_by_field_id);
+  }
+  return ret;
+}
+
+phosg::JSON BaseSchemaIndex::to_json() const {
+  auto tables_dict = phosg::JSON::dict();
+  for (const auto& [table_id, table] : this->tables) {
+    tables_dict.emplace(table_id, table.to_json());
+  }
+  return tables_dict;
+}
+
+shared_ptr<BaseSchemaIndex> BaseSchemaIndex::from_json(const phosg::JSON& json) {
+  unordered_map<string, TableSchema> tables;
+  for (const auto& [table_id, table_json] : json.as_dict()) {
+    tables.emplace(table_id, TableSchema(*table_json));
+  }
+  return make_shared<BaseSchemaIndex>(std::move(tables));
+}
+
+SchemaCache::SchemaCache(AirtableClient& client, uint64_t ttl_usecs, const string& cache_directory)
+    : client(client),
+      ttl_usecs(ttl_usecs),
+      cache_directory(cache_directory) {}
+
+string SchemaCache::filename_for_base(const string& base_id) const {
+  return std::format("{}/{}.schema.json", this->cache_directory, base_id);
+}
+
+shared_ptr<const BaseSchemaIndex> SchemaCache::load_from_disk(const string& base_id, uint64_t now) {
+  if (this->cache_directory.empty()) {
+    return nullptr;
+  }
+
+  try {
+    auto json = phosg::JSON::parse(phosg::load_file(this->filename_for_base(base_id)));
+    uint64_t fetch_time = json.at("fetch_time").as_int();
+    if (now - fetch_time >= this->ttl_usecs) {
+      return nullptr;
+    }
+    Entry entry{.index = BaseSchemaIndex::from_json(json.at("tables")), .fetch_time = fetch_time};
+    this->set_entry(base_id, entry);
+    return entry.index;
+
+  } catch (const exception&) {
+    // The file doesn't exist or is corrupt; ignore it and fetch the schema
+    return nullptr;
+  }
+}
+
+void SchemaCache::save_to_disk(const string& base_id, const Entry& entry) const {
+  if (this->cache_directory.empty()) {
+    return;
+  }
+
+  auto json = phosg::JSON::dict({
+      {"fetch_time", entry.fetch_time},
+      {"tables", entry.index->to_json()},
+  });
+
+  // Write to a temporary file and rename it, so other processes never see a
+  // partially-written file. The temporary file's name is unique to this call,
+  // so threads saving the same base at once don't write to the same file.
+  static atomic<uint64_t> next_temp_file_number = 0;
+  string filename = this->filename_for_base(base_id);
+  string temp_filename = std::format("{}.tmp.{}.{}", filename, getpid(), next_temp_file_number++);
+  phosg::save_file(temp_filename, json.serialize());
+  if (rename(temp_filename.c_str(), filename.c_str())) {
+    unlink(temp_filename.c_str());
+    throw runtime_error("cannot rename schema cache file");
+  }
+}
+
+void SchemaCache::set_entry(const string& base_id, const Entry& entry) {
+  unique_lock g(this->entries_lock);
+  this->entries[base_id] = entry;
+}
+
+void SchemaCache::set_save_error_handler(SaveErrorHandler handler) {
+  this->save_error_handler = std::move(handler);
+}
+
+asio::awaitable<shared_ptr<const BaseSchemaIndex>> SchemaCache::get(const string& base_id) {
+  uint64_t now = now_usecs();
+  {
+    shared_lock g(this->entries_lock);
+    auto it = this->entries.find(base_id);
+    if (it != this->entries.end() && (now - it->second.fetch_time < this->ttl_usecs)) {
+      co_return it->second.index;
+    }
+  }
+  auto index = this->load_from_disk(base_id, now);
+  if (index) {
+    co_return index;
+  }
+  co_return co_await this->refresh(base_id);
+}
+
+asio::awaitable<shared_ptr<const BaseSchemaIndex>> SchemaCache::refresh(const string& base_id) {
+  uint64_t fetch_time = now_usecs();
+  auto tables = co_await this->client.get_base_schema(base_id);
+
+  Entry entry{.index = make_shared<BaseSchemaIndex>(std::move(tables)), .fetch_time = fetch_time};
+  this->set_entry(base_id, entry);
+  try {
+    this->save_to_disk(base_id, entry);
+  } catch (const exception&) {
+    // The on-disk copy is only an optimization, so don't fail the request
+    if (this->save_error_handler) {
+      this->save_error_handler(base_id, current_exception());
+    }
+  }
+  co_return entry.index;
+}
+
+shared_ptr<const BaseSchemaIndex> SchemaCache::get_cached(const string& base_id) const {
+  shared_lock g(this->entries_lock);
+  auto it = this->entries.find(base_id);
+  return (it == this->entries.end()) ? nullptr : it->second.index;
+}
+
+void SchemaCache::invalidate(const string& base_id) {
+  {
+    unique_lock g(this->entries_lock);
+    this->entries.erase(base_id);
+  }
+  if (!this->cache_directory.empty()) {
+    unlink(this->filename_for_base(base_id).c_str());
+  }
+}
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <asio.hpp>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <phosg/JSON.hh>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+
+#include "AirtableClient.hh"
+#include "FieldTypes.hh"
+#include "TableDecoder.hh"
+
+// Lookup tables for one base's schema, so callers holding a table, field, or
+// view name can find its ID (and vice versa) without scanning the schema. All
+// lookup functions accept either a name or an ID.
+class BaseSchemaIndex {
+public:
+  struct TableIndex {
+    std::string table_id;
+    const TableSchema* schema;
+    std::unordered_map<std::string, std::string> field_name_to_id;
+    std::unordered_map<std::string, std::string> view_name_to_id;
+    // Decoders for this table's records, for records keyed by field name and
+    // by field ID respectively
+    std::shared_ptr<const TableDecoder> decoder_by_name;
+    std::shared_ptr<const TableDecoder> decoder_by_id;
+
+    // These return nullptr if the field or view doesn't exist
+    const std::string* find_field_id(const std::string& name_or_id) const;
+    const TableSchema::FieldSchema* find_field(const std::string& name_or_id) const;
+    const std::string* find_view_id(const std::string& name_or_id) const;
+
+    // These throw std::out_of_range if the field or view doesn't exist
+    const std::string& field_id(const std::string& name_or_id) const;
+    const std::string& field_name(const std::string& name_or_id) const;
+    const std::string& view_id(const std::string& name_or_id) const;
+
+    inline const std::shared_ptr<const TableDecoder>& decoder(bool key_by_field_id) const {
+      return key_by_field_id ? this->decoder_by_id : this->decoder_by_name;
+    }
+
+    // Converts a record's fields map from field IDs to field names (for
+    // records listed with return_fields_by_field_id), or vice versa. Keys that
+    // don't match any field in the table are left unchanged.
+    void rekey_fields_by_name(Record& record) const;
+    void rekey_fields_by_id(Record& record) const;
+  };
+
+  explicit BaseSchemaIndex(std::unordered_map<std::string, TableSchema>&& tables);
+  BaseSchemaIndex(const BaseSchemaIndex&) = delete;
+  BaseSchemaIndex(BaseSchemaIndex&&) = delete;
+  BaseSchemaIndex& operator=(const BaseSchemaIndex&) = delete;
+  BaseSchemaIndex& operator=(BaseSchemaIndex&&) = delete;
+  ~BaseSchemaIndex() = default;
+
+  // Returns the schemas of all tables, keyed by table ID (the same format
+  // returned by AirtableClient::get_base_schema)
+  inline const std::unordered_map<std::string, TableSchema>& all_tables() const {
+    return this->tables;
+  }
+
+  // Returns nullptr if the table doesn't exist
+  const TableIndex* find_table(const std::string& name_or_id) const;
+  // Throws std::out_of_range if the table doesn't exist
+  const TableIndex& table(const std::string& name_or_id) const;
+
+  // Returns a copy of options with all field names (in fields and
+  // sort_fields) and the view name replaced with their IDs. Field and view
+  // IDs in options are left as-is. If options has no decoder, the table's
+  // decoder is used. Throws std::out_of_range if any field or the view
+  // doesn't exist.
+  AirtableClient::ListRecordsOptions resolve_options(
+      const std::string& table_name_or_id, const AirtableClient::ListRecordsOptions& options) const;
+
+  phosg::JSON to_json() const;
+  static std::shared_ptr<BaseSchemaIndex> from_json(const phosg::JSON& json);
+
+private:
+  std::unordered_map<std::string, TableSchema> tables;
+  std::unordered_map<std::string, TableIndex> table_id_to_index;
+  std::unordered_map<std::string, std::string> table_name_to_id;
+};
+
+// Caches base schemas in memory and (optionally) on disk, so each process
+// doesn't have to re-fetch them at startup. Cached schemas expire after the
+// given TTL, after which the next get() call fetches the schema again.
+//
+// SchemaCache is thread-safe, so one cache can be shared by coroutines running
+// on multiple threads. Fetches are not deduplicated: if multiple coroutines
+// miss the cache for the same base at once, each fetches the schema, and the
+// last one to finish replaces the others' entries.
+class SchemaCache {
+public:
+  SchemaCache(
+      AirtableClient& client,
+      uint64_t ttl_usecs,
+      // If empty, schemas are not cached on disk
+      const std::string& cache_directory = "");
+  SchemaCache(const SchemaCache&) = delete;
+  SchemaCache(SchemaCache&&) = delete;
+  SchemaCache& operator=(const SchemaCache&) = delete;
+  SchemaCache& operator=(SchemaCache&&) = delete;
+  ~SchemaCache() = default;
+
+  // Called when a schema was fetched but couldn't be saved to disk. The fetch
+  // still succeeds, since the on-disk copy is only an optimization. If no
+  // handler is set, these errors are ignored. The handler is called on the
+  // thread that fetched the schema, and must be set before the cache is used.
+  using SaveErrorHandler = std::function<void(const std::string& base_id, std::exception_ptr exc)>;
+  void set_save_error_handler(SaveErrorHandler handler);
+
+  // Returns the schema index for the given base, fetching the schema if it
+  // isn't cached in memory or on disk, or if the cached copy has expired.
+  asio::awaitable<std::shared_ptr<const BaseSchemaIndex>> get(const std::string& base_id);
+  // Fetches the schema for the given base, bypassing the cache
+  asio::awaitable<std::shared_ptr<const BaseSchemaIndex>> refresh(const std::string& base_id);
+
+  // Returns the cached schema for the given base without fetching it, even if
+  // it has expired. Returns nullptr if the schema isn't cached in memory.
+  std::shared_ptr<const BaseSchemaIndex> get_cached(const std::string& base_id) const;
+  // Deletes the in-memory and on-disk copies of the given base's schema
+  void invalidate(const std::string& base_id);
+
+private:
+  struct Entry {
+    std::shared_ptr<const BaseSchemaIndex> index;
+    uint64_t fetch_time;
+  };
+
+  std::string filename_for_base(const std::string& base_id) const;
+  // Returns nullptr if the schema isn't on disk or has expired
+  std::shared_ptr<const BaseSchemaIndex> load_from_disk(const std::string& base_id, uint64_t now);
+  void save_to_disk(const std::string& base_id, const Entry& entry) const;
+  void set_entry(const std::string& base_id, const Entry& entry);
+
+  AirtableClient& client;
+  uint64_t ttl_usecs;
+  std::string cache_directory;
+  SaveErrorHandler save_error_handler;
+  // Only held while accessing entries, never during I/O or across a co_await
+  mutable std::shared_mutex entries_lock;
+  std::unordered_map<std::string, Entry> entries;
+};
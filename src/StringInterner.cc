@@ -0,0 +1,47 @@
+#include "StringInterner.hh"
+
+#include <stdexcept>
+
+using namespace std;
+
+StringInterner::StringInterner(size_t num_shards) {
+  // intern() uses the high 8 bits of each string's hash to pick its shard
+  if (num_shards < 1 || num_shards > 256) {
+    throw invalid_argument("shard count must be between 1 and 256");
+  }
+  this->shards = vector<Shard>(num_shards);
+}
+
+string_view StringInterner::intern(string_view s) {
+  size_t hash = KeyHash()(s);
+  // The set also uses the low bits of the hash, so use the high bits to pick
+  // the shard
+  auto& shard = this->shards[(hash >> (sizeof(size_t) * 8 - 8)) % this->shards.size()];
+  lock_guard g(shard.lock);
+  auto it = shard.index.find(s);
+  if (it != shard.index.end()) {
+    return *it;
+  }
+  string_view ret = shard.strings.emplace_front(s);
+  shard.index.emplace(ret);
+  shard.total_bytes += s.size();
+  return ret;
+}
+
+size_t StringInterner::size() const {
+  size_t ret = 0;
+  for (const auto& shard : this->shards) {
+    lock_guard g(shard.lock);
+    ret += shard.index.size();
+  }
+  return ret;
+}
+
+size_t StringInterner::bytes() const {
+  size_t ret = 0;
+  for (const auto& shard : this->shards) {
+    lock_guard g(shard.lock);
+    ret += shard.total_bytes;
+  }
+  return ret;
+}
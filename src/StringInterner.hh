@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <forward_list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+// Stores one copy of each distinct string it's given, so that objects which
+// would otherwise each hold their own copy of the same string (for example,
+// the field names of every Record from a table) can refer to the shared copy
+// instead. Strings are never removed, and views returned by intern() remain
+// valid for the lifetime of the interner; objects that hold such views should
+// also hold a reference to the interner.
+//
+// StringInterner is thread-safe. Strings are split among several shards by
+// hash, each with its own lock, so threads parsing different records at the
+// same time rarely wait for each other. Interners that are only used by one
+// thread at a time can use a single shard, which makes them much smaller.
+class StringInterner {
+public:
+  static constexpr size_t DEFAULT_NUM_SHARDS = 16;
+
+  // num_shards must be between 1 and 256
+  explicit StringInterner(size_t num_shards = DEFAULT_NUM_SHARDS);
+  StringInterner(const StringInterner&) = delete;
+  StringInterner(StringInterner&&) = delete;
+  StringInterner& operator=(const StringInterner&) = delete;
+  StringInterner& operator=(StringInterner&&) = delete;
+  ~StringInterner() = default;
+
+  // Returns a view of the stored copy of s, adding it if needed
+  std::string_view intern(std::string_view s);
+
+  size_t size() const;
+  // Returns the total length of all the stored strings
+  size_t bytes() const;
+
+private:
+  struct KeyHash {
+    using is_transparent = void;
+    inline size_t operator()(std::string_view s) const {
+      return std::hash<std::string_view>()(s);
+    }
+  };
+
+  struct Shard {
+    mutable std::mutex lock;
+    // The set's entries point into strings, which is a list so they remain
+    // valid as strings are added. (A deque would also work, but it allocates
+    // when it's constructed, and most single-shard interners, like the ones
+    // RecordFields creates for itself, hold only a few strings.)
+    std::forward_list<std::string> strings;
+    std::unordered_set<std::string_view, KeyHash, std::equal_to<>> index;
+    size_t total_bytes = 0;
+  };
+  std::vector<Shard> shards;
+};
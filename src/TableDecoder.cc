@@ -0,0 +1,398 @@
+#include "TableDecoder.hh"
+
+#include <string.h>
+
+#include <mutex>
+#include <stdexcept>
+
+#include "PageArena.hh"
+
+using namespace std;
+
+static TableDecoder::CellKind kind_for_type(const string& type) {
+  using CellKind = TableDecoder::CellKind;
+  static const unordered_map<string, CellKind> kinds = {
+      {"singleLineText", CellKind::STRING},
+      {"multilineText", CellKind::STRING},
+      {"richText", CellKind::STRING},
+      {"email", CellKind::STRING},
+      {"url", CellKind::STRING},
+      {"phoneNumber", CellKind::STRING},
+      {"singleSelect", CellKind::SELECT},
+      {"date", CellKind::STRING},
+      {"dateTime", CellKind::STRING},
+      {"createdTime", CellKind::STRING},
+      {"lastModifiedTime", CellKind::STRING},
+      {"number", CellKind::NUMBER},
+      {"currency", CellKind::NUMBER},
+      {"percent", CellKind::NUMBER},
+      {"duration", CellKind::NUMBER},
+      {"rating", CellKind::NUMBER},
+      {"count", CellKind::NUMBER},
+      {"autoNumber", CellKind::NUMBER},
+      {"checkbox", CellKind::CHECKBOX},
+      {"multipleSelects", CellKind::MULTI_SELECT},
+      {"multipleRecordLinks", CellKind::STRING_LIST},
+      {"singleCollaborator", CellKind::COLLABORATOR},
+      {"createdBy", CellKind::COLLABORATOR},
+      {"lastModifiedBy", CellKind::COLLABORATOR},
+      {"multipleCollaborators", CellKind::COLLABORATOR_LIST},
+      {"multipleAttachments", CellKind::ATTACHMENT_LIST},
+      {"button", CellKind::BUTTON},
+      {"barcode", CellKind::BARCODE},
+      {"aiText", CellKind::AI_TEXT},
+  };
+  auto it = kinds.find(type);
+  return (it == kinds.end()) ? CellKind::GENERIC : it->second;
+}
+
+// Returns the type of a computed field's result (options.result.type), or
+// nullptr if the schema doesn't specify it
+static const string* result_type_for_field(const TableSchema::FieldSchema& field) {
+  if (!field.options.is_dict()) {
+    return nullptr;
+  }
+  const auto& options_dict = field.options.as_dict();
+  auto result_it = options_dict.find("result");
+  if (result_it == options_dict.end() || !result_it->second->is_dict()) {
+    return nullptr;
+  }
+  const auto& result_dict = result_it->second->as_dict();
+  auto type_it = result_dict.find("type");
+  if (type_it == result_dict.end() || !type_it->second->is_string()) {
+    return nullptr;
+  }
+  return &type_it->second->as_string();
+}
+
+TableDecoder::CellKind TableDecoder::kind_for_field(const TableSchema::FieldSchema& field) {
+  if (field.type == "formula" || field.type == "rollup") {
+    // These produce a single value of the result type
+    const string* result_type = result_type_for_field(field);
+    return result_type ? kind_for_type(*result_type) : CellKind::GENERIC;
+
+  } else if (field.type == "multipleLookupValues" || field.type == "lookup") {
+    // These produce a list of values of the result type. Lookups of list
+    // fields (e.g. multiple selects) are flattened into a single list.
+    const string* result_type = result_type_for_field(field);
+    switch (result_type ? kind_for_type(*result_type) : CellKind::GENERIC) {
+      case CellKind::STRING:
+      case CellKind::STRING_LIST:
+      case CellKind::SELECT:
+      case CellKind::MULTI_SELECT:
+        return CellKind::STRING_LIST;
+      case CellKind::NUMBER:
+        return CellKind::NUMBER_LIST;
+      case CellKind::COLLABORATOR:
+      case CellKind::COLLABORATOR_LIST:
+        return CellKind::COLLABORATOR_LIST;
+      case CellKind::ATTACHMENT_LIST:
+        return CellKind::ATTACHMENT_LIST;
+      default:
+        return CellKind::GENERIC;
+    }
+
+  } else {
+    return kind_for_type(field.type);
+  }
+}
+
+// Appends an item to a multiple select cache key (see SelectCells)
+static void append_multi_select_key_item(string& key, string_view item) {
+  uint32_t size = item.size();
+  key.append(reinterpret_cast<const char*>(&size), sizeof(size));
+  key.append(item);
+}
+
+unique_ptr<TableDecoder::SelectCells> TableDecoder::select_cells_for_field(
+    const TableSchema::FieldSchema& field, CellKind kind) {
+  if (kind != CellKind::SELECT && kind != CellKind::MULTI_SELECT) {
+    return nullptr;
+  }
+  auto ret = make_unique<SelectCells>();
+  if (!field.options.is_dict()) {
+    return ret;
+  }
+  const auto& options_dict = field.options.as_dict();
+  auto choices_it = options_dict.find("choices");
+  if (choices_it == options_dict.end() || !choices_it->second->is_list()) {
+    return ret;
+  }
+  for (const auto& choice_json : choices_it->second->as_list()) {
+    if (!choice_json->is_dict()) {
+      continue;
+    }
+    const auto& choice_dict = choice_json->as_dict();
+    auto name_it = choice_dict.find("name");
+    if (name_it == choice_dict.end() || !name_it->second->is_string()) {
+      continue;
+    }
+    const string& name = name_it->second->as_string();
+    if (kind == CellKind::SELECT) {
+      ret->cells.emplace(name, make_shared<const StringField>(name));
+    } else {
+      string key;
+      append_multi_select_key_item(key, name);
+      ret->cells.emplace(std::move(key), make_shared<const StringArrayField>(vector<string>{name}));
+    }
+    if (ret->cells.size() >= MAX_CACHED_SELECT_CELLS) {
+      break;
+    }
+  }
+  return ret;
+}
+
+TableDecoder::TableDecoder(const TableSchema& schema, bool key_by_field_id) {
+  for (const auto& [field_id, field] : schema.fields) {
+    CellKind kind = this->kind_for_field(field);
+    this->fields.emplace(
+        key_by_field_id ? field_id : field.name,
+        FieldDecoder{kind, TableDecoder::select_cells_for_field(field, kind)});
+  }
+}
+
+TableDecoder::CellKind TableDecoder::kind_for_key(string_view key) const {
+  auto it = this->fields.find(key);
+  return (it == this->fields.end()) ? CellKind::GENERIC : it->second.kind;
+}
+
+shared_ptr<Field> TableDecoder::decode_field(string_view key, JSONReader& r, const shared_ptr<PageArena>& arena) const {
+  auto it = this->fields.find(key);
+  if (it == this->fields.end()) {
+    return TableDecoder::decode_field(CellKind::GENERIC, r, arena);
+  }
+  const auto& field_decoder = it->second;
+  if (field_decoder.select_cells) {
+    auto ret = TableDecoder::decode_select(*field_decoder.select_cells, field_decoder.kind, r, arena);
+    if (ret) {
+      return ret;
+    }
+  }
+  return TableDecoder::decode_field(field_decoder.kind, r, arena);
+}
+
+// Returns a new Field with the same value as a cached select cell, so the
+// record that gets it can modify it without affecting other records
+static shared_ptr<Field> copy_select_cell(
+    const Field& cell, TableDecoder::CellKind kind, const shared_ptr<PageArena>& arena) {
+  if (kind == TableDecoder::CellKind::SELECT) {
+    return make_shared_in_arena<StringField>(arena, static_cast<const StringField&>(cell).value);
+  } else {
+    return make_shared_in_arena<StringArrayField>(arena, static_cast<const StringArrayField&>(cell).value);
+  }
+}
+
+shared_ptr<Field> TableDecoder::decode_select(
+    SelectCells& select_cells, CellKind kind, JSONReader& r, const shared_ptr<PageArena>& arena) {
+  // Read the cell's value as a cache key, without allocating any Fields
+  string scratch;
+  string multi_key;
+  string_view key;
+  if (kind == CellKind::SELECT) {
+    if (r.peek() != '\"') {
+      return nullptr;
+    }
+    key = r.read_string_view(scratch);
+  } else {
+    if (r.peek() != '[') {
+      return nullptr;
+    }
+    JSONReader list_start = r;
+    r.expect('[');
+    if (!r.consume(']')) {
+      do {
+        if (r.peek() != '\"') {
+          r = list_start;
+          return nullptr;
+        }
+        append_multi_select_key_item(multi_key, r.read_string_view(scratch));
+      } while (r.consume(','));
+      r.expect(']');
+    }
+    key = multi_key;
+  }
+
+  {
+    shared_lock g(select_cells.lock);
+    auto it = select_cells.cells.find(key);
+    if (it != select_cells.cells.end()) {
+      return copy_select_cell(*it->second, kind, arena);
+    }
+  }
+
+  // This value hasn't been seen before; make a Field for it and cache it if
+  // there's room
+  shared_ptr<const Field> cell;
+  if (kind == CellKind::SELECT) {
+    cell = make_shared<const StringField>(string(key));
+  } else {
+    auto array_field = make_shared<StringArrayField>();
+    for (size_t offset = 0; offset < multi_key.size();) {
+      uint32_t size;
+      memcpy(&size, multi_key.data() + offset, sizeof(size));
+      offset += sizeof(size);
+      array_field->value.emplace_back(multi_key.substr(offset, size));
+      offset += size;
+    }
+    cell = std::move(array_field);
+  }
+  {
+    unique_lock g(select_cells.lock);
+    if (select_cells.cells.size() < MAX_CACHED_SELECT_CELLS) {
+      select_cells.cells.emplace(string(key), cell);
+    }
+  }
+  return copy_select_cell(*cell, kind, arena);
+}
+
+static inline bool is_number_start(char ch) {
+  return (ch == '-') || (ch >= '0' && ch <= '9');
+}
+
+static shared_ptr<Field> decode_number(JSONReader& r, const shared_ptr<PageArena>& arena) {
+  auto num = r.read_number();
+  if (num.is_integer) {
+    return make_shared_in_arena<IntegerField>(arena, num.as_int);
+  } else {
+    return make_shared_in_arena<FloatField>(arena, num.as_float);
+  }
+}
+
+// Reads a list whose items should all start with expected_start_ch, calling
+// read_item for each one. If any item doesn't, the reader is rewound to the
+// beginning of the list and false is returned, so the caller can fall back to
+// Record::parse_field.
+template <typename FnT>
+static bool decode_list(JSONReader& r, char expected_start_ch, FnT&& read_item) {
+  JSONReader list_start = r;
+  r.expect('[');
+  if (r.consume(']')) {
+    return true;
+  }
+  do {
+    char ch = r.peek();
+    if ((expected_start_ch == '0') ? !is_number_start(ch) : (ch != expected_start_ch)) {
+      r = list_start;
+      return false;
+    }
+    read_item();
+  } while (r.consume(','));
+  r.expect(']');
+  return true;
+}
+
+shared_ptr<Field> TableDecoder::decode_field(CellKind kind, JSONReader& r, const shared_ptr<PageArena>& arena) {
+  char ch = r.peek();
+  switch (kind) {
+    case CellKind::STRING:
+    case CellKind::SELECT:
+      if (ch == '\"') {
+        return make_shared_in_arena<StringField>(arena, r.read_string());
+      }
+      break;
+
+    case CellKind::NUMBER:
+      if (is_number_start(ch)) {
+        return decode_number(r, arena);
+      }
+      break;
+
+    case CellKind::CHECKBOX:
+      if (ch == 't' || ch == 'f') {
+        return make_shared_in_arena<CheckboxField>(arena, r.read_bool());
+      }
+      break;
+
+    case CellKind::STRING_LIST:
+    case CellKind::MULTI_SELECT:
+      if (ch == '[') {
+        auto ret = make_shared_in_arena<StringArrayField>(arena);
+        if (decode_list(r, '\"', [&]() -> void { ret->value.emplace_back(r.read_string()); })) {
+          return ret;
+        }
+      }
+      break;
+
+    case CellKind::NUMBER_LIST:
+      if (ch == '[') {
+        auto ret = make_shared_in_arena<NumberArrayField>(arena);
+        if (decode_list(r, '0', [&]() -> void { ret->value.emplace_back(r.read_number().as_float); })) {
+          // parse_field returns an empty StringArrayField for empty lists
+          if (ret->value.empty()) {
+            return make_shared_in_arena<StringArrayField>(arena);
+          }
+          return ret;
+        }
+      }
+      break;
+
+    case CellKind::COLLABORATOR:
+      if (ch == '{') {
+        return make_shared_in_arena<CollaboratorField>(arena, r);
+      }
+      break;
+
+    case CellKind::COLLABORATOR_LIST:
+      if (ch == '[') {
+        auto ret = make_shared_in_arena<MultiCollaboratorField>(arena);
+        if (decode_list(r, '{', [&]() -> void { ret->value.emplace_back(r); })) {
+          if (ret->value.empty()) {
+            return make_shared_in_arena<StringArrayField>(arena);
+          }
+          return ret;
+        }
+      }
+      break;
+
+    case CellKind::ATTACHMENT_LIST:
+      if (ch == '[') {
+        auto ret = make_shared_in_arena<AttachmentField>(arena);
+        if (decode_list(r, '{', [&]() -> void { ret->value.emplace_back(r); })) {
+          if (ret->value.empty()) {
+            return make_shared_in_arena<StringArrayField>(arena);
+          }
+          return ret;
+        }
+      }
+      break;
+
+    case CellKind::BUTTON:
+      if (ch == '{') {
+        auto ret = make_shared_in_arena<ButtonField>(arena);
+        r.read_object([&](string_view key) -> void {
+          if (key == "url" && r.peek() == '\"') {
+            ret->url = r.read_string();
+          } else if (key == "label" && r.peek() == '\"') {
+            ret->label = r.read_string();
+          } else {
+            r.skip_value();
+          }
+        });
+        return ret;
+      }
+      break;
+
+    case CellKind::BARCODE:
+    case CellKind::AI_TEXT:
+      if (ch == '{') {
+        const char* value_key = (kind == CellKind::BARCODE) ? "text" : "value";
+        auto ret = make_shared_in_arena<StringField>(arena);
+        r.read_object([&](string_view key) -> void {
+          if (key == value_key && r.peek() == '\"') {
+            ret->value = r.read_string();
+          } else {
+            r.skip_value();
+          }
+        });
+        return ret;
+      }
+      break;
+
+    case CellKind::GENERIC:
+      break;
+
+    default:
+      throw logic_error("invalid cell kind");
+  }
+  return Record::parse_field(r, arena);
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "FieldTypes.hh"
+#include "JSONReader.hh"
+
+// Decodes a table's cells using the types from its schema, instead of guessing
+// each cell's type from its JSON shape as Record::parse_field does. The
+// decoder maps each field (by name or ID, matching how the records were
+// requested) to a specialized routine, so decoding a cell is one lookup and
+// one branch, with no probing of keys and no exceptions for valid data.
+//
+// Cells are decoded into the same Field types that parse_field produces, with
+// a few additions for types that parse_field can't handle: barcode cells
+// become the barcode's text, and AI text cells become the generated text (or
+// an empty string if generation failed).
+//
+// If a cell doesn't have the shape its schema implies (for example, if the
+// schema is out of date), or if the field isn't in the schema, the cell is
+// decoded with parse_field instead.
+//
+// Single and multiple select cells are cached: the decoder keeps one Field for
+// each value (or list of values) it has seen in a field, and decodes a select
+// cell by looking up its value there instead of building it from the JSON.
+// Each record still gets its own copy of the cached Field (including its
+// option strings, which are not shared between records), so records' cells
+// can be modified independently. Fields for the options listed in the schema
+// are created in advance; other values (e.g. multiple-select combinations)
+// are added as they're seen, up to MAX_CACHED_SELECT_CELLS per field.
+// Decoding is thread-safe.
+class TableDecoder {
+public:
+  enum class CellKind {
+    GENERIC = 0, // Use Record::parse_field
+    STRING, // Text, dates, phone numbers, etc.
+    NUMBER, // Numbers, currencies, percents, durations, ratings, counts, etc.
+    CHECKBOX,
+    STRING_LIST, // Linked records and lookups of text
+    NUMBER_LIST, // Lookups of numbers
+    COLLABORATOR,
+    COLLABORATOR_LIST,
+    ATTACHMENT_LIST,
+    BUTTON,
+    BARCODE,
+    AI_TEXT,
+    SELECT, // Same as STRING, but cached
+    MULTI_SELECT, // Same as STRING_LIST, but cached
+  };
+
+  static constexpr size_t MAX_CACHED_SELECT_CELLS = 4096;
+
+  // If key_by_field_id is true, the decoder expects records that were listed
+  // with ListRecordsOptions::return_fields_by_field_id.
+  TableDecoder(const TableSchema& schema, bool key_by_field_id);
+  TableDecoder(const TableDecoder&) = delete;
+  TableDecoder(TableDecoder&&) = default;
+  TableDecoder& operator=(const TableDecoder&) = delete;
+  TableDecoder& operator=(TableDecoder&&) = default;
+  ~TableDecoder() = default;
+
+  // Returns the kind of decoder to use for a field of the given schema
+  static CellKind kind_for_field(const TableSchema::FieldSchema& field);
+  // Returns the kind of decoder used for the given field name or ID, or
+  // GENERIC if it isn't in the schema
+  CellKind kind_for_key(std::string_view key) const;
+
+  // Decodes one cell value. If an arena is given, the Field is allocated from
+  // it (see PageArena). The static version doesn't cache select cells.
+  std::shared_ptr<Field> decode_field(
+      std::string_view key, JSONReader& r, const std::shared_ptr<PageArena>& arena = nullptr) const;
+  static std::shared_ptr<Field> decode_field(
+      CellKind kind, JSONReader& r, const std::shared_ptr<PageArena>& arena = nullptr);
+
+private:
+  struct KeyHash {
+    using is_transparent = void;
+    inline size_t operator()(std::string_view s) const {
+      return std::hash<std::string_view>()(s);
+    }
+  };
+
+  // Cached cells for one select field. For single selects, the keys are
+  // the option names; for multiple selects, they're the option names, each
+  // preceded by its length as a 4-byte integer.
+  struct SelectCells {
+    std::shared_mutex lock;
+    std::unordered_map<std::string, std::shared_ptr<const Field>, KeyHash, std::equal_to<>> cells;
+  };
+
+  struct FieldDecoder {
+    CellKind kind;
+    std::unique_ptr<SelectCells> select_cells; // Null unless kind is SELECT or MULTI_SELECT
+  };
+
+  static std::unique_ptr<SelectCells> select_cells_for_field(const TableSchema::FieldSchema& field, CellKind kind);
+  // Returns nullptr if the cell doesn't have the expected shape
+  static std::shared_ptr<Field> decode_select(
+      SelectCells& select_cells, CellKind kind, JSONReader& r, const std::shared_ptr<PageArena>& arena);
+
+  std::unordered_map<std::string, FieldDecoder, KeyHash, std::equal_to<>> fields;
+};
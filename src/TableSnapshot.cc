@@ -0,0 +1,486 @@
+#include "TableSnapshot.hh"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <bit>
+#include <format>
+#include <stdexcept>
+
+using namespace std;
+
+static constexpr uint64_t SNAPSHOT_MAGIC = 0x50414E5354524941; // "AIRTSNAP" in little-endian
+static constexpr uint32_t SNAPSHOT_VERSION = 1;
+static constexpr uint32_t NO_STRING = 0xFFFFFFFF;
+
+struct TableSnapshot::Header {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t schema_string_id; // NO_STRING if no schema was saved
+  uint64_t num_records;
+  uint64_t num_fields;
+  uint64_t num_strings;
+  uint64_t high_water_mark;
+  uint64_t string_table_offset;
+  uint64_t record_headers_offset;
+  uint64_t column_headers_offset;
+};
+
+struct TableSnapshot::RecordHeader {
+  char id[17]; // Not null-terminated
+  uint8_t unused[7];
+  uint64_t creation_time;
+};
+
+struct TableSnapshot::ColumnHeader {
+  uint32_t name_string_id;
+  uint32_t unused;
+  uint64_t cells_offset;
+};
+
+struct TableSnapshot::Cell {
+  CellType type;
+  uint32_t unused;
+  uint64_t value;
+};
+
+static_assert(sizeof(TableSnapshot::Header) == 0x48);
+static_assert(sizeof(TableSnapshot::RecordHeader) == 0x20);
+static_assert(sizeof(TableSnapshot::ColumnHeader) == 0x10);
+static_assert(sizeof(TableSnapshot::Cell) == 0x10);
+
+static inline size_t align8(size_t offset) {
+  return (offset + 7) & ~static_cast<size_t>(7);
+}
+
+TableSnapshot::TableSnapshot(const string& filename)
+    : data(nullptr),
+      size(0),
+      header(nullptr),
+      string_offsets(nullptr),
+      string_data(nullptr),
+      record_headers(nullptr),
+      column_headers(nullptr),
+      field_name_interner(make_shared<StringInterner>()) {
+  int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    throw runtime_error(std::format("cannot open snapshot {}: {}", filename, strerror(errno)));
+  }
+  struct stat st;
+  if (fstat(fd, &st)) {
+    int error = errno;
+    close(fd);
+    throw runtime_error(std::format("cannot stat snapshot {}: {}", filename, strerror(error)));
+  }
+  this->size = st.st_size;
+  if (this->size < sizeof(Header)) {
+    close(fd);
+    throw runtime_error("snapshot file is too small");
+  }
+  void* mapped = mmap(nullptr, this->size, PROT_READ, MAP_PRIVATE, fd, 0);
+  int error = errno;
+  close(fd);
+  if (mapped == MAP_FAILED) {
+    throw runtime_error(std::format("cannot map snapshot {}: {}", filename, strerror(error)));
+  }
+  this->data = reinterpret_cast<const uint8_t*>(mapped);
+
+  try {
+    this->header = reinterpret_cast<const Header*>(this->data);
+    if (this->header->magic != SNAPSHOT_MAGIC) {
+      throw runtime_error("file is not a snapshot, or was written on a machine with different endianness");
+    }
+    if (this->header->version != SNAPSHOT_VERSION) {
+      throw runtime_error("unsupported snapshot version");
+    }
+
+    // Check that all sections are within the file. Individual strings and
+    // cells are bounds-checked when accessed, so opening a snapshot doesn't
+    // need to touch every page.
+    auto check_section = [&](uint64_t offset, uint64_t count, uint64_t item_size) -> void {
+      if ((offset & 7) || (offset > this->size) || (count > (this->size - offset) / item_size)) {
+        throw runtime_error("snapshot section is out of bounds");
+      }
+    };
+    check_section(this->header->string_table_offset, this->header->num_strings + 1, sizeof(uint64_t));
+    check_section(this->header->record_headers_offset, this->header->num_records, sizeof(RecordHeader));
+    check_section(this->header->column_headers_offset, this->header->num_fields, sizeof(ColumnHeader));
+
+    this->string_offsets = reinterpret_cast<const uint64_t*>(this->data + this->header->string_table_offset);
+    this->string_data = reinterpret_cast<const char*>(this->string_offsets + this->header->num_strings + 1);
+    check_section(
+        this->header->string_table_offset + (this->header->num_strings + 1) * sizeof(uint64_t),
+        this->string_offsets[this->header->num_strings], 1);
+
+    this->record_headers = reinterpret_cast<const RecordHeader*>(this->data + this->header->record_headers_offset);
+    this->column_headers = reinterpret_cast<const ColumnHeader*>(this->data + this->header->column_headers_offset);
+    for (size_t z = 0; z < this->header->num_fields; z++) {
+      check_section(this->column_headers[z].cells_offset, this->header->num_records, sizeof(Cell));
+      this->field_name_to_index.emplace(this->get_string(this->column_headers[z].name_string_id), z);
+    }
+
+  } catch (const exception&) {
+    munmap(const_cast<uint8_t*>(this->data), this->size);
+    throw;
+  }
+}
+
+TableSnapshot::~TableSnapshot() {
+  munmap(const_cast<uint8_t*>(this->data), this->size);
+}
+
+size_t TableSnapshot::num_records() const {
+  return this->header->num_records;
+}
+
+size_t TableSnapshot::num_fields() const {
+  return this->header->num_fields;
+}
+
+uint64_t TableSnapshot::high_water_mark() const {
+  return this->header->high_water_mark;
+}
+
+string_view TableSnapshot::record_id(size_t record_index) const {
+  if (record_index >= this->header->num_records) {
+    throw out_of_range("record index out of range");
+  }
+  return string_view(this->record_headers[record_index].id, sizeof(this->record_headers[record_index].id));
+}
+
+uint64_t TableSnapshot::creation_time(size_t record_index) const {
+  if (record_index >= this->header->num_records) {
+    throw out_of_range("record index out of range");
+  }
+  return this->record_headers[record_index].creation_time;
+}
+
+string_view TableSnapshot::field_name(size_t field_index) const {
+  if (field_index >= this->header->num_fields) {
+    throw out_of_range("field index out of range");
+  }
+  return this->get_string(this->column_headers[field_index].name_string_id);
+}
+
+optional<size_t> TableSnapshot::field_index(string_view name) const {
+  auto it = this->field_name_to_index.find(name);
+  if (it == this->field_name_to_index.end()) {
+    return nullopt;
+  }
+  return it->second;
+}
+
+string_view TableSnapshot::get_string(uint32_t string_id) const {
+  if (string_id >= this->header->num_strings) {
+    throw out_of_range("string ID out of range");
+  }
+  uint64_t start = this->string_offsets[string_id];
+  uint64_t end = this->string_offsets[string_id + 1];
+  if ((start > end) || (end > this->string_offsets[this->header->num_strings])) {
+    throw runtime_error("snapshot string table is corrupt");
+  }
+  return string_view(this->string_data + start, end - start);
+}
+
+const TableSnapshot::Cell& TableSnapshot::cell(size_t record_index, size_t field_index) const {
+  if (record_index >= this->header->num_records) {
+    throw out_of_range("record index out of range");
+  }
+  if (field_index >= this->header->num_fields) {
+    throw out_of_range("field index out of range");
+  }
+  const Cell* column = reinterpret_cast<const Cell*>(this->data + this->column_headers[field_index].cells_offset);
+  return column[record_index];
+}
+
+TableSnapshot::CellType TableSnapshot::cell_type(size_t record_index, size_t field_index) const {
+  return this->cell(record_index, field_index).type;
+}
+
+string_view TableSnapshot::cell_string(size_t record_index, size_t field_index) const {
+  const auto& c = this->cell(record_index, field_index);
+  if (c.type != CellType::STRING && c.type != CellType::JSON) {
+    throw runtime_error("cell does not contain a string");
+  }
+  return this->get_string(c.value);
+}
+
+int64_t TableSnapshot::cell_integer(size_t record_index, size_t field_index) const {
+  const auto& c = this->cell(record_index, field_index);
+  if (c.type != CellType::INTEGER) {
+    throw runtime_error("cell does not contain an integer");
+  }
+  return static_cast<int64_t>(c.value);
+}
+
+double TableSnapshot::cell_float(size_t record_index, size_t field_index) const {
+  const auto& c = this->cell(record_index, field_index);
+  if (c.type != CellType::FLOAT) {
+    throw runtime_error("cell does not contain a float");
+  }
+  return bit_cast<double>(c.value);
+}
+
+bool TableSnapshot::cell_checkbox(size_t record_index, size_t field_index) const {
+  const auto& c = this->cell(record_index, field_index);
+  if (c.type != CellType::CHECKBOX) {
+    throw runtime_error("cell does not contain a checkbox");
+  }
+  return c.value != 0;
+}
+
+shared_ptr<Field> TableSnapshot::get_field(size_t record_index, size_t field_index) const {
+  const auto& c = this->cell(record_index, field_index);
+  switch (c.type) {
+    case CellType::ABSENT:
+      return nullptr;
+    case CellType::STRING:
+      return make_shared<StringField>(string(this->get_string(c.value)));
+    case CellType::INTEGER:
+      return make_shared<IntegerField>(static_cast<int64_t>(c.value));
+    case CellType::FLOAT:
+      return make_shared<FloatField>(bit_cast<double>(c.value));
+    case CellType::CHECKBOX:
+      return make_shared<CheckboxField>(c.value != 0);
+    case CellType::JSON:
+      return Record::parse_field(phosg::JSON::parse(string(this->get_string(c.value))));
+    default:
+      throw runtime_error("snapshot contains invalid cell type");
+  }
+}
+
+Record TableSnapshot::get_record(size_t record_index) const {
+  Record ret;
+  ret.fields = RecordFields(this->field_name_interner);
+  string_view id = this->record_id(record_index);
+  memcpy(ret.id, id.data(), id.size());
+  ret.id[id.size()] = 0;
+  ret.creation_time = this->creation_time(record_index);
+  for (size_t field_index = 0; field_index < this->header->num_fields; field_index++) {
+    auto field = this->get_field(record_index, field_index);
+    if (field) {
+      ret.fields.append(this->field_name(field_index), std::move(field));
+    }
+  }
+  ret.fields.finish_appending();
+  return ret;
+}
+
+vector<Record> TableSnapshot::get_all_records() const {
+  vector<Record> ret;
+  ret.reserve(this->header->num_records);
+  for (size_t z = 0; z < this->header->num_records; z++) {
+    ret.emplace_back(this->get_record(z));
+  }
+  return ret;
+}
+
+optional<TableSchema> TableSnapshot::schema() const {
+  if (this->header->schema_string_id == NO_STRING) {
+    return nullopt;
+  }
+  return TableSchema(phosg::JSON::parse(string(this->get_string(this->header->schema_string_id))));
+}
+
+TableSnapshotWriter::TableSnapshotWriter() : high_water_mark(0) {}
+
+uint32_t TableSnapshotWriter::add_string(const string& s) {
+  auto it = this->string_to_id.find(s);
+  if (it != this->string_to_id.end()) {
+    return it->second;
+  }
+  if (this->strings.size() >= NO_STRING) {
+    throw runtime_error("too many strings in snapshot");
+  }
+  uint32_t id = this->strings.size();
+  this->strings.emplace_back(s);
+  this->string_to_id.emplace(s, id);
+  return id;
+}
+
+uint32_t TableSnapshotWriter::field_index_for_name(string_view name) {
+  auto it = this->field_name_to_index.find(name);
+  if (it != this->field_name_to_index.end()) {
+    return it->second;
+  }
+  uint32_t index = this->field_name_string_ids.size();
+  this->field_name_string_ids.emplace_back(this->add_string(string(name)));
+  this->field_name_to_index.emplace(name, index);
+  return index;
+}
+
+void TableSnapshotWriter::add_record(const Record& record) {
+  if (strlen(record.id) != 17) {
+    throw runtime_error("Record ID length is incorrect");
+  }
+  auto& pending = this->records.emplace_back();
+  memcpy(pending.id, record.id, sizeof(pending.id));
+  pending.creation_time = record.creation_time;
+  for (const auto& [name, field] : record.fields) {
+    PendingCell c;
+    switch (field->type) {
+      case Field::ValueType::String:
+        c.type = TableSnapshot::CellType::STRING;
+        c.value = this->add_string(static_cast<const StringField&>(*field).value);
+        break;
+      case Field::ValueType::Integer:
+        c.type = TableSnapshot::CellType::INTEGER;
+        c.value = static_cast<uint64_t>(static_cast<const IntegerField&>(*field).value);
+        break;
+      case Field::ValueType::Float:
+        c.type = TableSnapshot::CellType::FLOAT;
+        c.value = bit_cast<uint64_t>(static_cast<const FloatField&>(*field).value);
+        break;
+      case Field::ValueType::Checkbox:
+        c.type = TableSnapshot::CellType::CHECKBOX;
+        c.value = static_cast<const CheckboxField&>(*field).value ? 1 : 0;
+        break;
+      default:
+        c.type = TableSnapshot::CellType::JSON;
+        c.value = this->add_string(field->to_json().serialize());
+        break;
+    }
+    pending.cells.emplace_back(this->field_index_for_name(name), c);
+  }
+}
+
+void TableSnapshotWriter::set_schema(const TableSchema& schema) {
+  this->schema_string_id = this->add_string(schema.to_json().serialize());
+}
+
+void TableSnapshotWriter::set_high_water_mark(uint64_t high_water_mark) {
+  this->high_water_mark = high_water_mark;
+}
+
+string TableSnapshotWriter::serialize() const {
+  using Header = TableSnapshot::Header;
+  using RecordHeader = TableSnapshot::RecordHeader;
+  using ColumnHeader = TableSnapshot::ColumnHeader;
+  using Cell = TableSnapshot::Cell;
+
+  size_t num_records = this->records.size();
+  size_t num_fields = this->field_name_string_ids.size();
+  size_t string_data_size = 0;
+  for (const auto& s : this->strings) {
+    string_data_size += s.size();
+  }
+
+  Header header;
+  header.magic = SNAPSHOT_MAGIC;
+  header.version = SNAPSHOT_VERSION;
+  header.schema_string_id = this->schema_string_id.value_or(NO_STRING);
+  header.num_records = num_records;
+  header.num_fields = num_fields;
+  header.num_strings = this->strings.size();
+  header.high_water_mark = this->high_water_mark;
+  header.string_table_offset = sizeof(Header);
+  header.record_headers_offset = align8(header.string_table_offset + (this->strings.size() + 1) * sizeof(uint64_t) + string_data_size);
+  header.column_headers_offset = header.record_headers_offset + num_records * sizeof(RecordHeader);
+  size_t columns_offset = header.column_headers_offset + num_fields * sizeof(ColumnHeader);
+
+  string ret(columns_offset + num_fields * num_records * sizeof(Cell), '\0');
+  uint8_t* out = reinterpret_cast<uint8_t*>(ret.data());
+  memcpy(out, &header, sizeof(header));
+
+  uint64_t* string_offsets = reinterpret_cast<uint64_t*>(out + header.string_table_offset);
+  char* string_data = reinterpret_cast<char*>(string_offsets + this->strings.size() + 1);
+  uint64_t string_offset = 0;
+  for (size_t z = 0; z < this->strings.size(); z++) {
+    string_offsets[z] = string_offset;
+    memcpy(string_data + string_offset, this->strings[z].data(), this->strings[z].size());
+    string_offset += this->strings[z].size();
+  }
+  string_offsets[this->strings.size()] = string_offset;
+
+  RecordHeader* record_headers = reinterpret_cast<RecordHeader*>(out + header.record_headers_offset);
+  ColumnHeader* column_headers = reinterpret_cast<ColumnHeader*>(out + header.column_headers_offset);
+  for (size_t field_index = 0; field_index < num_fields; field_index++) {
+    column_headers[field_index].name_string_id = this->field_name_string_ids[field_index];
+    column_headers[field_index].cells_offset = columns_offset + field_index * num_records * sizeof(Cell);
+  }
+
+  // Cells not written here remain zero, which is CellType::ABSENT
+  for (size_t record_index = 0; record_index < num_records; record_index++) {
+    const auto& pending = this->records[record_index];
+    memcpy(record_headers[record_index].id, pending.id, sizeof(record_headers[record_index].id));
+    record_headers[record_index].creation_time = pending.creation_time;
+    for (const auto& [field_index, pending_cell] : pending.cells) {
+      Cell* column = reinterpret_cast<Cell*>(out + column_headers[field_index].cells_offset);
+      column[record_index].type = pending_cell.type;
+      column[record_index].value = pending_cell.value;
+    }
+  }
+
+  return ret;
+}
+
+void TableSnapshotWriter::save(const string& filename) const {
+  string data = this->serialize();
+
+  // The temporary file's name is unique to this call (not just this process),
+  // so threads saving the same snapshot at once don't write to the same file
+  static atomic<uint64_t> next_temp_file_number = 0;
+  string temp_filename = std::format("{}.tmp.{}.{}", filename, getpid(), next_temp_file_number++);
+  int fd = open(temp_filename.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    throw runtime_error(std::format("cannot open {}: {}", temp_filename, strerror(errno)));
+  }
+
+  auto fail = [&](const char* what) -> void {
+    int error = errno;
+    close(fd);
+    unlink(temp_filename.c_str());
+    throw runtime_error(std::format("cannot {} {}: {}", what, temp_filename, strerror(error)));
+  };
+
+  for (size_t offset = 0; offset < data.size();) {
+    ssize_t bytes_written = write(fd, data.data() + offset, data.size() - offset);
+    if (bytes_written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      fail("write");
+    }
+    offset += bytes_written;
+  }
+  if (fsync(fd)) {
+    fail("sync");
+  }
+  close(fd);
+
+  if (rename(temp_filename.c_str(), filename.c_str())) {
+    int error = errno;
+    unlink(temp_filename.c_str());
+    throw runtime_error(std::format("cannot rename {} to {}: {}", temp_filename, filename, strerror(error)));
+  }
+
+  // Make the rename itself durable
+  size_t slash_pos = filename.rfind('/');
+  string dir_name = (slash_pos == string::npos) ? "." : filename.substr(0, slash_pos ? slash_pos : 1);
+  int dir_fd = open(dir_name.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dir_fd >= 0) {
+    fsync(dir_fd);
+    close(dir_fd);
+  }
+}
+
+void save_table_snapshot(
+    const string& filename,
+    const vector<Record>& records,
+    const TableSchema* schema,
+    uint64_t high_water_mark) {
+  TableSnapshotWriter w;
+  for (const auto& record : records) {
+    w.add_record(record);
+  }
+  if (schema) {
+    w.set_schema(*schema);
+  }
+  w.set_high_water_mark(high_water_mark);
+  w.save(filename);
+}
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "FieldTypes.hh"
+
+// Snapshots are compact binary files containing the records of one table (and
+// optionally its schema), meant to be memory-mapped at startup instead of
+// re-downloading the table. The layout is:
+//   Header
+//   String table: (num_strings + 1) uint64_t offsets, then the string data
+//   Record headers: num_records RecordHeader structs
+//   Column descriptors: num_fields ColumnHeader structs
+//   Columns: for each field, num_records Cell structs
+// All integers are in native byte order; snapshots are meant to be read on the
+// machine that wrote them (or one of the same architecture). Strings are
+// deduplicated, so repeated values (e.g. select options) are stored once.
+// Complex cells (arrays, collaborators, attachments, etc.) are stored as
+// serialized JSON in the string table and are only parsed when accessed.
+
+class TableSnapshot {
+public:
+  enum class CellType : uint32_t {
+    ABSENT = 0,
+    STRING, // value is a string ID
+    INTEGER, // value is an int64_t
+    FLOAT, // value is a double
+    CHECKBOX, // value is 0 or 1
+    JSON, // value is the string ID of the cell's serialized JSON
+  };
+
+  // Opens and maps the given file. Throws std::runtime_error if the file
+  // can't be opened or is not a valid snapshot.
+  explicit TableSnapshot(const std::string& filename);
+  TableSnapshot(const TableSnapshot&) = delete;
+  TableSnapshot(TableSnapshot&&) = delete;
+  TableSnapshot& operator=(const TableSnapshot&) = delete;
+  TableSnapshot& operator=(TableSnapshot&&) = delete;
+  ~TableSnapshot();
+
+  size_t num_records() const;
+  size_t num_fields() const;
+  uint64_t high_water_mark() const;
+
+  std::string_view record_id(size_t record_index) const;
+  uint64_t creation_time(size_t record_index) const;
+
+  std::string_view field_name(size_t field_index) const;
+  // Returns the index of the named field, or std::nullopt if no record in the
+  // snapshot has a value for it.
+  std::optional<size_t> field_index(std::string_view name) const;
+
+  // Typed cell accessors. These do not allocate; cell_string returns a view
+  // into the mapped file, which is valid as long as the snapshot is open.
+  CellType cell_type(size_t record_index, size_t field_index) const;
+  std::string_view cell_string(size_t record_index, size_t field_index) const; // STRING and JSON cells
+  int64_t cell_integer(size_t record_index, size_t field_index) const;
+  double cell_float(size_t record_index, size_t field_index) const;
+  bool cell_checkbox(size_t record_index, size_t field_index) const;
+
+  // Decodes a single cell. Returns nullptr if the record has no value for the
+  // field.
+  std::shared_ptr<Field> get_field(size_t record_index, size_t field_index) const;
+  // Decodes an entire record, or all records. The records' field names are
+  // interned in the snapshot's interner.
+  Record get_record(size_t record_index) const;
+  std::vector<Record> get_all_records() const;
+  inline const std::shared_ptr<StringInterner>& get_field_name_interner() const {
+    return this->field_name_interner;
+  }
+
+  // Returns the table's schema, if one was saved with the snapshot
+  std::optional<TableSchema> schema() const;
+
+  std::string_view get_string(uint32_t string_id) const;
+
+  // On-disk structures (defined in TableSnapshot.cc)
+  struct Header;
+  struct RecordHeader;
+  struct ColumnHeader;
+  struct Cell;
+
+private:
+  const Cell& cell(size_t record_index, size_t field_index) const;
+
+  const uint8_t* data;
+  size_t size;
+  const Header* header;
+  const uint64_t* string_offsets;
+  const char* string_data;
+  const RecordHeader* record_headers;
+  const ColumnHeader* column_headers;
+  std::unordered_map<std::string_view, size_t> field_name_to_index;
+  std::shared_ptr<StringInterner> field_name_interner;
+};
+
+class TableSnapshotWriter {
+public:
+  TableSnapshotWriter();
+  TableSnapshotWriter(const TableSnapshotWriter&) = delete;
+  TableSnapshotWriter(TableSnapshotWriter&&) = delete;
+  TableSnapshotWriter& operator=(const TableSnapshotWriter&) = delete;
+  TableSnapshotWriter& operator=(TableSnapshotWriter&&) = delete;
+  ~TableSnapshotWriter() = default;
+
+  void add_record(const Record& record);
+  void set_schema(const TableSchema& schema);
+  // Stores an opaque timestamp with the snapshot; this is intended for the
+  // high-water mark of a TableSyncer, so a restarted process can resume
+  // incremental syncing from the snapshot.
+  void set_high_water_mark(uint64_t high_water_mark);
+
+  // Serializes the snapshot into a string. Most callers should use save()
+  // instead.
+  std::string serialize() const;
+  // Writes the snapshot atomically: the data is written to a temporary file in
+  // the same directory, flushed to disk, and renamed over the target file, so
+  // readers never see a partially-written snapshot.
+  void save(const std::string& filename) const;
+
+private:
+  struct PendingCell {
+    TableSnapshot::CellType type;
+    uint64_t value;
+  };
+  struct PendingRecord {
+    char id[18];
+    uint64_t creation_time;
+    std::vector<std::pair<uint32_t, PendingCell>> cells; // (field_index, cell)
+  };
+
+  uint32_t add_string(const std::string& s);
+  uint32_t field_index_for_name(std::string_view name);
+
+  struct KeyHash {
+    using is_transparent = void;
+    inline size_t operator()(std::string_view s) const {
+      return std::hash<std::string_view>()(s);
+    }
+  };
+
+  std::vector<std::string> strings;
+  std::unordered_map<std::string, uint32_t> string_to_id;
+  std::vector<uint32_t> field_name_string_ids;
+  std::unordered_map<std::string, uint32_t, KeyHash, std::equal_to<>> field_name_to_index;
+  std::vector<PendingRecord> records;
+  std::optional<uint32_t> schema_string_id;
+  uint64_t high_water_mark;
+};
+
+// Convenience function for the common case of saving an entire table
+void save_table_snapshot(
+    const std::string& filename,
+    const std::vector<Record>& records,
+    const TableSchema* schema = nullptr,
+    uint64_t high_water_mark = 0);
@@ -0,0 +1,336 @@
+#include "Tracing.hh"
+
+#include <algorithm>
+#include <format>
+#include <phosg/Filesystem.hh>
+#include <random>
+
+#include "JSONWriter.hh"
+
+using namespace std;
+
+static atomic<uint32_t> next_thread_index = 1;
+
+static uint32_t current_thread_index() {
+  static thread_local uint32_t index = next_thread_index.fetch_add(1, memory_order_relaxed);
+  return index;
+}
+
+Tracer::Tracer(size_t max_spans)
+    : max_spans(max_spans),
+      start_time(clock::now()),
+      start_system_time(chrono::system_clock::now()) {
+  // Trace and span IDs only need to be unique, but they're randomized so
+  // traces from different processes (or tracers) can be merged
+  random_device rd;
+  this->trace_id_high = (static_cast<uint64_t>(rd()) << 32) | rd();
+  this->id_base = (static_cast<uint64_t>(rd()) << 32) | rd();
+}
+
+uint64_t Tracer::next_id() {
+  uint64_t ret = this->id_base + this->id_counter.fetch_add(1, memory_order_relaxed);
+  return ret ? ret : this->next_id();
+}
+
+uint64_t Tracer::nsecs_since_start(clock::time_point t) const {
+  return (t > this->start_time) ? chrono::duration_cast<chrono::nanoseconds>(t - this->start_time).count() : 0;
+}
+
+void Tracer::record(SpanRecord&& span) {
+  lock_guard g(this->lock);
+  if (this->finished_spans.size() >= this->max_spans) {
+    this->dropped_spans++;
+  } else {
+    this->finished_spans.emplace_back(std::move(span));
+  }
+}
+
+vector<Tracer::SpanRecord> Tracer::spans() const {
+  lock_guard g(this->lock);
+  return this->finished_spans;
+}
+
+size_t Tracer::num_dropped_spans() const {
+  lock_guard g(this->lock);
+  return this->dropped_spans;
+}
+
+void Tracer::clear() {
+  lock_guard g(this->lock);
+  this->finished_spans.clear();
+  this->dropped_spans = 0;
+}
+
+static void write_attribute_value(JSONWriter& w, const Tracer::AttributeValue& value) {
+  if (holds_alternative<int64_t>(value)) {
+    w.write_int(get<int64_t>(value));
+  } else {
+    w.write_string(get<string>(value));
+  }
+}
+
+string Tracer::to_chrome_trace() const {
+  auto spans = this->spans();
+
+  // Each span becomes a begin event and an end event. Viewers match them up
+  // by nesting, so at equal timestamps, end events must come before begin
+  // events, outer spans must begin first, and inner spans must end first.
+  struct Event {
+    uint64_t ts_nsecs;
+    bool is_begin;
+    uint64_t other_ts_nsecs;
+    size_t span_index;
+  };
+  vector<Event> events;
+  events.reserve(spans.size() * 2);
+  for (size_t z = 0; z < spans.size(); z++) {
+    events.emplace_back(Event{spans[z].start_nsecs, true, spans[z].end_nsecs, z});
+    events.emplace_back(Event{spans[z].end_nsecs, false, spans[z].start_nsecs, z});
+  }
+  sort(events.begin(), events.end(), [](const Event& a, const Event& b) -> bool {
+    if (a.ts_nsecs != b.ts_nsecs) {
+      return a.ts_nsecs < b.ts_nsecs;
+    }
+    if (a.is_begin != b.is_begin) {
+      return !a.is_begin;
+    }
+    return a.other_ts_nsecs > b.other_ts_nsecs;
+  });
+
+  JSONWriter w;
+  w.begin_object();
+  w.write_key("displayTimeUnit");
+  w.write_string("ms");
+  w.write_key("traceEvents");
+  w.begin_array();
+  w.begin_object();
+  w.write_key("name");
+  w.write_string("process_name");
+  w.write_key("ph");
+  w.write_string("M");
+  w.write_key("pid");
+  w.write_int(1);
+  w.write_key("args");
+  w.begin_object();
+  w.write_key("name");
+  w.write_string("libairtable");
+  w.end_object();
+  w.end_object();
+
+  for (const auto& ev : events) {
+    const auto& span = spans[ev.span_index];
+    w.begin_object();
+    w.write_key("name");
+    w.write_string(span.name);
+    w.write_key("cat");
+    w.write_string("airtable");
+    w.write_key("ph");
+    w.write_string(ev.is_begin ? "b" : "e");
+    w.write_key("id");
+    w.write_string(std::format("0x{:016x}", span.trace_id));
+    w.write_key("pid");
+    w.write_int(1);
+    w.write_key("tid");
+    w.write_uint(span.thread_index);
+    w.write_key("ts");
+    w.write_float(ev.ts_nsecs / 1000.0);
+    if (ev.is_begin) {
+      w.write_key("args");
+      w.begin_object();
+      w.write_key("span_id");
+      w.write_string(std::format("{:016x}", span.span_id));
+      if (span.parent_span_id) {
+        w.write_key("parent_span_id");
+        w.write_string(std::format("{:016x}", span.parent_span_id));
+      }
+      for (const auto& [key, value] : span.attributes) {
+        w.write_key(key);
+        write_attribute_value(w, value);
+      }
+      if (!span.error.empty()) {
+        w.write_key("error");
+        w.write_string(span.error);
+      }
+      w.end_object();
+    }
+    w.end_object();
+  }
+
+  w.end_array();
+  w.end_object();
+  return w.take();
+}
+
+string Tracer::to_otlp_json(const string& service_name) const {
+  auto spans = this->spans();
+  uint64_t start_unix_nsecs = chrono::duration_cast<chrono::nanoseconds>(
+      this->start_system_time.time_since_epoch()).count();
+
+  JSONWriter w;
+  w.begin_object();
+  w.write_key("resourceSpans");
+  w.begin_array();
+  w.begin_object();
+  w.write_key("resource");
+  w.begin_object();
+  w.write_key("attributes");
+  w.begin_array();
+  w.begin_object();
+  w.write_key("key");
+  w.write_string("service.name");
+  w.write_key("value");
+  w.begin_object();
+  w.write_key("stringValue");
+  w.write_string(service_name);
+  w.end_object();
+  w.end_object();
+  w.end_array();
+  w.end_object();
+  w.write_key("scopeSpans");
+  w.begin_array();
+  w.begin_object();
+  w.write_key("scope");
+  w.begin_object();
+  w.write_key("name");
+  w.write_string("libairtable");
+  w.end_object();
+  w.write_key("spans");
+  w.begin_array();
+
+  // OTLP JSON encodes IDs as hex strings and 64-bit integers as decimal
+  // strings
+  auto write_attribute = [&w](const char* key, const AttributeValue& value) -> void {
+    w.begin_object();
+    w.write_key("key");
+    w.write_string(key);
+    w.write_key("value");
+    w.begin_object();
+    if (holds_alternative<int64_t>(value)) {
+      w.write_key("intValue");
+      w.write_string(std::format("{}", get<int64_t>(value)));
+    } else {
+      w.write_key("stringValue");
+      w.write_string(get<string>(value));
+    }
+    w.end_object();
+    w.end_object();
+  };
+
+  for (const auto& span : spans) {
+    w.begin_object();
+    w.write_key("traceId");
+    w.write_string(std::format("{:016x}{:016x}", this->trace_id_high, span.trace_id));
+    w.write_key("spanId");
+    w.write_string(std::format("{:016x}", span.span_id));
+    if (span.parent_span_id) {
+      w.write_key("parentSpanId");
+      w.write_string(std::format("{:016x}", span.parent_span_id));
+    }
+    w.write_key("name");
+    w.write_string(span.name);
+    w.write_key("kind");
+    w.write_int(1); // SPAN_KIND_INTERNAL
+    w.write_key("startTimeUnixNano");
+    w.write_string(std::format("{}", start_unix_nsecs + span.start_nsecs));
+    w.write_key("endTimeUnixNano");
+    w.write_string(std::format("{}", start_unix_nsecs + span.end_nsecs));
+    w.write_key("attributes");
+    w.begin_array();
+    write_attribute("thread.id", static_cast<int64_t>(span.thread_index));
+    for (const auto& [key, value] : span.attributes) {
+      write_attribute(key, value);
+    }
+    w.end_array();
+    if (!span.error.empty()) {
+      w.write_key("status");
+      w.begin_object();
+      w.write_key("code");
+      w.write_int(2); // STATUS_CODE_ERROR
+      w.write_key("message");
+      w.write_string(span.error);
+      w.end_object();
+    }
+    w.end_object();
+  }
+
+  w.end_array();
+  w.end_object();
+  w.end_array();
+  w.end_object();
+  w.end_array();
+  w.end_object();
+  return w.take();
+}
+
+void Tracer::write_chrome_trace(const string& filename) const {
+  phosg::save_file(filename, this->to_chrome_trace());
+}
+
+void Tracer::write_otlp_json(const string& filename, const string& service_name) const {
+  phosg::save_file(filename, this->to_otlp_json(service_name));
+}
+
+TraceSpan::TraceSpan(Tracer* tracer, const char* name) : tracer(tracer) {
+  if (this->tracer) {
+    this->record.span_id = this->tracer->next_id();
+    this->record.trace_id = this->record.span_id;
+    this->record.name = name;
+    this->record.start_nsecs = this->tracer->nsecs_since_start(Tracer::clock::now());
+  }
+}
+
+TraceSpan::TraceSpan(const TraceSpan* parent, const char* name)
+    : tracer((parent && parent->tracer) ? parent->tracer : nullptr) {
+  if (this->tracer) {
+    this->record.trace_id = parent->record.trace_id;
+    this->record.span_id = this->tracer->next_id();
+    this->record.parent_span_id = parent->record.span_id;
+    this->record.name = name;
+    this->record.start_nsecs = this->tracer->nsecs_since_start(Tracer::clock::now());
+  }
+}
+
+TraceSpan::~TraceSpan() {
+  this->end();
+}
+
+void TraceSpan::set_attribute(const char* key, string_view value) {
+  if (this->tracer) {
+    this->record.attributes.emplace_back(key, string(value));
+  }
+}
+
+void TraceSpan::set_attribute(const char* key, int64_t value) {
+  if (this->tracer) {
+    this->record.attributes.emplace_back(key, value);
+  }
+}
+
+void TraceSpan::set_error(string_view message) {
+  if (this->tracer) {
+    this->record.error = message;
+  }
+}
+
+void TraceSpan::add_child(const char* name, Tracer::clock::time_point start, Tracer::clock::time_point end) const {
+  if (this->tracer) {
+    Tracer::SpanRecord child;
+    child.trace_id = this->record.trace_id;
+    child.span_id = this->tracer->next_id();
+    child.parent_span_id = this->record.span_id;
+    child.name = name;
+    child.start_nsecs = this->tracer->nsecs_since_start(start);
+    child.end_nsecs = this->tracer->nsecs_since_start(end);
+    child.thread_index = current_thread_index();
+    this->tracer->record(std::move(child));
+  }
+}
+
+void TraceSpan::end() {
+  if (this->tracer) {
+    this->record.end_nsecs = this->tracer->nsecs_since_start(Tracer::clock::now());
+    this->record.thread_index = current_thread_index();
+    this->tracer->record(std::move(this->record));
+    this->tracer = nullptr;
+  }
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <variant>
+#include <vector>
+
+// Request tracing for AsyncHTTPClient and AirtableClient. Where metrics (see
+// Metrics.hh) aggregate many requests, a trace records each step of each
+// request as a span with a start and end time and a parent span, so a viewer
+// can show how the steps of a job overlap (e.g. page fetches, retries, waits
+// after rate limiting, and parsing on the CPU pool). Traces can be exported
+// in the Chrome trace_event format (for chrome://tracing or Perfetto) or as
+// OTLP JSON (for OpenTelemetry tools).
+
+// Collects finished spans. Spans may be started, ended, and exported from any
+// number of threads at once. Once max_spans spans have been collected, further
+// spans are dropped (and counted) until the tracer is cleared.
+class Tracer {
+public:
+  using clock = std::chrono::steady_clock;
+
+  using AttributeValue = std::variant<int64_t, std::string>;
+
+  struct SpanRecord {
+    // The low 64 bits of the trace ID (the high 64 bits are the same for all
+    // spans from a tracer; see get_trace_id_high). All spans in a tree share
+    // the root span's trace ID.
+    uint64_t trace_id = 0;
+    uint64_t span_id = 0;
+    // 0 for root spans
+    uint64_t parent_span_id = 0;
+    // Must be a string literal (or otherwise outlive the tracer)
+    const char* name = nullptr;
+    // Relative to the tracer's creation time
+    uint64_t start_nsecs = 0;
+    uint64_t end_nsecs = 0;
+    // A small number identifying the thread the span ended on
+    uint32_t thread_index = 0;
+    // Empty unless the span failed
+    std::string error;
+    std::vector<std::pair<const char*, AttributeValue>> attributes;
+  };
+
+  explicit Tracer(size_t max_spans = 1000000);
+  Tracer(const Tracer&) = delete;
+  Tracer(Tracer&&) = delete;
+  Tracer& operator=(const Tracer&) = delete;
+  Tracer& operator=(Tracer&&) = delete;
+  ~Tracer() = default;
+
+  // Returns a new nonzero span (or trace) ID
+  uint64_t next_id();
+  inline uint64_t get_trace_id_high() const {
+    return this->trace_id_high;
+  }
+  // Returns the time relative to the tracer's creation time
+  uint64_t nsecs_since_start(clock::time_point t) const;
+
+  void record(SpanRecord&& span);
+
+  // Returns a copy of all spans collected so far, in the order they ended
+  std::vector<SpanRecord> spans() const;
+  size_t num_dropped_spans() const;
+  // Discards all collected spans
+  void clear();
+
+  // Returns the collected spans in the Chrome trace_event JSON format. Each
+  // trace is shown as a separate track of nested async events, so requests
+  // that overlap in time don't overlap on screen.
+  std::string to_chrome_trace() const;
+  // Returns the collected spans in the OTLP JSON format (an
+  // ExportTraceServiceRequest containing a single resource)
+  std::string to_otlp_json(const std::string& service_name = "libairtable") const;
+  void write_chrome_trace(const std::string& filename) const;
+  void write_otlp_json(const std::string& filename, const std::string& service_name = "libairtable") const;
+
+private:
+  size_t max_spans;
+  uint64_t trace_id_high;
+  uint64_t id_base;
+  std::atomic<uint64_t> id_counter = 0;
+  clock::time_point start_time;
+  std::chrono::system_clock::time_point start_system_time;
+
+  mutable std::mutex lock;
+  std::vector<SpanRecord> finished_spans; // Protected by lock
+  size_t dropped_spans = 0; // Protected by lock
+};
+
+// A span that is recorded in a tracer when it ends (when end() is called or
+// it's destroyed). A span is inactive (and all of its methods do nothing) if
+// it was created with a null tracer or an inactive parent, so code can create
+// spans unconditionally and tracing costs almost nothing when it's disabled.
+//
+// A child span refers to its parent's IDs only when it's created, so the
+// parent may be used (and ended) on another thread. The usual case is a
+// coroutine passing a pointer to its span to a coroutine it awaits, which
+// may run on a different strand or on a CPU pool thread. A span itself is not
+// thread-safe: only one thread at a time may set its attributes or end it.
+class TraceSpan {
+public:
+  // Starts a root span, which begins a new trace
+  TraceSpan(Tracer* tracer, const char* name);
+  // Starts a child span of parent, or an inactive span if parent is null or
+  // inactive
+  TraceSpan(const TraceSpan* parent, const char* name);
+  TraceSpan(const TraceSpan&) = delete;
+  TraceSpan(TraceSpan&&) = delete;
+  TraceSpan& operator=(const TraceSpan&) = delete;
+  TraceSpan& operator=(TraceSpan&&) = delete;
+  ~TraceSpan();
+
+  inline bool active() const {
+    return this->tracer != nullptr;
+  }
+
+  void set_attribute(const char* key, std::string_view value);
+  void set_attribute(const char* key, int64_t value);
+  // Marks the span as failed. This is usually called from a catch block.
+  void set_error(std::string_view message);
+
+  // Records a child span that has already finished, with the given times.
+  // This is for steps that are timed elsewhere (e.g. by async_connect_tcp).
+  void add_child(const char* name, Tracer::clock::time_point start, Tracer::clock::time_point end) const;
+
+  // Ends the span and records it. Calling end() again does nothing.
+  void end();
+
+private:
+  Tracer* tracer;
+  Tracer::SpanRecord record;
+};
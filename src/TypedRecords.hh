@@ -0,0 +1,334 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <cmath>
+#include <concepts>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "FieldTypes.hh"
+#include "JSONReader.hh"
+#include "JSONWriter.hh"
+
+// Maps Airtable records directly to and from user-defined structs, without
+// going through Record's map of heap-allocated Fields. To use a struct as a
+// row type, specialize RecordMapping for it, like this:
+//
+//   struct Task {
+//     std::string id;
+//     uint64_t creation_time = 0;
+//     std::string name;
+//     double estimate_hours = 0.0;
+//     bool done = false;
+//     std::vector<std::string> tags;
+//     std::optional<int64_t> priority;
+//   };
+//
+//   template <>
+//   struct RecordMapping<Task> {
+//     static constexpr auto id = &Task::id; // Optional
+//     static constexpr auto creation_time = &Task::creation_time; // Optional
+//     static constexpr auto fields = std::make_tuple(
+//         airtable_field("Name", &Task::name),
+//         airtable_field("Estimate (hours)", &Task::estimate_hours),
+//         airtable_field("Done", &Task::done),
+//         airtable_field("Tags", &Task::tags),
+//         airtable_computed_field("Priority", &Task::priority));
+//   };
+//
+// The field names must match the keys in the records, so if the records are
+// listed with ListRecordsOptions::return_fields_by_field_id, they must be field
+// IDs instead. Computed fields (formulas, lookups, etc.) are read but never
+// written. The decoder and encoder for each field are chosen at compile time
+// from the member's type (see CellCodec below).
+//
+// Airtable omits empty cells from records, so members whose cells are absent
+// keep the values they had before decoding (new rows are value-initialized).
+// Null cells reset the member to its default value. If a cell's JSON doesn't
+// match the member's type (including numbers that don't fit in an integer
+// member), decoding throws std::runtime_error.
+
+// Reads and writes one cell value of type ValueT. Specializations are provided
+// for strings, bools, integers, floats, CollaboratorField, Attachment, and
+// std::vector and std::optional of any of these. To support other types,
+// specialize this with static read(JSONReader&, ValueT&) and
+// write(JSONWriter&, const ValueT&) functions.
+template <typename ValueT>
+struct CellCodec;
+
+template <>
+struct CellCodec<std::string> {
+  static inline void read(JSONReader& r, std::string& value) {
+    value = r.read_string();
+  }
+  static inline void write(JSONWriter& w, const std::string& value) {
+    w.write_string(value);
+  }
+};
+
+template <>
+struct CellCodec<bool> {
+  static inline void read(JSONReader& r, bool& value) {
+    value = r.read_bool();
+  }
+  static inline void write(JSONWriter& w, bool value) {
+    w.write_bool(value);
+  }
+};
+
+template <typename IntT>
+  requires(std::is_integral_v<IntT> && !std::is_same_v<IntT, bool>)
+struct CellCodec<IntT> {
+  static inline void read(JSONReader& r, IntT& value) {
+    auto num = r.read_number();
+    if (num.is_integer) {
+      if (!std::in_range<IntT>(num.as_int)) {
+        throw std::runtime_error("integer cell value is out of range");
+      }
+      value = static_cast<IntT>(num.as_int);
+    } else {
+      // Fractional values are truncated toward zero. Converting a value that
+      // doesn't fit in IntT (or NaN) is undefined, so those are rejected.
+      double truncated = std::trunc(num.as_float);
+      if (!(truncated >= static_cast<double>(std::numeric_limits<IntT>::min())) ||
+          !(truncated < std::ldexp(1.0, std::numeric_limits<IntT>::digits))) {
+        throw std::runtime_error("integer cell value is out of range");
+      }
+      value = static_cast<IntT>(truncated);
+    }
+  }
+  static inline void write(JSONWriter& w, IntT value) {
+    if constexpr (std::is_signed_v<IntT>) {
+      w.write_int(value);
+    } else {
+      w.write_uint(value);
+    }
+  }
+};
+
+template <typename FloatT>
+  requires std::is_floating_point_v<FloatT>
+struct CellCodec<FloatT> {
+  static inline void read(JSONReader& r, FloatT& value) {
+    value = r.read_number().as_float;
+  }
+  static inline void write(JSONWriter& w, FloatT value) {
+    w.write_float(value);
+  }
+};
+
+template <>
+struct CellCodec<CollaboratorField> {
+  static inline void read(JSONReader& r, CollaboratorField& value) {
+    value = CollaboratorField(r);
+  }
+  static inline void write(JSONWriter& w, const CollaboratorField& value) {
+    value.write_json(w);
+  }
+};
+
+template <>
+struct CellCodec<Attachment> {
+  static inline void read(JSONReader& r, Attachment& value) {
+    value = Attachment(r);
+  }
+  static inline void write(JSONWriter& w, const Attachment& value) {
+    value.write_json(w);
+  }
+};
+
+template <typename ItemT>
+struct CellCodec<std::vector<ItemT>> {
+  static void read(JSONReader& r, std::vector<ItemT>& value) {
+    value.clear();
+    r.read_array([&]() -> void {
+      CellCodec<ItemT>::read(r, value.emplace_back());
+    });
+  }
+  static void write(JSONWriter& w, const std::vector<ItemT>& value) {
+    w.begin_array();
+    for (const auto& item : value) {
+      CellCodec<ItemT>::write(w, item);
+    }
+    w.end_array();
+  }
+};
+
+template <typename ValueT>
+struct CellCodec<std::optional<ValueT>> {
+  static void read(JSONReader& r, std::optional<ValueT>& value) {
+    CellCodec<ValueT>::read(r, value.emplace());
+  }
+  static void write(JSONWriter& w, const std::optional<ValueT>& value) {
+    if (value.has_value()) {
+      CellCodec<ValueT>::write(w, *value);
+    } else {
+      w.write_null();
+    }
+  }
+};
+
+// Binds an Airtable field (by name or ID) to a member of RowT. Use
+// airtable_field or airtable_computed_field to create these.
+template <typename RowT, typename ValueT>
+struct FieldBinding {
+  using RowType = RowT;
+  using ValueType = ValueT;
+
+  std::string_view name;
+  ValueT RowT::* member;
+  bool read_only;
+};
+
+template <typename RowT, typename ValueT>
+constexpr FieldBinding<RowT, ValueT> airtable_field(std::string_view name, ValueT RowT::* member) {
+  return FieldBinding<RowT, ValueT>{name, member, false};
+}
+
+template <typename RowT, typename ValueT>
+constexpr FieldBinding<RowT, ValueT> airtable_computed_field(std::string_view name, ValueT RowT::* member) {
+  return FieldBinding<RowT, ValueT>{name, member, true};
+}
+
+// Specialize this for each row type (see the comment at the top of this file)
+template <typename RowT>
+struct RecordMapping;
+
+template <typename RowT>
+concept MappedRecord = std::default_initializable<RowT> && requires {
+  std::tuple_size<std::remove_cvref_t<decltype(RecordMapping<RowT>::fields)>>::value;
+};
+
+template <typename RowT>
+concept MappedRecordWithID = MappedRecord<RowT> && requires(RowT& row) {
+  { row.*(RecordMapping<RowT>::id) } -> std::same_as<std::string&>;
+};
+
+template <typename RowT>
+concept MappedRecordWithCreationTime = MappedRecord<RowT> && requires(RowT& row) {
+  { row.*(RecordMapping<RowT>::creation_time) } -> std::same_as<uint64_t&>;
+};
+
+namespace typed_records_detail {
+
+template <typename RowT>
+inline constexpr size_t num_fields = std::tuple_size_v<std::remove_cvref_t<decltype(RecordMapping<RowT>::fields)>>;
+
+template <typename ValueT>
+inline void read_cell(JSONReader& r, ValueT& value) {
+  if (r.peek() == 'n') {
+    r.read_null();
+    value = ValueT();
+  } else {
+    CellCodec<ValueT>::read(r, value);
+  }
+}
+
+// Decodes the cell into the member bound to key, if there is one. The
+// comparisons are unrolled at compile time, and each one checks the length
+// before the contents, so most mismatches cost one integer comparison.
+template <typename RowT, size_t... Indexes>
+inline bool read_bound_cell(JSONReader& r, std::string_view key, RowT& row, std::index_sequence<Indexes...>) {
+  const auto& fields = RecordMapping<RowT>::fields;
+  return ((key == std::get<Indexes>(fields).name &&
+              (read_cell(r, row.*(std::get<Indexes>(fields).member)), true)) ||
+      ...);
+}
+
+template <typename RowT, size_t... Indexes>
+inline void write_bound_cells(JSONWriter& w, const RowT& row, std::index_sequence<Indexes...>) {
+  const auto& fields = RecordMapping<RowT>::fields;
+  auto write_one = [&](const auto& binding) -> void {
+    if (!binding.read_only) {
+      using ValueT = typename std::remove_cvref_t<decltype(binding)>::ValueType;
+      w.write_key(binding.name);
+      CellCodec<ValueT>::write(w, row.*(binding.member));
+    }
+  };
+  (write_one(std::get<Indexes>(fields)), ...);
+}
+
+} // namespace typed_records_detail
+
+// Reads a record object (as returned by the list, get, create, and update
+// APIs) into row. Fields that aren't bound to any member are skipped.
+template <MappedRecord RowT>
+void read_mapped_record(JSONReader& r, RowT& row) {
+  r.read_object([&](std::string_view key) -> void {
+    if (key == "fields") {
+      r.read_object([&](std::string_view field_key) -> void {
+        if (!typed_records_detail::read_bound_cell(
+                r, field_key, row, std::make_index_sequence<typed_records_detail::num_fields<RowT>>())) {
+          r.skip_value();
+        }
+      });
+    } else if (key == "id") {
+      if constexpr (MappedRecordWithID<RowT>) {
+        row.*(RecordMapping<RowT>::id) = r.read_string();
+      } else {
+        r.skip_value();
+      }
+    } else if (key == "createdTime") {
+      if constexpr (MappedRecordWithCreationTime<RowT>) {
+        row.*(RecordMapping<RowT>::creation_time) = parse_airtable_time(r.read_string());
+      } else {
+        r.skip_value();
+      }
+    } else {
+      r.skip_value();
+    }
+  });
+}
+
+template <MappedRecord RowT>
+RowT read_mapped_record(JSONReader& r) {
+  RowT row{};
+  read_mapped_record(r, row);
+  return row;
+}
+
+// Writes the JSON for creating a record with row's contents. The ID and
+// computed fields are not written.
+template <MappedRecord RowT>
+void write_mapped_record_for_create(JSONWriter& w, const RowT& row) {
+  w.begin_object();
+  w.write_key("fields");
+  w.begin_object();
+  typed_records_detail::write_bound_cells(w, row, std::make_index_sequence<typed_records_detail::num_fields<RowT>>());
+  w.end_object();
+  w.end_object();
+}
+
+// Writes the JSON for updating a record with row's contents. The row type
+// must have an ID member.
+template <MappedRecordWithID RowT>
+void write_mapped_record_for_update(JSONWriter& w, const RowT& row) {
+  w.begin_object();
+  w.write_key("id");
+  w.write_string(row.*(RecordMapping<RowT>::id));
+  w.write_key("fields");
+  w.begin_object();
+  typed_records_detail::write_bound_cells(w, row, std::make_index_sequence<typed_records_detail::num_fields<RowT>>());
+  w.end_object();
+  w.end_object();
+}
+
+// Returns the names (or IDs) of all fields bound in RowT's mapping, in the
+// order they were declared
+template <MappedRecord RowT>
+std::vector<std::string> mapped_field_names() {
+  std::vector<std::string> ret;
+  std::apply([&](const auto&... bindings) -> void {
+    (ret.emplace_back(bindings.name), ...);
+  },
+      RecordMapping<RowT>::fields);
+  return ret;
+}